@@ -0,0 +1,222 @@
+#include "ads1115_bank.h"
+
+#include <algorithm>
+
+#include "input_conversion.h"
+#include "memory_monitor.h"
+#include "rt_event_loop.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const uint16_t kMux[ADS1115Bank::kChannels] = {
+    ADS1X15_REG_CONFIG_MUX_SINGLE_0, ADS1X15_REG_CONFIG_MUX_SINGLE_1,
+    ADS1X15_REG_CONFIG_MUX_SINGLE_2, ADS1X15_REG_CONFIG_MUX_SINGLE_3};
+
+// ADS1115 data rates and their config register values
+const int kDataRates[] = {8, 16, 32, 64, 128, 250, 475, 860};
+const uint16_t kDataRateBits[] = {0x0000, 0x0020, 0x0040, 0x0060,
+                                  0x0080, 0x00a0, 0x00c0, 0x00e0};
+
+// PGA gains from the widest to the narrowest range, and their full-scale
+// ranges as multiples of the narrowest (0.256 V)
+const adsGain_t kGains[] = {GAIN_TWOTHIRDS, GAIN_ONE,   GAIN_TWO,
+                            GAIN_FOUR,      GAIN_EIGHT, GAIN_SIXTEEN};
+const int kGainScale[] = {24, 16, 8, 4, 2, 1};
+const int kNumGains = 6;
+// Readings above this are considered clipping and switch to a wider range
+const int kRangeDownCounts = 30000;
+// Switch to a narrower range if the peak stays below this after rescaling
+const int kRangeUpCounts = 24000;
+
+// Sample rate report interval, in ms
+const unsigned int kReportInterval = 10000;
+
+}  // namespace
+
+ADS1115Bank::ADS1115Bank(TwoWire* i2c, adsGain_t gain, const int* addresses,
+                         int num_addresses, int data_rate, bool auto_gain)
+    : auto_gain_{auto_gain} {
+  min_gain_ = 0;
+  while (min_gain_ < kNumGains - 1 && kGains[min_gain_] != gain) {
+    min_gain_++;
+  }
+  for (int i = 0; i < kMaxInputs; i++) {
+    samples_[i].gain = min_gain_;
+  }
+
+  int rate_index = 0;
+  while (rate_index < 7 && kDataRates[rate_index] < data_rate) {
+    rate_index++;
+  }
+  data_rate_bits_ = kDataRateBits[rate_index];
+
+  for (int i = 0; i < num_addresses && i < kMaxDevices; i++) {
+    Device& device = devices_[i];
+    device.address = addresses[i];
+    device.ads.setGain(gain);
+    device.ads.setDataRate(data_rate_bits_);
+    device.present = device.ads.begin(device.address, i2c);
+    debugI("ADS1115 at 0x%02x: %s", device.address,
+           device.present ? "present" : "not found");
+  }
+
+  // The internal oscillator may be up to 10% slow
+  conversion_time_ = 1100000 / kDataRates[rate_index] + 100;
+  // Poll for the end of the conversion a few times per conversion time;
+  // the ADCs are only accessed once it has passed.
+  rt_event_loop()->onRepeatMicros(
+      std::max<uint32_t>(conversion_time_ / 4, 500), [this]() {
+        AllocationTagScope tag(Subsystem::kAnalog);
+        step();
+      });
+
+  sensesp::event_loop()->onRepeat(kReportInterval,
+                                  [this]() { report(kReportInterval); });
+}
+
+bool ADS1115Bank::read(int input, int32_t* counts, uint32_t* time) const {
+  if (input < 0 || input >= kMaxInputs || !samples_[input].valid) {
+    return false;
+  }
+  *counts = samples_[input].counts;
+  if (time != nullptr) {
+    *time = samples_[input].time;
+  }
+  return true;
+}
+
+float ADS1115Bank::compute_volts(int32_t counts) {
+  return counts * kADS1115VoltsPerCount;
+}
+
+adsGain_t ADS1115Bank::gain(int input) const {
+  return kGains[samples_[input].gain];
+}
+
+Adafruit_ADS1115* ADS1115Bank::acquire(int device) {
+  if (!has_device(device) || devices_[device].busy) {
+    return nullptr;
+  }
+  // step() runs on the same loop, so no scan conversion is being collected.
+  // A scan conversion in progress is abandoned: the burst overwrites the
+  // conversion register, so collecting it after release() would store a
+  // burst sample as a scan reading.
+  devices_[device].started = false;
+  devices_[device].busy = true;
+  return &devices_[device].ads;
+}
+
+void ADS1115Bank::release(int device) {
+  // The gain is set before every scan conversion, the data rate isn't
+  devices_[device].ads.setDataRate(data_rate_bits_);
+  devices_[device].busy = false;
+}
+
+void ADS1115Bank::update(Sample& sample, int16_t raw, uint32_t time) {
+  int magnitude = abs(raw);
+  if (magnitude > kRangeDownCounts && sample.gain > min_gain_) {
+    // Possibly clipped; retry at the wider range
+    sample.gain--;
+    sample.window = 0;
+    sample.peak = 0;
+    return;
+  }
+  sample.counts = raw * kGainScale[sample.gain];
+  sample.time = time;
+  sample.valid = true;
+
+  if (!auto_gain_) {
+    return;
+  }
+  if (magnitude > sample.peak) {
+    sample.peak = magnitude;
+  }
+  if (++sample.window >= kGainWindow) {
+    int next = sample.gain + 1;
+    if (next < kNumGains) {
+      // Peak in counts at the next gain
+      int peak = sample.peak * kGainScale[sample.gain] / kGainScale[next];
+      if (peak < kRangeUpCounts) {
+        sample.gain = next;
+      }
+    }
+    sample.window = 0;
+    sample.peak = 0;
+  }
+}
+
+void ADS1115Bank::step() {
+  if (channel_ >= 0 && micros() - conversion_start_ < conversion_time_) {
+    return;
+  }
+
+  // Collect the conversions started on the previous step
+  if (channel_ >= 0) {
+    uint32_t now = millis();
+    for (int i = 0; i < kMaxDevices; i++) {
+      Device& device = devices_[i];
+      if (!device.started || device.busy) {
+        continue;
+      }
+      update(samples_[i * kChannels + channel_],
+             device.ads.getLastConversionResults(), now);
+      device.started = false;
+      device.conversions++;
+    }
+  }
+
+  // Start the next channel on all devices at once
+  channel_ = (channel_ + 1) % kChannels;
+  for (int i = 0; i < kMaxDevices; i++) {
+    Device& device = devices_[i];
+    if (device.present && !device.busy) {
+      // The gain is part of the config register written to start
+      device.ads.setGain(kGains[samples_[i * kChannels + channel_].gain]);
+      device.ads.startADCReading(kMux[channel_], false);
+      device.started = true;
+    }
+  }
+  conversion_start_ = micros();
+}
+
+void ADS1115Bank::report(uint32_t elapsed) {
+  float total = 0;
+  for (int i = 0; i < kMaxDevices; i++) {
+    Device& device = devices_[i];
+    if (!device.present) {
+      continue;
+    }
+    uint32_t conversions = device.conversions;
+    float rate = (conversions - device.reported_conversions) * 1000.0 / elapsed;
+    device.reported_conversions = conversions;
+    sample_rate_[i] = rate;
+    total += rate;
+  }
+  total_sample_rate_ = total;
+}
+
+void ConnectADS1115BankOutputs(ADS1115Bank* bank) {
+  char sk_path[80];
+  char display_name[80];
+  for (int i = 0; i < ADS1115Bank::kMaxDevices; i++) {
+    if (!bank->has_device(i)) {
+      continue;
+    }
+    snprintf(sk_path, sizeof(sk_path), "sensors.halmet.adc.%d.sampleRate", i);
+    snprintf(display_name, sizeof(display_name), "ADC %d sample rate", i);
+    bank->sample_rate_[i].connect_to(new sensesp::SKOutputFloat(
+        sk_path, "",
+        new sensesp::SKMetadata("Hz", display_name,
+                                "Conversions per second of the ADC")));
+  }
+  bank->total_sample_rate_.connect_to(new sensesp::SKOutputFloat(
+      "sensors.halmet.adc.sampleRate", "",
+      new sensesp::SKMetadata("Hz", "ADC sample rate",
+                              "Conversions per second of all ADCs")));
+}
+
+}  // namespace halmet
@@ -0,0 +1,118 @@
+#ifndef HALMET_SRC_ADS1115_BANK_H_
+#define HALMET_SRC_ADS1115_BANK_H_
+
+#include <Adafruit_ADS1X15.h>
+#include <Wire.h>
+
+#include <atomic>
+
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/**
+ * @brief The HALMET ADS1115 and up to three expansion ADS1115 ADCs.
+ *
+ * The analog inputs are numbered across the devices: inputs 0-3 (A1-A4)
+ * are on the built-in ADC, 4-7 on the first expansion address and so on.
+ * Absent devices leave a gap, so the input numbers don't depend on which
+ * expansion ADCs are fitted.
+ *
+ * The bank scans all inputs continuously on rt_event_loop(). On each scan
+ * step, a single-shot conversion of the same channel is started on every
+ * device, and the results are collected one conversion time later. The
+ * devices convert in parallel, so the aggregate sample rate grows with the
+ * number of devices. read() returns the latest sample without waiting for
+ * the ADC.
+ *
+ * Each input has its own PGA gain. After a reading close to full scale, the
+ * input switches to the next wider range and the reading is dropped. When
+ * the peak of the last kGainWindow readings would stay below about 75% of
+ * full scale at the next higher gain, the input switches up. The gap between
+ * the two thresholds keeps an input from toggling between two gains.
+ * Samples are returned in counts of the highest gain (7.8125 uV), whatever
+ * the gain of the conversion, so the gain changes are invisible to readers.
+ */
+class ADS1115Bank {
+ public:
+  static constexpr int kMaxDevices = 4;
+  static constexpr int kChannels = 4;
+  static constexpr int kMaxInputs = kMaxDevices * kChannels;
+  /// Readings per gain step-up decision
+  static constexpr int kGainWindow = 8;
+
+  /// Probe the ADCs at `addresses` and start scanning. `gain` is the widest
+  /// input range used; with `auto_gain`, the inputs start at it and move to
+  /// higher gains as their levels allow. `data_rate` is an ADS1115 rate in
+  /// samples per second (8-860).
+  ADS1115Bank(TwoWire* i2c, adsGain_t gain, const int* addresses,
+              int num_addresses, int data_rate = 128, bool auto_gain = true);
+
+  bool has_device(int device) const {
+    return device >= 0 && device < kMaxDevices && devices_[device].present;
+  }
+  bool has_input(int input) const { return has_device(input / kChannels); }
+
+  /// Latest counts of `input` and the millis() time of its conversion.
+  /// Returns false if the input hasn't been sampled yet.
+  bool read(int input, int32_t* counts, uint32_t* time = nullptr) const;
+
+  /// Convert counts returned by read() to volts at the ADC input.
+  static float compute_volts(int32_t counts);
+
+  /// Current PGA gain of `input`, as an adsGain_t
+  adsGain_t gain(int input) const;
+
+  /// Take `device` out of the scan for exclusive use, e.g. a burst capture.
+  /// Call from rt_event_loop(). Returns nullptr if the device is absent or
+  /// already in use.
+  Adafruit_ADS1115* acquire(int device);
+  /// Return a device taken with acquire(). May be called from any task.
+  void release(int device);
+
+  /// Conversions per second of each device, updated every report interval
+  sensesp::ObservableValue<float> sample_rate_[kMaxDevices];
+  /// Sum over all devices
+  sensesp::ObservableValue<float> total_sample_rate_;
+
+ protected:
+  struct Device {
+    Adafruit_ADS1115 ads;
+    uint8_t address;
+    bool present;
+    std::atomic<bool> busy;  // Taken with acquire()
+    bool started;            // A scan conversion is in progress
+    uint32_t conversions;
+    uint32_t reported_conversions;
+  };
+
+  struct Sample {
+    int32_t counts;  // Normalized to the highest gain
+    uint32_t time;
+    bool valid;
+    uint8_t gain;  // Index into the gain table
+    uint8_t window;
+    uint16_t peak;
+  };
+
+  void step();
+  void update(Sample& sample, int16_t raw, uint32_t time);
+  void report(uint32_t elapsed);
+
+  Device devices_[kMaxDevices] = {};
+  Sample samples_[kMaxInputs] = {};
+  // Channel being converted, or -1 before the first step
+  int channel_ = -1;
+  uint8_t min_gain_;
+  uint16_t data_rate_bits_;
+  bool auto_gain_;
+  uint32_t conversion_time_;  // us
+  uint32_t conversion_start_ = 0;
+};
+
+/// Publish the ADC sample rates at sensors.halmet.adc.*
+void ConnectADS1115BankOutputs(ADS1115Bank* bank);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_ADS1115_BANK_H_
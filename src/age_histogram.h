@@ -0,0 +1,104 @@
+#ifndef HALMET_SRC_AGE_HISTOGRAM_H_
+#define HALMET_SRC_AGE_HISTOGRAM_H_
+
+#include <algorithm>
+#include <cstdint>
+
+namespace halmet {
+
+/**
+ * @brief Histogram of data ages with log-linear bins.
+ *
+ * Values below kSubBins have a bin each. Above, every power-of-two octave is
+ * split into kSubBins linear bins, so a reported quantile is at most 1/8
+ * (12.5%) above the true value: an age of 100 ms is reported as 103 ms, the
+ * top of the 96-103 ms bin. Values from 2^kMaxOctave up share an overflow
+ * bin; max() is exact.
+ *
+ * The bins are unitless; DataAgeMonitor uses milliseconds and
+ * IntervalJitterMonitor microseconds.
+ */
+class AgeHistogram {
+ public:
+  static constexpr int kSubBinBits = 3;
+  static constexpr uint32_t kSubBins = 1 << kSubBinBits;
+  /// Values up to 2^kMaxOctave - 1 (16.7 s in us) have their own bins
+  static constexpr int kMaxOctave = 24;
+  static constexpr int kNumBins =
+      (kMaxOctave - kSubBinBits + 1) * kSubBins + 1;
+
+  void add(uint32_t age) {
+    if (age > max_) {
+      max_ = age;
+    }
+    uint16_t& bin = bins_[bin_index(age)];
+    if (bin == UINT16_MAX) {
+      return;
+    }
+    bin++;
+    count_++;
+  }
+
+  /// Largest value of the bin containing the given quantile (0-1), limited
+  /// to the maximum.
+  uint32_t quantile(float q) const {
+    uint32_t target = q * count_;
+    uint32_t seen = 0;
+    for (int bin = 0; bin < kNumBins; bin++) {
+      seen += bins_[bin];
+      if (seen > target) {
+        return std::min<uint32_t>(bin_upper(bin), max_);
+      }
+    }
+    return max_;
+  }
+
+  uint32_t count() const { return count_; }
+  uint32_t max() const { return max_; }
+
+  void clear() {
+    std::fill(bins_, bins_ + kNumBins, 0);
+    count_ = 0;
+    max_ = 0;
+  }
+
+  static int bin_index(uint32_t value) {
+    if (value < kSubBins) {
+      return value;
+    }
+    int octave = 31 - __builtin_clz(value);
+    if (octave >= kMaxOctave) {
+      return kNumBins - 1;
+    }
+    int shift = octave - kSubBinBits;
+    return (shift + 1) * kSubBins + ((value >> shift) & (kSubBins - 1));
+  }
+
+  /// Smallest value in `bin`
+  static uint32_t bin_lower(int bin) {
+    if (bin < (int)kSubBins) {
+      return bin;
+    }
+    int shift = bin / kSubBins - 1;
+    return (kSubBins + bin % kSubBins) << shift;
+  }
+
+  /// Largest value in `bin`
+  static uint32_t bin_upper(int bin) {
+    if (bin == kNumBins - 1) {
+      return UINT32_MAX;
+    }
+    return bin_lower(bin + 1) - 1;
+  }
+
+ private:
+  // A report interval has a few hundred entries at most. A full bin stops
+  // counting rather than wrapping around.
+  uint16_t bins_[kNumBins] = {};
+  uint32_t count_ = 0;
+  uint32_t max_ = 0;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_AGE_HISTOGRAM_H_
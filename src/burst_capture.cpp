@@ -0,0 +1,244 @@
+#include "burst_capture.h"
+
+#include <algorithm>
+
+#include "halmet_analog.h"
+#include "rt_event_loop.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const uint16_t kMux[ADS1115Bank::kChannels] = {
+    ADS1X15_REG_CONFIG_MUX_SINGLE_0, ADS1X15_REG_CONFIG_MUX_SINGLE_1,
+    ADS1X15_REG_CONFIG_MUX_SINGLE_2, ADS1X15_REG_CONFIG_MUX_SINGLE_3};
+
+// Nominal conversion period at 860 SPS
+const float kSampleRate = 860;  // Hz
+const uint64_t kConversionPeriod = 1163;  // us
+// Readings per nominal conversion period. Even with the ADC clock 10% fast,
+// no conversion is skipped.
+const int kReadingsPerConversion = 2;
+const uint64_t kReadPeriod =
+    kConversionPeriod / kReadingsPerConversion;  // us
+// Readings dropped after switching to continuous mode: the first results
+// still belong to the scan configuration.
+const int kSettleReadings = 2 * kReadingsPerConversion;
+
+// How often the real-time loop checks whether a capture is due
+const unsigned int kStartCheckInterval = 1000;  // ms
+// How often the SensESP loop checks for a finished capture
+const unsigned int kReadyCheckInterval = 50;  // ms
+
+// The capture task runs next to the real-time loop, above it so that a
+// sample isn't delayed by a scan step
+const BaseType_t kCaptureCore = 1;
+const UBaseType_t kCapturePriority = 11;
+const uint32_t kCaptureStackSize = 2048;
+
+}  // namespace
+
+BurstCapture::BurstCapture(ADS1115Bank* bank, const String& config_path)
+    : BlobSaveable{config_path}, bank_{bank} {
+  load();
+
+  raw_ = new int16_t[RippleAnalyzer::kWindow];
+  volts_ = new float[RippleAnalyzer::kWindow];
+
+  esp_timer_create_args_t timer_args = {};
+  timer_args.callback = &BurstCapture::on_timer;
+  timer_args.arg = this;
+  timer_args.dispatch_method = ESP_TIMER_TASK;
+  timer_args.name = "burst_capture";
+  if (xTaskCreatePinnedToCore(task, "burst_capture", kCaptureStackSize, this,
+                              kCapturePriority, &task_,
+                              kCaptureCore) != pdPASS ||
+      esp_timer_create(&timer_args, &timer_) != ESP_OK) {
+    debugE("Burst capture: unable to create the sample task or timer");
+    return;
+  }
+
+  rt_event_loop()->onRepeat(kStartCheckInterval, [this]() { start(); });
+  sensesp::event_loop()->onRepeat(kReadyCheckInterval,
+                                  [this]() { analyze(); });
+}
+
+void BurstCapture::on_timer(void* arg) {
+  xTaskNotifyGive(static_cast<BurstCapture*>(arg)->task_);
+}
+
+void BurstCapture::task(void* arg) {
+  auto capture = static_cast<BurstCapture*>(arg);
+  while (true) {
+    // Notifications that arrive while a sample is read are coalesced, so a
+    // late read doesn't cause a burst of reads of the same conversion
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    capture->sample();
+  }
+}
+
+void BurstCapture::start() {
+  if (state_ != kIdle || input_ < 1 || input_ > ADS1115Bank::kMaxInputs) {
+    return;
+  }
+  if (started_ && millis() - last_start_ < interval_ * 1000u) {
+    return;
+  }
+  int input = input_ - 1;
+  device_ = input / ADS1115Bank::kChannels;
+  ads_ = bank_->acquire(device_);
+  if (ads_ == nullptr) {
+    return;
+  }
+
+  // Keep the range the scan has settled on for this input
+  ads_->setGain(bank_->gain(input));
+  volts_per_count_ = ads_->computeVolts(1);
+  ads_->setDataRate(RATE_ADS1115_860SPS);
+  ads_->startADCReading(kMux[input % ADS1115Bank::kChannels], true);
+
+  settle_ = kSettleReadings;
+  count_ = 0;
+  num_readings_ = 0;
+  last_start_ = millis();
+  started_ = true;
+  state_ = kCapturing;
+  esp_timer_start_periodic(timer_, kReadPeriod);
+}
+
+void BurstCapture::sample() {
+  if (state_ != kCapturing) {
+    return;
+  }
+  int16_t reading = ads_->getLastConversionResults();
+  if (settle_ > 0) {
+    settle_--;
+    return;
+  }
+  if (num_readings_ > 0 && reading == last_reading_) {
+    num_readings_++;
+    return;
+  }
+  if (num_readings_ > 0) {
+    // Round the run to whole conversion periods
+    int num_samples = (num_readings_ + kReadingsPerConversion / 2) /
+                      kReadingsPerConversion;
+    add_samples(last_reading_, std::max(num_samples, 1));
+    if (state_ != kCapturing) {
+      return;
+    }
+  }
+  last_reading_ = reading;
+  num_readings_ = 1;
+}
+
+void BurstCapture::add_samples(int16_t value, int num_samples) {
+  for (int i = 0; i < num_samples && count_ < RippleAnalyzer::kWindow; i++) {
+    raw_[count_++] = value;
+  }
+  if (count_ < RippleAnalyzer::kWindow) {
+    return;
+  }
+  esp_timer_stop(timer_);
+  bank_->release(device_);
+  state_ = kReady;
+}
+
+void BurstCapture::analyze() {
+  if (state_ != kReady) {
+    return;
+  }
+  const size_t kWindow = RippleAnalyzer::kWindow;
+  float sample_rate = kSampleRate;
+  for (size_t i = 0; i < kWindow; i++) {
+    volts_[i] = raw_[i] * volts_per_count_ * kVoltageDividerScale;
+  }
+  state_ = kIdle;
+
+  int64_t start = esp_timer_get_time();
+  RippleAnalyzer::Result result = analyzer_.analyze(volts_, sample_rate);
+  analysis_time_.set(esp_timer_get_time() - start);
+
+  sample_rate_.set(sample_rate);
+  mean_.set(result.mean);
+  ripple_rms_.set(result.rms);
+  peak_to_peak_.set(result.peak_to_peak);
+  dominant_frequency_.set(result.dominant_frequency);
+  dominant_amplitude_.set(result.dominant_amplitude);
+  debugD("Burst capture: %.3f V, ripple %.4f V RMS, %.1f Hz, %.0f us",
+         result.mean, result.rms, result.dominant_frequency,
+         analysis_time_.get());
+}
+
+bool BurstCapture::to_json(JsonObject& config) {
+  config["input"] = input_;
+  config["interval"] = interval_;
+  if (sample_rate_.get() > 0) {
+    config["mean"] = mean_.get();
+    config["ripple_rms"] = ripple_rms_.get();
+    config["dominant_frequency"] = dominant_frequency_.get();
+  }
+  return true;
+}
+
+bool BurstCapture::from_json(const JsonObject& config) {
+  if (!config["input"].is<int>() || !config["interval"].is<int>()) {
+    return false;
+  }
+  input_ = config["input"];
+  interval_ = config["interval"];
+  if (interval_ < 1) {
+    interval_ = 1;
+  }
+  // Capture with the new settings right away
+  started_ = false;
+  return true;
+}
+
+const String ConfigSchema(const BurstCapture& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "input": { "title": "Analog input", "type": "integer", "minimum": 0, "maximum": 16, "description": "Input to capture (1-16), 0 to disable" },
+      "interval": { "title": "Interval", "type": "integer", "minimum": 1, "description": "Time between captures (s)" },
+      "mean": { "title": "Mean voltage", "type": "number", "readOnly": true },
+      "ripple_rms": { "title": "Ripple RMS", "type": "number", "readOnly": true },
+      "dominant_frequency": { "title": "Dominant frequency", "type": "number", "readOnly": true }
+    }
+  })###";
+}
+
+void ConnectBurstCaptureOutputs(BurstCapture* capture) {
+  using sensesp::SKMetadata;
+  using sensesp::SKOutputFloat;
+
+  capture->mean_.connect_to(new SKOutputFloat(
+      "sensors.halmet.ripple.mean", "",
+      new SKMetadata("V", "Burst capture mean voltage")));
+  capture->ripple_rms_.connect_to(new SKOutputFloat(
+      "sensors.halmet.ripple.rms", "",
+      new SKMetadata("V", "Ripple RMS",
+                     "RMS of the AC part of the captured input")));
+  capture->peak_to_peak_.connect_to(new SKOutputFloat(
+      "sensors.halmet.ripple.peakToPeak", "",
+      new SKMetadata("V", "Ripple peak-to-peak")));
+  capture->dominant_frequency_.connect_to(new SKOutputFloat(
+      "sensors.halmet.ripple.dominantFrequency", "",
+      new SKMetadata("Hz", "Ripple frequency",
+                     "Frequency of the strongest AC component")));
+  capture->dominant_amplitude_.connect_to(new SKOutputFloat(
+      "sensors.halmet.ripple.dominantAmplitude", "",
+      new SKMetadata("V", "Ripple amplitude",
+                     "Amplitude of the strongest AC component")));
+  capture->sample_rate_.connect_to(new SKOutputFloat(
+      "sensors.halmet.ripple.sampleRate", "",
+      new SKMetadata("Hz", "Burst capture sample rate")));
+  capture->analysis_time_.connect_to(new SKOutputFloat(
+      "sensors.halmet.ripple.analysisTime", "",
+      new SKMetadata("", "Ripple analysis time",
+                     "CPU time of the spectrum analysis (us)")));
+}
+
+}  // namespace halmet
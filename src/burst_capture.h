@@ -0,0 +1,106 @@
+#ifndef HALMET_SRC_BURST_CAPTURE_H_
+#define HALMET_SRC_BURST_CAPTURE_H_
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+
+#include "ads1115_bank.h"
+#include "config_blob_store.h"
+#include "ripple_analyzer.h"
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/**
+ * @brief High-rate burst capture and ripple analysis of an analog input.
+ *
+ * Every capture interval, the ADC of the selected input is taken out of the
+ * bank scan and switched to continuous conversion at 860 SPS. An esp_timer
+ * wakes a dedicated task twice per nominal conversion period, and the task
+ * reads the conversion register over I2C. The capture doesn't depend on the
+ * event loop timing and doesn't block it, and the shared esp_timer task
+ * never waits for the I2C bus. The other ADCs keep scanning during the
+ * capture, the inputs of the captured ADC pause for about 0.6 s.
+ *
+ * The ADS1115 clock is only accurate to 10%, and without the ALERT/RDY pin
+ * there's no way to tell when a conversion is ready: in continuous mode,
+ * the OS bit of the config register always reads busy. Reading at twice
+ * the data rate doesn't skip conversions but reads most of them twice, so
+ * a run of identical readings is counted as the number of conversion
+ * periods it spans, and at least one. The samples are then analyzed at the
+ * nominal data rate.
+ *
+ * Once RippleAnalyzer::kWindow samples are in, the ADC goes back to the
+ * scan and the window is analyzed on the SensESP loop. The results are
+ * published as producers, together with the sample rate and the CPU time
+ * of the analysis.
+ */
+class BurstCapture : public BlobSaveable {
+ public:
+  BurstCapture(ADS1115Bank* bank, const String& config_path);
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  /// Mean voltage of the last capture, in V
+  sensesp::ObservableValue<float> mean_;
+  /// RMS of the AC part, in V
+  sensesp::ObservableValue<float> ripple_rms_;
+  sensesp::ObservableValue<float> peak_to_peak_;
+  /// Frequency (Hz) and amplitude (V) of the strongest AC component
+  sensesp::ObservableValue<float> dominant_frequency_;
+  sensesp::ObservableValue<float> dominant_amplitude_;
+  /// Sample rate the last capture was analyzed at, in Hz
+  sensesp::ObservableValue<float> sample_rate_;
+  /// CPU time of the last analysis, in us
+  sensesp::ObservableValue<float> analysis_time_;
+
+ protected:
+  enum State { kIdle, kCapturing, kReady };
+
+  static void on_timer(void* arg);
+  static void task(void* arg);
+  void start();
+  void sample();
+  void add_samples(int16_t value, int num_samples);
+  void analyze();
+
+  ADS1115Bank* bank_;
+  RippleAnalyzer analyzer_;
+  int16_t* raw_;
+  float* volts_;
+  esp_timer_handle_t timer_ = nullptr;
+  TaskHandle_t task_ = nullptr;
+
+  // Configuration
+  int input_ = 0;       // 1-based, 0 to disable
+  int interval_ = 60;   // s
+
+  // Capture state. Set up on rt_event_loop() while idle, then owned by the
+  // capture task until the state turns kReady.
+  std::atomic<int> state_{kIdle};
+  Adafruit_ADS1115* ads_ = nullptr;
+  int device_ = 0;
+  float volts_per_count_ = 0;
+  int settle_ = 0;
+  size_t count_ = 0;
+  // The current run of identical readings
+  int16_t last_reading_ = 0;
+  int num_readings_ = 0;
+  uint32_t last_start_ = 0;
+  bool started_ = false;
+};
+
+const String ConfigSchema(const BurstCapture& obj);
+
+inline bool ConfigRequiresRestart(const BurstCapture& obj) { return false; }
+
+/// Publish the burst capture results at sensors.halmet.ripple.*
+void ConnectBurstCaptureOutputs(BurstCapture* capture);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_BURST_CAPTURE_H_
@@ -0,0 +1,245 @@
+#include "channel_config.h"
+
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+ChannelConfig::ChannelConfig(const String& config_path)
+    : BlobSaveable{config_path} {
+  // The layout of the original example firmware
+  tanks_ = {{1, "Fuel", "fuel.main", 0, 0, 200}};
+  voltages_ = {{2, "A2"}};
+  alarms_ = {{2, "D2", false}, {3, "D3", true}};
+  engines_ = {{0, "main", 1, 2, 3, 1}};
+
+  load();
+  validate();
+}
+
+const ChannelConfig::Alarm* ChannelConfig::find_alarm(int input) const {
+  for (const auto& alarm : alarms_) {
+    if (alarm.input == input) {
+      return &alarm;
+    }
+  }
+  return nullptr;
+}
+
+const ChannelConfig::Tank* ChannelConfig::find_tank(int input) const {
+  for (const auto& tank : tanks_) {
+    if (tank.input == input) {
+      return &tank;
+    }
+  }
+  return nullptr;
+}
+
+void ChannelConfig::validate() {
+  bool analog_used[kNumAnalogInputs + 1] = {};
+  bool digital_used[kNumDigitalInputs + 1] = {};
+
+  auto claim = [](int input, bool* used, int num_inputs, const char* kind,
+                  const String& name) {
+    if (input < 1 || input > num_inputs || used[input]) {
+      debugE("Channel config: %s %s has an invalid or used input %d", kind,
+             name.c_str(), input);
+      return false;
+    }
+    used[input] = true;
+    return true;
+  };
+
+  std::vector<Tank> tanks;
+  for (const auto& tank : tanks_) {
+    if (claim(tank.input, analog_used, kNumAnalogInputs, "tank", tank.name)) {
+      tanks.push_back(tank);
+    }
+  }
+  tanks_ = tanks;
+
+  std::vector<Voltage> voltages;
+  for (const auto& voltage : voltages_) {
+    if (claim(voltage.input, analog_used, kNumAnalogInputs, "voltage",
+              voltage.name)) {
+      voltages.push_back(voltage);
+    }
+  }
+  voltages_ = voltages;
+
+  std::vector<Alarm> alarms;
+  for (const auto& alarm : alarms_) {
+    if (claim(alarm.input, digital_used, kNumDigitalInputs, "alarm",
+              alarm.name)) {
+      alarms.push_back(alarm);
+    }
+  }
+  alarms_ = alarms;
+
+  std::vector<Engine> engines;
+  for (auto engine : engines_) {
+    bool duplicate = false;
+    for (const auto& other : engines) {
+      duplicate |= other.instance == engine.instance;
+    }
+    if (duplicate || engine.instance < 0 || engine.instance > 252) {
+      debugE("Channel config: engine %s has an invalid or used instance %d",
+             engine.name.c_str(), engine.instance);
+      continue;
+    }
+    if (engine.tacho_input != 0 &&
+        !claim(engine.tacho_input, digital_used, kNumDigitalInputs, "tacho",
+               engine.name)) {
+      engine.tacho_input = 0;
+    }
+    // The engine alarms refer to configured alarm inputs
+    if (engine.low_oil_pressure_input != 0 &&
+        find_alarm(engine.low_oil_pressure_input) == nullptr) {
+      debugE("Channel config: engine %s: D%d is not an alarm input",
+             engine.name.c_str(), engine.low_oil_pressure_input);
+      engine.low_oil_pressure_input = 0;
+    }
+    if (engine.over_temperature_input != 0 &&
+        find_alarm(engine.over_temperature_input) == nullptr) {
+      debugE("Channel config: engine %s: D%d is not an alarm input",
+             engine.name.c_str(), engine.over_temperature_input);
+      engine.over_temperature_input = 0;
+    }
+    if (engine.fuel_tank_input != 0 &&
+        find_tank(engine.fuel_tank_input) == nullptr) {
+      debugE("Channel config: engine %s: A%d is not a tank input",
+             engine.name.c_str(), engine.fuel_tank_input);
+      engine.fuel_tank_input = 0;
+    }
+    engines.push_back(engine);
+  }
+  engines_ = engines;
+}
+
+bool ChannelConfig::to_json(JsonObject& config) {
+  JsonArray tanks = config["tanks"].to<JsonArray>();
+  for (const auto& tank : tanks_) {
+    JsonObject obj = tanks.add<JsonObject>();
+    obj["input"] = tank.input;
+    obj["name"] = tank.name;
+    obj["sk_id"] = tank.sk_id;
+    obj["n2k_instance"] = tank.n2k_instance;
+    obj["fluid_type"] = tank.fluid_type;
+    obj["capacity"] = tank.capacity;
+  }
+
+  JsonArray voltages = config["voltages"].to<JsonArray>();
+  for (const auto& voltage : voltages_) {
+    JsonObject obj = voltages.add<JsonObject>();
+    obj["input"] = voltage.input;
+    obj["name"] = voltage.name;
+  }
+
+  JsonArray alarms = config["alarms"].to<JsonArray>();
+  for (const auto& alarm : alarms_) {
+    JsonObject obj = alarms.add<JsonObject>();
+    obj["input"] = alarm.input;
+    obj["name"] = alarm.name;
+    obj["inverted"] = alarm.inverted;
+  }
+
+  JsonArray engines = config["engines"].to<JsonArray>();
+  for (const auto& engine : engines_) {
+    JsonObject obj = engines.add<JsonObject>();
+    obj["instance"] = engine.instance;
+    obj["name"] = engine.name;
+    obj["tacho_input"] = engine.tacho_input;
+    obj["low_oil_pressure_input"] = engine.low_oil_pressure_input;
+    obj["over_temperature_input"] = engine.over_temperature_input;
+    obj["fuel_tank_input"] = engine.fuel_tank_input;
+  }
+  return true;
+}
+
+bool ChannelConfig::from_json(const JsonObject& config) {
+  String expected[] = {"tanks", "voltages", "alarms", "engines"};
+  for (auto str : expected) {
+    if (!config[str].is<JsonArray>()) {
+      debugE("ChannelConfig: Missing configuration key %s", str.c_str());
+      return false;
+    }
+  }
+
+  tanks_.clear();
+  JsonArray tanks = config["tanks"];
+  for (JsonVariant obj : tanks) {
+    tanks_.push_back({obj["input"] | 0, obj["name"] | "",
+                      obj["sk_id"] | "", obj["n2k_instance"] | 0,
+                      obj["fluid_type"] | 0, obj["capacity"] | 0.0f});
+  }
+
+  voltages_.clear();
+  JsonArray voltages = config["voltages"];
+  for (JsonVariant obj : voltages) {
+    voltages_.push_back({obj["input"] | 0, obj["name"] | ""});
+  }
+
+  alarms_.clear();
+  JsonArray alarms = config["alarms"];
+  for (JsonVariant obj : alarms) {
+    alarms_.push_back({obj["input"] | 0, obj["name"] | "",
+                       obj["inverted"] | false});
+  }
+
+  engines_.clear();
+  JsonArray engines = config["engines"];
+  for (JsonVariant obj : engines) {
+    engines_.push_back({obj["instance"] | 0, obj["name"] | "",
+                        obj["tacho_input"] | 0,
+                        obj["low_oil_pressure_input"] | 0,
+                        obj["over_temperature_input"] | 0,
+                        obj["fuel_tank_input"] | 0});
+  }
+  return true;
+}
+
+const String ConfigSchema(const ChannelConfig& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "tanks": { "title": "Tanks", "type": "array", "maxItems": 16, "items": {
+        "type": "object",
+        "properties": {
+          "input": { "title": "Analog input (1-16)", "type": "integer", "minimum": 1, "maximum": 16, "description": "A1-A4: HALMET, A5-A8, A9-A12, A13-A16: expansion ADCs at 0x48, 0x49, 0x4a" },
+          "name": { "title": "Name", "type": "string", "description": "Used in the configuration paths, e.g. Fuel" },
+          "sk_id": { "title": "Signal K id", "type": "string", "description": "e.g. fuel.main" },
+          "n2k_instance": { "title": "NMEA 2000 tank instance", "type": "integer", "minimum": 0, "maximum": 15 },
+          "fluid_type": { "title": "NMEA 2000 fluid type", "type": "integer", "description": "0: fuel, 1: fresh water, 2: waste water, 3: live well, 4: oil, 5: black water" },
+          "capacity": { "title": "Capacity (l)", "type": "number" }
+        }
+      }},
+      "voltages": { "title": "Voltage inputs", "type": "array", "maxItems": 16, "items": {
+        "type": "object",
+        "properties": {
+          "input": { "title": "Analog input (1-16)", "type": "integer", "minimum": 1, "maximum": 16, "description": "A1-A4: HALMET, A5-A8, A9-A12, A13-A16: expansion ADCs at 0x48, 0x49, 0x4a" },
+          "name": { "title": "Name", "type": "string", "description": "e.g. A2" }
+        }
+      }},
+      "alarms": { "title": "Alarm inputs", "type": "array", "maxItems": 4, "items": {
+        "type": "object",
+        "properties": {
+          "input": { "title": "Digital input (1-4)", "type": "integer", "minimum": 1, "maximum": 4 },
+          "name": { "title": "Name", "type": "string", "description": "e.g. D2" },
+          "inverted": { "title": "Active low", "type": "boolean" }
+        }
+      }},
+      "engines": { "title": "Engines", "type": "array", "maxItems": 4, "items": {
+        "type": "object",
+        "properties": {
+          "instance": { "title": "NMEA 2000 engine instance", "type": "integer", "minimum": 0 },
+          "name": { "title": "Name", "type": "string", "description": "Signal K propulsion id, e.g. main" },
+          "tacho_input": { "title": "Tacho digital input (1-4, 0: none)", "type": "integer", "minimum": 0, "maximum": 4 },
+          "low_oil_pressure_input": { "title": "Low oil pressure alarm input (1-4, 0: none)", "type": "integer", "minimum": 0, "maximum": 4 },
+          "over_temperature_input": { "title": "Over temperature alarm input (1-4, 0: none)", "type": "integer", "minimum": 0, "maximum": 4 },
+          "fuel_tank_input": { "title": "Fuel tank analog input (1-16, 0: none)", "type": "integer", "minimum": 0, "maximum": 16, "description": "The fuel rate is estimated from the volume of this tank" }
+        }
+      }}
+    }
+  })###";
+}
+
+}  // namespace halmet
@@ -0,0 +1,88 @@
+#ifndef HALMET_SRC_CHANNEL_CONFIG_H_
+#define HALMET_SRC_CHANNEL_CONFIG_H_
+
+#include <vector>
+
+#include "config_blob_store.h"
+#include "sensesp/system/saveable.h"
+
+namespace halmet {
+
+/**
+ * @brief Channel layout of the HALMET inputs and NMEA 2000 engines.
+ *
+ * Declares which analog inputs are tank senders or voltage inputs (A1-A4
+ * on HALMET, A5-A16 on expansion ADS1115 ADCs at 0x48, 0x49 and 0x4a),
+ * which digital inputs (D1-D4) are alarms, and which engines exist with
+ * their tacho and alarm inputs. setup() instantiates the channels from this
+ * configuration at boot, so adding a tank or an engine is a configuration
+ * change rather than a code change.
+ *
+ * Inputs are numbered from 1; 0 means "not connected".
+ */
+class ChannelConfig : public BlobSaveable {
+ public:
+  static constexpr int kNumAnalogInputs = 16;
+  static constexpr int kNumDigitalInputs = 4;
+
+  struct Tank {
+    int input;     // A1-A16
+    String name;   // Used in the configuration paths
+    String sk_id;  // Signal K tank id, e.g. "fuel.main"
+    int n2k_instance;
+    int fluid_type;  // tN2kFluidType
+    float capacity;  // l
+  };
+
+  struct Voltage {
+    int input;  // A1-A16
+    String name;
+  };
+
+  struct Alarm {
+    int input;  // D1-D4
+    String name;
+    bool inverted;  // Active low
+  };
+
+  struct Engine {
+    int instance;  // NMEA 2000 engine instance
+    String name;   // Signal K propulsion id, e.g. "main"
+    int tacho_input;             // D1-D4
+    int low_oil_pressure_input;  // D1-D4, an alarm input
+    int over_temperature_input;  // D1-D4, an alarm input
+    int fuel_tank_input;         // A1-A16, a tank input
+  };
+
+  ChannelConfig(const String& config_path);
+
+  const std::vector<Tank>& tanks() const { return tanks_; }
+  const std::vector<Voltage>& voltages() const { return voltages_; }
+  const std::vector<Alarm>& alarms() const { return alarms_; }
+  const std::vector<Engine>& engines() const { return engines_; }
+
+  /// The alarm on digital input `input`, or nullptr.
+  const Alarm* find_alarm(int input) const;
+  /// The tank on analog input `input`, or nullptr.
+  const Tank* find_tank(int input) const;
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  /// Drop channels with invalid or doubly used inputs.
+  void validate();
+
+  std::vector<Tank> tanks_;
+  std::vector<Voltage> voltages_;
+  std::vector<Alarm> alarms_;
+  std::vector<Engine> engines_;
+};
+
+const String ConfigSchema(const ChannelConfig& obj);
+
+inline bool ConfigRequiresRestart(const ChannelConfig& obj) { return true; }
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_CHANNEL_CONFIG_H_
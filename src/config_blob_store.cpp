@@ -0,0 +1,310 @@
+#include "config_blob_store.h"
+
+#include <SPIFFS.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const uint8_t kFormatVersion = 1;
+const char* kSlotPaths[2] = {"/config_a.blob", "/config_b.blob"};
+const size_t kHeaderLen = 20;
+// Larger blobs are neither written nor read
+const uint32_t kMaxBlobLen = 32 * 1024;
+// How often pending changes are checked for, and how long to wait for more
+// changes before writing
+const unsigned int kWriteCheckInterval = 500;  // ms
+const unsigned int kWriteDelay = 1000;         // ms
+
+uint32_t GetU32(const uint8_t* buf) {
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+void PutU32(uint8_t* buf, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    buf[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+struct Header {
+  uint32_t seq = 0;
+  uint32_t length = 0;
+  uint32_t crc = 0;
+};
+
+// Read and check the header at the start of a slot file
+bool ReadHeader(File& file, Header* header) {
+  uint8_t buf[kHeaderLen];
+  if (file.read(buf, kHeaderLen) != kHeaderLen ||
+      memcmp(buf, "HCFG", 4) != 0 || buf[4] != kFormatVersion) {
+    return false;
+  }
+  header->seq = GetU32(buf + 8);
+  header->length = GetU32(buf + 12);
+  header->crc = GetU32(buf + 16);
+  return header->length <= kMaxBlobLen;
+}
+
+}  // namespace
+
+ConfigBlobStore* ConfigBlobStore::instance_ = nullptr;
+
+void ConfigBlobStore::enable() {
+  if (instance_ == nullptr) {
+    instance_ = new ConfigBlobStore();
+  }
+}
+
+ConfigBlobStore::ConfigBlobStore() {
+  mutex_ = xSemaphoreCreateMutex();
+
+  // Only the headers are read to find the newest slot, which is then read
+  // and parsed once. If it turns out to be corrupt, the other slot is used.
+  uint32_t seqs[2] = {};
+  bool valid[2];
+  for (int slot = 0; slot < 2; slot++) {
+    valid[slot] = read_header(slot, &seqs[slot]);
+  }
+  // Sequence numbers are compared with wrap-around
+  int newest = valid[1] && (!valid[0] || (int32_t)(seqs[1] - seqs[0]) > 0);
+  for (int slot : {newest, 1 - newest}) {
+    if (valid[slot] && read_slot(slot)) {
+      current_slot_ = slot;
+      seq_ = seqs[slot];
+      break;
+    }
+  }
+
+  if (current_slot_ >= 0) {
+    debugI("Config blob: loaded %s, sequence %u", kSlotPaths[current_slot_],
+           (unsigned)seq_);
+  } else {
+    doc_.to<JsonObject>();
+    debugI("Config blob: no valid blob, starting empty");
+  }
+
+  sensesp::event_loop()->onRepeat(kWriteCheckInterval, [this]() { write(); });
+}
+
+bool ConfigBlobStore::read_header(int slot, uint32_t* seq) {
+  File file = SPIFFS.open(kSlotPaths[slot], FILE_READ);
+  if (!file) {
+    return false;
+  }
+  Header header;
+  bool ok = ReadHeader(file, &header);
+  file.close();
+  *seq = header.seq;
+  return ok;
+}
+
+bool ConfigBlobStore::read_slot(int slot) {
+  File file = SPIFFS.open(kSlotPaths[slot], FILE_READ);
+  if (!file) {
+    return false;
+  }
+  Header header;
+  if (!ReadHeader(file, &header)) {
+    file.close();
+    return false;
+  }
+  uint8_t* data = static_cast<uint8_t*>(malloc(header.length));
+  if (data == nullptr) {
+    file.close();
+    return false;
+  }
+  bool ok = file.read(data, header.length) == header.length &&
+            esp_rom_crc32_le(0, data, header.length) == header.crc;
+  file.close();
+  if (ok) {
+    ok = !deserializeMsgPack(doc_, data, header.length) &&
+         doc_.is<JsonObject>();
+  }
+  free(data);
+  if (!ok) {
+    debugW("Config blob: %s is corrupt", kSlotPaths[slot]);
+  }
+  return ok;
+}
+
+void ConfigBlobStore::write() {
+  // The blob is serialized under the mutex, but written to flash without
+  // it, so that save() calls, e.g. from the real-time loop, don't wait for
+  // the flash write.
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  if (!dirty_ || millis() - last_change_ < kWriteDelay) {
+    xSemaphoreGive(mutex_);
+    return;
+  }
+  size_t length = measureMsgPack(doc_);
+  if (length > kMaxBlobLen) {
+    // read_slot() would reject the blob at the next boot and fall back to
+    // the legacy files, so keep the last good slot instead. Retrying can't
+    // help until a configuration shrinks.
+    dirty_ = false;
+    xSemaphoreGive(mutex_);
+    debugE("Config blob: %u bytes exceed the limit of %u; changes not saved",
+           (unsigned)length, (unsigned)kMaxBlobLen);
+    return;
+  }
+  uint8_t* data = static_cast<uint8_t*>(malloc(kHeaderLen + length));
+  if (data == nullptr) {
+    xSemaphoreGive(mutex_);
+    debugE("Config blob: out of memory");
+    return;
+  }
+  serializeMsgPack(doc_, data + kHeaderLen, length);
+  // Changes from here on are written by the next check
+  dirty_ = false;
+  xSemaphoreGive(mutex_);
+
+  uint32_t seq = seq_ + 1;
+  memcpy(data, "HCFG", 4);
+  data[4] = kFormatVersion;
+  data[5] = data[6] = data[7] = 0;
+  PutU32(data + 8, seq);
+  PutU32(data + 12, length);
+  PutU32(data + 16, esp_rom_crc32_le(0, data + kHeaderLen, length));
+
+  // Overwrite the older slot; the current one stays valid until this one
+  // has been written completely.
+  int slot = current_slot_ == 0 ? 1 : 0;
+  File file = SPIFFS.open(kSlotPaths[slot], FILE_WRITE);
+  size_t written = 0;
+  if (file) {
+    written = file.write(data, kHeaderLen + length);
+    file.close();
+  }
+  free(data);
+
+  if (written != kHeaderLen + length) {
+    // Leave the changes pending; the next check retries
+    debugE("Config blob: writing %s failed", kSlotPaths[slot]);
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    dirty_ = true;
+    last_change_ = millis();
+    xSemaphoreGive(mutex_);
+    return;
+  }
+  // The slot and sequence number are only used by write(), on the SensESP
+  // loop
+  current_slot_ = slot;
+  seq_ = seq;
+  config_stats().writes_ = config_stats().writes_.get() + 1;
+  config_stats().bytes_written_ = config_stats().bytes_written_.get() + written;
+  debugD("Config blob: wrote %u bytes to %s", (unsigned)written,
+         kSlotPaths[slot]);
+}
+
+bool ConfigBlobStore::load(sensesp::Serializable* saveable,
+                           const String& config_path) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  JsonVariant entry = doc_[config_path];
+  bool found = entry.is<JsonObject>();
+  if (found) {
+    JsonObject config = entry.as<JsonObject>();
+    saveable->from_json(config);
+  }
+  xSemaphoreGive(mutex_);
+  return found;
+}
+
+bool ConfigBlobStore::save(sensesp::Serializable* saveable,
+                           const String& config_path) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  JsonObject config = doc_[config_path].to<JsonObject>();
+  bool ok = saveable->to_json(config);
+  dirty_ = true;
+  last_change_ = millis();
+  xSemaphoreGive(mutex_);
+  return ok;
+}
+
+ConfigStats& config_stats() {
+  static ConfigStats stats;
+  return stats;
+}
+
+bool LoadConfig(sensesp::FileSystemSaveable* saveable) {
+  const String& config_path = saveable->get_config_path();
+  if (config_path == "") {
+    return false;
+  }
+
+  int64_t start = esp_timer_get_time();
+  ConfigBlobStore* store = ConfigBlobStore::get();
+  bool ok;
+  if (store != nullptr && store->load(saveable, config_path)) {
+    config_stats().blob_loads_ = config_stats().blob_loads_.get() + 1;
+    ok = true;
+  } else {
+    ok = saveable->sensesp::FileSystemSaveable::load();
+    config_stats().file_loads_ = config_stats().file_loads_.get() + 1;
+    if (ok && store != nullptr) {
+      // Migrate the configuration into the blob
+      store->save(saveable, config_path);
+    }
+  }
+  config_stats().load_time_ = config_stats().load_time_.get() +
+                              (esp_timer_get_time() - start) / 1000.0f;
+  return ok;
+}
+
+bool SaveConfig(sensesp::FileSystemSaveable* saveable) {
+  const String& config_path = saveable->get_config_path();
+  if (config_path == "") {
+    return false;
+  }
+
+  ConfigBlobStore* store = ConfigBlobStore::get();
+  if (store != nullptr) {
+    return store->save(saveable, config_path);
+  }
+
+  bool ok = saveable->sensesp::FileSystemSaveable::save();
+  if (ok) {
+    config_stats().writes_ = config_stats().writes_.get() + 1;
+    // Count the size of the file that was written
+    String filename;
+    if (saveable->find_config_file(config_path, filename)) {
+      File file = SPIFFS.open(filename, FILE_READ);
+      if (file) {
+        config_stats().bytes_written_ =
+            config_stats().bytes_written_.get() + file.size();
+        file.close();
+      }
+    }
+  }
+  return ok;
+}
+
+void ConnectConfigStatsOutputs() {
+  ConfigStats& stats = config_stats();
+  stats.load_time_.connect_to(new sensesp::SKOutputFloat(
+      "sensors.halmet.config.loadTime", "",
+      new sensesp::SKMetadata("", "Config load time",
+                              "Time spent loading configurations (ms)")));
+  stats.file_loads_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.config.fileLoads", "",
+      new sensesp::SKMetadata("", "Config file loads",
+                              "Configurations loaded from their own file")));
+  stats.blob_loads_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.config.blobLoads", "",
+      new sensesp::SKMetadata("", "Config blob loads",
+                              "Configurations loaded from the config blob")));
+  stats.writes_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.config.writes", "",
+      new sensesp::SKMetadata("", "Config writes",
+                              "Configuration file writes since boot")));
+  stats.bytes_written_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.config.bytesWritten", "",
+      new sensesp::SKMetadata("", "Config bytes written",
+                              "Configuration bytes written since boot")));
+}
+
+}  // namespace halmet
@@ -0,0 +1,149 @@
+#ifndef HALMET_SRC_CONFIG_BLOB_STORE_H_
+#define HALMET_SRC_CONFIG_BLOB_STORE_H_
+
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <utility>
+
+#include "sensesp/system/observablevalue.h"
+#include "sensesp/system/saveable.h"
+#include "sensesp/ui/config_item.h"
+
+namespace halmet {
+
+/**
+ * @brief Configuration of many objects in one MessagePack blob.
+ *
+ * Instead of one JSON file per configurable object, the configurations are
+ * kept as a MessagePack map keyed by config path. The blob is read and
+ * parsed once at boot. Saves update the map in memory and are written out
+ * after a short delay, so a burst of saves from the web UI costs one write.
+ *
+ * Two slot files are written alternately. Each starts with a header with a
+ * sequence number and a CRC of the data; at boot, the valid slot with the
+ * highest sequence number wins. Only the headers are read to pick it, so
+ * only one slot is parsed. A write interrupted by a power loss leaves the
+ * previous slot intact.
+ *
+ * Slot layout (all integers little-endian):
+ *
+ *   "HCFG" | version:u8 | reserved:u8[3] | seq:u32 | length:u32 | crc32:u32 |
+ *   MessagePack map
+ *
+ * Objects without an entry in the blob are loaded from their own file once
+ * and then migrated into the blob. The legacy files are left in place.
+ */
+class ConfigBlobStore {
+ public:
+  /// The store, or nullptr if not enabled.
+  static ConfigBlobStore* get() { return instance_; }
+
+  /// Enable the store. Call after the file system has been mounted and
+  /// before creating any objects that use LoadConfig().
+  static void enable();
+
+  /// Load `saveable` from the blob. Returns false if there's no entry.
+  bool load(sensesp::Serializable* saveable, const String& config_path);
+  /// Store the configuration of `saveable` in the blob.
+  bool save(sensesp::Serializable* saveable, const String& config_path);
+
+ protected:
+  ConfigBlobStore();
+
+  /// Check the header of a slot and get its sequence number.
+  bool read_header(int slot, uint32_t* seq);
+  /// Check and parse a slot into doc_.
+  bool read_slot(int slot);
+  /// Write the blob if there are changes and none for kWriteDelay.
+  void write();
+
+  static ConfigBlobStore* instance_;
+
+  JsonDocument doc_;
+  SemaphoreHandle_t mutex_;
+  int current_slot_ = -1;
+  uint32_t seq_ = 0;
+  bool dirty_ = false;
+  uint32_t last_change_ = 0;
+};
+
+/**
+ * @brief Configuration load and save counters.
+ *
+ * Cover the objects that load through LoadConfig(), with or without the
+ * blob store, so that the two can be compared.
+ */
+struct ConfigStats {
+  /// Time spent loading configurations since boot, in ms
+  sensesp::ObservableValue<float> load_time_;
+  /// Configurations loaded from individual files
+  sensesp::ObservableValue<int> file_loads_{0};
+  /// Configurations loaded from the blob
+  sensesp::ObservableValue<int> blob_loads_{0};
+  /// File writes and bytes written by configuration saves since boot
+  sensesp::ObservableValue<int> writes_{0};
+  sensesp::ObservableValue<int> bytes_written_{0};
+};
+
+ConfigStats& config_stats();
+
+/// Publish the configuration store counters at sensors.halmet.config.*
+void ConnectConfigStatsOutputs();
+
+/// Load `saveable` from the blob store if enabled and it has an entry,
+/// otherwise from the object's own file.
+bool LoadConfig(sensesp::FileSystemSaveable* saveable);
+/// Save `saveable` to the blob store if enabled, otherwise to its own file.
+bool SaveConfig(sensesp::FileSystemSaveable* saveable);
+
+/**
+ * @brief FileSystemSaveable that loads and saves through the blob store.
+ */
+class BlobSaveable : public sensesp::FileSystemSaveable {
+ public:
+  BlobSaveable(const String& config_path)
+      : sensesp::FileSystemSaveable{config_path} {}
+
+  virtual bool load() override { return LoadConfig(this); }
+  virtual bool save() override { return SaveConfig(this); }
+};
+
+/**
+ * @brief Blob store support for SensESP classes.
+ *
+ * SensESP objects load their file in their constructor. BlobBacked<T> is
+ * constructed with `config_path` and the arguments of T's constructor, in
+ * which the config path must be empty so that T doesn't load anything. The
+ * config path is set and the configuration loaded once T is complete.
+ *
+ *   new BlobBacked<sensesp::Linear>("/Tanks/Fuel/Total Volume", 0.12, 0, "")
+ */
+template <typename T>
+class BlobBacked : public T {
+ public:
+  template <typename... Args>
+  BlobBacked(const String& config_path, Args&&... args)
+      : T(std::forward<Args>(args)...) {
+    this->config_path_ = config_path;
+    load();
+  }
+
+  virtual bool load() override { return LoadConfig(this); }
+  virtual bool save() override { return SaveConfig(this); }
+};
+
+template <typename T>
+const String ConfigSchema(const BlobBacked<T>& obj) {
+  return ConfigSchema(static_cast<const T&>(obj));
+}
+
+template <typename T>
+bool ConfigRequiresRestart(const BlobBacked<T>& obj) {
+  return ConfigRequiresRestart(static_cast<const T&>(obj));
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_CONFIG_BLOB_STORE_H_
@@ -0,0 +1,78 @@
+#include "data_age.h"
+
+#include "rt_event_loop.h"
+#include "sensesp/signalk/signalk_output.h"
+
+namespace halmet {
+
+namespace {
+
+struct Metric {
+  sensesp::ObservableValue<float>* producer;
+  const char* suffix;
+  const char* description;
+};
+
+void ConnectMetricOutputs(const Metric* metrics, int num_metrics,
+                          const char* group, const char* label,
+                          const String& id) {
+  for (int i = 0; i < num_metrics; i++) {
+    const Metric& metric = metrics[i];
+    char sk_path[80];
+    snprintf(sk_path, sizeof(sk_path), "sensors.halmet.%s.%s.%s", group,
+             id.c_str(), metric.suffix);
+    char display_name[80];
+    snprintf(display_name, sizeof(display_name), "%s %s %s", id.c_str(), label,
+             metric.suffix);
+
+    // The monitors may report on the real-time loop
+    ToAppLoop<float>(metric.producer)
+        ->connect_to(new sensesp::SKOutputFloat(
+            sk_path, "",
+            new sensesp::SKMetadata("s", display_name, metric.description)));
+  }
+}
+
+}  // namespace
+
+DataAgeMonitor::DataAgeMonitor(unsigned int max_age,
+                               unsigned int report_interval,
+                               std::shared_ptr<reactesp::EventLoop> loop)
+    : max_age_{max_age} {
+  loop->onRepeat(report_interval, [this]() { report(); });
+}
+
+IntervalJitterMonitor::IntervalJitterMonitor(
+    unsigned int nominal_interval, unsigned int report_interval,
+    std::shared_ptr<reactesp::EventLoop> loop)
+    : nominal_us_{nominal_interval * 1000} {
+  loop->onRepeat(report_interval, [this]() { report(); });
+}
+
+void IntervalJitterMonitor::report() {
+  if (histogram_.count() == 0) {
+    return;
+  }
+  p95_.set(histogram_.quantile(0.95) / 1e6);
+  max_.set(histogram_.max() / 1e6);
+  histogram_.clear();
+}
+
+void ConnectDataAgeOutputs(DataAgeMonitor* monitor, const String& id) {
+  const Metric metrics[] = {
+      {&monitor->median_, "median", "Median data age at transmission"},
+      {&monitor->p95_, "p95", "95th percentile data age at transmission"},
+      {&monitor->max_, "max", "Maximum data age at transmission"},
+  };
+  ConnectMetricOutputs(metrics, 3, "dataAge", "data age", id);
+}
+
+void ConnectJitterOutputs(IntervalJitterMonitor* monitor, const String& id) {
+  const Metric metrics[] = {
+      {&monitor->p95_, "p95", "95th percentile interval deviation"},
+      {&monitor->max_, "max", "Maximum interval deviation"},
+  };
+  ConnectMetricOutputs(metrics, 2, "jitter", "jitter", id);
+}
+
+}  // namespace halmet
@@ -0,0 +1,204 @@
+#ifndef HALMET_SRC_DATA_AGE_H_
+#define HALMET_SRC_DATA_AGE_H_
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+
+#include "age_histogram.h"
+#include "sensesp/system/lambda_consumer.h"
+#include "sensesp/system/observablevalue.h"
+#include "sensesp/transforms/transform.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Acquisition timestamp of the value currently being propagated.
+ *
+ * SensESP producers call their consumers synchronously, so a value and
+ * everything derived from it by transforms is emitted inside the call stack
+ * of the original sensor. A sensor opens a Scope around its emit() and any
+ * consumer further down the chain can read the acquisition time with
+ * current() without the value types having to change.
+ */
+class AcquisitionTime {
+ public:
+  /// Acquisition time in millis() of the value being emitted, or 0 if the
+  /// emission didn't originate from a stamped sensor (e.g. a repeat).
+  static uint32_t current() { return current_; }
+
+  class Scope {
+   public:
+    Scope(uint32_t acquired = millis()) : previous_{current_} {
+      // Keep the earliest stamp if the chain is stamped more than once
+      if (current_ == 0) {
+        current_ = acquired == 0 ? 1 : acquired;
+      }
+    }
+    ~Scope() { current_ = previous_; }
+
+   private:
+    uint32_t previous_;
+  };
+
+ private:
+  static inline thread_local uint32_t current_ = 0;
+};
+
+/**
+ * @brief Pass-through transform that stamps values with their acquisition
+ * time.
+ *
+ * Use directly after sensors that don't stamp their values themselves.
+ * `offset` is subtracted from the current time, e.g. half the counting window
+ * for a pulse counter.
+ */
+template <typename T>
+class AcquisitionStamp : public sensesp::Transform<T, T> {
+ public:
+  AcquisitionStamp(unsigned int offset = 0)
+      : sensesp::Transform<T, T>(""), offset_{offset} {}
+
+  virtual void set(const T& input) override {
+    AcquisitionTime::Scope scope(millis() - offset_);
+    this->emit(input);
+  }
+
+ private:
+  unsigned int offset_;
+};
+
+/**
+ * @brief Age-of-data metrics for one output.
+ *
+ * Tracks the acquisition time of each input of an output (a PGN or an SK
+ * path). Every time the output is transmitted, record() adds the age of the
+ * oldest input to the histogram. Median, 95th percentile and maximum age over
+ * the last report interval are published as producers.
+ */
+class DataAgeMonitor {
+ public:
+  /// Inputs older than `max_age` are expired and don't count. `loop` must be
+  /// the event loop that calls record(). The tracked producers may emit on
+  /// another loop.
+  DataAgeMonitor(unsigned int max_age, unsigned int report_interval = 10000,
+                 std::shared_ptr<reactesp::EventLoop> loop =
+                     sensesp::event_loop());
+
+  /// Track the acquisition time of values emitted by `producer`.
+  template <typename T>
+  void track(sensesp::ValueProducer<T>* producer) {
+    std::atomic<uint32_t>* acquired = &acquired_.emplace_back(0);
+    producer->connect_to(
+        new sensesp::LambdaConsumer<T>([acquired](const T& value) {
+          uint32_t stamp = AcquisitionTime::current();
+          if (stamp != 0) {
+            acquired->store(stamp, std::memory_order_relaxed);
+          }
+        }));
+  }
+
+  /// Track `producer` and record an age every time it emits a fresh value.
+  /// Used for outputs that hand values on immediately, e.g. SK outputs.
+  template <typename T>
+  void track_and_record(sensesp::ValueProducer<T>* producer) {
+    track(producer);
+    producer->connect_to(new sensesp::LambdaConsumer<T>([this](const T&) {
+      if (AcquisitionTime::current() != 0) {
+        record();
+      }
+    }));
+  }
+
+  /// Record the age of the data at the point of transmission.
+  void record() {
+    uint32_t now = millis();
+    bool valid = false;
+    uint32_t oldest = 0;
+    for (const auto& acquired : acquired_) {
+      uint32_t stamp = acquired.load(std::memory_order_relaxed);
+      uint32_t age = now - stamp;
+      if (stamp == 0 || age > max_age_) {
+        continue;
+      }
+      if (!valid || age > oldest) {
+        oldest = age;
+      }
+      valid = true;
+    }
+    if (valid) {
+      histogram_.add(oldest);
+    }
+  }
+
+  sensesp::ObservableValue<float> median_;
+  sensesp::ObservableValue<float> p95_;
+  sensesp::ObservableValue<float> max_;
+
+ protected:
+  void report() {
+    if (histogram_.count() == 0) {
+      return;
+    }
+    // Published in seconds to match the SK unit of time
+    median_.set(histogram_.quantile(0.5) / 1000.);
+    p95_.set(histogram_.quantile(0.95) / 1000.);
+    max_.set(histogram_.max() / 1000.);
+    histogram_.clear();
+  }
+
+  unsigned int max_age_;
+  // Acquisition time of each tracked input. A deque doesn't move its
+  // elements when one is added.
+  std::deque<std::atomic<uint32_t>> acquired_;
+  AgeHistogram histogram_;
+};
+
+/**
+ * @brief Timing jitter of a periodic event.
+ *
+ * record() is called every time the event runs. The deviation of each
+ * interval from the nominal interval is added to a histogram with
+ * microsecond resolution, and the 95th percentile and maximum over the last
+ * report interval are published as producers.
+ */
+class IntervalJitterMonitor {
+ public:
+  /// `loop` must be the event loop that calls record().
+  IntervalJitterMonitor(unsigned int nominal_interval,
+                        unsigned int report_interval = 10000,
+                        std::shared_ptr<reactesp::EventLoop> loop =
+                            sensesp::event_loop());
+
+  void record() {
+    uint32_t now = micros();
+    if (last_ != 0) {
+      int32_t deviation = (int32_t)(now - last_) - (int32_t)nominal_us_;
+      histogram_.add(deviation < 0 ? -deviation : deviation);
+    }
+    last_ = now;
+  }
+
+  sensesp::ObservableValue<float> p95_;
+  sensesp::ObservableValue<float> max_;
+
+ protected:
+  void report();
+
+  uint32_t nominal_us_;
+  uint32_t last_ = 0;
+  AgeHistogram histogram_;
+};
+
+/// Publish the metrics of `monitor` at sensors.halmet.dataAge.<id>.*
+void ConnectDataAgeOutputs(DataAgeMonitor* monitor, const String& id);
+
+/// Publish the metrics of `monitor` at sensors.halmet.jitter.<id>.*
+void ConnectJitterOutputs(IntervalJitterMonitor* monitor, const String& id);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_DATA_AGE_H_
@@ -0,0 +1,398 @@
+#include "data_logger.h"
+
+#include <SPIFFS.h>
+#include <esp_timer.h>
+#include <time.h>
+
+#include "sensesp/system/lambda_consumer.h"
+
+namespace halmet {
+
+namespace {
+
+const uint8_t kFormatVersion = 1;
+// Record timestamps are stored in units of this many milliseconds
+const uint16_t kTickMs = 100;
+// Worst case encoded record: 5 byte varint, channel byte, 5 byte varint
+const size_t kMaxRecordLen = 11;
+// Segments created before this point in time have no valid wall clock
+const time_t kMinValidEpoch = 1600000000;
+// Share of the file system the ring may use. The rest is left for the
+// configuration files, the configuration blob slots, the input trace and
+// the SPIFFS page overhead and garbage collection.
+const float kMaxFsShare = 0.4;
+// The segment size is reduced so that at least this many segments fit
+const unsigned int kMinSegments = 4;
+const unsigned int kMinSegmentSize = 1024;  // bytes
+
+size_t PutVarint(uint8_t* buf, uint32_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    buf[len++] = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  buf[len++] = static_cast<uint8_t>(value);
+  return len;
+}
+
+uint32_t ZigZag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+size_t PutU16(uint8_t* buf, uint16_t value) {
+  buf[0] = value & 0xff;
+  buf[1] = value >> 8;
+  return 2;
+}
+
+size_t PutU32(uint8_t* buf, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    buf[i] = (value >> (8 * i)) & 0xff;
+  }
+  return 4;
+}
+
+uint32_t CurrentTick() {
+  return static_cast<uint32_t>(esp_timer_get_time() / 1000 / kTickMs);
+}
+
+}  // namespace
+
+DataLogger::DataLogger(const String& config_path)
+    : BlobSaveable{config_path} {
+  mutex_ = xSemaphoreCreateRecursiveMutex();
+  load();
+
+  if (!enabled_) {
+    return;
+  }
+
+  // Limit the ring to a share of the file system. The default ring doesn't
+  // fit in the SPIFFS partition of min_spiffs.csv, and on a full file system
+  // the configuration saves would fail.
+  unsigned int fs_size = SPIFFS.totalBytes();
+  unsigned int budget = fs_size * kMaxFsShare;
+  ring_segment_size_ = min(segment_size_, budget / kMinSegments);
+  if (ring_segment_size_ < kMinSegmentSize) {
+    debugE("Data log: file system too small (%u bytes)", fs_size);
+    return;
+  }
+  ring_segments_ = min(max_segments_, budget / ring_segment_size_);
+  if (ring_segment_size_ != segment_size_ || ring_segments_ != max_segments_) {
+    debugW("Data log: ring limited to %u segments of %u bytes",
+           ring_segments_, ring_segment_size_);
+  }
+
+  scan_segments();
+  fs_used_at_start_ = SPIFFS.usedBytes();
+
+  sensesp::event_loop()->onRepeat(sample_interval_, [this]() { sample(); });
+  sensesp::event_loop()->onRepeat(flush_interval_, [this]() { flush(); });
+}
+
+int DataLogger::add_channel(const String& name, float resolution) {
+  xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+  channels_.push_back({name, resolution, 0, 0, false, false, 0});
+  // A new channel changes the segment header, so start a fresh segment.
+  if (segment_open_) {
+    start_segment(CurrentTick());
+  }
+  xSemaphoreGiveRecursive(mutex_);
+  return channels_.size() - 1;
+}
+
+void DataLogger::connect_from(sensesp::ValueProducer<float>* producer,
+                              const String& name, float resolution) {
+  int channel = add_channel(name, resolution);
+  producer->connect_to(new sensesp::LambdaConsumer<float>(
+      [this, channel](float value) {
+        xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+        Channel& ch = channels_[channel];
+        ch.current = lroundf(value / ch.resolution);
+        ch.has_value = true;
+        xSemaphoreGiveRecursive(mutex_);
+      }));
+}
+
+void DataLogger::connect_from(sensesp::ValueProducer<bool>* producer,
+                              const String& name) {
+  int channel = add_channel(name, 1);
+  producer->connect_to(
+      new sensesp::LambdaConsumer<bool>([this, channel](bool value) {
+        xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+        channels_[channel].current = value;
+        channels_[channel].has_value = true;
+        xSemaphoreGiveRecursive(mutex_);
+      }));
+}
+
+void DataLogger::sample() {
+  const uint32_t tick = CurrentTick();
+  const uint32_t keepalive_ticks = keepalive_interval_ / kTickMs;
+
+  xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+  for (size_t i = 0; i < channels_.size(); i++) {
+    Channel& ch = channels_[i];
+    if (!ch.has_value) {
+      continue;
+    }
+    bool logged = segment_open_ && ch.logged_in_segment;
+    if (logged && ch.current == ch.last_logged &&
+        tick - ch.last_logged_tick < keepalive_ticks) {
+      continue;
+    }
+    write_record(i, tick, ch.current);
+  }
+  xSemaphoreGiveRecursive(mutex_);
+}
+
+void DataLogger::write_record(uint8_t channel, uint32_t tick, int32_t value) {
+  if (!segment_open_ || segment_len_ + kMaxRecordLen > ring_segment_size_) {
+    start_segment(tick);
+  }
+
+  Channel& ch = channels_[channel];
+  int32_t previous = ch.logged_in_segment ? ch.last_logged : 0;
+
+  uint8_t record[kMaxRecordLen];
+  size_t len = PutVarint(record, tick - last_record_tick_);
+  record[len++] = channel;
+  len += PutVarint(record + len, ZigZag(value - previous));
+  append(record, len);
+
+  last_record_tick_ = tick;
+  ch.last_logged = value;
+  ch.last_logged_tick = tick;
+  ch.logged_in_segment = true;
+  samples_++;
+}
+
+void DataLogger::start_segment(uint32_t tick) {
+  if (segment_open_) {
+    flush();
+    next_seq_++;
+  }
+  // Drop the oldest segments to keep the ring within its size limit
+  while (next_seq_ - first_seq_ >= ring_segments_) {
+    SPIFFS.remove(segment_path(first_seq_));
+    first_seq_++;
+  }
+
+  segment_open_ = true;
+  segment_len_ = 0;
+  last_record_tick_ = tick;
+  for (auto& ch : channels_) {
+    ch.logged_in_segment = false;
+  }
+
+  time_t now = time(nullptr);
+  uint8_t header[16];
+  size_t len = 0;
+  memcpy(header, "HLOG", 4);
+  len += 4;
+  header[len++] = kFormatVersion;
+  header[len++] = channels_.size();
+  len += PutU16(header + len, kTickMs);
+  len += PutU32(header + len, now >= kMinValidEpoch ? now : 0);
+  len += PutU32(header + len, tick);
+  append(header, len);
+
+  for (const auto& ch : channels_) {
+    uint8_t desc[5];
+    memcpy(desc, &ch.resolution, 4);
+    desc[4] = min(ch.name.length(), 255U);
+    append(desc, sizeof(desc));
+    append(reinterpret_cast<const uint8_t*>(ch.name.c_str()), desc[4]);
+  }
+}
+
+void DataLogger::append(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    if (buffer_len_ == kBufferSize) {
+      flush();
+    }
+    size_t n = min(len, kBufferSize - buffer_len_);
+    memcpy(buffer_ + buffer_len_, data, n);
+    buffer_len_ += n;
+    segment_len_ += n;
+    logged_bytes_ += n;
+    data += n;
+    len -= n;
+  }
+}
+
+void DataLogger::flush() {
+  xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+  if (buffer_len_ > 0) {
+    File file = SPIFFS.open(segment_path(next_seq_), FILE_APPEND);
+    if (file) {
+      file.write(buffer_, buffer_len_);
+      file.close();
+      flash_writes_++;
+    } else {
+      debugE("Data log: cannot open %s", segment_path(next_seq_).c_str());
+    }
+    buffer_len_ = 0;
+
+    // Filesystem growth per logged byte includes page padding and metadata.
+    // Only meaningful while no segments have been deleted in this session.
+    size_t used = SPIFFS.usedBytes();
+    if (first_seq_ == initial_first_seq_ && used > fs_used_at_start_) {
+      write_amplification_ =
+          static_cast<float>(used - fs_used_at_start_) / logged_bytes_;
+    }
+    debugD(
+        "Data log: %u samples, %.2f bytes/sample, %u flash writes, "
+        "write amplification %.2f",
+        samples_, samples_ ? static_cast<float>(logged_bytes_) / samples_ : 0,
+        flash_writes_, write_amplification_);
+  }
+  xSemaphoreGiveRecursive(mutex_);
+}
+
+void DataLogger::scan_segments() {
+  bool found = false;
+  uint32_t lowest = 0;
+  uint32_t highest = 0;
+
+  File root = SPIFFS.open("/");
+  File file = root.openNextFile();
+  while (file) {
+    const char* name = file.name();
+    if (name[0] == '/') {
+      name++;
+    }
+    unsigned int seq;
+    if (sscanf(name, "dl_%8x.bin", &seq) == 1) {
+      if (!found || seq < lowest) {
+        lowest = seq;
+      }
+      if (!found || seq > highest) {
+        highest = seq;
+      }
+      found = true;
+    }
+    file = root.openNextFile();
+  }
+
+  // Always start a new segment at boot; the channel set may have changed.
+  first_seq_ = found ? lowest : 0;
+  next_seq_ = found ? highest + 1 : 0;
+  initial_first_seq_ = first_seq_;
+}
+
+String DataLogger::segment_path(uint32_t seq) const {
+  char path[20];
+  snprintf(path, sizeof(path), "/dl_%08x.bin", seq);
+  return path;
+}
+
+void DataLogger::add_http_handler(std::shared_ptr<sensesp::HTTPServer> server) {
+  auto handler = std::make_shared<sensesp::HTTPRequestHandler>(
+      1 << HTTP_GET, "/api/datalog",
+      [this](httpd_req_t* req) { return handle_download(req); });
+  server->add_handler(handler);
+}
+
+esp_err_t DataLogger::handle_download(httpd_req_t* req) {
+  // Snapshot the segment range so that records written during the download
+  // don't race with the transfer.
+  xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+  flush();
+  uint32_t first = first_seq_;
+  uint32_t last = next_seq_;
+  xSemaphoreGiveRecursive(mutex_);
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition",
+                     "attachment; filename=\"halmet.hlog\"");
+
+  uint8_t chunk[512];
+  for (uint32_t seq = first; seq <= last; seq++) {
+    File file = SPIFFS.open(segment_path(seq), FILE_READ);
+    if (!file) {
+      // Not yet created or already rotated out
+      continue;
+    }
+    size_t remaining = file.size();
+    PutU32(chunk, remaining);
+    if (httpd_resp_send_chunk(req, reinterpret_cast<char*>(chunk), 4) !=
+        ESP_OK) {
+      file.close();
+      return ESP_FAIL;
+    }
+    while (remaining > 0) {
+      size_t n = file.read(chunk, min(remaining, sizeof(chunk)));
+      if (n == 0) {
+        // Segment truncated underneath us; pad to keep the framing intact
+        n = min(remaining, sizeof(chunk));
+        memset(chunk, 0, n);
+      }
+      if (httpd_resp_send_chunk(req, reinterpret_cast<char*>(chunk), n) !=
+          ESP_OK) {
+        file.close();
+        return ESP_FAIL;
+      }
+      remaining -= n;
+    }
+    file.close();
+  }
+  return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+bool DataLogger::to_json(JsonObject& config) {
+  config["enabled"] = enabled_;
+  config["sample_interval"] = sample_interval_;
+  config["keepalive_interval"] = keepalive_interval_;
+  config["flush_interval"] = flush_interval_;
+  config["segment_size"] = segment_size_;
+  config["max_segments"] = max_segments_;
+  config["ring_size"] = ring_segments_ * ring_segment_size_;
+  config["samples"] = samples_;
+  config["bytes_per_sample"] =
+      samples_ ? static_cast<float>(logged_bytes_) / samples_ : 0;
+  config["flash_writes"] = flash_writes_;
+  config["write_amplification"] = write_amplification_;
+  return true;
+}
+
+bool DataLogger::from_json(const JsonObject& config) {
+  String expected[] = {"sample_interval", "keepalive_interval",
+                       "flush_interval", "segment_size", "max_segments"};
+  for (auto str : expected) {
+    if (!config[str].is<unsigned int>()) {
+      return false;
+    }
+  }
+  if (config["enabled"].is<bool>()) {
+    enabled_ = config["enabled"];
+  }
+  sample_interval_ = config["sample_interval"];
+  keepalive_interval_ = config["keepalive_interval"];
+  flush_interval_ = config["flush_interval"];
+  segment_size_ = config["segment_size"];
+  max_segments_ = max(config["max_segments"].as<unsigned int>(), 2U);
+  return true;
+}
+
+const String ConfigSchema(const DataLogger& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "enabled": { "title": "Enabled", "type": "boolean" },
+      "sample_interval": { "title": "Sample interval", "type": "integer", "description": "Interval between samples (ms)" },
+      "keepalive_interval": { "title": "Keepalive interval", "type": "integer", "description": "Unchanged values are logged again after this interval (ms)" },
+      "flush_interval": { "title": "Flush interval", "type": "integer", "description": "Maximum time records are buffered in RAM (ms)" },
+      "segment_size": { "title": "Segment size", "type": "integer", "description": "Size of one log segment file (bytes)" },
+      "max_segments": { "title": "Number of segments", "type": "integer", "description": "Oldest segment is deleted when this count is exceeded" },
+      "ring_size": { "title": "Ring size", "type": "integer", "readOnly": true, "description": "Size of the log after limiting it to 40% of the file system (bytes)" },
+      "samples": { "title": "Samples logged", "type": "integer", "readOnly": true },
+      "bytes_per_sample": { "title": "Bytes per sample", "type": "number", "readOnly": true },
+      "flash_writes": { "title": "Flash writes", "type": "integer", "readOnly": true },
+      "write_amplification": { "title": "Write amplification", "type": "number", "readOnly": true, "description": "Filesystem growth per logged byte" }
+    }
+  })###";
+}
+
+}  // namespace halmet
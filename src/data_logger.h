@@ -0,0 +1,124 @@
+#ifndef HALMET_SRC_DATA_LOGGER_H_
+#define HALMET_SRC_DATA_LOGGER_H_
+
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <memory>
+#include <vector>
+
+#include "config_blob_store.h"
+#include "sensesp/net/http_server.h"
+#include "sensesp/system/saveable.h"
+#include "sensesp/system/valueproducer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Compact on-device history logger.
+ *
+ * Selected producers are sampled at a fixed interval and written as
+ * delta-encoded fixed-point records into a ring of append-only segment files.
+ * When the ring is full, the oldest segment is deleted. The whole log can be
+ * downloaded from /api/datalog and converted to CSV with
+ * tools/halmet_log_decode.py.
+ *
+ * Segment layout (all integers little-endian):
+ *
+ *   "HLOG" | version:u8 | channel_count:u8 | tick_ms:u16 |
+ *   epoch_s:u32 | start_tick:u32 |
+ *   channel_count * (resolution:f32 | name_len:u8 | name) |
+ *   records...
+ *
+ * Each record is varint(time delta in ticks) | channel:u8 |
+ * zigzag varint(value delta in resolution units). Time and value deltas are
+ * reset at the start of every segment so that segments decode independently.
+ * The download stream is a sequence of length-prefixed (u32) segments.
+ */
+class DataLogger : public BlobSaveable {
+ public:
+  DataLogger(const String& config_path);
+
+  /// Tee a float producer into the log. Values are stored as multiples of
+  /// `resolution`.
+  void connect_from(sensesp::ValueProducer<float>* producer,
+                    const String& name, float resolution);
+  /// Tee a boolean (alarm) producer into the log.
+  void connect_from(sensesp::ValueProducer<bool>* producer,
+                    const String& name);
+
+  /// Register the streaming download handler on the HTTP server.
+  void add_http_handler(std::shared_ptr<sensesp::HTTPServer> server);
+
+  /// Write out any buffered records.
+  void flush();
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  struct Channel {
+    String name;
+    float resolution;
+    int32_t current;      // Latest input value in resolution units
+    int32_t last_logged;  // Last value written to the current segment
+    bool has_value;
+    bool logged_in_segment;
+    uint32_t last_logged_tick;
+  };
+
+  int add_channel(const String& name, float resolution);
+  void sample();
+  void write_record(uint8_t channel, uint32_t tick, int32_t value);
+  void start_segment(uint32_t tick);
+  void append(const uint8_t* data, size_t len);
+  void scan_segments();
+  String segment_path(uint32_t seq) const;
+  esp_err_t handle_download(httpd_req_t* req);
+
+  bool enabled_ = true;
+  unsigned int sample_interval_ = 10000;  // ms
+  unsigned int keepalive_interval_ = 600000;  // ms
+  unsigned int flush_interval_ = 60000;  // ms
+  unsigned int segment_size_ = 64 * 1024;  // bytes
+  unsigned int max_segments_ = 16;
+  // Ring limited to the file system size
+  unsigned int ring_segment_size_ = 0;  // bytes
+  unsigned int ring_segments_ = 0;
+
+  std::vector<Channel> channels_;
+
+  // Write-back buffer; flushed when full or every flush_interval_.
+  static constexpr size_t kBufferSize = 512;
+  uint8_t buffer_[kBufferSize];
+  size_t buffer_len_ = 0;
+
+  uint32_t first_seq_ = 0;
+  uint32_t next_seq_ = 0;  // Sequence number of the segment being written
+  uint32_t initial_first_seq_ = 0;
+  size_t segment_len_ = 0;
+  bool segment_open_ = false;
+  uint32_t last_record_tick_ = 0;
+
+  // Measurements
+  uint32_t samples_ = 0;
+  uint32_t logged_bytes_ = 0;
+  uint32_t flash_writes_ = 0;
+  size_t fs_used_at_start_ = 0;
+  float write_amplification_ = 0;
+
+  // Guards the channels and the segment state. Taken by the producer
+  // callbacks, the sampling and flushes, and the download handler on the
+  // HTTP task.
+  SemaphoreHandle_t mutex_;
+};
+
+const String ConfigSchema(const DataLogger& obj);
+
+inline bool ConfigRequiresRestart(const DataLogger& obj) { return true; }
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_DATA_LOGGER_H_
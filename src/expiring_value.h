@@ -1,6 +1,10 @@
 #ifndef HALMET_SRC_EXPIRING_VALUE_H_
 #define HALMET_SRC_EXPIRING_VALUE_H_
 
+#include <Arduino.h>
+
+#include "sensesp/system/valueconsumer.h"
+
 template <typename T>
 class ExpiringValue {
  public:
@@ -41,4 +45,25 @@ class ExpiringValue {
   unsigned long last_update_;
 };
 
+/**
+ * @brief Consumer that holds the latest input value until it expires.
+ *
+ * Unlike sensesp::RepeatExpiring, no timer is involved: expiry is evaluated
+ * when the value is read. The value reads as expired until the first input
+ * arrives.
+ */
+template <typename T>
+class ExpiringInput : public sensesp::ValueConsumer<T> {
+ public:
+  ExpiringInput(unsigned long expiration_duration, T expired_value)
+      : value_{expired_value, expiration_duration, expired_value} {}
+
+  virtual void set(const T& input) override { value_.update(input); }
+
+  T get() const { return value_.get(); }
+
+ private:
+  ExpiringValue<T> value_;
+};
+
 #endif  // HALMET_SRC_EXPIRING_VALUE_H_
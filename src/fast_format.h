@@ -0,0 +1,76 @@
+#ifndef HALMET_SRC_FAST_FORMAT_H_
+#define HALMET_SRC_FAST_FORMAT_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace halmet {
+
+/**
+ * @brief Format a float with a fixed number of decimals into a buffer.
+ *
+ * Integer-only formatting that never touches the heap, unlike printf("%f"),
+ * which goes through newlib's dtoa and its bigint allocator. Non-finite values
+ * are written as "null". Values that don't fit into an int64 after scaling
+ * are clamped.
+ *
+ * @return Number of characters written, excluding the terminating zero, or 0
+ * if the buffer is too small.
+ */
+inline size_t FormatFloat(char* buf, size_t size, float value,
+                          int decimals = 3) {
+  static const uint32_t kPow10[] = {1,      10,      100,     1000,
+                                    10000,  100000,  1000000, 10000000,
+                                    100000000};
+  if (decimals < 0) {
+    decimals = 0;
+  } else if (decimals > 8) {
+    decimals = 8;
+  }
+
+  char tmp[32];
+  size_t len = 0;
+
+  if (!std::isfinite(value)) {
+    const char* null_str = "null";
+    while (*null_str) tmp[len++] = *null_str++;
+  } else {
+    bool negative = value < 0;
+    double scaled = std::fabs(static_cast<double>(value)) * kPow10[decimals];
+    uint64_t fixed = scaled >= 9.2e18 ? 9200000000000000000ULL
+                                      : static_cast<uint64_t>(scaled + 0.5);
+    // Write digits in reverse order
+    char rev[24];
+    size_t n = 0;
+    int frac_digits = 0;
+    do {
+      rev[n++] = '0' + fixed % 10;
+      fixed /= 10;
+      if (++frac_digits == decimals) {
+        rev[n++] = '.';
+      }
+    } while (fixed > 0 || frac_digits <= decimals);
+    // Drop trailing zeros of the fraction part (and a trailing dot)
+    size_t start = 0;
+    if (decimals > 0) {
+      while (rev[start] == '0') start++;
+      if (rev[start] == '.') start++;
+    }
+    if (negative && !(n - start == 1 && rev[start] == '0')) {
+      tmp[len++] = '-';
+    }
+    while (n > start) tmp[len++] = rev[--n];
+  }
+
+  if (len + 1 > size) {
+    return 0;
+  }
+  for (size_t i = 0; i < len; i++) buf[i] = tmp[i];
+  buf[len] = '\0';
+  return len;
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_FAST_FORMAT_H_
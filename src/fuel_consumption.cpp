@@ -0,0 +1,77 @@
+#include "fuel_consumption.h"
+
+#include <algorithm>
+
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+// m3/s in one l/h
+const float kLitersPerHour = 1 / 3.6e6;
+
+}  // namespace
+
+FuelConsumption::FuelConsumption(const String& config_path)
+    : BlobSaveable{config_path} {
+  load();
+  estimator_ = new FuelRateEstimator(block_time_,
+                                     rate_change_ * kLitersPerHour / 60,
+                                     max_uncertainty_ * kLitersPerHour);
+}
+
+void FuelConsumption::set(const float& value) {
+  estimator_->update(value, millis());
+  if (estimator_->valid()) {
+    // The volume decreases while fuel is consumed
+    fuel_rate_.set(std::max(0.0f, -estimator_->rate()));
+  }
+}
+
+bool FuelConsumption::to_json(JsonObject& config) {
+  config["block_time"] = block_time_;
+  config["rate_change"] = rate_change_;
+  config["max_uncertainty"] = max_uncertainty_;
+  if (estimator_ != nullptr && estimator_->valid()) {
+    config["fuel_rate"] = -estimator_->rate() / kLitersPerHour;
+    config["uncertainty"] = estimator_->rate_stddev() / kLitersPerHour;
+  }
+  if (estimator_ != nullptr) {
+    config["rejected"] = estimator_->rejected();
+    config["resets"] = estimator_->resets();
+    config["rate_changes"] = estimator_->maneuvers();
+  }
+  return true;
+}
+
+bool FuelConsumption::from_json(const JsonObject& config) {
+  String expected[] = {"block_time", "rate_change", "max_uncertainty"};
+  for (auto str : expected) {
+    if (!config[str].is<float>()) {
+      return false;
+    }
+  }
+  block_time_ = std::max(config["block_time"].as<float>(), 1.0f);
+  rate_change_ = config["rate_change"];
+  max_uncertainty_ = config["max_uncertainty"];
+  return true;
+}
+
+const String ConfigSchema(const FuelConsumption& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "block_time": { "title": "Averaging block", "type": "number", "description": "Tank volume samples are averaged over blocks of this length to remove slosh (s)" },
+      "rate_change": { "title": "Rate change", "type": "number", "description": "Expected change of the fuel rate (l/h per minute). Larger values follow throttle changes faster but are noisier." },
+      "max_uncertainty": { "title": "Maximum uncertainty", "type": "number", "description": "The fuel rate is output once its standard deviation is below this value or 5% of the rate (l/h)" },
+      "fuel_rate": { "title": "Fuel rate", "type": "number", "readOnly": true, "description": "l/h" },
+      "uncertainty": { "title": "Uncertainty", "type": "number", "readOnly": true, "description": "Standard deviation of the fuel rate (l/h)" },
+      "rejected": { "title": "Rejected blocks", "type": "integer", "readOnly": true, "description": "Block averages rejected as outliers" },
+      "resets": { "title": "Volume resets", "type": "integer", "readOnly": true, "description": "Steps of the volume, e.g. refuelling" },
+      "rate_changes": { "title": "Rate changes", "type": "integer", "readOnly": true, "description": "Detected sudden changes of the fuel rate" }
+    }
+  })###";
+}
+
+}  // namespace halmet
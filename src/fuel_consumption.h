@@ -0,0 +1,50 @@
+#ifndef HALMET_SRC_FUEL_CONSUMPTION_H_
+#define HALMET_SRC_FUEL_CONSUMPTION_H_
+
+#include "config_blob_store.h"
+#include "fuel_rate_estimator.h"
+#include "sensesp/system/observablevalue.h"
+#include "sensesp/system/valueconsumer.h"
+
+namespace halmet {
+
+/**
+ * @brief Engine fuel rate estimated from the volume of its fuel tank.
+ *
+ * Consumes the tank volume (m3) and runs a FuelRateEstimator over it. Once
+ * the estimate is valid, the fuel rate is emitted after every volume
+ * sample, so that inputs expiring after a few seconds, like the ones of
+ * N2kEngineParameterDynamicSender, stay fresh while the estimate itself
+ * only changes once per averaging block. Nothing is emitted while the
+ * estimate is uncertain, e.g. during the first minutes after boot.
+ */
+class FuelConsumption : public BlobSaveable,
+                        public sensesp::ValueConsumer<float> {
+ public:
+  FuelConsumption(const String& config_path = "");
+
+  /// Volume input, m3
+  virtual void set(const float& value) override;
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  /// Fuel consumed, m3/s
+  sensesp::ObservableValue<float> fuel_rate_;
+
+ protected:
+  // Configuration
+  float block_time_ = 10;      // s
+  float rate_change_ = 2;      // l/h per minute
+  float max_uncertainty_ = 1;  // l/h
+
+  FuelRateEstimator* estimator_ = nullptr;
+};
+
+const String ConfigSchema(const FuelConsumption& obj);
+
+inline bool ConfigRequiresRestart(const FuelConsumption& obj) { return true; }
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_FUEL_CONSUMPTION_H_
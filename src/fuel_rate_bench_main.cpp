@@ -0,0 +1,40 @@
+// Host benchmark of the fuel rate estimator.
+//
+// Measures the CPU time per volume sample of FuelRateEstimator. The
+// estimation accuracy on synthetic and recorded traces is checked by
+// test/test_fuel_rate_estimator. Build and run with:
+//
+//   pio run -e native_fuel_rate_bench
+//   .pio/build/native_fuel_rate_bench/program
+
+#ifdef HALMET_FUEL_RATE_BENCH
+
+#include <cstdio>
+#include <ctime>
+
+#include "fuel_rate_estimator.h"
+
+using namespace halmet;
+
+namespace {
+
+// Tank senders are read every 500 ms
+const uint32_t kSampleInterval = 500;  // ms
+
+}  // namespace
+
+int main() {
+  // CPU time per sample
+  const int kIterations = 10000000;
+  FuelRateEstimator estimator;
+  clock_t start = clock();
+  for (int i = 0; i < kIterations; i++) {
+    estimator.update(0.1f - i * 1e-9f + (i % 7) * 1e-4f, i * kSampleInterval);
+  }
+  double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("%.1f ns per sample (%g)\n", elapsed * 1e9 / kIterations,
+         estimator.rate() < 0 ? 1.0 : 0.0);
+  return 0;
+}
+
+#endif  // HALMET_FUEL_RATE_BENCH
@@ -0,0 +1,168 @@
+#include "fuel_rate_estimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace halmet {
+
+namespace {
+
+// Prior standard deviation of the rate: about 100 l/h
+const double kInitialRateStddev = 2.8e-5;  // m3/s
+// Lower bound of the block mean variance: 0.1 l
+const double kMinNoiseVariance = 1e-8;  // m3^2
+// Weight of a new block in the learned noise variance, once warmed up
+const double kNoiseLearningRate = 0.05;
+// Blocks before the estimate can be valid
+const int kMinBlocks = 3;
+// The estimate is also valid within this fraction of the rate
+const double kMaxRelativeUncertainty = 0.05;
+// Weight of a block in the running mean of the normalized innovations
+const double kBiasWeight = 0.25;
+// Running mean that triggers a rate change, and the variance it adds:
+// about 20 l/h
+const double kManeuverBias = 1.5;
+const double kManeuverRateStddev = 5.6e-6;  // m3/s
+
+}  // namespace
+
+FuelRateEstimator::FuelRateEstimator(float block_time, float rate_change,
+                                     float max_uncertainty)
+    : block_time_{block_time},
+      rate_change_{rate_change},
+      max_uncertainty_{max_uncertainty} {}
+
+void FuelRateEstimator::reset() {
+  block_started_ = false;
+  initialized_ = false;
+  blocks_ = 0;
+  consecutive_rejects_ = 0;
+}
+
+float FuelRateEstimator::rate_stddev() const {
+  return initialized_ ? sqrt(p_[1][1]) : INFINITY;
+}
+
+bool FuelRateEstimator::valid() const {
+  return initialized_ && blocks_ >= kMinBlocks &&
+         rate_stddev() <= std::max(max_uncertainty_,
+                                   kMaxRelativeUncertainty * fabs(x_[1]));
+}
+
+bool FuelRateEstimator::update(float volume, uint32_t time_ms) {
+  if (std::isnan(volume)) {
+    return false;
+  }
+  if (!block_started_) {
+    block_started_ = true;
+    block_start_ms_ = time_ms;
+    block_n_ = 0;
+    block_mean_ = 0;
+    block_m2_ = 0;
+  }
+  block_n_++;
+  double delta = volume - block_mean_;
+  block_mean_ += delta / block_n_;
+  block_m2_ += delta * (volume - block_mean_);
+
+  uint32_t elapsed = time_ms - block_start_ms_;
+  if (elapsed < block_time_ * 1000) {
+    return false;
+  }
+  // The block mean is the volume at the middle of the block
+  uint32_t center_ms = block_start_ms_ + elapsed / 2;
+  double dt = initialized_ ? (uint32_t)(center_ms - last_center_ms_) / 1000.
+                           : 0;
+  last_center_ms_ = center_ms;
+  block_started_ = false;
+  update_block(block_mean_, block_m2_ / block_n_, dt);
+  return true;
+}
+
+void FuelRateEstimator::update_block(double mean, double variance,
+                                     double dt) {
+  if (!initialized_) {
+    // The spread within the first block is a conservative noise guess
+    r_ = std::max(variance, kMinNoiseVariance);
+    x_[0] = mean;
+    x_[1] = 0;
+    p_[0][0] = r_;
+    p_[0][1] = p_[1][0] = 0;
+    p_[1][1] = kInitialRateStddev * kInitialRateStddev;
+    last_mean_ = mean;
+    initialized_ = true;
+    blocks_ = 1;
+    learned_ = 0;
+    bias_ = 0;
+    return;
+  }
+  blocks_++;
+
+  // Difference from the previous mean, less the expected change: two
+  // independent block mean errors
+  double difference = mean - last_mean_ - x_[1] * dt;
+  last_mean_ = mean;
+
+  // Predict: constant rate, with the rate as a random walk
+  double q = rate_change_ * rate_change_;
+  x_[0] += x_[1] * dt;
+  p_[0][0] += 2 * dt * p_[0][1] + dt * dt * p_[1][1] + q * dt * dt * dt / 3;
+  p_[0][1] += dt * p_[1][1] + q * dt * dt / 2;
+  p_[1][0] = p_[0][1];
+  p_[1][1] += q * dt;
+
+  double innovation = mean - x_[0];
+  double s = p_[0][0] + r_;
+  bool learn = consecutive_rejects_ == 0;
+  if (innovation * innovation > kGate * kGate * s) {
+    rejected_++;
+    if (++consecutive_rejects_ >= kResetBlocks) {
+      // A real step in the volume. The rate is unaffected.
+      resets_++;
+      consecutive_rejects_ = 0;
+      x_[0] = mean;
+      p_[0][0] = r_;
+      p_[0][1] = p_[1][0] = 0;
+      bias_ = 0;
+    }
+    return;
+  }
+  consecutive_rejects_ = 0;
+
+  // Innovations persistently on one side mean that the rate has changed
+  // faster than the random walk allows, e.g. the throttle was moved: open up
+  // the rate variance so that it is tracked quickly.
+  bias_ += kBiasWeight * (innovation / sqrt(s) - bias_);
+  if (fabs(bias_) > kManeuverBias) {
+    maneuvers_++;
+    bias_ = 0;
+    // The volume has drifted from the prediction for about the averaging
+    // time of the bias
+    double drift = kManeuverRateStddev * dt / kBiasWeight;
+    p_[0][0] += drift * drift;
+    p_[1][1] += kManeuverRateStddev * kManeuverRateStddev;
+    s = p_[0][0] + r_;
+  }
+
+  double k0 = p_[0][0] / s;
+  double k1 = p_[0][1] / s;
+  x_[0] += k0 * innovation;
+  x_[1] += k1 * innovation;
+  p_[1][1] -= k1 * p_[0][1];
+  p_[0][0] *= 1 - k0;
+  p_[0][1] *= 1 - k0;
+  p_[1][0] = p_[0][1];
+
+  // Learn the block mean noise from consecutive accepted means, averaging
+  // evenly until warmed up
+  if (learn) {
+    learned_++;
+    double weight = std::max(kNoiseLearningRate, 1. / learned_);
+    // Clipped, so that a step that passes the gate doesn't inflate it
+    double sample = std::min(difference * difference / 2, 4 * r_);
+    r_ += weight * (sample - r_);
+    r_ = std::max(r_, kMinNoiseVariance);
+  }
+}
+
+}  // namespace halmet
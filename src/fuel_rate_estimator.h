@@ -0,0 +1,94 @@
+#ifndef HALMET_SRC_FUEL_RATE_ESTIMATOR_H_
+#define HALMET_SRC_FUEL_RATE_ESTIMATOR_H_
+
+#include <cstdint>
+
+namespace halmet {
+
+/**
+ * @brief Streaming estimate of the rate of change of a tank volume.
+ *
+ * The volume samples are averaged over fixed blocks, which removes most of
+ * the slosh, and the block means are fed to a constant-velocity Kalman
+ * filter with the volume and its rate of change as the state. The noise of
+ * the block means is learned from the differences of consecutive means, so
+ * a calm tank converges faster than one in a seaway. A block mean further
+ * than kGate standard deviations from the prediction is rejected; if
+ * kResetBlocks means in a row are rejected, the volume has really jumped
+ * (refuelling, or a tank drained) and the volume state is reset while the
+ * rate is kept.
+ *
+ * Updates are O(1) per sample and nothing is allocated. All quantities are
+ * SI: m3, m3/s and seconds.
+ *
+ * See test/test_fuel_rate_estimator.
+ */
+class FuelRateEstimator {
+ public:
+  /// Rejection threshold of the block means, in standard deviations
+  static constexpr double kGate = 4;
+  /// Consecutive rejected block means that reset the volume
+  static constexpr int kResetBlocks = 3;
+
+  /// `block_time` is the averaging block length in s. `rate_change` is the
+  /// expected rate of change of the rate, in m3/s per s: how fast the
+  /// consumption may change. The estimate is valid once its standard
+  /// deviation is below `max_uncertainty` (m3/s).
+  FuelRateEstimator(float block_time = 10, float rate_change = 1e-8,
+                    float max_uncertainty = 3e-7);
+
+  /// Add a volume sample taken at `time_ms`. Returns true if a block was
+  /// completed and the estimate updated.
+  bool update(float volume, uint32_t time_ms);
+
+  void reset();
+
+  /// Rate of change of the volume, m3/s; negative while consuming
+  float rate() const { return x_[1]; }
+  /// Standard deviation of rate()
+  float rate_stddev() const;
+  /// True if the rate is known to within max_uncertainty
+  bool valid() const;
+  /// Filtered volume, m3
+  float volume() const { return x_[0]; }
+  /// Block means rejected as outliers, and volume resets
+  int rejected() const { return rejected_; }
+  int resets() const { return resets_; }
+  /// Detected changes of the rate
+  int maneuvers() const { return maneuvers_; }
+
+ protected:
+  void update_block(double mean, double variance, double dt);
+
+  double block_time_;
+  double rate_change_;
+  double max_uncertainty_;
+
+  // Current block: Welford running mean and variance
+  bool block_started_ = false;
+  uint32_t block_start_ms_ = 0;
+  int block_n_ = 0;
+  double block_mean_ = 0;
+  double block_m2_ = 0;
+
+  // Filter state: volume and rate, and their covariance
+  bool initialized_ = false;
+  double x_[2] = {};
+  double p_[2][2] = {};
+  uint32_t last_center_ms_ = 0;
+  double last_mean_ = 0;
+  // Learned variance of the block means
+  double r_ = 0;
+  int blocks_ = 0;
+  int learned_ = 0;
+  // Running mean of the normalized innovations
+  double bias_ = 0;
+  int consecutive_rejects_ = 0;
+  int rejected_ = 0;
+  int resets_ = 0;
+  int maneuvers_ = 0;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_FUEL_RATE_ESTIMATOR_H_
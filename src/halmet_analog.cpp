@@ -1,34 +1,51 @@
 #include "halmet_analog.h"
 
+#include "input_trace.h"
+#include "rt_event_loop.h"
 #include "sensesp/sensors/sensor.h"
 #include "sensesp/signalk/signalk_output.h"
 #include "sensesp/system/valueproducer.h"
 #include "sensesp/transforms/curveinterpolator.h"
 #include "sensesp/transforms/linear.h"
 #include "sensesp/ui/config_item.h"
+#include "shared_scheduler.h"
+#include "sk_delta_sender.h"
 
 namespace halmet {
 
-// HALMET constant measurement current (A)
-const float kMeasurementCurrent = 0.01;
-
-// Default fuel tank size, in m3
-const float kTankDefaultSize = 120. / 1000;
-
-sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
-                                          int channel, const String& name,
-                                          const String& sk_id, int sort_order,
-                                          bool enable_signalk_output) {
-  const uint ads_read_delay = 500;  // ms
-
-  // Configure the sender resistance sensor
+bool ReadADC(ADS1115Bank* bank, int input, int32_t* counts, uint32_t* time) {
+  InputTrace* trace = InputTrace::get();
+  uint8_t device = input / ADS1115Bank::kChannels;
+  uint8_t channel = input % ADS1115Bank::kChannels;
+  if (trace != nullptr && trace->replay_adc(device, channel, counts)) {
+    *time = millis();
+  } else if (!bank->read(input, counts, time)) {
+    return false;
+  }
+  if (trace != nullptr) {
+    trace->record_adc(device, channel, *counts);
+  }
+  return true;
+}
 
-  auto sender_resistance =
-      new sensesp::RepeatSensor<float>(ads_read_delay, [ads1115, channel]() {
-        int16_t adc_output = ads1115->readADC_SingleEnded(channel);
-        float adc_output_volts = ads1115->computeVolts(adc_output);
-        return kVoltageDividerScale * adc_output_volts / kMeasurementCurrent;
-      });
+sensesp::FloatProducer* ConnectTankSender(
+    ADS1115Bank* bank, int input, const String& name, const String& sk_id,
+    int sort_order, bool enable_signalk_output, bool enable_ui,
+    sensesp::FloatProducer** volume) {
+  // Configure the sender resistance sensor. The ADC is read on the real-time
+  // loop, so the Signal K outputs below are connected through ToAppLoop().
+  // All tanks are read by the same shared scheduler.
+
+  auto sender_resistance = new sensesp::ObservableValue<float>();
+  SharedScheduler::get(kTankReadDelay)->add([bank, input, sender_resistance]() {
+    int32_t adc_output;
+    uint32_t time;
+    if (!ReadADC(bank, input, &adc_output, &time)) {
+      return;
+    }
+    AcquisitionTime::Scope scope(time);
+    sender_resistance->set(SenderResistance(adc_output));
+  });
 
   if (enable_signalk_output) {
     char resistance_sk_config_path[80];
@@ -51,17 +68,21 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
     snprintf(resistance_meta_description, sizeof(resistance_meta_description),
              "Measured tank %s sender resistance", name.c_str());
 
-    auto sender_resistance_sk_output = new sensesp::SKOutputFloat(
+    auto sender_resistance_sk_output = new SKDeltaOutputFloat(
         resistance_sk_path, resistance_sk_config_path,
         new sensesp::SKMetadata("ohm", resistance_meta_display_name,
-                                resistance_meta_description));
-
-    ConfigItem(sender_resistance_sk_output)
-        ->set_title(resistance_title)
-        ->set_description(resistance_description)
-        ->set_sort_order(sort_order);
-
-    sender_resistance->connect_to(sender_resistance_sk_output);
+                                resistance_meta_description),
+        1);
+
+    if (enable_ui) {
+      ConfigItem(sender_resistance_sk_output)
+          ->set_title(resistance_title)
+          ->set_description(resistance_description)
+          ->set_sort_order(sort_order);
+    }
+
+    ToAppLoop<float>(sender_resistance)
+        ->connect_to(sender_resistance_sk_output);
   }
 
   // Configure the piecewise linear interpolator for the tank level (ratio)
@@ -76,14 +97,17 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
   snprintf(curve_description, sizeof(curve_description),
            "Piecewise linear curve for the %s tank level", name.c_str());
 
-  auto tank_level = (new sensesp::CurveInterpolator(nullptr, curve_config_path))
+  auto tank_level = (new BlobBacked<sensesp::CurveInterpolator>(
+                         curve_config_path, nullptr, ""))
                         ->set_input_title("Sender Resistance (ohms)")
                         ->set_output_title("Fuel Level (ratio)");
 
-  ConfigItem(tank_level)
-      ->set_title(curve_title)
-      ->set_description(curve_description)
-      ->set_sort_order(sort_order + 1);
+  if (enable_ui) {
+    ConfigItem(tank_level)
+        ->set_title(curve_title)
+        ->set_description(curve_description)
+        ->set_sort_order(sort_order + 1);
+  }
 
   if (tank_level->get_samples().empty()) {
     // If there's no prior configuration, provide a default curve
@@ -115,17 +139,19 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
     snprintf(level_meta_description, sizeof(level_meta_description),
              "Tank %s level", name.c_str());
 
-    auto tank_level_sk_output = new sensesp::SKOutputFloat(
+    auto tank_level_sk_output = new SKDeltaOutputFloat(
         level_sk_path, level_config_path,
         new sensesp::SKMetadata("ratio", level_meta_display_name,
                                 level_meta_description));
 
-    ConfigItem(tank_level_sk_output)
-        ->set_title(level_title)
-        ->set_description(level_description)
-        ->set_sort_order(sort_order + 2);
+    if (enable_ui) {
+      ConfigItem(tank_level_sk_output)
+          ->set_title(level_title)
+          ->set_description(level_description)
+          ->set_sort_order(sort_order + 2);
+    }
 
-    tank_level->connect_to(tank_level_sk_output);
+    ToAppLoop<float>(tank_level)->connect_to(tank_level_sk_output);
   }
 
   // Configure the linear transform for the tank volume
@@ -139,15 +165,20 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
   char volume_description[80];
   snprintf(volume_description, sizeof(volume_description),
            "Calculated total volume of the %s tank", name.c_str());
-  auto tank_volume =
-      new sensesp::Linear(kTankDefaultSize, 0, volume_config_path);
+  auto tank_volume = new BlobBacked<sensesp::Linear>(
+      volume_config_path, kTankDefaultSize, 0, "");
 
-  ConfigItem(tank_volume)
-      ->set_title(volume_title)
-      ->set_description(volume_description)
-      ->set_sort_order(sort_order + 3);
+  if (enable_ui) {
+    ConfigItem(tank_volume)
+        ->set_title(volume_title)
+        ->set_description(volume_description)
+        ->set_sort_order(sort_order + 3);
+  }
 
   tank_level->connect_to(tank_volume);
+  if (volume != nullptr) {
+    *volume = tank_volume;
+  }
 
   if (enable_signalk_output) {
     char volume_sk_config_path[80];
@@ -169,17 +200,20 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
     snprintf(volume_meta_description, sizeof(volume_meta_description),
              "Calculated tank %s remaining volume", name.c_str());
 
-    auto tank_volume_sk_output = new sensesp::SKOutputFloat(
+    auto tank_volume_sk_output = new SKDeltaOutputFloat(
         volume_sk_path, volume_sk_config_path,
         new sensesp::SKMetadata("m3", volume_meta_display_name,
-                                volume_meta_description));
+                                volume_meta_description),
+        5);
 
-    ConfigItem(tank_volume_sk_output)
-        ->set_title(volume_title)
-        ->set_description(volume_description)
-        ->set_sort_order(sort_order + 4);
+    if (enable_ui) {
+      ConfigItem(tank_volume_sk_output)
+          ->set_title(volume_title)
+          ->set_description(volume_description)
+          ->set_sort_order(sort_order + 4);
+    }
 
-    tank_volume->connect_to(tank_volume_sk_output);
+    ToAppLoop<float>(tank_volume)->connect_to(tank_volume_sk_output);
   }
 
   return tank_level;
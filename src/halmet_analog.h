@@ -1,30 +1,41 @@
 #ifndef HALMET_ANALOG_H_
 #define HALMET_ANALOG_H_
 
-#include <Adafruit_ADS1X15.h>
-
+#include "ads1115_bank.h"
+#include "config_blob_store.h"
+#include "data_age.h"
+#include "input_conversion.h"
+#include "rt_event_loop.h"
 #include "sensesp/sensors/sensor.h"
 #include "sensesp_base_app.h"
 
 namespace halmet {
 
-// HALMET voltage divider scale factor
-const float kVoltageDividerScale = 33.3 / 3.3;
-
-sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
-                                          int channel, const String& name,
-                                          const String& sk_id, int sort_order,
-                                          bool enable_signalk_output = true);
-
+// Get the latest sample of an analog input and its acquisition time.
+// Returns false if the input hasn't been sampled yet. If an input trace is
+// active, the reading is captured, or in replay mode, replaced with the
+// recorded value.
+bool ReadADC(ADS1115Bank* bank, int input, int32_t* counts, uint32_t* time);
+
+// Returns the tank level producer. The level is emitted on rt_event_loop().
+// If `volume` is given, it is set to the tank volume producer (m3), emitted
+// on the same loop. Without `enable_ui`, e.g. in NMEA 2000 only mode, no
+// config items are created.
+sensesp::FloatProducer* ConnectTankSender(
+    ADS1115Bank* bank, int input, const String& name, const String& sk_id,
+    int sort_order, bool enable_signalk_output = true, bool enable_ui = true,
+    sensesp::FloatProducer** volume = nullptr);
+
+// Voltage input read on rt_event_loop().
 class ADS1115VoltageInput : public sensesp::FloatSensor {
  public:
-  ADS1115VoltageInput(Adafruit_ADS1115* ads1115, int channel,
+  ADS1115VoltageInput(ADS1115Bank* bank, int input,
                       const String& config_path,
                       unsigned int read_interval = 500,
                       float calibration_factor = 1.0)
       : sensesp::FloatSensor(config_path),
-        ads1115_{ads1115},
-        channel_{channel},
+        bank_{bank},
+        input_{input},
         read_interval_{read_interval},
         calibration_factor_{calibration_factor} {
     load();
@@ -33,11 +44,19 @@ class ADS1115VoltageInput : public sensesp::FloatSensor {
   }
 
   void update() {
-    int16_t adc_output = ads1115_->readADC_SingleEnded(channel_);
-    float adc_output_volts = ads1115_->computeVolts(adc_output);
+    int32_t adc_output;
+    uint32_t time;
+    if (!ReadADC(bank_, input_, &adc_output, &time)) {
+      return;
+    }
+    float adc_output_volts = ADS1115Bank::compute_volts(adc_output);
+    AcquisitionTime::Scope scope(time);
     this->emit(calibration_factor_ * kVoltageDividerScale * adc_output_volts);
   }
 
+  virtual bool load() override { return LoadConfig(this); }
+  virtual bool save() override { return SaveConfig(this); }
+
   virtual bool to_json(JsonObject& root) override {
     root["calibration_factor"] = calibration_factor_;
     return true;
@@ -56,17 +75,17 @@ class ADS1115VoltageInput : public sensesp::FloatSensor {
 
   reactesp::RepeatEvent* set_repeat_event(unsigned int read_interval) {
     if (repeat_event_ != nullptr) {
-      repeat_event_->remove(sensesp::event_loop());
+      repeat_event_->remove(rt_event_loop());
     }
 
-    repeat_event_ = sensesp::event_loop()->onRepeat(
+    repeat_event_ = rt_event_loop()->onRepeat(
         read_interval, [this]() { this->update(); });
     return repeat_event_;
   }
 
  private:
-  Adafruit_ADS1115* ads1115_;
-  int channel_;
+  ADS1115Bank* bank_;
+  int input_;
   unsigned int read_interval_;
   float calibration_factor_;
 };
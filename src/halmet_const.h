@@ -12,6 +12,10 @@ const int kSCLPin = 22;
 // ADS1115 I2C address
 const int kADS1115Address = 0x4b;
 
+// I2C addresses of the optional expansion ADS1115 ADCs, in input order:
+// A5-A8, A9-A12 and A13-A16
+const int kExpansionADS1115Addresses[] = {0x48, 0x49, 0x4a};
+
 // CAN bus (NMEA 2000) pins on HALMET
 const gpio_num_t kCANRxPin = GPIO_NUM_18;
 const gpio_num_t kCANTxPin = GPIO_NUM_19;
@@ -22,6 +26,10 @@ const int kDigitalInputPin2 = GPIO_NUM_25;
 const int kDigitalInputPin3 = GPIO_NUM_27;
 const int kDigitalInputPin4 = GPIO_NUM_26;
 
+// The BOOT button of the ESP32 module. Also used by the SensESP button
+// handler in full mode.
+const int kButtonPin = GPIO_NUM_0;
+
 
 
 
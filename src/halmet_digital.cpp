@@ -1,18 +1,99 @@
 #include "halmet_digital.h"
 
-#include "sensesp/sensors/digital_input.h"
+#include <atomic>
+
+#include "config_blob_store.h"
+#include "data_age.h"
+#include "input_conversion.h"
+#include "input_trace.h"
+#include "rt_event_loop.h"
 #include "sensesp/sensors/sensor.h"
 #include "sensesp/signalk/signalk_output.h"
 #include "sensesp/transforms/frequency.h"
 #include "sensesp/ui/config_item.h"
+#include "shared_scheduler.h"
+#include "sk_delta_sender.h"
 
 using namespace sensesp;
 
-// Default RPM count scale factor, corresponds to 100 pulses per revolution.
-// This is rarely, if ever correct.
-const float kDefaultFrequencyScale = 1 / 100.;
+// Alarm input polling interval, in ms
+const unsigned int kAlarmReadDelay = 100;
+
+namespace {
+
+/**
+ * @brief Interrupt-driven pulse counter read on the real-time event loop.
+ *
+ * Equivalent to sensesp::DigitalInputCounter, but the counting window isn't
+ * subject to the SensESP event loop latency. The configuration is
+ * compatible. Counters with the same read delay share one scheduler.
+ */
+class PulseCounter : public IntSensor {
+ public:
+  PulseCounter(uint8_t pin, int pin_mode, int interrupt_type,
+               unsigned int read_delay, String config_path)
+      : IntSensor(config_path), pin_{pin}, read_delay_{read_delay} {
+    load();
+    pinMode(pin_, pin_mode);
+    attachInterruptArg(digitalPinToInterrupt(pin_), on_pulse, this,
+                       interrupt_type);
+    halmet::SharedScheduler::get(read_delay_)->add([this]() { read(); });
+  }
+
+  /// Counting window in ms, as loaded from the configuration
+  unsigned int read_delay() const { return read_delay_; }
+
+  virtual bool load() override { return halmet::LoadConfig(this); }
+  virtual bool save() override { return halmet::SaveConfig(this); }
+
+  virtual bool to_json(JsonObject& root) override {
+    root["read_delay"] = read_delay_;
+    return true;
+  }
+
+  virtual bool from_json(const JsonObject& config) override {
+    if (!config["read_delay"].is<unsigned int>()) {
+      return false;
+    }
+    read_delay_ = config["read_delay"];
+    return true;
+  }
+
+ protected:
+  void read() {
+    int32_t count = counter_.exchange(0);
+    halmet::InputTrace* trace = halmet::InputTrace::get();
+    if (trace != nullptr) {
+      trace->replay_counter(pin_, &count);
+      trace->record_counter(pin_, count);
+    }
+    this->emit(count);
+  }
+
+  static void IRAM_ATTR on_pulse(void* arg) {
+    static_cast<PulseCounter*>(arg)->counter_++;
+  }
+
+  uint8_t pin_;
+  unsigned int read_delay_;
+  std::atomic<int> counter_{0};
+};
+
+const String ConfigSchema(const PulseCounter& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "read_delay": { "title": "Read delay", "type": "integer", "description": "The time, in milliseconds, between each read of the input" }
+    }
+  })###";
+}
+
+const bool ConfigRequiresRestart(const PulseCounter& obj) { return true; }
+
+}  // namespace
 
-FloatProducer* ConnectTachoSender(int pin, String name) {
+Frequency* ConnectTachoSender(int pin, String name, bool enable_signalk_output,
+                              bool enable_ui) {
   char config_path[80];
   char sk_path[80];
   char config_title[80];
@@ -23,11 +104,14 @@ FloatProducer* ConnectTachoSender(int pin, String name) {
   snprintf(config_description, sizeof(config_description), "Tacho %s Input Pin",
            name.c_str());
   auto tacho_input =
-      new DigitalInputCounter(pin, INPUT, RISING, 500, config_path);
+      new PulseCounter(pin, INPUT, RISING, halmet::kTachoReadDelay,
+                       config_path);
 
-  ConfigItem(tacho_input)
-      ->set_title(config_title)
-      ->set_description(config_description);
+  if (enable_ui) {
+    ConfigItem(tacho_input)
+        ->set_title(config_title)
+        ->set_description(config_description);
+  }
 
   snprintf(config_path, sizeof(config_path), "/Tacho %s/Revolution Multiplier",
            name.c_str());
@@ -35,58 +119,85 @@ FloatProducer* ConnectTachoSender(int pin, String name) {
            name.c_str());
   snprintf(config_description, sizeof(config_description),
            "Tacho %s Multiplier", name.c_str());
-  auto tacho_frequency = new Frequency(kDefaultFrequencyScale, config_path);
+  auto tacho_frequency = new halmet::BlobBacked<Frequency>(
+      config_path, halmet::kDefaultFrequencyScale, "");
 
-  ConfigItem(tacho_frequency)
-      ->set_title(config_title)
-      ->set_description(config_description);
+  if (enable_ui) {
+    ConfigItem(tacho_frequency)
+        ->set_title(config_title)
+        ->set_description(config_description);
+  }
 
-  tacho_input->connect_to(tacho_frequency);
+  // Stamp the counts with the middle of the counting window
+  tacho_input
+      ->connect_to(
+          new halmet::AcquisitionStamp<int>(tacho_input->read_delay() / 2))
+      ->connect_to(tacho_frequency);
 
 #ifdef ENABLE_SIGNALK
-  snprintf(config_path, sizeof(config_path), "/Tacho %s/Revolutions SK Path",
-           name.c_str());
-  snprintf(sk_path, sizeof(sk_path), "propulsion.%s.revolutions", name.c_str());
-  snprintf(config_title, sizeof(config_title), "Tacho %s Signal K Path",
-           name.c_str());
-  snprintf(config_description, sizeof(config_description),
-           "Tacho %s Signal K Path", name.c_str());
-
-  auto tacho_frequency_sk_output = new SKOutputFloat(sk_path, config_path);
-
-  ConfigItem(tacho_frequency_sk_output)
-      ->set_title(config_title)
-      ->set_description(config_description);
-
-  tacho_frequency->connect_to(tacho_frequency_sk_output);
+  if (enable_signalk_output) {
+    snprintf(config_path, sizeof(config_path), "/Tacho %s/Revolutions SK Path",
+             name.c_str());
+    snprintf(sk_path, sizeof(sk_path), "propulsion.%s.revolutions",
+             name.c_str());
+    snprintf(config_title, sizeof(config_title), "Tacho %s Signal K Path",
+             name.c_str());
+    snprintf(config_description, sizeof(config_description),
+             "Tacho %s Signal K Path", name.c_str());
+
+    auto tacho_frequency_sk_output =
+        new halmet::SKDeltaOutputFloat(sk_path, config_path, nullptr, 2);
+
+    if (enable_ui) {
+      ConfigItem(tacho_frequency_sk_output)
+          ->set_title(config_title)
+          ->set_description(config_description);
+    }
+
+    tacho_frequency->connect_to(tacho_frequency_sk_output);
+  }
 #endif
 
   return tacho_frequency;
 }
 
-BoolProducer* ConnectAlarmSender(int pin, String name) {
+BoolProducer* ConnectAlarmSender(int pin, String name,
+                                 bool enable_signalk_output, bool enable_ui) {
   char config_path[80];
   char sk_path[80];
   char config_title[80];
   char config_description[80];
 
-  auto* alarm_input = new DigitalInputState(pin, INPUT, 100);
+  // All alarm inputs are polled by one shared scheduler on the SensESP loop
+  pinMode(pin, INPUT);
+  auto alarm_input = new ObservableValue<bool>();
+  halmet::SharedScheduler::get(kAlarmReadDelay, event_loop())
+      ->add([pin, alarm_input]() {
+        halmet::AcquisitionTime::Scope scope;
+        alarm_input->set(digitalRead(pin));
+      });
 
 #ifdef ENABLE_SIGNALK
-  snprintf(config_path, sizeof(config_path), "/Alarm %s/SK Path", name.c_str());
-  snprintf(sk_path, sizeof(sk_path), "alarm.%s", name.c_str());
-  snprintf(config_title, sizeof(config_title), "Alarm %s Signal K Path",
-           name.c_str());
-  snprintf(config_description, sizeof(config_description),
-           "Alarm %s Signal K Path", name.c_str());
-
-  auto alarm_sk_output = new SKOutputBool(sk_path, config_path);
-
-  ConfigItem(alarm_sk_output)
-      ->set_title(config_title)
-      ->set_description(config_description);
-
-  alarm_input->connect_to(alarm_sk_output);
+  if (enable_signalk_output) {
+    snprintf(config_path, sizeof(config_path), "/Alarm %s/SK Path",
+             name.c_str());
+    snprintf(sk_path, sizeof(sk_path), "alarm.%s", name.c_str());
+    snprintf(config_title, sizeof(config_title), "Alarm %s Signal K Path",
+             name.c_str());
+    snprintf(config_description, sizeof(config_description),
+             "Alarm %s Signal K Path", name.c_str());
+
+    auto alarm_sk_output =
+        new halmet::BlobBacked<SKOutputBool>(config_path, sk_path, "");
+
+    if (enable_ui) {
+      ConfigItem(alarm_sk_output)
+          ->set_title(config_title)
+          ->set_description(config_description);
+    }
+
+    alarm_input->connect_to(alarm_sk_output);
+  }
 #endif
 
   return alarm_input;
@@ -2,10 +2,18 @@
 #define __SRC_HALMET_DIGITAL_H__
 
 #include "sensesp/sensors/sensor.h"
+#include "sensesp/transforms/frequency.h"
 
 using namespace sensesp;
 
-FloatProducer* ConnectTachoSender(int pin, String name);
-BoolProducer* ConnectAlarmSender(int pin, String name);
+// Returns the tacho frequency producer, emitted on halmet::rt_event_loop().
+// Without `enable_ui`, e.g. in NMEA 2000 only mode, no config items are
+// created.
+Frequency* ConnectTachoSender(int pin, String name,
+                              bool enable_signalk_output = true,
+                              bool enable_ui = true);
+BoolProducer* ConnectAlarmSender(int pin, String name,
+                                 bool enable_signalk_output = true,
+                                 bool enable_ui = true);
 
 #endif
@@ -9,6 +9,8 @@ namespace halmet {
 const int kScreenWidth = 128;
 const int kScreenHeight = 64;
 
+static bool display_paused = false;
+
 bool InitializeSSD1306(const std::shared_ptr<sensesp::SensESPBaseApp> sensesp_app,
                        Adafruit_SSD1306** display, TwoWire* i2c) {
   *display = new Adafruit_SSD1306(kScreenWidth, kScreenHeight, i2c, -1);
@@ -35,6 +37,9 @@ void ClearRow(Adafruit_SSD1306* display, int row) {
 }
 
 void PrintValue(Adafruit_SSD1306* display, int row, String title, float value) {
+  if (display_paused) {
+    return;
+  }
   ClearRow(display, row);
   display->setCursor(0, 8 * row);
   display->printf("%s: %.1f", title.c_str(), value);
@@ -43,10 +48,15 @@ void PrintValue(Adafruit_SSD1306* display, int row, String title, float value) {
 
 void PrintValue(Adafruit_SSD1306* display, int row, String title,
                 String value) {
+  if (display_paused) {
+    return;
+  }
   ClearRow(display, row);
   display->setCursor(0, 8 * row);
   display->printf("%s: %s", title.c_str(), value.c_str());
   display->display();
 }
 
+void SetDisplayPaused(bool paused) { display_paused = paused; }
+
 }  // namespace halmet
@@ -16,6 +16,9 @@ void ClearRow(Adafruit_SSD1306* display, int row);
 void PrintValue(Adafruit_SSD1306* display, int row, String title, float value);
 void PrintValue(Adafruit_SSD1306* display, int row, String title, String value);
 
+// Skip display updates while paused, e.g. to shed load
+void SetDisplayPaused(bool paused);
+
 }  // namespace halmet
 
 #endif
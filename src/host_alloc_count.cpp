@@ -0,0 +1,59 @@
+#include "host_alloc_count.h"
+
+#ifndef ARDUINO
+
+#include <atomic>
+
+namespace {
+
+std::atomic<size_t> num_allocs{0};
+
+}  // namespace
+
+#ifdef __GLIBC__
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(num, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  num_allocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) { __libc_free(ptr); }
+
+}  // extern "C"
+
+#endif  // __GLIBC__
+
+namespace halmet {
+
+bool HostAllocationsCounted() {
+#ifdef __GLIBC__
+  return true;
+#else
+  return false;
+#endif
+}
+
+size_t HostAllocations() {
+  return num_allocs.load(std::memory_order_relaxed);
+}
+
+}  // namespace halmet
+
+#endif  // ARDUINO
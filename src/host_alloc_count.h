@@ -0,0 +1,21 @@
+#ifndef HALMET_SRC_HOST_ALLOC_COUNT_H_
+#define HALMET_SRC_HOST_ALLOC_COUNT_H_
+
+#ifndef ARDUINO
+
+#include <cstddef>
+
+namespace halmet {
+
+/// True if heap allocations are counted: host_alloc_count.cpp wraps the
+/// glibc malloc, calloc and realloc. Elsewhere, HostAllocations() stays 0.
+bool HostAllocationsCounted();
+
+/// Number of heap allocations since the program started. Use differences.
+size_t HostAllocations();
+
+}  // namespace halmet
+
+#endif  // ARDUINO
+
+#endif  // HALMET_SRC_HOST_ALLOC_COUNT_H_
@@ -0,0 +1,52 @@
+#include "host_clock.h"
+
+#ifndef ARDUINO
+
+#include <ctime>
+
+namespace halmet {
+
+namespace {
+
+bool simulated = false;
+uint32_t simulated_ms = 0;
+
+uint32_t MonotonicMillis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+}  // namespace
+
+void UseSimulatedClock(uint32_t start_ms) {
+  simulated = true;
+  simulated_ms = start_ms;
+}
+
+void AdvanceClock(uint32_t ms) { simulated_ms += ms; }
+
+}  // namespace halmet
+
+extern "C" {
+
+uint32_t millis() {
+  static const uint32_t start = halmet::MonotonicMillis();
+  if (halmet::simulated) {
+    return halmet::simulated_ms;
+  }
+  return halmet::MonotonicMillis() - start;
+}
+
+void delay(uint32_t ms) {
+  if (halmet::simulated) {
+    halmet::simulated_ms += ms;
+    return;
+  }
+  struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000};
+  nanosleep(&ts, nullptr);
+}
+
+}  // extern "C"
+
+#endif  // ARDUINO
@@ -0,0 +1,29 @@
+#ifndef HALMET_SRC_HOST_CLOCK_H_
+#define HALMET_SRC_HOST_CLOCK_H_
+
+#ifndef ARDUINO
+
+#include <cstdint>
+
+// The NMEA2000 library expects the platform to provide these. On the host,
+// millis() counts from the first call, or follows the simulated clock.
+extern "C" {
+uint32_t millis();
+void delay(uint32_t ms);
+}
+
+namespace halmet {
+
+/// Switch millis() and delay() to a simulated clock starting at `start_ms`.
+/// delay() then advances the simulated time instead of sleeping, so tests
+/// run faster than real time and don't depend on the host load.
+void UseSimulatedClock(uint32_t start_ms = 0);
+
+/// Advance the simulated clock by `ms`.
+void AdvanceClock(uint32_t ms);
+
+}  // namespace halmet
+
+#endif  // ARDUINO
+
+#endif  // HALMET_SRC_HOST_CLOCK_H_
@@ -0,0 +1,42 @@
+#ifndef HALMET_SRC_INPUT_CONVERSION_H_
+#define HALMET_SRC_INPUT_CONVERSION_H_
+
+#include <cstdint>
+
+namespace halmet {
+
+// Conversions of the raw HALMET inputs that don't depend on SensESP or the
+// hardware, shared by the firmware and the host replay runner
+// (replay_host_main.cpp).
+
+/// Volts per ADS1115 count at the narrowest range (0.256 V)
+const float kADS1115VoltsPerCount = 0.256 / 32768;
+
+/// HALMET voltage divider scale factor
+const float kVoltageDividerScale = 33.3 / 3.3;
+
+/// HALMET constant tank sender measurement current (A)
+const float kMeasurementCurrent = 0.01;
+
+/// Default tank size, in m3
+const float kTankDefaultSize = 120. / 1000;
+
+/// Tank sender read interval, in ms
+const unsigned int kTankReadDelay = 500;
+
+/// Default RPM count scale factor, corresponds to 100 pulses per revolution.
+/// This is rarely, if ever correct.
+const float kDefaultFrequencyScale = 1 / 100.;
+
+/// Tacho pulse counting window, in ms
+const unsigned int kTachoReadDelay = 500;
+
+/// Tank sender resistance in ohms from ADS1115 counts
+inline float SenderResistance(int32_t counts) {
+  float volts = counts * kADS1115VoltsPerCount;
+  return kVoltageDividerScale * volts / kMeasurementCurrent;
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_INPUT_CONVERSION_H_
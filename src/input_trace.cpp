@@ -0,0 +1,401 @@
+#include "input_trace.h"
+
+#include "rt_event_loop.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const uint8_t kFormatVersion = 2;
+const char* kTracePath = "/trace.bin";
+const char* kReplayPath = "/replay.bin";
+// How often buffered records are written to flash
+const unsigned int kFlushInterval = 200;  // ms
+// How often the replay advances
+const unsigned int kReplayInterval = 5;  // ms
+// How often the replay trace is read ahead
+const unsigned int kPrefetchInterval = 20;  // ms
+// Worst case record header: 5 byte varint and the type byte
+const size_t kMaxRecordHeaderLen = 6;
+
+size_t PutVarint(uint8_t* buf, uint32_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    buf[len++] = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  buf[len++] = static_cast<uint8_t>(value);
+  return len;
+}
+
+uint32_t ZigZag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+int32_t UnZigZag(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+bool ReadVarint(File& file, uint32_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int byte = file.read();
+    if (byte < 0) {
+      return false;
+    }
+    *value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+InputTrace* InputTrace::instance_ = nullptr;
+
+InputTrace::InputTrace(const String& config_path)
+    : BlobSaveable{config_path} {
+  mutex_ = xSemaphoreCreateRecursiveMutex();
+  flush_mutex_ = xSemaphoreCreateMutex();
+  load();
+
+  if (mode_ == kOff) {
+    return;
+  }
+  instance_ = this;
+
+  // Every session starts a new capture
+  SPIFFS.remove(kTracePath);
+  uint8_t header[5] = {'H', 'T', 'R', 'C', kFormatVersion};
+  memcpy(buffer_, header, sizeof(header));
+  buffer_len_ = sizeof(header);
+  trace_len_ = sizeof(header);
+  last_record_ms_ = millis();
+  sensesp::event_loop()->onRepeat(kFlushInterval, [this]() { flush(); });
+
+  if (mode_ == kReplay) {
+    replay_file_ = SPIFFS.open(kReplayPath, FILE_READ);
+    char magic[5] = {};
+    if (!replay_file_ || replay_file_.read((uint8_t*)magic, 5) != 5 ||
+        memcmp(magic, "HTRC", 4) != 0 || magic[4] != kFormatVersion) {
+      debugE("Input trace: no valid replay trace at %s", kReplayPath);
+      replay_done_ = true;
+      return;
+    }
+    debugI("Input trace: replaying %s", kReplayPath);
+    prefetch_replay();
+    sensesp::event_loop()->onRepeat(kPrefetchInterval,
+                                    [this]() { prefetch_replay(); });
+    rt_event_loop()->onRepeat(kReplayInterval,
+                              [this]() { advance_replay(); });
+  }
+}
+
+void InputTrace::record_adc(uint8_t device, uint8_t channel, int32_t counts) {
+  uint8_t payload[7] = {device, channel};
+  size_t len = 2 + PutVarint(payload + 2, ZigZag(counts));
+  append(kAdc, payload, len);
+}
+
+void InputTrace::record_counter(uint8_t pin, int32_t count) {
+  uint8_t payload[6] = {pin};
+  size_t len = 1 + PutVarint(payload + 1, count);
+  append(kCounter, payload, len);
+}
+
+void InputTrace::record_can(bool transmitted, const tN2kMsg& msg) {
+  uint8_t payload[5 + 3 + 2 + tN2kMsg::MaxDataLen];
+  size_t len = PutVarint(payload, msg.PGN);
+  payload[len++] = msg.Priority;
+  payload[len++] = msg.Source;
+  payload[len++] = msg.Destination;
+  len += PutVarint(payload + len, msg.DataLen);
+  memcpy(payload + len, msg.Data, msg.DataLen);
+  len += msg.DataLen;
+  append(transmitted ? kCanTx : kCanRx, payload, len);
+}
+
+void InputTrace::append(uint8_t type, const uint8_t* payload, size_t len) {
+  xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+  uint32_t now = millis();
+  size_t total = kMaxRecordHeaderLen + len;
+  if (trace_len_ + total > max_size_) {
+    truncated_ = true;
+  }
+  // Records are dropped rather than flushed here: append() may be called
+  // from the real-time loop, which must not wait for flash writes.
+  if (truncated_ || buffer_len_ + total > kBufferSize) {
+    if (!truncated_) {
+      dropped_++;
+    }
+    xSemaphoreGiveRecursive(mutex_);
+    return;
+  }
+  size_t header_len = PutVarint(buffer_ + buffer_len_, now - last_record_ms_);
+  buffer_[buffer_len_ + header_len++] = type;
+  memcpy(buffer_ + buffer_len_ + header_len, payload, len);
+  buffer_len_ += header_len + len;
+  trace_len_ += header_len + len;
+  last_record_ms_ = now;
+  xSemaphoreGiveRecursive(mutex_);
+}
+
+void InputTrace::flush() {
+  xSemaphoreTake(flush_mutex_, portMAX_DELAY);
+
+  // Swap the buffers under the lock and write outside it, so that append()
+  // only ever waits for the swap
+  xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+  uint8_t* full = buffer_;
+  size_t len = buffer_len_;
+  buffer_ = buffer_ == buffers_[0] ? buffers_[1] : buffers_[0];
+  buffer_len_ = 0;
+  xSemaphoreGiveRecursive(mutex_);
+
+  if (len > 0) {
+    File file = SPIFFS.open(kTracePath, FILE_APPEND);
+    if (file) {
+      file.write(full, len);
+      file.close();
+    } else {
+      debugE("Input trace: cannot open %s", kTracePath);
+    }
+  }
+  xSemaphoreGive(flush_mutex_);
+}
+
+bool InputTrace::replay_adc(uint8_t device, uint8_t channel, int32_t* counts) {
+  int key = device * 4 + channel;
+  if (mode_ != kReplay || key >= kMaxAdcKeys || !adc_valid_[key]) {
+    return false;
+  }
+  *counts = adc_counts_[key];
+  return true;
+}
+
+bool InputTrace::replay_counter(uint8_t pin, int32_t* count) {
+  if (mode_ != kReplay || pin >= kMaxPins || !counter_valid_[pin]) {
+    return false;
+  }
+  *count = counter_counts_[pin];
+  counter_counts_[pin] = 0;
+  return true;
+}
+
+void InputTrace::prefetch_replay() {
+  while (!replay_eof_.load(std::memory_order_relaxed)) {
+    if (!pending_valid_) {
+      if (!read_replay_record(&pending_)) {
+        replay_file_.close();
+        replay_eof_.store(true, std::memory_order_release);
+        break;
+      }
+      // CAN traffic isn't replayed; the outputs are regenerated
+      bool replayed =
+          (pending_.type == kAdc && pending_.key < kMaxAdcKeys) ||
+          (pending_.type == kCounter && pending_.key < kMaxPins);
+      if (!replayed) {
+        continue;
+      }
+      pending_valid_ = true;
+    }
+    uint32_t head = replay_head_.load(std::memory_order_relaxed);
+    if (head - replay_tail_.load(std::memory_order_acquire) ==
+        kReplayCapacity) {
+      // The real-time loop takes the events at trace speed
+      break;
+    }
+    replay_ring_[head % kReplayCapacity] = pending_;
+    replay_head_.store(head + 1, std::memory_order_release);
+    pending_valid_ = false;
+  }
+}
+
+void InputTrace::advance_replay() {
+  if (replay_done_) {
+    return;
+  }
+  if (!replay_started_) {
+    replay_start_ = millis();
+    replay_started_ = true;
+  }
+  uint32_t elapsed = millis() - replay_start_;
+  // Check for the end before reading the head: every event was queued
+  // before replay_eof_ was set
+  bool eof = replay_eof_.load(std::memory_order_acquire);
+  uint32_t tail = replay_tail_.load(std::memory_order_relaxed);
+  uint32_t head = replay_head_.load(std::memory_order_acquire);
+  while (tail != head) {
+    const ReplayEvent& event = replay_ring_[tail % kReplayCapacity];
+    if (event.time > elapsed) {
+      return;
+    }
+    if (event.type == kAdc) {
+      adc_counts_[event.key] = event.value;
+      adc_valid_[event.key] = true;
+    } else {
+      // Counts are summed in case the reader falls behind the trace
+      counter_counts_[event.key] += event.value;
+      counter_valid_[event.key] = true;
+    }
+    replay_tail_.store(++tail, std::memory_order_release);
+  }
+  if (eof) {
+    debugI("Input trace: replay finished after %u ms", elapsed);
+    replay_done_ = true;
+  }
+}
+
+bool InputTrace::read_replay_record(ReplayEvent* event) {
+  uint32_t delta;
+  if (!ReadVarint(replay_file_, &delta)) {
+    return false;
+  }
+  replay_time_ += delta;
+  event->time = replay_time_;
+  int type = replay_file_.read();
+  event->type = type;
+  uint32_t value;
+  switch (type) {
+    case kAdc: {
+      int device = replay_file_.read();
+      int channel = replay_file_.read();
+      if (channel < 0 || !ReadVarint(replay_file_, &value)) {
+        return false;
+      }
+      int key = device * 4 + channel;
+      event->key = key < kMaxAdcKeys ? key : 0xff;
+      event->value = UnZigZag(value);
+      return true;
+    }
+    case kCounter: {
+      int pin = replay_file_.read();
+      if (pin < 0 || !ReadVarint(replay_file_, &value)) {
+        return false;
+      }
+      event->key = pin;
+      event->value = value;
+      return true;
+    }
+    case kCanTx:
+    case kCanRx: {
+      uint32_t pgn;
+      uint8_t addressing[3];
+      if (!ReadVarint(replay_file_, &pgn) ||
+          replay_file_.read(addressing, 3) != 3 ||
+          !ReadVarint(replay_file_, &value) || value > tN2kMsg::MaxDataLen) {
+        return false;
+      }
+      uint8_t data[tN2kMsg::MaxDataLen];
+      return replay_file_.read(data, value) == value;
+    }
+    default:
+      return false;
+  }
+}
+
+void InputTrace::add_http_handler(std::shared_ptr<sensesp::HTTPServer> server) {
+  auto download_handler = std::make_shared<sensesp::HTTPRequestHandler>(
+      1 << HTTP_GET, "/api/trace",
+      [this](httpd_req_t* req) { return handle_download(req); });
+  server->add_handler(download_handler);
+  auto upload_handler = std::make_shared<sensesp::HTTPRequestHandler>(
+      1 << HTTP_PUT, "/api/trace",
+      [this](httpd_req_t* req) { return handle_upload(req); });
+  server->add_handler(upload_handler);
+}
+
+esp_err_t InputTrace::handle_download(httpd_req_t* req) {
+  flush();
+  File file = SPIFFS.open(kTracePath, FILE_READ);
+  if (!file) {
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
+  // Records appended during the download are left out
+  size_t remaining = file.size();
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition",
+                     "attachment; filename=\"halmet.htrc\"");
+
+  uint8_t chunk[512];
+  while (remaining > 0) {
+    size_t n = file.read(chunk, min(remaining, sizeof(chunk)));
+    if (n == 0 || httpd_resp_send_chunk(req, reinterpret_cast<char*>(chunk),
+                                        n) != ESP_OK) {
+      file.close();
+      return ESP_FAIL;
+    }
+    remaining -= n;
+  }
+  file.close();
+  return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+esp_err_t InputTrace::handle_upload(httpd_req_t* req) {
+  if (req->content_len > max_size_) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Trace too large");
+    return ESP_FAIL;
+  }
+  File file = SPIFFS.open(kReplayPath, FILE_WRITE);
+  if (!file) {
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+  char chunk[512];
+  size_t remaining = req->content_len;
+  while (remaining > 0) {
+    int n = httpd_req_recv(req, chunk, min(remaining, sizeof(chunk)));
+    if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+      continue;
+    }
+    if (n <= 0) {
+      file.close();
+      SPIFFS.remove(kReplayPath);
+      return ESP_FAIL;
+    }
+    file.write(reinterpret_cast<uint8_t*>(chunk), n);
+    remaining -= n;
+  }
+  file.close();
+  return httpd_resp_sendstr(
+      req, "Replay trace stored; set the trace mode to replay and restart.\n");
+}
+
+bool InputTrace::to_json(JsonObject& config) {
+  config["mode"] = mode_;
+  config["max_size"] = max_size_;
+  config["trace_size"] = trace_len_;
+  config["truncated"] = truncated_;
+  config["dropped"] = dropped_;
+  return true;
+}
+
+bool InputTrace::from_json(const JsonObject& config) {
+  if (!config["mode"].is<int>() || !config["max_size"].is<unsigned int>()) {
+    return false;
+  }
+  mode_ = config["mode"];
+  max_size_ = config["max_size"];
+  return true;
+}
+
+const String ConfigSchema(const InputTrace& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "mode": { "title": "Mode", "type": "integer", "enum": [0, 1, 2], "description": "0: off, 1: capture, 2: replay /replay.bin and capture" },
+      "max_size": { "title": "Maximum trace size", "type": "integer", "description": "Capture stops when the trace reaches this size (bytes)" },
+      "trace_size": { "title": "Trace size", "type": "integer", "readOnly": true },
+      "truncated": { "title": "Truncated", "type": "boolean", "readOnly": true, "description": "The trace reached its maximum size" },
+      "dropped": { "title": "Dropped records", "type": "integer", "readOnly": true, "description": "Records dropped because the write buffer was full" }
+    }
+  })###";
+}
+
+}  // namespace halmet
@@ -0,0 +1,147 @@
+#ifndef HALMET_SRC_INPUT_TRACE_H_
+#define HALMET_SRC_INPUT_TRACE_H_
+
+#include <N2kMsg.h>
+#include <SPIFFS.h>
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <atomic>
+#include <memory>
+
+#include "config_blob_store.h"
+#include "sensesp/net/http_server.h"
+#include "sensesp/system/saveable.h"
+
+namespace halmet {
+
+/**
+ * @brief Record and replay of raw inputs and CAN traffic.
+ *
+ * In capture mode, ADS1115 counts, pulse counter values and transmitted and
+ * received N2k messages are written with millisecond timestamps to
+ * /trace.bin. The trace can be downloaded from GET /api/trace.
+ *
+ * In replay mode, a trace uploaded with PUT /api/trace is played back from
+ * /replay.bin: the ADC and pulse counter reads return the recorded values
+ * instead of the hardware inputs, so the recorded conditions run through the
+ * real tank, tacho and N2k sender code. The trace is read ahead on the
+ * SensESP loop; the real-time loop only takes the decoded values from a
+ * ring, so it never waits for flash reads. The outputs are captured to
+ * /trace.bin as usual and can be compared with the original trace using
+ * tools/halmet_trace.py.
+ *
+ * Trace layout (all integers little-endian):
+ *
+ *   "HTRC" | version:u8 | records...
+ *
+ * Each record is varint(time delta in ms) | type:u8 | payload:
+ *
+ *   ADC:     device:u8 | channel:u8 | zigzag varint(counts)
+ *            (counts of 7.8125 uV, see ADS1115Bank; 1 LSB at GAIN_ONE in
+ *            version 1 traces)
+ *   Counter: pin:u8 | varint(count)
+ *   CAN:     varint(pgn) | priority:u8 | source:u8 | destination:u8 |
+ *            varint(length) | data
+ */
+class InputTrace : public BlobSaveable {
+ public:
+  enum Mode { kOff = 0, kCapture = 1, kReplay = 2 };
+
+  enum RecordType : uint8_t {
+    kAdc = 1,
+    kCounter = 2,
+    kCanTx = 3,
+    kCanRx = 4,
+  };
+
+  InputTrace(const String& config_path);
+
+  /// The active trace, or nullptr if tracing is off.
+  static InputTrace* get() { return instance_; }
+
+  void record_adc(uint8_t device, uint8_t channel, int32_t counts);
+  void record_counter(uint8_t pin, int32_t count);
+  void record_can(bool transmitted, const tN2kMsg& msg);
+
+  /// In replay mode, replace `counts` with the recorded value. Returns false
+  /// if the hardware should be read instead.
+  bool replay_adc(uint8_t device, uint8_t channel, int32_t* counts);
+  /// In replay mode, replace `count` with the recorded counts since the
+  /// previous call. Returns false if the hardware count should be used.
+  bool replay_counter(uint8_t pin, int32_t* count);
+
+  /// Register the download and upload handlers on the HTTP server.
+  void add_http_handler(std::shared_ptr<sensesp::HTTPServer> server);
+
+  void flush();
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  static constexpr int kMaxAdcKeys = 16;
+  static constexpr int kMaxPins = 40;
+
+  /// A decoded ADC or counter record of the replay trace
+  struct ReplayEvent {
+    uint32_t time;  // Trace time, ms
+    uint8_t type;
+    uint8_t key;    // ADC key or counter pin
+    int32_t value;
+  };
+
+  void append(uint8_t type, const uint8_t* payload, size_t len);
+  void prefetch_replay();
+  void advance_replay();
+  bool read_replay_record(ReplayEvent* event);
+  esp_err_t handle_download(httpd_req_t* req);
+  esp_err_t handle_upload(httpd_req_t* req);
+
+  static InputTrace* instance_;
+
+  int mode_ = kOff;
+  unsigned int max_size_ = 256 * 1024;  // bytes
+
+  // Capture. Records are appended to one buffer while flush() writes the
+  // other one to flash.
+  static constexpr size_t kBufferSize = 4096;
+  uint8_t buffers_[2][kBufferSize];
+  uint8_t* buffer_ = buffers_[0];
+  size_t buffer_len_ = 0;
+  size_t trace_len_ = 0;
+  uint32_t last_record_ms_ = 0;
+  bool truncated_ = false;
+  uint32_t dropped_ = 0;
+  SemaphoreHandle_t mutex_;        // Guards buffer_ and buffer_len_
+  SemaphoreHandle_t flush_mutex_;  // Keeps the flushes in order
+
+  // Replay. replay_ring_ is a single-producer single-consumer ring like
+  // LoopBridge: prefetch_replay() fills it on the SensESP loop and
+  // advance_replay() empties it on the real-time loop.
+  static constexpr uint32_t kReplayCapacity = 256;
+  File replay_file_;
+  uint32_t replay_time_ = 0;  // Trace time of the last record read
+  ReplayEvent pending_;       // Read, but the ring was full
+  bool pending_valid_ = false;
+  ReplayEvent replay_ring_[kReplayCapacity];
+  std::atomic<uint32_t> replay_head_{0};
+  std::atomic<uint32_t> replay_tail_{0};
+  std::atomic<bool> replay_eof_{false};
+  uint32_t replay_start_ = 0;
+  bool replay_started_ = false;
+  bool replay_done_ = false;
+  int32_t adc_counts_[kMaxAdcKeys];
+  bool adc_valid_[kMaxAdcKeys] = {};
+  int32_t counter_counts_[kMaxPins] = {};
+  bool counter_valid_[kMaxPins] = {};
+};
+
+const String ConfigSchema(const InputTrace& obj);
+
+inline bool ConfigRequiresRestart(const InputTrace& obj) { return true; }
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_INPUT_TRACE_H_
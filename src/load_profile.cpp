@@ -0,0 +1,228 @@
+#include "load_profile.h"
+
+#include <Preferences.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/signalk/signalk_put_request_listener.h"
+#include "sensesp/system/lambda_consumer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const char* kPreferencesNamespace = "halmet_prof";
+const uint8_t kStatsVersion = 1;
+
+// Longer gaps between values are not counted; the input has stopped.
+const uint32_t kMaxGap = 10000;  // ms
+// How often a save requested by set() is checked for
+const unsigned int kSaveRequestCheckInterval = 1000;  // ms
+
+}  // namespace
+
+LoadProfile::LoadProfile(const String& id, float lower, float upper,
+                         int num_bins, float active_threshold,
+                         const String& config_path)
+    : BlobSaveable{config_path},
+      id_{id},
+      lower_{lower},
+      upper_{upper},
+      num_bins_{num_bins},
+      active_threshold_{active_threshold} {
+  load();
+  load_stats();
+
+  sensesp::event_loop()->onRepeat(kSaveInterval, [this]() {
+    if (dirty_) {
+      save_stats();
+    }
+  });
+  sensesp::event_loop()->onRepeat(kSaveRequestCheckInterval, [this]() {
+    if (save_requested_.exchange(false) && dirty_) {
+      save_stats();
+    }
+  });
+}
+
+void LoadProfile::set(const float& value) {
+  uint32_t now = millis();
+  if (has_value_) {
+    uint32_t elapsed = now - last_time_;
+    if (elapsed <= kMaxGap && last_value_ >= active_threshold_) {
+      accumulate(last_value_, elapsed);
+    }
+    // Save when the activity ends, e.g. the engine is stopped, so that the
+    // last run isn't lost if the power goes off before the next periodic
+    // save. NaN counts as inactive.
+    if (last_value_ >= active_threshold_ && !(value >= active_threshold_)) {
+      save_requested_ = true;
+    }
+  }
+  has_value_ = !std::isnan(value);
+  last_value_ = value;
+  last_time_ = now;
+}
+
+void LoadProfile::accumulate(float value, uint32_t ms) {
+  if (ms == 0) {
+    return;
+  }
+  int bin = (value - lower_) / (upper_ - lower_) * num_bins_;
+  bin = bin < 0 ? 0 : (bin >= num_bins_ ? num_bins_ - 1 : bin);
+  uint32_t residual = bin_residual_[bin] + ms;
+  stats_.bin_seconds[bin] += residual / 1000;
+  bin_residual_[bin] = residual % 1000;
+
+  // Time-weighted running statistics
+  double weight = ms / 1000.0;
+  if (stats_.weight == 0) {
+    stats_.min = value;
+    stats_.max = value;
+  }
+  stats_.min = std::min(stats_.min, value);
+  stats_.max = std::max(stats_.max, value);
+  stats_.weight += weight;
+  double delta = value - stats_.mean;
+  stats_.mean += delta * weight / stats_.weight;
+  stats_.m2 += weight * delta * (value - stats_.mean);
+  dirty_ = true;
+}
+
+float LoadProfile::bin_lower(int bin) const {
+  return lower_ + (upper_ - lower_) * bin / num_bins_;
+}
+
+void LoadProfile::reset() {
+  stats_ = {};
+  stats_.version = kStatsVersion;
+  stats_.num_bins = num_bins_;
+  stats_.lower = lower_;
+  stats_.upper = upper_;
+  for (auto& residual : bin_residual_) {
+    residual = 0;
+  }
+  dirty_ = true;
+}
+
+size_t LoadProfile::stats_size() const {
+  return offsetof(Stats, bin_seconds) + num_bins_ * sizeof(uint32_t);
+}
+
+void LoadProfile::load_stats() {
+  Preferences prefs;
+  prefs.begin(kPreferencesNamespace, true);
+  size_t size = prefs.getBytesLength(id_.c_str());
+  Stats stored = {};
+  if (size == stats_size()) {
+    prefs.getBytes(id_.c_str(), &stored, size);
+  }
+  prefs.end();
+
+  if (stored.version == kStatsVersion && stored.num_bins == num_bins_ &&
+      stored.lower == lower_ && stored.upper == upper_) {
+    stats_ = stored;
+    return;
+  }
+  if (size != 0) {
+    debugW("Load profile %s: stored bins don't match, starting over",
+           id_.c_str());
+  }
+  reset();
+}
+
+void LoadProfile::save_stats() {
+  Preferences prefs;
+  prefs.begin(kPreferencesNamespace, false);
+  prefs.putBytes(id_.c_str(), &stats_, stats_size());
+  prefs.end();
+  dirty_ = false;
+}
+
+void LoadProfile::publish() {
+  JsonDocument doc;
+  doc["activeTime"] = stats_.weight;
+  if (stats_.weight > 0) {
+    doc["min"] = stats_.min;
+    doc["max"] = stats_.max;
+    doc["mean"] = stats_.mean;
+    doc["stdDev"] = std::sqrt(stats_.m2 / stats_.weight);
+  }
+  JsonArray bins = doc["bins"].to<JsonArray>();
+  for (int i = 0; i < num_bins_; i++) {
+    JsonObject bin = bins.add<JsonObject>();
+    bin["from"] = bin_lower(i);
+    if (i < num_bins_ - 1) {
+      bin["to"] = bin_lower(i + 1);
+    }
+    bin["time"] = stats_.bin_seconds[i];
+  }
+  String json;
+  serializeJson(doc, json);
+  profile_.set(json);
+}
+
+bool LoadProfile::to_json(JsonObject& config) {
+  config["lower"] = lower_;
+  config["upper"] = upper_;
+  config["bins"] = num_bins_;
+  config["active_threshold"] = active_threshold_;
+  config["reset"] = false;
+  config["active_hours"] = stats_.weight / 3600;
+  return true;
+}
+
+bool LoadProfile::from_json(const JsonObject& config) {
+  if (!config["lower"].is<float>() || !config["upper"].is<float>() ||
+      !config["bins"].is<int>() || !config["active_threshold"].is<float>()) {
+    return false;
+  }
+  float lower = config["lower"];
+  float upper = config["upper"];
+  int num_bins = config["bins"];
+  if (upper <= lower || num_bins < 1 || num_bins > kMaxBins) {
+    return false;
+  }
+  bool bins_changed =
+      lower != lower_ || upper != upper_ || num_bins != num_bins_;
+  lower_ = lower;
+  upper_ = upper;
+  num_bins_ = num_bins;
+  active_threshold_ = config["active_threshold"];
+
+  bool reset_requested = config["reset"].is<bool>() && config["reset"];
+  // Nothing is loaded yet when called from the constructor
+  if (stats_.version != 0 && (bins_changed || reset_requested)) {
+    debugI("Load profile %s: statistics cleared", id_.c_str());
+    reset();
+    save_stats();
+  }
+  return true;
+}
+
+const String ConfigSchema(const LoadProfile& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "lower": { "title": "Lower bound", "type": "number", "description": "Lower edge of the first bin" },
+      "upper": { "title": "Upper bound", "type": "number", "description": "Upper edge of the last bin; higher values count in the last bin" },
+      "bins": { "title": "Number of bins", "type": "integer", "minimum": 1, "maximum": 16 },
+      "active_threshold": { "title": "Active threshold", "type": "number", "description": "Values below this are not counted, e.g. an engine that isn't running" },
+      "reset": { "title": "Reset statistics", "type": "boolean", "description": "Clear the statistics when the configuration is saved. Changing the bins clears them too." },
+      "active_hours": { "title": "Active time (h)", "type": "number", "readOnly": true }
+    }
+  })###";
+}
+
+void ConnectLoadProfileOutputs(LoadProfile* profile, const String& sk_path) {
+  profile->profile_.connect_to(new sensesp::SKOutputRawJson(sk_path, ""));
+  auto request = new sensesp::SKPutRequestListener<bool>(sk_path);
+  request->connect_to(new sensesp::LambdaConsumer<bool>(
+      [profile](bool) { profile->publish(); }));
+}
+
+}  // namespace halmet
@@ -0,0 +1,105 @@
+#ifndef HALMET_SRC_LOAD_PROFILE_H_
+#define HALMET_SRC_LOAD_PROFILE_H_
+
+#include <atomic>
+
+#include "config_blob_store.h"
+#include "sensesp/system/observablevalue.h"
+#include "sensesp/system/valueconsumer.h"
+
+namespace halmet {
+
+/**
+ * @brief Long-term time-at-level statistics of a value, e.g. engine RPM.
+ *
+ * Each input value is held until the next one, and the time in between is
+ * added to the histogram bin of the value and to time-weighted running
+ * statistics (min, max, mean and variance, with West's incremental
+ * algorithm). Values below the active threshold, e.g. an engine that isn't
+ * running, are not counted. Updates are O(1) and no samples are kept.
+ *
+ * The bins divide [lower, upper) evenly; values below `lower` count in the
+ * first bin and values from `upper` up in the last one. The statistics are
+ * stored in NVS as one compact blob of at most 112 bytes, every
+ * kSaveInterval if they changed, and when the value drops below the active
+ * threshold, e.g. when the engine is stopped before the power is switched
+ * off. Changing the bins or setting "reset" in
+ * the web UI clears them.
+ *
+ * The statistics are published as a JSON object on request: a Signal K PUT
+ * to the output path (see ConnectLoadProfileOutputs()) publishes them once.
+ */
+class LoadProfile : public BlobSaveable, public sensesp::ValueConsumer<float> {
+ public:
+  static constexpr int kMaxBins = 16;
+  /// How often changed statistics are written to NVS, in ms
+  static constexpr unsigned int kSaveInterval = 15 * 60 * 1000;
+
+  /// `id` is the NVS key, at most 15 characters.
+  LoadProfile(const String& id, float lower, float upper, int num_bins,
+              float active_threshold, const String& config_path = "");
+
+  virtual void set(const float& value) override;
+
+  /// Emit the statistics as a JSON object on `profile_`.
+  void publish();
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  /// The statistics, emitted by publish()
+  sensesp::ObservableValue<String> profile_;
+
+ protected:
+  // Persisted in NVS; only the used bins are stored
+  struct Stats {
+    uint8_t version;
+    uint8_t num_bins;
+    uint16_t reserved;
+    float lower;
+    float upper;
+    float min;
+    float max;
+    double mean;
+    double weight;  // Active time, s
+    double m2;      // Sum of the weighted squared deviations
+    uint32_t bin_seconds[kMaxBins];
+  };
+
+  void accumulate(float value, uint32_t ms);
+  void reset();
+  void load_stats();
+  void save_stats();
+  size_t stats_size() const;
+  float bin_lower(int bin) const;
+
+  String id_;
+  // Configuration
+  float lower_;
+  float upper_;
+  int num_bins_;
+  float active_threshold_;
+
+  Stats stats_ = {};
+  // Time not yet added to the whole seconds of each bin, in ms
+  uint16_t bin_residual_[kMaxBins] = {};
+  bool has_value_ = false;
+  float last_value_ = 0;
+  uint32_t last_time_ = 0;
+  bool dirty_ = false;
+  // Set by set() when the value drops below the active threshold; the save
+  // itself runs on the SensESP loop
+  std::atomic<bool> save_requested_{false};
+};
+
+const String ConfigSchema(const LoadProfile& obj);
+
+inline bool ConfigRequiresRestart(const LoadProfile& obj) { return false; }
+
+/// Publish the statistics of `profile` at `sk_path` when a Signal K PUT
+/// request to the same path is received.
+void ConnectLoadProfileOutputs(LoadProfile* profile, const String& sk_path);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_LOAD_PROFILE_H_
@@ -0,0 +1,48 @@
+#include "load_shedding_policy.h"
+
+namespace halmet {
+
+LoadSheddingPolicy::LoadSheddingPolicy(int num_stages, float shed_load,
+                                       float restore_load, int restore_windows)
+    : num_stages_{num_stages},
+      shed_load_{shed_load},
+      restore_load_{restore_load},
+      restore_windows_{restore_windows} {}
+
+int LoadSheddingPolicy::update(float load, int misses) {
+  if (since_restore_ >= 0) {
+    since_restore_++;
+  }
+
+  if (load > shed_load_ || misses > 0) {
+    calm_windows_ = 0;
+    if (level_ < num_stages_) {
+      // A restore that brought the overload back: wait longer next time
+      int hold_off = restore_windows_ * hold_off_factor_;
+      if (since_restore_ >= 0 && since_restore_ <= hold_off &&
+          hold_off_factor_ < kMaxHoldOffFactor) {
+        hold_off_factor_ *= 2;
+      }
+      level_++;
+    }
+    return level_;
+  }
+
+  if (load >= restore_load_ || level_ == 0) {
+    calm_windows_ = 0;
+    if (level_ == 0 &&
+        since_restore_ > restore_windows_ * kMaxHoldOffFactor) {
+      // Stable for a long time after the last restore
+      hold_off_factor_ = 1;
+    }
+    return level_;
+  }
+  if (++calm_windows_ >= restore_windows_ * hold_off_factor_) {
+    level_--;
+    calm_windows_ = 0;
+    since_restore_ = 0;
+  }
+  return level_;
+}
+
+}  // namespace halmet
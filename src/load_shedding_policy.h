@@ -0,0 +1,48 @@
+#ifndef HALMET_SRC_LOAD_SHEDDING_POLICY_H_
+#define HALMET_SRC_LOAD_SHEDDING_POLICY_H_
+
+namespace halmet {
+
+/**
+ * @brief Decides how many load shedding stages are active.
+ *
+ * Fed once per evaluation window with the loop load (busy fraction) and the
+ * number of missed deadlines. A window above the shed threshold, or with a
+ * missed deadline, sheds one more stage. After `restore_windows` calm
+ * windows below the restore threshold, the last shed stage is restored. If
+ * a restore is followed by an overload within the hold-off, the hold-off
+ * doubles, so a load that sits right at a threshold doesn't make the
+ * stages toggle.
+ *
+ * OverloadGovernor feeds it the measured loop load;
+ * test/test_load_shedding_policy feeds it the load of an OverloadSim.
+ */
+class LoadSheddingPolicy {
+ public:
+  /// `shed_load` and `restore_load` are busy fractions (0-1).
+  LoadSheddingPolicy(int num_stages, float shed_load = 0.85,
+                     float restore_load = 0.6, int restore_windows = 5);
+
+  /// Evaluate a window. Returns the number of stages to shed.
+  int update(float load, int misses);
+
+  int level() const { return level_; }
+  int num_stages() const { return num_stages_; }
+
+ protected:
+  static constexpr int kMaxHoldOffFactor = 16;
+
+  int num_stages_;
+  float shed_load_;
+  float restore_load_;
+  int restore_windows_;
+  int level_ = 0;
+  int calm_windows_ = 0;
+  int hold_off_factor_ = 1;
+  // Windows since the last restore, or -1 if nothing was restored yet
+  int since_restore_ = -1;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_LOAD_SHEDDING_POLICY_H_
@@ -25,13 +25,34 @@
 #include "sensesp/transforms/linear.h"
 #include "sensesp/ui/config_item.h"
 #include "sensesp_app_builder.h"
+#include "sensesp_minimal_app_builder.h"
 #define BUILDER_CLASS SensESPAppBuilder
 
+#include "burst_capture.h"
+#include "channel_config.h"
+#include "config_blob_store.h"
+#include "data_age.h"
+#include "data_logger.h"
+#include "fuel_consumption.h"
 #include "halmet_analog.h"
 #include "halmet_const.h"
 #include "halmet_digital.h"
 #include "halmet_display.h"
 #include "halmet_serial.h"
+#include "input_trace.h"
+#include "load_profile.h"
+#include "memory_monitor.h"
+#include "n2k_address_store.h"
+#include "n2k_receiver.h"
+#include "n2k_request_responder.h"
+#include "n2k_tx_queue.h"
+#include "overload_governor.h"
+#include "power_manager.h"
+#include "rt_event_loop.h"
+#include "runtime_mode.h"
+#include "sk_delta_sender.h"
+#include "sse_stream.h"
+#include "tacho_self_test.h"
 #include "sensesp/net/http_server.h"
 #include "sensesp/net/networking.h"
 
@@ -42,6 +63,7 @@ using namespace halmet;
 // Declare some global variables required for the firmware operation.
 
 tNMEA2000* nmea2000;
+N2kReceiver* n2k_receiver;
 elapsedMillis n2k_time_since_rx = 0;
 elapsedMillis n2k_time_since_tx = 0;
 
@@ -62,13 +84,25 @@ bool alarm_states[4] = {false, false, false, false};
 // GAIN_EIGHT:     8x gain   +/- 0.512V  1 bit = 0.25mV   0.015625mV
 // GAIN_SIXTEEN:   16x gain  +/- 0.256V  1 bit = 0.125mV  0.0078125mV
 
+// With ENABLE_ADC_AUTO_GAIN, this is the widest range used, and each input
+// switches to the highest gain its level allows. A 0-190 ohm tank sender
+// (at most 0.19 V) then reads at GAIN_EIGHT or higher while a battery
+// voltage input stays at GAIN_ONE.
 const adsGain_t kADS1115Gain = GAIN_ONE;
+#define ENABLE_ADC_AUTO_GAIN
+#ifdef ENABLE_ADC_AUTO_GAIN
+const bool kADS1115AutoGain = true;
+#else
+const bool kADS1115AutoGain = false;
+#endif
 
 /////////////////////////////////////////////////////////////////////
 // Test output pin configuration. If ENABLE_TEST_OUTPUT_PIN is defined,
 // GPIO 33 will output a pulse wave at 380 Hz with a 50% duty cycle.
 // If this output and GND are connected to one of the digital inputs, it can
 // be used to test that the frequency counter functionality is working.
+// With the output connected to D1, the Tacho Self-Test in the web UI sweeps
+// the output frequency and reports the tacho accuracy and latency.
 #define ENABLE_TEST_OUTPUT_PIN
 #ifdef ENABLE_TEST_OUTPUT_PIN
 const int kTestOutputPin = GPIO_NUM_33;
@@ -77,6 +111,30 @@ const int kTestOutputPin = GPIO_NUM_33;
 const int kTestOutputFrequency = 380;
 #endif
 
+/////////////////////////////////////////////////////////////////////
+// Real-time event loop. If ENABLE_REALTIME_LOOP is defined, the ADC and
+// tacho inputs and all NMEA 2000 traffic run on a separate event loop in a
+// task pinned to core 1, away from the Signal K, HTTP and Wi-Fi load on
+// core 0. Comment it out to run everything on the SensESP event loop, e.g.
+// to compare the published sensors.halmet.jitter values.
+#define ENABLE_REALTIME_LOOP
+
+/////////////////////////////////////////////////////////////////////
+// Configuration blob store. If ENABLE_CONFIG_BLOB_STORE is defined, the
+// HALMET configurations are kept in a single MessagePack blob instead of one
+// JSON file per object. Existing files are migrated on the first boot and
+// left in place, but later changes are saved to the blob only: after
+// switching back, the configuration is that of the last boot without it.
+// Compare the published sensors.halmet.config values with and without it.
+// #define ENABLE_CONFIG_BLOB_STORE
+
+/////////////////////////////////////////////////////////////////////
+// Power management. If ENABLE_POWER_MANAGEMENT is defined, the CPU clock
+// scales down while the event loops wait for their next deadline. Power
+// saving can be switched at runtime in the web UI to compare the supply
+// current and the sensors.halmet.jitter values of both modes.
+#define ENABLE_POWER_MANAGEMENT
+
 /////////////////////////////////////////////////////////////////////
 // The setup function performs one-time application initialization.
 void setup() {
@@ -87,32 +145,94 @@ void setup() {
 
   Serial.begin(115200);
 
+#ifdef ENABLE_REALTIME_LOOP
+  // Must be enabled before any objects using rt_event_loop() are created
+  EnableRealtimeLoop();
+#endif
+
   /////////////////////////////////////////////////////////////////////
   // Initialize the application framework
 
-  // Construct the global SensESPApp() object
-  BUILDER_CLASS builder;
-  sensesp_app = (&builder)
-                    // EDIT: Set a custom hostname for the app.
-                    ->set_hostname("halmet")
-                    // EDIT: Optionally, hard-code the WiFi and Signal K server
-                    // settings. This is normally not needed.
-                    //->set_wifi("My WiFi SSID", "my_wifi_password")
-                    //->set_sk_server("192.168.10.3", 80)
-                    // EDIT: Enable OTA updates with a password.
-                    //->enable_ota("my_ota_password")
-                    ->get_app();
+  // Attribute heap allocations to subsystems. Only has an effect when built
+  // with -D HALMET_ALLOCATION_TAGGING.
+  TagAllocations(Subsystem::kSignalK);
+
+  // Full or NMEA 2000 only mode. Stored in NVS, so it's known before the
+  // application and its file system are set up. In NMEA 2000 only mode,
+  // there's no web UI and no Signal K connection, so the config items and
+  // the Signal K outputs below aren't created at all.
+  auto runtime_mode = new RuntimeMode("/Runtime Mode", kButtonPin);
+  bool headless = runtime_mode->headless();
+
+  if (headless) {
+    // NMEA 2000 only: Wi-Fi, the HTTP server, mDNS and the Signal K
+    // connection are never started, and sensesp_app stays empty.
+    SensESPMinimalAppBuilder minimal_builder;
+    minimal_builder.set_hostname("halmet")->get_app();
+  } else {
+    // Construct the global SensESPApp() object
+    BUILDER_CLASS builder;
+    sensesp_app = (&builder)
+                      // EDIT: Set a custom hostname for the app.
+                      ->set_hostname("halmet")
+                      // EDIT: Optionally, hard-code the WiFi and Signal K
+                      // server settings. This is normally not needed.
+                      //->set_wifi("My WiFi SSID", "my_wifi_password")
+                      //->set_sk_server("192.168.10.3", 80)
+                      // EDIT: Enable OTA updates with a password.
+                      //->enable_ota("my_ota_password")
+                      ->get_app();
+  }
+  runtime_mode->start();
+
+  if (!headless) {
+    ConfigItem(runtime_mode)
+        ->set_title("Runtime Mode")
+        ->set_description("Full or NMEA 2000 only operation")
+        ->set_sort_order(3600);
+  }
+
+#ifdef ENABLE_CONFIG_BLOB_STORE
+  // Must be enabled before any objects using the store are created
+  ConfigBlobStore::enable();
+#endif
+
+#ifdef ENABLE_POWER_MANAGEMENT
+  auto power_manager = new PowerManager("/Power Management");
+
+  if (!headless) {
+    ConfigItem(power_manager)
+        ->set_title("Power Management")
+        ->set_description("CPU frequency scaling between event loop ticks")
+        ->set_sort_order(3500);
+  }
+#endif
+
+  // Capture raw inputs and CAN traffic, or replay a captured trace through
+  // the input processing. Must be created before the inputs.
+  auto input_trace = new InputTrace("/Input Trace");
+
+  if (!headless) {
+    ConfigItem(input_trace)
+        ->set_title("Input Trace")
+        ->set_description("Record and replay of raw inputs and CAN traffic")
+        ->set_sort_order(3200);
+  }
+
+  TagAllocations(Subsystem::kAnalog);
 
   // initialize the I2C bus
   i2c = new TwoWire(0);
   i2c->begin(kSDAPin, kSCLPin);
 
-  // Initialize ADS1115
-  auto ads1115 = new Adafruit_ADS1115();
-
-  ads1115->setGain(kADS1115Gain);
-  bool ads_initialized = ads1115->begin(kADS1115Address, i2c);
-  debugD("ADS1115 initialized: %d", ads_initialized);
+  // Initialize the built-in ADS1115 and any expansion ADS1115 ADCs. The
+  // inputs of all ADCs are sampled continuously on the real-time loop.
+  const int ads1115_addresses[] = {
+      kADS1115Address, kExpansionADS1115Addresses[0],
+      kExpansionADS1115Addresses[1], kExpansionADS1115Addresses[2]};
+  auto ads1115_bank =
+      new ADS1115Bank(i2c, kADS1115Gain, ads1115_addresses, 4, 128,
+                      kADS1115AutoGain);
 
 #ifdef ENABLE_TEST_OUTPUT_PIN
   pinMode(kTestOutputPin, OUTPUT);
@@ -121,16 +241,19 @@ void setup() {
   // Set the duty cycle to 50%
   // Duty cycle value is calculated based on the resolution
   // For 13-bit resolution, max value is 8191, so 50% is 4096
-  ledcWrite(0, 4096);
+  ledcWrite(kTestOutputPin, 4096);
 #endif
 
   /////////////////////////////////////////////////////////////////////
   // Initialize NMEA 2000 functionality
 
+  TagAllocations(Subsystem::kN2k);
+
   nmea2000 = new tNMEA2000_esp32(kCANTxPin, kCANRxPin);
 
-  // Reserve enough buffer for sending all messages.
-  nmea2000->SetN2kCANSendFrameBufSize(250);
+  // Keep the send buffer small: periodic messages wait in N2kTxQueue, where
+  // newer data replaces them, until the buffer has room.
+  nmea2000->SetN2kCANSendFrameBufSize(kN2kSendFrameBufSize);
   nmea2000->SetN2kCANReceiveFrameBufSize(250);
 
   // Set Product information
@@ -158,169 +281,658 @@ void setup() {
       50,                      // Device class: Propulsion
       2046);                   // Manufacturer code
 
-  nmea2000->SetMode(tNMEA2000::N2km_NodeOnly,
-                    71  // Default N2k node address
+  // Start from the source address claimed during the previous session to
+  // avoid a new address claim negotiation at every boot.
+  auto n2k_address_store = new N2kAddressStore(nmea2000,
+                                               71  // Default N2k node address
   );
+
+  // Values of other devices on the bus to bring into the sensor pipeline
+  n2k_receiver = new N2kReceiver("/NMEA 2000/Receive");
+
+  if (!headless) {
+    ConfigItem(n2k_receiver)
+        ->set_title("NMEA 2000 Receive")
+        ->set_description(
+            "Fields of received PGNs published as Signal K values")
+        ->set_sort_order(2950);
+  }
+
+  // A single handler for all received messages: the receiver's table finds
+  // the subscribed fields, instead of the library walking a list of
+  // per-PGN handlers for every message. Also captures received messages if
+  // an input trace is active.
+  nmea2000->SetMsgHandler([](const tN2kMsg& msg) {
+    if (InputTrace::get() != nullptr) {
+      InputTrace::get()->record_can(false, msg);
+    }
+    n2k_receiver->handle(msg);
+  });
+
+  // Listen to all traffic so that the messages of other devices reach the
+  // receiver, but don't forward it anywhere.
+  nmea2000->ExtendReceiveMessages(n2k_receiver->receive_messages());
+  // Listed in the PGN List reply, so that displays know what they may
+  // request
+  static const unsigned long kTransmitMessages[] = {
+      127488L, 127489L,
+#ifdef ENABLE_NMEA2000_OUTPUT
+      // The tank senders are only created with the NMEA 2000 tank output
+      127505L,
+#endif
+      0};
+  nmea2000->ExtendTransmitMessages(kTransmitMessages);
+  nmea2000->SetMode(tNMEA2000::N2km_ListenAndNode,
+                    n2k_address_store->preferred_address());
   nmea2000->EnableForward(false);
   nmea2000->Open();
+  n2k_address_store->start();
 
   // No need to parse the messages at every single loop iteration; 1 ms will do
-  event_loop()->onRepeat(1, []() { nmea2000->ParseMessages(); });
+  rt_event_loop()->onRepeat(
+      1, TagCallback([]() { nmea2000->ParseMessages(); }));
+
+  // Periodic PGNs go through a freshest-data-wins queue so that a
+  // disconnected or saturated bus doesn't fill the send buffer with stale
+  // frames.
+  auto n2k_tx_queue = new N2kTxQueue(nmea2000);
+
+  // ISO Requests for the periodic PGNs are answered from the messages held
+  // by the queue instead of waiting for the next periodic send.
+  auto n2k_request_responder = new N2kRequestResponder(nmea2000, n2k_tx_queue);
 
   // Initialize the OLED display
-  bool display_present = InitializeSSD1306(sensesp_app->get(), &display, i2c);
+  TagAllocations(Subsystem::kDisplay);
+  bool display_present =
+      InitializeSSD1306(SensESPBaseApp::get(), &display, i2c);
+
+  ///////////////////////////////////////////////////////////////////
+  // Channel layout
+
+  TagAllocations(Subsystem::kOther);
+
+  // The tanks, voltage inputs, alarms, tachos and engines are declared in
+  // the Channels configuration and instantiated below. Edit the layout in
+  // the web UI; the changes take effect after a restart.
+  auto channel_config = new ChannelConfig("/Channels");
+
+  if (!headless) {
+    ConfigItem(channel_config)
+        ->set_title("Channels")
+        ->set_description(
+            "Tanks, voltage inputs, alarms, tachos and engine instances")
+        ->set_sort_order(2900);
+  }
+
+  const int kDigitalInputPins[] = {kDigitalInputPin1, kDigitalInputPin2,
+                                   kDigitalInputPin3, kDigitalInputPin4};
+
+  // Log a compact history of selected values to flash. The log can be
+  // downloaded from http://halmet.local/api/datalog and converted to CSV with
+  // tools/halmet_log_decode.py. The channels below add their values to it.
+  auto data_logger = new DataLogger("/Data Logger");
+
+  if (!headless) {
+    ConfigItem(data_logger)
+        ->set_title("Data Logger")
+        ->set_description("On-device history log of selected values")
+        ->set_sort_order(3100);
+  }
+
+  // Stream values to a browser or curl for commissioning and calibration:
+  // curl -N "http://halmet.local/api/stream?ch=a2,tacho_d1&rate=10"
+  auto live_stream = new SSEStream(20);
+
+  // Scratch buffers for the generated names and paths
+  char name[40];
+  char config_path[80];
+  char title[80];
+  char sk_path[80];
 
   ///////////////////////////////////////////////////////////////////
   // Analog inputs
 
-  bool enable_signalk_output = true;
+  TagAllocations(Subsystem::kAnalog);
+
+  // NMEA 2000 only mode has neither the Signal K connection nor the web UI
+  bool enable_signalk_output = !headless;
+  bool enable_ui = !headless;
 
-  // Connect the tank senders.
-  // EDIT: To enable more tanks, uncomment the lines below.
-  auto tank_a1_volume = ConnectTankSender(ads1115, 0, "Fuel", "fuel.main", 3000,
-                                          enable_signalk_output);
-  // auto tank_a2_volume = ConnectTankSender(ads1115, 1, "A2");
-  // auto tank_a3_volume = ConnectTankSender(ads1115, 2, "A3");
-  // auto tank_a4_volume = ConnectTankSender(ads1115, 3, "A4");
+  // Tank volumes by analog input, for the engine fuel rates
+  FloatProducer* tank_volumes[ChannelConfig::kNumAnalogInputs + 1] = {};
+
+  // Connect the tank senders. All tanks are read by one shared scheduler.
+  for (size_t i = 0; i < channel_config->tanks().size(); i++) {
+    const ChannelConfig::Tank& tank = channel_config->tanks()[i];
+    if (!ads1115_bank->has_input(tank.input - 1)) {
+      debugE("Tank %s: no ADC for input A%d", tank.name.c_str(), tank.input);
+      continue;
+    }
+    auto tank_level = ConnectTankSender(
+        ads1115_bank, tank.input - 1, tank.name, tank.sk_id, 3000 + 20 * i,
+        enable_signalk_output, enable_ui, &tank_volumes[tank.input]);
+
+    // Values produced on the real-time loop are handed over to the SensESP
+    // loop for the display, logging and streaming.
+    auto tank_level_app = ToAppLoop<float>(tank_level);
 
 #ifdef ENABLE_NMEA2000_OUTPUT
-  // Tank 1, instance 0. Capacity 200 liters. You can change the capacity
-  // in the web UI as well.
-  // EDIT: Make sure this matches your tank configuration above.
-  N2kFluidLevelSender* tank_a1_sender = new N2kFluidLevelSender(
-      "/Tanks/Fuel/NMEA 2000", 0, N2kft_Fuel, 200, nmea2000);
-
-  ConfigItem(tank_a1_sender)
-      ->set_title("Tank A1 NMEA 2000")
-      ->set_description("NMEA 2000 tank sender for tank A1")
-      ->set_sort_order(3005);
-
-  tank_a1_volume->connect_to(&(tank_a1_sender->tank_level_));
+    // You can change the capacity in the web UI as well.
+    TagAllocations(Subsystem::kN2k);
+    snprintf(config_path, sizeof(config_path), "/Tanks/%s/NMEA 2000",
+             tank.name.c_str());
+    auto tank_sender = new N2kFluidLevelSender<>(
+        config_path, tank.n2k_instance, (tN2kFluidType)tank.fluid_type,
+        tank.capacity, nmea2000);
+    tank_sender->set_tx_queue(n2k_tx_queue);
+
+    snprintf(title, sizeof(title), "Tank A%d NMEA 2000", tank.input);
+    if (!headless) {
+      ConfigItem(tank_sender)
+          ->set_title(title)
+          ->set_description("NMEA 2000 tank sender")
+          ->set_sort_order(3005 + 20 * i);
+    }
+
+    tank_level->connect_to(&(tank_sender->tank_level_));
+
+    auto tank_data_age = new DataAgeMonitor(10000, 10000, rt_event_loop());
+    tank_data_age->track(&(tank_sender->tank_level_));
+    tank_sender->set_data_age_monitor(tank_data_age);
+    if (enable_signalk_output) {
+      snprintf(name, sizeof(name), "tankA%d", tank.input);
+      ConnectDataAgeOutputs(tank_data_age, name);
+    }
+    TagAllocations(Subsystem::kAnalog);
 #endif  // ENABLE_NMEA2000_OUTPUT
 
-  if (display_present) {
-    // EDIT: Duplicate the lines below to make the display show all your tanks.
-    tank_a1_volume->connect_to(new LambdaConsumer<float>(
-        [](float value) { PrintValue(display, 2, "Tank A1", 100 * value); }));
+    if (display_present && i == 0) {
+      // The display has room for the first tank only
+      String label = String("Tank A") + String(tank.input);
+      tank_level_app->connect_to(
+          new LambdaConsumer<float>([label](float value) {
+            PrintValue(display, 2, label, 100 * value);
+          }));
+    }
+
+    snprintf(name, sizeof(name), "tank_a%d_level", tank.input);
+    data_logger->connect_from(tank_level_app, name, 0.001);
+    snprintf(name, sizeof(name), "tank_a%d", tank.input);
+    live_stream->add_channel(strdup(name), tank_level_app, 4);
   }
 
-  // Read the voltage level of analog input A2
-  auto a2_voltage = new ADS1115VoltageInput(ads1115, 1, "/Voltage A2");
+  // Read the voltage levels of the analog voltage inputs
+  for (size_t i = 0; i < channel_config->voltages().size(); i++) {
+    const ChannelConfig::Voltage& voltage = channel_config->voltages()[i];
+    if (!ads1115_bank->has_input(voltage.input - 1)) {
+      debugE("Voltage %s: no ADC for input A%d", voltage.name.c_str(),
+             voltage.input);
+      continue;
+    }
+    String id = voltage.name;
+    id.toLowerCase();
+
+    snprintf(config_path, sizeof(config_path), "/Voltage %s",
+             voltage.name.c_str());
+    auto voltage_input =
+        new ADS1115VoltageInput(ads1115_bank, voltage.input - 1, config_path);
+
+    snprintf(title, sizeof(title), "Analog Voltage %s", voltage.name.c_str());
+    if (!headless) {
+      ConfigItem(voltage_input)
+          ->set_title(title)
+          ->set_description("Voltage level of an analog input")
+          ->set_sort_order(3080 + i);
+    }
+
+    auto voltage_app = ToAppLoop<float>(voltage_input);
+
+    // If you want to output something else than the voltage value,
+    // you can insert a suitable transform here.
+    // For example, to convert the voltage to a distance with a conversion
+    // factor of 0.17 m/V, you could use the following code:
+    // auto distance = new Linear(0.17, 0.0);
+    // voltage_app->connect_to(distance);
+    //
+    // Similarly, time-at-level statistics of a converted value, e.g. the
+    // coolant temperature in K from a sender, can be kept with a
+    // LoadProfile (see the engine RPM profile below).
+
+    if (enable_signalk_output) {
+      snprintf(sk_path, sizeof(sk_path), "sensors.%s.voltage", id.c_str());
+      voltage_app->connect_to(new SKDeltaOutputFloat(
+          sk_path, title, new SKMetadata("V", title), 2));
+
+      // Measure the age of the voltage when it is handed to Signal K
+      auto voltage_data_age = new DataAgeMonitor(1000);
+      voltage_data_age->track_and_record(voltage_app);
+      snprintf(name, sizeof(name), "%sVoltage", id.c_str());
+      ConnectDataAgeOutputs(voltage_data_age, name);
+    }
+
+    snprintf(name, sizeof(name), "voltage_%s", id.c_str());
+    data_logger->connect_from(voltage_app, name, 0.01);
+    live_stream->add_channel(strdup(id.c_str()), voltage_app, 4);
+  }
 
-  ConfigItem(a2_voltage)
-      ->set_title("Analog Voltage A2")
-      ->set_description("Voltage level of analog input A2")
-      ->set_sort_order(3000);
+  // Ripple analysis of an analog input: periodic 860 SPS bursts, analyzed
+  // on the device. The input is selected in the web UI.
+  auto burst_capture = new BurstCapture(ads1115_bank, "/Burst Capture");
+  if (!headless) {
+    ConfigItem(burst_capture)
+        ->set_title("Ripple Analysis")
+        ->set_description(
+            "Capture an analog input at 860 samples per second and report its "
+            "ripple and dominant frequency")
+        ->set_sort_order(3400);
+  }
+  if (enable_signalk_output) {
+    ConnectBurstCaptureOutputs(burst_capture);
+  }
 
-  a2_voltage->connect_to(new LambdaConsumer<float>(
-      [](float value) { debugD("Voltage A2: %f", value); }));
+  ///////////////////////////////////////////////////////////////////
+  // Digital alarm inputs
 
-  // If you want to output something else than the voltage value,
-  // you can insert a suitable transform here.
-  // For example, to convert the voltage to a distance with a conversion
-  // factor of 0.17 m/V, you could use the following code:
-  // auto a2_distance = new Linear(0.17, 0.0);
-  // a2_voltage->connect_to(a2_distance);
+  TagAllocations(Subsystem::kDigital);
 
-  a2_voltage->connect_to(
-      new SKOutputFloat("sensors.a2.voltage", "Analog Voltage A2",
-                        new SKMetadata("V", "Analog Voltage A2")));
-  // Example of how to output the distance value to Signal K.
-  // a2_distance->connect_to(
-  //     new SKOutputFloat("sensors.a2.distance", "Analog Distance A2",
-  //                       new SKMetadata("m", "Analog Distance A2")));
+  // Alarm values by digital input number, after inversion
+  BoolProducer* alarm_values[ChannelConfig::kNumDigitalInputs + 1] = {};
 
-  ///////////////////////////////////////////////////////////////////
-  // Digital alarm inputs
+  for (const auto& alarm : channel_config->alarms()) {
+    BoolProducer* alarm_value =
+        ConnectAlarmSender(kDigitalInputPins[alarm.input - 1], alarm.name,
+                           enable_signalk_output, enable_ui);
+    if (alarm.inverted) {
+      alarm_value = alarm_value->connect_to(
+          new LambdaTransform<bool, bool>([](bool value) { return !value; }));
+    }
+    alarm_values[alarm.input] = alarm_value;
 
-  // EDIT: More alarm inputs can be defined by duplicating the lines below.
-  // Make sure to not define a pin for both a tacho and an alarm.
-  auto alarm_d2_input = ConnectAlarmSender(kDigitalInputPin2, "D2");
-  auto alarm_d3_input = ConnectAlarmSender(kDigitalInputPin3, "D3");
-  // auto alarm_d4_input = ConnectAlarmSender(kDigitalInputPin4, "D4");
-
-  // Update the alarm states based on the input value changes.
-  // EDIT: If you added more alarm inputs, uncomment the respective lines below.
-  alarm_d2_input->connect_to(
-      new LambdaConsumer<bool>([](bool value) { alarm_states[1] = value; }));
-  // In this example, alarm_d3_input is active low, so invert the value.
-  auto alarm_d3_inverted = alarm_d3_input->connect_to(
-      new LambdaTransform<bool, bool>([](bool value) { return !value; }));
-  alarm_d3_inverted->connect_to(
-      new LambdaConsumer<bool>([](bool value) { alarm_states[2] = value; }));
-  // alarm_d4_input->connect_to(
-  //     new LambdaConsumer<bool>([](bool value) { alarm_states[3] = value; }));
-
-  // EDIT: This example connects the D2 alarm input to the low oil pressure
-  // warning. Modify according to your needs.
-  N2kEngineParameterDynamicSender* engine_dynamic_sender =
-      new N2kEngineParameterDynamicSender("/NMEA 2000/Engine 1 Dynamic", 0,
-                                          nmea2000);
-
-  ConfigItem(engine_dynamic_sender)
-      ->set_title("Engine 1 Dynamic")
-      ->set_description("NMEA 2000 dynamic engine parameters for engine 1")
-      ->set_sort_order(3010);
-
-  alarm_d2_input->connect_to(engine_dynamic_sender->low_oil_pressure_);
-
-  // This is just an example -- normally temperature alarms would not be
-  // active-low (inverted).
-  alarm_d3_inverted->connect_to(engine_dynamic_sender->over_temperature_);
+    // Update the alarm states for the display
+    int index = alarm.input - 1;
+    alarm_value->connect_to(new LambdaConsumer<bool>(
+        [index](bool value) { alarm_states[index] = value; }));
+
+    snprintf(name, sizeof(name), "alarm_d%d", alarm.input);
+    data_logger->connect_from(alarm_value, name);
+  }
 
   // FIXME: Transmit the alarms over SK as well.
 
   ///////////////////////////////////////////////////////////////////
-  // Digital tacho inputs
+  // Engines: tacho inputs and NMEA 2000 engine parameters
+
+  for (size_t i = 0; i < channel_config->engines().size(); i++) {
+    const ChannelConfig::Engine& engine = channel_config->engines()[i];
+    // Engine numbers in the configuration paths start from 1
+    int number = engine.instance + 1;
+
+    if (engine.low_oil_pressure_input != 0 ||
+        engine.over_temperature_input != 0 || engine.fuel_tank_input != 0) {
+      // The alarm inputs are read on the SensESP loop and handed over to
+      // the real-time loop, where the fuel rate is estimated and the sender
+      // runs.
+      TagAllocations(Subsystem::kN2k);
+      snprintf(config_path, sizeof(config_path),
+               "/NMEA 2000/Engine %d Dynamic", number);
+      auto engine_dynamic_sender = new N2kEngineParameterDynamicSender<>(
+          config_path, engine.instance, nmea2000);
+      engine_dynamic_sender->set_tx_queue(n2k_tx_queue);
+
+      snprintf(title, sizeof(title), "Engine %d Dynamic", number);
+      if (!headless) {
+        ConfigItem(engine_dynamic_sender)
+            ->set_title(title)
+            ->set_description("NMEA 2000 dynamic engine parameters")
+            ->set_sort_order(3010 + 20 * i);
+      }
 
-  // Connect the tacho senders. Engine name is "main".
-  // EDIT: More tacho inputs can be defined by duplicating the line below.
-  auto tacho_d1_frequency = ConnectTachoSender(kDigitalInputPin1, "main");
+      // Measure how old the alarm states are when PGN 127489 is sent
+      auto engine_dynamic_data_age =
+          new DataAgeMonitor(5000, 10000, rt_event_loop());
+      auto low_oil_pressure = alarm_values[engine.low_oil_pressure_input];
+      if (low_oil_pressure != nullptr) {
+        auto low_oil_pressure_rt = ToRealtimeLoop<bool>(low_oil_pressure);
+        low_oil_pressure_rt->connect_to(
+            engine_dynamic_sender->low_oil_pressure_);
+        engine_dynamic_data_age->track(low_oil_pressure_rt);
+      }
+      auto over_temperature = alarm_values[engine.over_temperature_input];
+      if (over_temperature != nullptr) {
+        auto over_temperature_rt = ToRealtimeLoop<bool>(over_temperature);
+        over_temperature_rt->connect_to(
+            engine_dynamic_sender->over_temperature_);
+        engine_dynamic_data_age->track(over_temperature_rt);
+
+        // Time spent at high coolant temperature
+        snprintf(name, sizeof(name), "ovtemp%d", engine.instance);
+        snprintf(config_path, sizeof(config_path),
+                 "/Engine %s/Over Temperature Profile", engine.name.c_str());
+        auto over_temperature_profile =
+            new LoadProfile(name, 1, 2, 1, 0.5, config_path);
+        over_temperature
+            ->connect_to(new LambdaTransform<bool, float>(
+                [](bool value) { return value ? 1 : 0; }))
+            ->connect_to(over_temperature_profile);
+        snprintf(title, sizeof(title), "Engine %d Over Temperature Profile",
+                 number);
+        if (!headless) {
+          ConfigItem(over_temperature_profile)
+              ->set_title(title)
+              ->set_description("Time with the over temperature alarm active")
+              ->set_sort_order(3017 + 20 * i);
+        }
+        if (enable_signalk_output) {
+          snprintf(sk_path, sizeof(sk_path),
+                   "propulsion.%s.loadProfile.overTemperature",
+                   engine.name.c_str());
+          ConnectLoadProfileOutputs(over_temperature_profile, sk_path);
+        }
+      }
+
+      // Fuel rate estimated from the fuel tank volume
+      auto fuel_volume = tank_volumes[engine.fuel_tank_input];
+      if (fuel_volume != nullptr) {
+        snprintf(config_path, sizeof(config_path), "/Engine %s/Fuel Rate",
+                 engine.name.c_str());
+        auto fuel_consumption = new FuelConsumption(config_path);
+        fuel_volume->connect_to(fuel_consumption);
+        snprintf(title, sizeof(title), "Engine %d Fuel Rate", number);
+        if (!headless) {
+          ConfigItem(fuel_consumption)
+              ->set_title(title)
+              ->set_description("Fuel rate estimated from the tank volume")
+              ->set_sort_order(3018 + 20 * i);
+        }
+
+        // PGN 127489 carries the fuel rate in l/h
+        fuel_consumption->fuel_rate_
+            .connect_to(new LambdaTransform<float, float>(
+                [](float rate) { return rate * 3.6e6f; }))
+            ->connect_to(engine_dynamic_sender->fuel_rate_);
+
+        if (enable_signalk_output) {
+          snprintf(sk_path, sizeof(sk_path), "propulsion.%s.fuel.rate",
+                   engine.name.c_str());
+          ToAppLoop<float>(&fuel_consumption->fuel_rate_)
+              ->connect_to(new SKDeltaOutputFloat(
+                  sk_path, "",
+                  new SKMetadata("m3/s", "Fuel rate",
+                                 "Estimated from the tank volume"),
+                  8));
+        }
+      }
+      engine_dynamic_sender->set_data_age_monitor(engine_dynamic_data_age);
+      if (enable_signalk_output) {
+        snprintf(name, sizeof(name), "engine%dDynamic", number);
+        ConnectDataAgeOutputs(engine_dynamic_data_age, name);
+      }
+    }
 
-  // Connect outputs to the N2k senders.
-  // EDIT: Make sure this matches your tacho configuration above.
-  //       Duplicate the lines below to connect more tachos, but be sure to
-  //       use different engine instances.
-  N2kEngineParameterRapidSender* engine_rapid_sender =
-      new N2kEngineParameterRapidSender("/NMEA 2000/Engine 1 Rapid Update", 0,
-                                        nmea2000);  // Engine 1, instance 0
+    if (engine.tacho_input == 0) {
+      continue;
+    }
 
-  ConfigItem(engine_rapid_sender)
-      ->set_title("Engine 1 Rapid Update")
-      ->set_description("NMEA 2000 rapid update engine parameters for engine 1")
-      ->set_sort_order(3015);
+    TagAllocations(Subsystem::kDigital);
 
-  tacho_d1_frequency->connect_to(&(engine_rapid_sender->engine_speed_));
+    auto tacho_frequency =
+        ConnectTachoSender(kDigitalInputPins[engine.tacho_input - 1],
+                           engine.name, enable_signalk_output, enable_ui);
+    auto tacho_frequency_app = ToAppLoop<float>(tacho_frequency);
 
-  if (display_present) {
-    tacho_d1_frequency->connect_to(new LambdaConsumer<float>(
-        [](float value) { PrintValue(display, 3, "RPM D1", 60 * value); }));
+#ifdef ENABLE_TEST_OUTPUT_PIN
+    if (engine.tacho_input == 1) {
+      auto tacho_self_test = new TachoSelfTest(
+          kTestOutputPin, kTestOutputFrequency, tacho_frequency,
+          "/Tacho " + engine.name + "/Self-Test");
+
+      if (!headless) {
+        ConfigItem(tacho_self_test)
+            ->set_title("Tacho Self-Test")
+            ->set_description(
+                "Sweep the test output on GPIO 33 and measure the tacho D1 "
+                "accuracy and latency. Connect the test output to D1 first.")
+            ->set_sort_order(3300);
+      }
+    }
+#endif
+
+    TagAllocations(Subsystem::kN2k);
+    snprintf(config_path, sizeof(config_path),
+             "/NMEA 2000/Engine %d Rapid Update", number);
+    auto engine_rapid_sender = new N2kEngineParameterRapidSender<>(
+        config_path, engine.instance, nmea2000);
+    engine_rapid_sender->set_tx_queue(n2k_tx_queue);
+
+    snprintf(title, sizeof(title), "Engine %d Rapid Update", number);
+    if (!headless) {
+      ConfigItem(engine_rapid_sender)
+          ->set_title(title)
+          ->set_description("NMEA 2000 rapid update engine parameters")
+          ->set_sort_order(3015 + 20 * i);
+    }
+
+    tacho_frequency->connect_to(&(engine_rapid_sender->engine_speed_));
+
+    // Measure how old the engine speed is when PGN 127488 is sent
+    auto engine_rapid_data_age =
+        new DataAgeMonitor(1000, 10000, rt_event_loop());
+    engine_rapid_data_age->track(&(engine_rapid_sender->engine_speed_));
+    engine_rapid_sender->set_data_age_monitor(engine_rapid_data_age);
+    snprintf(name, sizeof(name), "engine%dRapid", number);
+
+    // Measure the timing jitter of the 100 ms PGN 127488 transmissions
+    auto engine_rapid_jitter =
+        new IntervalJitterMonitor(100, 10000, rt_event_loop());
+    engine_rapid_sender->set_jitter_monitor(engine_rapid_jitter);
+#ifdef ENABLE_POWER_MANAGEMENT
+    power_manager->compare_jitter(engine_rapid_jitter);
+#endif
+    runtime_mode->compare_jitter(engine_rapid_jitter);
+
+    if (enable_signalk_output) {
+      TagAllocations(Subsystem::kSignalK);
+      ConnectDataAgeOutputs(engine_rapid_data_age, name);
+      ConnectJitterOutputs(engine_rapid_jitter, name);
+      snprintf(sk_path, sizeof(sk_path),
+               "sensors.halmet.n2k.engine%dRapid.buildCycles", number);
+      ToAppLoop<int>(&engine_rapid_sender->build_cycles_)
+          ->connect_to(new SKOutputInt(
+              sk_path, "",
+              new SKMetadata("", "PGN 127488 build cycles",
+                             "Mean CPU cycles spent building one message")));
+    }
+
+    if (display_present && engine.tacho_input == 1) {
+      tacho_frequency_app->connect_to(new LambdaConsumer<float>(
+          [](float value) { PrintValue(display, 3, "RPM D1", 60 * value); }));
+    }
+
+    auto engine_rpm =
+        tacho_frequency_app->connect_to(new LambdaTransform<float, float>(
+            [](float value) { return 60 * value; }));
+    snprintf(name, sizeof(name), "rpm_%s", engine.name.c_str());
+    data_logger->connect_from(engine_rpm, name, 1);
+
+    // Engine hours in 500 rpm bands, counted while the engine turns
+    snprintf(name, sizeof(name), "rpm%d", engine.instance);
+    snprintf(config_path, sizeof(config_path), "/Engine %s/RPM Profile",
+             engine.name.c_str());
+    auto rpm_profile = new LoadProfile(name, 0, 4000, 8, 100, config_path);
+    engine_rpm->connect_to(rpm_profile);
+    snprintf(title, sizeof(title), "Engine %d RPM Profile", number);
+    if (!headless) {
+      ConfigItem(rpm_profile)
+          ->set_title(title)
+          ->set_description("Running time in each RPM band")
+          ->set_sort_order(3016 + 20 * i);
+    }
+    if (enable_signalk_output) {
+      snprintf(sk_path, sizeof(sk_path),
+               "propulsion.%s.loadProfile.revolutions", engine.name.c_str());
+      ConnectLoadProfileOutputs(rpm_profile, sk_path);
+    }
+    snprintf(name, sizeof(name), "tacho_d%d", engine.tacho_input);
+    live_stream->add_channel(strdup(name), tacho_frequency_app, 3);
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // NMEA 2000 received values
+
+  TagAllocations(Subsystem::kSignalK);
+
+  if (enable_signalk_output) {
+    for (size_t i = 0; i < n2k_receiver->fields().size(); i++) {
+      const N2kReceiver::Field& field = n2k_receiver->fields()[i];
+      auto field_app = ToAppLoop<float>(n2k_receiver->output(i));
+      field_app->connect_to(
+          new SKDeltaOutputFloat(field.sk_path, "", nullptr, 4));
+    }
+
+    ToAppLoop<int>(&n2k_receiver->received_)
+        ->connect_to(new SKOutputInt("sensors.halmet.n2k.rxMessages", "",
+                        new SKMetadata("Hz", "N2k received messages")));
+    ToAppLoop<int>(&n2k_receiver->decoded_)
+        ->connect_to(new SKOutputInt("sensors.halmet.n2k.rxValues", "",
+                        new SKMetadata("Hz", "N2k received values",
+                                       "Subscribed fields decoded")));
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // NMEA 2000 transmit diagnostics
+
+  if (enable_signalk_output) {
+    ToAppLoop<int>(&n2k_tx_queue->superseded_)->connect_to(new SKOutputInt(
+        "sensors.halmet.n2k.txSuperseded", "",
+        new SKMetadata("", "N2k superseded messages",
+                       "Periodic messages replaced before being sent")));
+    ToAppLoop<int>(&n2k_tx_queue->send_failures_)->connect_to(new SKOutputInt(
+        "sensors.halmet.n2k.txFailures", "",
+        new SKMetadata("", "N2k send failures",
+                       "Messages rejected because the send buffer was full")));
+    ToAppLoop<int>(&n2k_tx_queue->bus_off_count_)
+        ->connect_to(new SKOutputInt("sensors.halmet.n2k.busOffCount", "",
+                        new SKMetadata("", "N2k bus-off events")));
+    ToAppLoop<float>(&n2k_address_store->time_to_ready_)
+        ->connect_to(new SKOutputFloat(
+        "sensors.halmet.n2k.timeToReady", "",
+        new SKMetadata("s", "N2k time to ready",
+                       "Time from CAN open to a settled address claim")));
+    ToAppLoop<int>(&n2k_request_responder->responses_)
+        ->connect_to(new SKOutputInt("sensors.halmet.n2k.requestResponses", "",
+                        new SKMetadata("", "N2k ISO request responses")));
+    ToAppLoop<int>(&n2k_request_responder->rate_limited_)
+        ->connect_to(new SKOutputInt(
+            "sensors.halmet.n2k.requestsRateLimited", "",
+            new SKMetadata("", "N2k ISO requests rate limited",
+                           "Requests dropped because the requester exceeded "
+                           "its reply rate")));
+    ToAppLoop<int>(&n2k_address_store->claim_changes_)
+        ->connect_to(new SKOutputInt("sensors.halmet.n2k.claimChanges", "",
+                        new SKMetadata("", "N2k boot address claim changes")));
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // History logging and live value stream
+
+  TagAllocations(Subsystem::kOther);
+
+  // The log and the trace are still recorded in NMEA 2000 only mode and can
+  // be downloaded after switching back to full mode.
+  if (!headless) {
+    data_logger->add_http_handler(sensesp_app->get_http_server());
+
+    // Download the input trace from http://halmet.local/api/trace, or upload
+    // a trace to replay:
+    // curl -T golden.htrc http://halmet.local/api/trace
+    input_trace->add_http_handler(sensesp_app->get_http_server());
+
+    live_stream->add_http_handler(sensesp_app->get_http_server());
+  }
+
+  ///////////////////////////////////////////////////////////////////
+  // Memory telemetry
+
+  // Free heap, fragmentation and stack headroom of the main tasks
+  auto memory_monitor = new MemoryMonitor();
+  memory_monitor->add_task("loopTask");
+  memory_monitor->add_task("rt_loop");
+  memory_monitor->add_task("app_loop");
+  memory_monitor->add_task("httpd");
+  memory_monitor->add_task("sse_stream");
+
+  if (enable_signalk_output) {
+    ConnectMemoryOutputs(memory_monitor);
+
+    // ADC throughput
+    ConnectADS1115BankOutputs(ads1115_bank);
+
+    // Configuration load time and flash writes
+    ConnectConfigStatsOutputs();
+
+#ifdef ENABLE_POWER_MANAGEMENT
+    // Event loop load
+    ConnectPowerOutputs(power_manager);
+#endif
   }
 
   ///////////////////////////////////////////////////////////////////
   // Display setup
 
+  TagAllocations(Subsystem::kDisplay);
+
   // Connect the outputs to the display
   if (display_present) {
-    event_loop()->onRepeat(1000, []() {
-      PrintValue(display, 1, "IP:", WiFi.localIP().toString());
-    });
+    if (headless) {
+      PrintValue(display, 1, "Mode:", "N2k only");
+    } else {
+      event_loop()->onRepeat(1000, TagCallback([]() {
+        PrintValue(display, 1, "IP:", WiFi.localIP().toString());
+      }));
+    }
 
     // Create a poor man's "christmas tree" display for the alarms
-    event_loop()->onRepeat(1000, []() {
+    event_loop()->onRepeat(1000, TagCallback([]() {
       char state_string[5] = {};
       for (int i = 0; i < 4; i++) {
         state_string[i] = alarm_states[i] ? '*' : '_';
       }
       PrintValue(display, 4, "Alarm", state_string);
-    });
+    }));
   }
 
-  // To avoid garbage collecting all shared pointers created in setup(),
-  // loop from here.
-  while (true) {
-    loop();
+  ///////////////////////////////////////////////////////////////////
+  // Overload governor
+
+  TagAllocations(Subsystem::kOther);
+
+  // When the event loops are overloaded, e.g. while Wi-Fi reconnects with
+  // the web UI open, shed work in this order to keep the CAN transmit
+  // cadence and the alarm inputs on time. Restored in reverse order.
+  auto overload_governor = new OverloadGovernor();
+  if (display_present) {
+    overload_governor->add_stage(
+        "display refresh", LoopId::kApp,
+        [](bool shed) { SetDisplayPaused(shed); });
+  }
+  if (!headless) {
+    overload_governor->add_stage(
+        "Signal K update rate", LoopId::kApp, [](bool shed) {
+          SKDeltaSender::get()->set_rate_divider(shed ? 10 : 1);
+        });
   }
+  // The only work of the real-time loop that can be shed is its debug output
+  overload_governor->add_stage(
+      "debug logging", LoopId::kRealtime, [](bool shed) {
+        esp_log_level_set("*", shed ? ESP_LOG_WARN : ESP_LOG_DEBUG);
+      });
+  if (enable_signalk_output) {
+    ConnectOverloadGovernorOutputs(overload_governor);
+  }
+
+  // To avoid garbage collecting all shared pointers created in setup(),
+  // run the event loops from here.
+  RunEventLoops();
 }
 
 void loop() { event_loop()->tick(); }
@@ -0,0 +1,251 @@
+#include "memory_monitor.h"
+
+#include <esp_heap_caps.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const char* kSubsystemNames[] = {"other",   "analog",  "digital",
+                                 "n2k",     "display", "signalk"};
+static_assert(sizeof(kSubsystemNames) / sizeof(kSubsystemNames[0]) ==
+                  (int)Subsystem::kCount,
+              "Subsystem names out of sync");
+
+std::atomic<int32_t> live_bytes[(int)Subsystem::kCount];
+
+}  // namespace
+
+const char* SubsystemName(Subsystem subsystem) {
+  return kSubsystemNames[(int)subsystem];
+}
+
+#ifdef HALMET_ALLOCATION_TAGGING
+
+namespace {
+
+// loopTask, rt_loop, app_loop, httpd and a few spare. The thread-local
+// storage pointers of ESP-IDF are taken by pthreads.
+const int kMaxTaggedTasks = 8;
+
+// The current subsystem of a task. A slot is claimed once by its task and
+// never released; only the owning task writes the subsystem.
+struct TaskTag {
+  std::atomic<TaskHandle_t> task;
+  std::atomic<uint8_t> subsystem;
+};
+
+TaskTag task_tags[kMaxTaggedTasks];
+
+TaskTag* FindTaskTag(bool claim) {
+  // Null until the scheduler runs, e.g. in global constructors
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  if (task == nullptr) {
+    return nullptr;
+  }
+  for (TaskTag& tag : task_tags) {
+    if (tag.task.load(std::memory_order_relaxed) == task) {
+      return &tag;
+    }
+  }
+  if (!claim) {
+    return nullptr;
+  }
+  for (TaskTag& tag : task_tags) {
+    TaskHandle_t expected = nullptr;
+    if (tag.task.compare_exchange_strong(expected, task)) {
+      return &tag;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+void TagAllocations(Subsystem subsystem) {
+  TaskTag* tag = FindTaskTag(true);
+  if (tag != nullptr) {
+    tag->subsystem.store((uint8_t)subsystem, std::memory_order_relaxed);
+  }
+}
+
+Subsystem AllocationTag() {
+  TaskTag* tag = FindTaskTag(false);
+  return tag == nullptr
+             ? Subsystem::kOther
+             : (Subsystem)tag->subsystem.load(std::memory_order_relaxed);
+}
+
+std::function<void()> TagCallback(std::function<void()> callback) {
+  Subsystem subsystem = AllocationTag();
+  return [subsystem, callback]() {
+    AllocationTagScope scope(subsystem);
+    callback();
+  };
+}
+
+bool allocation_tagging_enabled() { return true; }
+
+namespace {
+
+// Prepended to every block; keeps the 8-byte alignment of malloc()
+struct AllocationHeader {
+  uint32_t size;
+  uint8_t subsystem;
+  uint8_t reserved[3];
+};
+static_assert(sizeof(AllocationHeader) == 8, "Unexpected header size");
+
+void* TaggedAlloc(size_t size) {
+  auto header =
+      static_cast<AllocationHeader*>(malloc(sizeof(AllocationHeader) + size));
+  if (header == nullptr) {
+    return nullptr;
+  }
+  uint8_t subsystem = (uint8_t)AllocationTag();
+  header->size = size;
+  header->subsystem = subsystem;
+  live_bytes[subsystem].fetch_add(size, std::memory_order_relaxed);
+  return header + 1;
+}
+
+void TaggedFree(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  auto header = static_cast<AllocationHeader*>(ptr) - 1;
+  live_bytes[header->subsystem].fetch_sub(header->size,
+                                          std::memory_order_relaxed);
+  free(header);
+}
+
+void* TaggedAllocOrAbort(size_t size) {
+  void* ptr = TaggedAlloc(size);
+  if (ptr == nullptr) {
+    abort();
+  }
+  return ptr;
+}
+
+}  // namespace
+
+#else
+
+void TagAllocations(Subsystem subsystem) {}
+
+Subsystem AllocationTag() { return Subsystem::kOther; }
+
+std::function<void()> TagCallback(std::function<void()> callback) {
+  return callback;
+}
+
+bool allocation_tagging_enabled() { return false; }
+
+#endif  // HALMET_ALLOCATION_TAGGING
+
+MemoryMonitor::MemoryMonitor(unsigned int report_interval) {
+  sensesp::event_loop()->onRepeat(report_interval, [this]() { report(); });
+}
+
+sensesp::ObservableValue<int>* MemoryMonitor::add_task(const char* name) {
+  auto stack_high_water = new sensesp::ObservableValue<int>();
+  tasks_.push_back({name, nullptr, stack_high_water});
+  return stack_high_water;
+}
+
+void MemoryMonitor::report() {
+  free_heap_ = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  largest_free_block_ = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  min_free_heap_ = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+  for (auto& task : tasks_) {
+    if (task.handle == nullptr) {
+      // Tasks are never deleted, so the handle stays valid once found
+      task.handle = xTaskGetHandle(task.name);
+      if (task.handle == nullptr) {
+        continue;
+      }
+    }
+    // In ESP-IDF, the high-water mark is in bytes
+    task.stack_high_water->set(uxTaskGetStackHighWaterMark(task.handle));
+  }
+
+  if (allocation_tagging_enabled()) {
+    for (int i = 0; i < (int)Subsystem::kCount; i++) {
+      live_bytes_[i] = live_bytes[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void ConnectMemoryOutputs(MemoryMonitor* monitor) {
+  monitor->free_heap_.connect_to(
+      new sensesp::SKOutputInt("sensors.halmet.memory.freeHeap", "",
+                               new sensesp::SKMetadata("", "Free heap")));
+  monitor->largest_free_block_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.memory.largestFreeBlock", "",
+      new sensesp::SKMetadata("", "Largest free heap block")));
+  monitor->min_free_heap_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.memory.minFreeHeap", "",
+      new sensesp::SKMetadata("", "Minimum free heap since boot")));
+
+  char sk_path[80];
+  char display_name[80];
+  for (const auto& task : monitor->tasks()) {
+    snprintf(sk_path, sizeof(sk_path), "sensors.halmet.memory.stack.%s",
+             task.name);
+    snprintf(display_name, sizeof(display_name), "%s stack high-water mark",
+             task.name);
+    task.stack_high_water->connect_to(new sensesp::SKOutputInt(
+        sk_path, "",
+        new sensesp::SKMetadata("", display_name,
+                                "Lowest amount of free stack, in bytes")));
+  }
+
+  if (!allocation_tagging_enabled()) {
+    return;
+  }
+  for (int i = 0; i < (int)Subsystem::kCount; i++) {
+    const char* name = SubsystemName((Subsystem)i);
+    snprintf(sk_path, sizeof(sk_path), "sensors.halmet.memory.alloc.%s",
+             name);
+    snprintf(display_name, sizeof(display_name), "%s heap", name);
+    monitor->live_bytes_[i].connect_to(new sensesp::SKOutputInt(
+        sk_path, "",
+        new sensesp::SKMetadata("", display_name,
+                                "Live heap bytes allocated by the subsystem")));
+  }
+}
+
+}  // namespace halmet
+
+#ifdef HALMET_ALLOCATION_TAGGING
+
+// Replacements of the global allocation functions
+
+void* operator new(size_t size) { return halmet::TaggedAllocOrAbort(size); }
+void* operator new[](size_t size) { return halmet::TaggedAllocOrAbort(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return halmet::TaggedAlloc(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return halmet::TaggedAlloc(size);
+}
+void operator delete(void* ptr) noexcept { halmet::TaggedFree(ptr); }
+void operator delete[](void* ptr) noexcept { halmet::TaggedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { halmet::TaggedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { halmet::TaggedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  halmet::TaggedFree(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  halmet::TaggedFree(ptr);
+}
+
+#endif  // HALMET_ALLOCATION_TAGGING
@@ -0,0 +1,114 @@
+#ifndef HALMET_SRC_MEMORY_MONITOR_H_
+#define HALMET_SRC_MEMORY_MONITOR_H_
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <functional>
+#include <vector>
+
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/**
+ * @brief Subsystems that heap allocations can be attributed to.
+ */
+enum class Subsystem : uint8_t {
+  kOther = 0,
+  kAnalog,
+  kDigital,
+  kN2k,
+  kDisplay,
+  kSignalK,
+  kCount,
+};
+
+const char* SubsystemName(Subsystem subsystem);
+
+/**
+ * @brief Attribute subsequent allocations by the calling task to
+ * `subsystem`.
+ *
+ * Only has an effect if the firmware is built with
+ * -D HALMET_ALLOCATION_TAGGING, which replaces the global operator new and
+ * delete with versions that keep per-subsystem byte counts. Each task has
+ * its own current subsystem, kept in a small table of task slots. Tasks
+ * that never tagged, or that find the table full, count as
+ * Subsystem::kOther, as do C allocations (malloc, Arduino String).
+ *
+ * setup() tags the objects it creates. The loop tasks run the callbacks of
+ * all subsystems, so the callbacks set the tag themselves: through
+ * TagCallback(), AllocationTagScope, SharedScheduler and the loop bridges.
+ */
+void TagAllocations(Subsystem subsystem);
+
+/// The subsystem the calling task's allocations are attributed to.
+Subsystem AllocationTag();
+
+/**
+ * @brief Attribute the calling task's allocations to a subsystem for the
+ * lifetime of the scope.
+ */
+class AllocationTagScope {
+ public:
+  explicit AllocationTagScope(Subsystem subsystem)
+      : previous_{AllocationTag()} {
+    TagAllocations(subsystem);
+  }
+  ~AllocationTagScope() { TagAllocations(previous_); }
+
+ private:
+  Subsystem previous_;
+};
+
+/// Wrap an event loop callback so that its allocations are attributed to
+/// the subsystem the calling task is tagged with now.
+std::function<void()> TagCallback(std::function<void()> callback);
+
+/// True if the firmware was built with allocation tagging.
+bool allocation_tagging_enabled();
+
+/**
+ * @brief Heap and stack telemetry.
+ *
+ * Publishes free heap, largest free block and the minimum free heap since
+ * boot, the stack high-water mark of selected FreeRTOS tasks and, with
+ * allocation tagging, the live heap bytes of each subsystem. A falling free
+ * heap points to a leak, a largest free block falling faster than the free
+ * heap to fragmentation.
+ */
+class MemoryMonitor {
+ public:
+  MemoryMonitor(unsigned int report_interval = 10000);
+
+  /// Report the stack high-water mark of the task `name`. The task may be
+  /// created later.
+  sensesp::ObservableValue<int>* add_task(const char* name);
+
+  sensesp::ObservableValue<int> free_heap_;
+  sensesp::ObservableValue<int> largest_free_block_;
+  sensesp::ObservableValue<int> min_free_heap_;
+  /// Live heap bytes per subsystem, indexed by Subsystem
+  sensesp::ObservableValue<int> live_bytes_[(int)Subsystem::kCount];
+
+  struct Task {
+    const char* name;
+    TaskHandle_t handle;
+    sensesp::ObservableValue<int>* stack_high_water;
+  };
+
+  const std::vector<Task>& tasks() const { return tasks_; }
+
+ protected:
+  void report();
+
+  std::vector<Task> tasks_;
+};
+
+/// Publish the metrics of `monitor` at sensors.halmet.memory.*
+void ConnectMemoryOutputs(MemoryMonitor* monitor);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_MEMORY_MONITOR_H_
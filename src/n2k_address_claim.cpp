@@ -0,0 +1,33 @@
+#include "n2k_address_claim.h"
+
+namespace halmet {
+
+uint8_t N2kAddressClaim::preferred_address(uint8_t stored_address,
+                                           uint8_t default_address) {
+  return stored_address <= kMaxSourceAddress ? stored_address
+                                             : default_address;
+}
+
+void N2kAddressClaim::start(uint32_t now) {
+  open_time_ = now;
+  last_change_ = now;
+  address_ = nmea2000_->GetN2kSource();
+}
+
+bool N2kAddressClaim::poll(uint32_t now) {
+  bool changed = nmea2000_->ReadResetAddressChanged();
+  if (changed) {
+    last_change_ = now;
+    address_ = nmea2000_->GetN2kSource();
+    if (!ready_) {
+      claim_changes_++;
+    }
+  }
+  if (!ready_ && settled(now)) {
+    ready_ = true;
+    time_to_ready_ = last_change_ + kSettleTime - open_time_;
+  }
+  return changed;
+}
+
+}  // namespace halmet
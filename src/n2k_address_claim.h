@@ -0,0 +1,62 @@
+#ifndef HALMET_SRC_N2K_ADDRESS_CLAIM_H_
+#define HALMET_SRC_N2K_ADDRESS_CLAIM_H_
+
+#include <NMEA2000.h>
+
+#include <cstdint>
+
+namespace halmet {
+
+/**
+ * @brief Follow the source address claim of a tNMEA2000 node.
+ *
+ * Detects when the claimed address has settled, counts the address changes
+ * until then and measures the time from Open() to the settled claim. The
+ * caller passes the time in, so this runs on the host against a simulated
+ * bus (see test/test_n2k_address_claim) as well as in N2kAddressStore.
+ */
+class N2kAddressClaim {
+ public:
+  /// ISO 11783-5: a claim is valid if not contested within 250 ms
+  static constexpr uint32_t kSettleTime = 250;  // ms
+  /// Highest source address of a self-configurable node
+  static constexpr uint8_t kMaxSourceAddress = 251;
+
+  N2kAddressClaim(tNMEA2000* nmea2000) : nmea2000_{nmea2000} {}
+
+  /// Address to start from: `stored_address` if it's a valid source
+  /// address, otherwise `default_address`.
+  static uint8_t preferred_address(uint8_t stored_address,
+                                   uint8_t default_address);
+
+  /// Call right after tNMEA2000::Open().
+  void start(uint32_t now);
+  /// Call periodically. Returns true if the address changed.
+  bool poll(uint32_t now);
+
+  /// Current source address
+  uint8_t address() const { return address_; }
+  /// True if the address hasn't changed for kSettleTime.
+  bool settled(uint32_t now) const {
+    return now - last_change_ >= kSettleTime;
+  }
+  /// True once the first claim has settled.
+  bool ready() const { return ready_; }
+  /// Time from start() to the first settled claim, in ms
+  uint32_t time_to_ready() const { return time_to_ready_; }
+  /// Address changes before the first claim settled
+  int claim_changes() const { return claim_changes_; }
+
+ protected:
+  tNMEA2000* nmea2000_;
+  uint8_t address_ = 0;
+  uint32_t open_time_ = 0;
+  uint32_t last_change_ = 0;
+  bool ready_ = false;
+  uint32_t time_to_ready_ = 0;
+  int claim_changes_ = 0;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_ADDRESS_CLAIM_H_
@@ -0,0 +1,69 @@
+#include "n2k_address_store.h"
+
+#include <Preferences.h>
+
+#include "rt_event_loop.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const char* kPreferencesNamespace = "halmet_n2k";
+const char* kAddressKey = "src_addr";
+
+const unsigned int kPollInterval = 50;  // ms
+
+}  // namespace
+
+N2kAddressStore::N2kAddressStore(tNMEA2000* nmea2000, uint8_t default_address)
+    : claim_{nmea2000} {
+  Preferences prefs;
+  prefs.begin(kPreferencesNamespace, true);
+  stored_address_ = prefs.getUChar(kAddressKey, 0xff);
+  prefs.end();
+
+  preferred_address_ =
+      N2kAddressClaim::preferred_address(stored_address_, default_address);
+  debugI("N2k preferred source address: %d", preferred_address_);
+}
+
+void N2kAddressStore::start() {
+  claim_.start(millis());
+  source_address_ = claim_.address();
+  rt_event_loop()->onRepeat(kPollInterval, [this]() { poll(); });
+}
+
+void N2kAddressStore::poll() {
+  uint32_t now = millis();
+  bool was_ready = claim_.ready();
+
+  if (claim_.poll(now)) {
+    source_address_ = claim_.address();
+    claim_changes_ = claim_.claim_changes();
+    debugI("N2k source address changed to %d", source_address_.get());
+  }
+
+  if (!claim_.settled(now)) {
+    return;
+  }
+
+  if (!was_ready) {
+    time_to_ready_ = claim_.time_to_ready() / 1000.;
+    debugI("N2k address %d settled %.2f s after open, %d claim changes",
+           source_address_.get(), time_to_ready_.get(), claim_changes_.get());
+  }
+
+  uint8_t address = claim_.address();
+  if (address != stored_address_ &&
+      address <= N2kAddressClaim::kMaxSourceAddress) {
+    Preferences prefs;
+    prefs.begin(kPreferencesNamespace, false);
+    prefs.putUChar(kAddressKey, address);
+    prefs.end();
+    stored_address_ = address;
+    debugI("Stored N2k source address %d", address);
+  }
+}
+
+}  // namespace halmet
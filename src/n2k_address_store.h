@@ -0,0 +1,50 @@
+#ifndef HALMET_SRC_N2K_ADDRESS_STORE_H_
+#define HALMET_SRC_N2K_ADDRESS_STORE_H_
+
+#include <NMEA2000.h>
+
+#include "n2k_address_claim.h"
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/**
+ * @brief Persist the claimed NMEA 2000 source address across reboots.
+ *
+ * Starting from the address claimed during the previous session avoids a
+ * fresh address claim negotiation at every boot. The address is written to
+ * NVS only after it has been stable for the claim settling time, so a claim
+ * storm doesn't turn into a flash write storm.
+ *
+ * Also measures how long it takes from Open() until the address has settled
+ * and our PGNs are accepted by the other nodes. The claim itself is followed
+ * by N2kAddressClaim.
+ */
+class N2kAddressStore {
+ public:
+  N2kAddressStore(tNMEA2000* nmea2000, uint8_t default_address = 71);
+
+  /// Address to pass to tNMEA2000::SetMode()
+  uint8_t preferred_address() const { return preferred_address_; }
+
+  /// Call right after tNMEA2000::Open().
+  void start();
+
+  /// Current source address
+  sensesp::ObservableValue<int> source_address_;
+  /// Time from Open() to a settled address claim, in seconds
+  sensesp::ObservableValue<float> time_to_ready_;
+  /// Address changes during the boot-time claim
+  sensesp::ObservableValue<int> claim_changes_{0};
+
+ protected:
+  void poll();
+
+  N2kAddressClaim claim_;
+  uint8_t preferred_address_;
+  uint8_t stored_address_;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_ADDRESS_STORE_H_
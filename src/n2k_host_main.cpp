@@ -0,0 +1,102 @@
+// Host build of the HALMET NMEA 2000 node for bus load testing.
+//
+// Runs the NMEA 2000 stack on a Linux SocketCAN interface and transmits the
+// same periodic PGNs at the same intervals as the firmware, with synthetic
+// values. Build and run with:
+//
+//   pio run -e native_n2k
+//   .pio/build/native_n2k/program vcan0
+//
+// and measure the transmit timing with tools/n2k_bus_load.py.
+
+#ifdef HALMET_N2K_HOST
+
+#include <N2kMessages.h>
+
+#include <cmath>
+#include <cstdio>
+
+#include "host_clock.h"
+#include "n2k_socketcan.h"
+
+using namespace halmet;
+
+namespace {
+
+// Transmit intervals of the periodic PGNs, as in the firmware senders
+const uint32_t kEngineRapidInterval = 100;     // ms
+const uint32_t kEngineDynamicInterval = 500;   // ms
+const uint32_t kFluidLevelInterval = 2500;     // ms
+
+struct PeriodicPGN {
+  uint32_t interval;
+  uint32_t next;
+  void (*build)(tN2kMsg& msg, float t);
+};
+
+void BuildEngineRapid(tN2kMsg& msg, float t) {
+  SetN2kEngineParamRapid(msg, 0, 1500 + 500 * sinf(t / 10), N2kDoubleNA,
+                         N2kInt8NA);
+}
+
+void BuildEngineDynamic(tN2kMsg& msg, float t) {
+  tN2kEngineDiscreteStatus1 status_1;
+  tN2kEngineDiscreteStatus2 status_2;
+  SetN2kEngineDynamicParam(msg, 0, N2kDoubleNA, N2kDoubleNA, N2kDoubleNA,
+                           N2kDoubleNA, N2kDoubleNA, t / 3600, N2kDoubleNA,
+                           N2kDoubleNA, N2kInt8NA, N2kInt8NA, status_1,
+                           status_2);
+}
+
+void BuildFluidLevel(tN2kMsg& msg, float t) {
+  SetN2kFluidLevel(msg, 0, N2kft_Fuel, 50 + 40 * cosf(t / 100), 200);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const char* interface_name = argc > 1 ? argv[1] : "vcan0";
+  auto nmea2000 = new N2kSocketCAN(interface_name);
+
+  nmea2000->SetN2kCANSendFrameBufSize(250);
+  nmea2000->SetN2kCANReceiveFrameBufSize(250);
+  nmea2000->SetProductInformation("20231229", 104, "HALMET host", "1.0.0",
+                                  "1.0.0");
+  nmea2000->SetDeviceInformation(1, 140, 50, 2046);
+  nmea2000->SetMode(tNMEA2000::N2km_NodeOnly, 71);
+  nmea2000->EnableForward(false);
+  if (!nmea2000->Open()) {
+    fprintf(stderr, "Cannot open %s\n", interface_name);
+    return 1;
+  }
+
+  uint32_t start = millis();
+  PeriodicPGN pgns[] = {
+      {kEngineRapidInterval, start, BuildEngineRapid},
+      {kEngineDynamicInterval, start, BuildEngineDynamic},
+      {kFluidLevelInterval, start, BuildFluidLevel},
+  };
+  uint32_t send_failures = 0;
+  tN2kMsg msg;
+
+  while (true) {
+    nmea2000->ParseMessages();
+    uint32_t now = millis();
+    for (auto& pgn : pgns) {
+      if ((int32_t)(now - pgn.next) < 0) {
+        continue;
+      }
+      // Keep a fixed schedule instead of drifting with late loop iterations
+      pgn.next += pgn.interval;
+      pgn.build(msg, (now - start) / 1000.0f);
+      if (!nmea2000->SendMsg(msg)) {
+        send_failures++;
+        fprintf(stderr, "Send of PGN %lu failed (%u failures)\n", msg.PGN,
+                send_failures);
+      }
+    }
+    delay(1);
+  }
+}
+
+#endif  // HALMET_N2K_HOST
@@ -0,0 +1,59 @@
+#include "n2k_msg_template.h"
+
+#include <cstring>
+
+#ifdef ARDUINO
+#include "sensesp_base_app.h"
+#else
+// Host build, see src/n2k_template_bench_main.cpp
+#include <cstdio>
+#define debugE(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#endif
+
+namespace halmet {
+
+bool N2kMsgTemplate::matches(const tN2kMsg& other) const {
+  return msg_.PGN == other.PGN && msg_.DataLen == other.DataLen &&
+         memcmp(msg_.Data, other.Data, msg_.DataLen) == 0;
+}
+
+bool N2kMsgTemplate::check_layouts() {
+  // Enable patching for the duration of the check
+  layouts_ok_ = true;
+
+  const float na = N2kNumericNA<float>();
+  tN2kMsg reference;
+  bool ok = true;
+
+  // Each message is encoded with "not available" values, then patched with
+  // test values away from rounding boundaries and compared with the library
+  // encoding of the same values.
+  N2kMsgTemplate rapid;
+  rapid.set_engine_param_rapid<float>(0, na, na, N2kInt8NA);
+  rapid.set_engine_param_rapid<float>(1, 1234.5, 150000, -3);
+  SetN2kEngineParamRapid(reference, 1, 1234.5, 150000, -3);
+  ok = ok && rapid.matches(reference);
+
+  N2kMsgTemplate dynamic;
+  dynamic.set_engine_dynamic_param<float>(0, na, na, na, na, na, N2kUInt32NA,
+                                          na, na, N2kInt8NA, N2kInt8NA, 0, 0);
+  dynamic.set_engine_dynamic_param<float>(1, 350000, 363.2, 355.5, 13.8, 12.3,
+                                          3600000, 120000, 400000, 45, -30,
+                                          0x0005, 0x0081);
+  SetN2kEngineDynamicParam(reference, 1, 350000, 363.2, 355.5, 13.8, 12.3,
+                           3600000, 120000, 400000, 45, -30, 0x0005, 0x0081);
+  ok = ok && dynamic.matches(reference);
+
+  N2kMsgTemplate fluid;
+  fluid.set_fluid_level<float>(0, N2kft_Water, na, na);
+  fluid.set_fluid_level<float>(3, N2kft_Fuel, 62.5, 200);
+  SetN2kFluidLevel(reference, 3, N2kft_Fuel, 62.5, 200);
+  ok = ok && fluid.matches(reference);
+
+  if (!ok) {
+    debugE("N2k message templates don't match the library; patching disabled");
+  }
+  return ok;
+}
+
+}  // namespace halmet
@@ -0,0 +1,175 @@
+#ifndef HALMET_SRC_N2K_MSG_TEMPLATE_H_
+#define HALMET_SRC_N2K_MSG_TEMPLATE_H_
+
+#include <N2kMessages.h>
+#include <N2kMsg.h>
+
+#include <cmath>
+
+namespace halmet {
+
+/**
+ * @brief "Not available" value of the numeric type T.
+ *
+ * N2kDoubleNA (-1e9) is exactly representable both as a float and as an
+ * int32_t, so it survives the conversion to double in the N2k encoders.
+ */
+template <typename T>
+constexpr T N2kNumericNA() {
+  return static_cast<T>(N2kDoubleNA);
+}
+
+/**
+ * @brief Periodic message that is encoded once and then patched in place.
+ *
+ * The first call to a setter encodes the whole message with the library
+ * encoder. Later calls only rewrite the bytes of the individual fields, in
+ * single precision but with the same scaling, rounding and range handling
+ * as the library. The message buffer is persistent, so it can be handed to
+ * the CAN driver or N2kTxQueue::send_in_place() as is.
+ *
+ * The field offsets are checked once against the library encoders. If they
+ * don't match, every call falls back to a full encode.
+ */
+class N2kMsgTemplate {
+ public:
+  const tN2kMsg& msg() const { return msg_; }
+
+  /// PGN 127488, see SetN2kEngineParamRapid()
+  template <typename T>
+  void set_engine_param_rapid(uint8_t instance, T engine_speed,
+                              T boost_pressure, int8_t tilt_trim) {
+    if (!can_patch(127488L)) {
+      SetN2kEngineParamRapid(msg_, instance, engine_speed, boost_pressure,
+                             tilt_trim);
+      return;
+    }
+    set_byte(0, instance);
+    set_2byte_udouble(1, engine_speed, 0.25);
+    set_2byte_udouble(3, boost_pressure, 100);
+    set_byte(5, tilt_trim);
+  }
+
+  /// PGN 127489, see SetN2kEngineDynamicParam()
+  template <typename T>
+  void set_engine_dynamic_param(uint8_t instance, T oil_pressure,
+                                T oil_temperature, T coolant_temperature,
+                                T alternator_potential, T fuel_rate,
+                                uint32_t engine_hours, T coolant_pressure,
+                                T fuel_pressure, int8_t engine_load,
+                                int8_t engine_torque,
+                                tN2kEngineDiscreteStatus1 status_1,
+                                tN2kEngineDiscreteStatus2 status_2) {
+    if (!can_patch(127489L)) {
+      SetN2kEngineDynamicParam(
+          msg_, instance, oil_pressure, oil_temperature, coolant_temperature,
+          alternator_potential, fuel_rate, engine_hours, coolant_pressure,
+          fuel_pressure, engine_load, engine_torque, status_1, status_2);
+      return;
+    }
+    set_byte(0, instance);
+    set_2byte_udouble(1, oil_pressure, 100);
+    set_2byte_udouble(3, oil_temperature, 0.1);
+    set_2byte_udouble(5, coolant_temperature, 0.01);
+    set_2byte_double(7, alternator_potential, 0.01);
+    set_2byte_double(9, fuel_rate, 0.1);
+    set_uint32(11, engine_hours < kUInt32OutOfRange ? engine_hours
+                                                    : kUInt32OutOfRange);
+    set_2byte_udouble(15, coolant_pressure, 100);
+    set_2byte_udouble(17, fuel_pressure, 1000);
+    set_uint16(20, status_1.Status);
+    set_uint16(22, status_2.Status);
+    set_byte(24, engine_load);
+    set_byte(25, engine_torque);
+  }
+
+  /// PGN 127505, see SetN2kFluidLevel()
+  template <typename T>
+  void set_fluid_level(uint8_t instance, tN2kFluidType fluid_type, T level,
+                       T capacity) {
+    if (!can_patch(127505L)) {
+      SetN2kFluidLevel(msg_, instance, fluid_type, level, capacity);
+      return;
+    }
+    set_byte(0, (instance & 0x0f) | ((fluid_type & 0x0f) << 4));
+    set_2byte_double(1, level, 0.004);
+    set_4byte_udouble(3, capacity, 0.1);
+  }
+
+  /// True if the PGN, length and payload equal those of `other`.
+  bool matches(const tN2kMsg& other) const;
+
+ protected:
+  static constexpr uint16_t kUInt16OutOfRange = 0xfffe;
+  static constexpr int16_t kInt16OutOfRange = 0x7ffe;
+  static constexpr uint32_t kUInt32OutOfRange = 0xfffffffe;
+
+  bool can_patch(unsigned long pgn) {
+    if (layouts_checked_ == false) {
+      layouts_checked_ = true;
+      layouts_ok_ = check_layouts();
+    }
+    return layouts_ok_ && msg_.PGN == pgn;
+  }
+
+  /// Compare patched messages against the library encoders.
+  static bool check_layouts();
+
+  void set_byte(int index, uint8_t value) { msg_.Data[index] = value; }
+
+  void set_uint16(int index, uint16_t value) {
+    msg_.Data[index] = value;
+    msg_.Data[index + 1] = value >> 8;
+  }
+
+  void set_uint32(int index, uint32_t value) {
+    set_uint16(index, value);
+    set_uint16(index + 2, value >> 16);
+  }
+
+  template <typename T>
+  void set_2byte_udouble(int index, T value, float precision) {
+    if (value == N2kNumericNA<T>()) {
+      set_uint16(index, N2kUInt16NA);
+      return;
+    }
+    float scaled = roundf(value / precision);
+    set_uint16(index, scaled >= 0 && scaled < kUInt16OutOfRange
+                          ? (uint16_t)scaled
+                          : kUInt16OutOfRange);
+  }
+
+  template <typename T>
+  void set_2byte_double(int index, T value, float precision) {
+    if (value == N2kNumericNA<T>()) {
+      set_uint16(index, N2kInt16NA);
+      return;
+    }
+    float scaled = roundf(value / precision);
+    set_uint16(index, scaled >= -32768 && scaled < kInt16OutOfRange
+                          ? (int16_t)scaled
+                          : kInt16OutOfRange);
+  }
+
+  template <typename T>
+  void set_4byte_udouble(int index, T value, float precision) {
+    if (value == N2kNumericNA<T>()) {
+      set_uint32(index, N2kUInt32NA);
+      return;
+    }
+    float scaled = roundf(value / precision);
+    // 0xfffffffe isn't representable as a float; compare against 2^32
+    set_uint32(index, scaled >= 0 && scaled < 4294967296.f
+                          ? std::min<uint32_t>(scaled, kUInt32OutOfRange)
+                          : kUInt32OutOfRange);
+  }
+
+  tN2kMsg msg_;
+
+  static inline bool layouts_checked_ = false;
+  static inline bool layouts_ok_ = false;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_MSG_TEMPLATE_H_
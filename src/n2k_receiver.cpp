@@ -0,0 +1,100 @@
+#include "n2k_receiver.h"
+
+#include <algorithm>
+
+#include "rt_event_loop.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+N2kReceiver::N2kReceiver(const String& config_path)
+    : BlobSaveable{config_path}, table_{deliver, this} {
+  load();
+
+  // Subscription indexes follow the order of the valid fields
+  std::vector<Field> fields;
+  for (const auto& field : fields_) {
+    if (field.pgn < 0 || field.source < 0 || field.source > 255 ||
+        field.instance < 0 || field.instance > 255 ||
+        table_.subscribe(field.pgn, field.source, field.instance,
+                         field.field.c_str()) < 0) {
+      debugE("N2k receiver: can't receive PGN %d field %s", field.pgn,
+             field.field.c_str());
+      continue;
+    }
+    fields.push_back(field);
+    outputs_.push_back(new sensesp::ObservableValue<float>());
+    if (std::find(receive_messages_.begin(), receive_messages_.end(),
+                  (unsigned long)field.pgn) == receive_messages_.end()) {
+      receive_messages_.push_back(field.pgn);
+    }
+  }
+  fields_ = fields;
+  receive_messages_.push_back(0);
+
+  rt_event_loop()->onRepeat(kReportInterval, [this]() { report(); });
+}
+
+void N2kReceiver::handle(const tN2kMsg& msg) {
+  received_count_++;
+  decoded_count_ += table_.dispatch(msg.PGN, msg.Source, msg.Data,
+                                    msg.DataLen);
+}
+
+void N2kReceiver::deliver(void* context, int subscription, float value) {
+  static_cast<N2kReceiver*>(context)->outputs_[subscription]->set(value);
+}
+
+void N2kReceiver::report() {
+  received_.set(received_count_);
+  decoded_.set(decoded_count_);
+  received_count_ = 0;
+  decoded_count_ = 0;
+}
+
+bool N2kReceiver::to_json(JsonObject& config) {
+  JsonArray fields = config["fields"].to<JsonArray>();
+  for (const auto& field : fields_) {
+    JsonObject obj = fields.add<JsonObject>();
+    obj["pgn"] = field.pgn;
+    obj["source"] = field.source;
+    obj["instance"] = field.instance;
+    obj["field"] = field.field;
+    obj["sk_path"] = field.sk_path;
+  }
+  return true;
+}
+
+bool N2kReceiver::from_json(const JsonObject& config) {
+  if (!config["fields"].is<JsonArray>()) {
+    return false;
+  }
+  fields_.clear();
+  JsonArray fields = config["fields"];
+  for (JsonVariant obj : fields) {
+    fields_.push_back({obj["pgn"] | 0, obj["source"] | 255,
+                       obj["instance"] | 255, obj["field"] | "",
+                       obj["sk_path"] | ""});
+  }
+  return true;
+}
+
+const String ConfigSchema(const N2kReceiver& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "fields": { "title": "Received fields", "type": "array", "maxItems": 64, "items": {
+        "type": "object",
+        "properties": {
+          "pgn": { "title": "PGN", "type": "integer", "enum": [127250, 127257, 127488, 127489, 127506, 127508, 130312], "description": "127250: heading, 127257: attitude, 127488: engine rapid, 127489: engine dynamic, 127506: DC detailed status, 127508: battery status, 130312: temperature" },
+          "source": { "title": "Source address (255: any)", "type": "integer", "minimum": 0, "maximum": 255 },
+          "instance": { "title": "Instance (255: any)", "type": "integer", "minimum": 0, "maximum": 255, "description": "Engine, battery, DC or temperature instance; ignored for heading and attitude" },
+          "field": { "title": "Field", "type": "string", "description": "127250: heading, deviation, variation; 127257: yaw, pitch, roll; 127488: speed, boostPressure; 127489: oilPressure, oilTemperature, temperature, alternatorVoltage, fuelRate, runTime, coolantPressure, fuelPressure; 127506: stateOfCharge, stateOfHealth, timeRemaining, rippleVoltage; 127508: voltage, current, temperature; 130312: actual, set" },
+          "sk_path": { "title": "Signal K path", "type": "string", "description": "Values are in SI units, e.g. propulsion.port.temperature" }
+        }
+      }}
+    }
+  })###";
+}
+
+}  // namespace halmet
@@ -0,0 +1,85 @@
+#ifndef HALMET_SRC_N2K_RECEIVER_H_
+#define HALMET_SRC_N2K_RECEIVER_H_
+
+#include <N2kMsg.h>
+
+#include <vector>
+
+#include "config_blob_store.h"
+#include "n2k_rx_table.h"
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/**
+ * @brief Gateway of received NMEA 2000 values into the sensor pipeline.
+ *
+ * The configuration lists the fields to receive, each with a PGN, an
+ * optional source address and instance, and a Signal K path. Each field
+ * gets an ObservableValue<float> that emits the decoded value, in SI units,
+ * on rt_event_loop(), so that received values can be transformed, logged
+ * and published like local inputs.
+ *
+ * Call handle() for every received message. The fields are looked up in an
+ * N2kRxTable: a message nobody subscribed to costs two hash table lookups
+ * and no decoding.
+ */
+class N2kReceiver : public BlobSaveable {
+ public:
+  /// How often the message counters are updated, in ms
+  static constexpr unsigned int kReportInterval = 1000;
+
+  struct Field {
+    int pgn;
+    int source;    // 255: any
+    int instance;  // 255: any
+    String field;  // e.g. "temperature"; see N2kPGNDefs()
+    String sk_path;
+  };
+
+  N2kReceiver(const String& config_path);
+
+  /// Decode a received message. Call from the NMEA 2000 message handler.
+  void handle(const tN2kMsg& msg);
+
+  /// The valid configured fields
+  const std::vector<Field>& fields() const { return fields_; }
+  /// The values of fields()[index]
+  sensesp::ObservableValue<float>* output(int index) {
+    return outputs_[index];
+  }
+
+  /// Zero-terminated list of the received PGNs, for
+  /// tNMEA2000::ExtendReceiveMessages()
+  const unsigned long* receive_messages() const {
+    return receive_messages_.data();
+  }
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  /// Messages received, per kReportInterval
+  sensesp::ObservableValue<int> received_{0};
+  /// Field values decoded, per kReportInterval
+  sensesp::ObservableValue<int> decoded_{0};
+
+ protected:
+  static void deliver(void* context, int subscription, float value);
+  void report();
+
+  std::vector<Field> fields_;
+  N2kRxTable table_;
+  std::vector<sensesp::ObservableValue<float>*> outputs_;
+  std::vector<unsigned long> receive_messages_;
+  // Owned by rt_event_loop()
+  uint32_t received_count_ = 0;
+  uint32_t decoded_count_ = 0;
+};
+
+const String ConfigSchema(const N2kReceiver& obj);
+
+inline bool ConfigRequiresRestart(const N2kReceiver& obj) { return true; }
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_RECEIVER_H_
@@ -0,0 +1,71 @@
+#include "n2k_request_responder.h"
+
+#include <algorithm>
+
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+N2kRequestResponder* N2kRequestResponder::instance_ = nullptr;
+
+N2kRequestResponder::N2kRequestResponder(tNMEA2000* nmea2000,
+                                         N2kTxQueue* tx_queue)
+    : tx_queue_{tx_queue} {
+  instance_ = this;
+  nmea2000->SetISORqstHandler(handle_request);
+}
+
+bool N2kRequestResponder::handle_request(unsigned long pgn,
+                                         unsigned char requester,
+                                         int device_index) {
+  return instance_ != nullptr && instance_->respond(pgn, requester);
+}
+
+bool N2kRequestResponder::respond(unsigned long pgn, uint8_t requester) {
+  if (!tx_queue_->has_cached(pgn, kMaxAge)) {
+    return false;
+  }
+  if (!take_token(requester)) {
+    rate_limited_.set(rate_limited_.get() + 1);
+    return true;
+  }
+  tx_queue_->resend(pgn, kMaxAge);
+  responses_.set(responses_.get() + 1);
+  return true;
+}
+
+bool N2kRequestResponder::take_token(uint8_t address) {
+  uint32_t now = millis();
+  Requester* entry = nullptr;
+  Requester* oldest = &requesters_[0];
+  for (auto& r : requesters_) {
+    if (r.address == address) {
+      entry = &r;
+      break;
+    }
+    if (now - r.last_seen > now - oldest->last_seen) {
+      oldest = &r;
+    }
+  }
+  if (entry == nullptr) {
+    // A new requester starts with a full bucket
+    entry = oldest;
+    entry->address = address;
+    entry->tokens = kBurst;
+    entry->last_refill = now;
+  }
+  entry->last_seen = now;
+
+  uint32_t earned = (now - entry->last_refill) / kRefillInterval;
+  if (earned > 0) {
+    entry->tokens = std::min<uint32_t>(kBurst, entry->tokens + earned);
+    entry->last_refill += earned * kRefillInterval;
+  }
+  if (entry->tokens == 0) {
+    return false;
+  }
+  entry->tokens--;
+  return true;
+}
+
+}  // namespace halmet
@@ -0,0 +1,69 @@
+#ifndef HALMET_SRC_N2K_REQUEST_RESPONDER_H_
+#define HALMET_SRC_N2K_REQUEST_RESPONDER_H_
+
+#include <NMEA2000.h>
+
+#include "n2k_tx_queue.h"
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/**
+ * @brief Answer NMEA 2000 ISO Requests (PGN 59904) from the transmit cache.
+ *
+ * A requested periodic PGN is answered at once with the latest message of
+ * each of its instances held by N2kTxQueue, as it was last encoded; an ISO
+ * Request can't name an instance. Nothing is encoded for the reply, and it
+ * goes out on the same freshest-data-wins path as the periodic messages.
+ *
+ * Each requester has a token bucket of kBurst replies, refilled at one
+ * reply per kRefillInterval, so a device polling in a tight loop can't
+ * take over the bus. Requests over the limit are dropped silently rather
+ * than answered with a NAK, which would tell the requester that the PGN
+ * isn't supported. PGNs that aren't cached, or whose messages are older
+ * than kMaxAge, are NAKed by the library.
+ *
+ * Product and configuration information, heartbeat and the PGN list are
+ * answered by the library itself.
+ */
+class N2kRequestResponder {
+ public:
+  /// Replies a requester may get in a burst
+  static constexpr int kBurst = 4;
+  /// Time to earn one more reply, in ms
+  static constexpr uint32_t kRefillInterval = 250;
+  /// Cached messages older than this are not sent, in ms
+  static constexpr uint32_t kMaxAge = 5000;
+  /// Requesters tracked; the least recently seen one is replaced
+  static constexpr int kMaxRequesters = 8;
+
+  /// Installs the library ISO Request handler. Only one instance may exist.
+  N2kRequestResponder(tNMEA2000* nmea2000, N2kTxQueue* tx_queue);
+
+  /// Requests answered from the cache
+  sensesp::ObservableValue<int> responses_{0};
+  /// Requests dropped by the rate limit
+  sensesp::ObservableValue<int> rate_limited_{0};
+
+ protected:
+  struct Requester {
+    uint8_t address = 0xff;
+    uint8_t tokens = 0;
+    uint32_t last_refill = 0;
+    uint32_t last_seen = 0;
+  };
+
+  static bool handle_request(unsigned long pgn, unsigned char requester,
+                             int device_index);
+  bool respond(unsigned long pgn, uint8_t requester);
+  bool take_token(uint8_t address);
+
+  static N2kRequestResponder* instance_;
+
+  N2kTxQueue* tx_queue_;
+  Requester requesters_[kMaxRequesters];
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_REQUEST_RESPONDER_H_
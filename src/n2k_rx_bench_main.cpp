@@ -0,0 +1,280 @@
+// Host benchmark of the NMEA 2000 receive dispatch.
+//
+// Replays the received messages of an input trace through N2kRxTable and
+// through a linear scan of the same subscriptions, the way a chain of
+// per-PGN message handlers would see them, and reports the mean dispatch
+// time per message and the heap allocations during dispatch. Without a
+// trace file, a synthetic one-minute high-load bus (about 1100 messages/s
+// from 26 devices) is used. Build and run with:
+//
+//   pio run -e native_n2k_rx_bench
+//   .pio/build/native_n2k_rx_bench/program [trace.htrc]
+//
+// Traces are recorded on the device with the Input Trace in capture mode;
+// see src/input_trace.h. The dispatch results and the absence of
+// allocations are checked by test/test_n2k_rx_table.
+
+#ifdef HALMET_N2K_RX_BENCH
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "host_alloc_count.h"
+#include "n2k_rx_table.h"
+
+using namespace halmet;
+
+namespace {
+
+struct Message {
+  uint32_t pgn;
+  uint8_t source;
+  uint8_t len;
+  uint8_t data[223];
+};
+
+struct Subscription {
+  uint32_t pgn;
+  uint8_t source;
+  uint8_t instance;
+  const char* field;
+};
+
+// A typical gateway configuration: two engines, three batteries, attitude
+// and heading, some of them bound to a specific source
+const Subscription kSubscriptions[] = {
+    {127488, 0xff, 0, "speed"},
+    {127488, 0xff, 1, "speed"},
+    {127489, 0xff, 0, "runTime"},
+    {127489, 0xff, 0, "temperature"},
+    {127489, 0xff, 0, "oilPressure"},
+    {127489, 0xff, 1, "runTime"},
+    {127489, 0xff, 1, "temperature"},
+    {127489, 0xff, 1, "oilPressure"},
+    {127508, 0xff, 0, "voltage"},
+    {127508, 0xff, 0, "current"},
+    {127508, 0xff, 1, "voltage"},
+    {127508, 0xff, 2, "voltage"},
+    {127506, 0xff, 0, "stateOfCharge"},
+    {127257, 0xff, 0xff, "pitch"},
+    {127257, 0xff, 0xff, "roll"},
+    {127250, 17, 0xff, "heading"},
+    {130312, 0xff, 3, "actual"},
+};
+const int kNumSubscriptions =
+    sizeof(kSubscriptions) / sizeof(kSubscriptions[0]);
+
+/////////////////////////////////////////////////////////////////////
+// Traces
+
+uint32_t ReadVarint(const std::vector<uint8_t>& buf, size_t* pos) {
+  uint32_t result = 0;
+  int shift = 0;
+  while (*pos < buf.size()) {
+    uint8_t byte = buf[(*pos)++];
+    result |= (uint32_t)(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+    shift += 7;
+  }
+  return result;
+}
+
+// The received CAN records of an input trace
+bool LoadTrace(const char* path, std::vector<Message>* messages) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  std::vector<uint8_t> buf;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    buf.insert(buf.end(), chunk, chunk + n);
+  }
+  fclose(file);
+  if (buf.size() < 5 || memcmp(buf.data(), "HTRC", 4) != 0) {
+    return false;
+  }
+
+  size_t pos = 5;
+  while (pos < buf.size()) {
+    ReadVarint(buf, &pos);  // Time delta
+    uint8_t type = buf[pos++];
+    if (type == 1) {  // ADC
+      pos += 2;
+      ReadVarint(buf, &pos);
+    } else if (type == 2) {  // Counter
+      pos += 1;
+      ReadVarint(buf, &pos);
+    } else if (type == 3 || type == 4) {  // CAN transmitted, received
+      Message msg = {};
+      msg.pgn = ReadVarint(buf, &pos);
+      msg.source = buf[pos + 1];
+      pos += 3;
+      uint32_t len = ReadVarint(buf, &pos);
+      if (pos + len > buf.size() || len > sizeof(msg.data)) {
+        return false;
+      }
+      msg.len = len;
+      memcpy(msg.data, &buf[pos], len);
+      pos += len;
+      if (type == 4) {
+        messages->push_back(msg);
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// One minute of a busy bus: per device, a PGN at its usual interval
+void SynthesizeTrace(std::vector<Message>* messages) {
+  struct Source {
+    uint32_t pgn;
+    uint8_t source;
+    uint8_t instance_offset;
+    uint8_t instance;
+    uint8_t len;
+    uint32_t interval;  // ms
+  };
+  std::vector<Source> sources = {
+      {127488, 30, 0, 0, 8, 100},   {127488, 31, 0, 1, 8, 100},
+      {127489, 30, 0, 0, 26, 500},  {127489, 31, 0, 1, 26, 500},
+      {127508, 40, 0, 0, 8, 1500},  {127508, 41, 0, 1, 8, 1500},
+      {127508, 42, 0, 2, 8, 1500},  {127506, 40, 1, 0, 9, 1500},
+      {127257, 17, 0xff, 0, 8, 100}, {127250, 17, 0xff, 0, 8, 100},
+      {127250, 18, 0xff, 0, 8, 100}, {130312, 50, 1, 3, 8, 2000},
+  };
+  // Traffic nobody subscribes to: GNSS, wind, speed, rudder, AIS...
+  const uint32_t kOtherPGNs[] = {129025, 129026, 130306, 128259, 127245,
+                                 128267, 129029, 129039, 127251, 130310,
+                                 129283, 129284, 126992, 127258, 130577,
+                                 129038, 127237, 128275};
+  for (int i = 0; i < 18; i++) {
+    uint32_t pgn = kOtherPGNs[i];
+    uint8_t len = pgn == 129029 || pgn >= 129038 ? 43 : 8;
+    sources.push_back({pgn, (uint8_t)(60 + i), 0xff, 0, len,
+                       (uint32_t)(i % 2 == 0 ? 10 : 50)});
+  }
+
+  srand(1);
+  for (uint32_t t = 0; t < 60000; t++) {
+    for (const Source& s : sources) {
+      if (t % s.interval != 0) {
+        continue;
+      }
+      Message msg = {};
+      msg.pgn = s.pgn;
+      msg.source = s.source;
+      msg.len = s.len;
+      for (int i = 0; i < s.len; i++) {
+        msg.data[i] = rand();
+      }
+      if (s.instance_offset != 0xff) {
+        msg.data[s.instance_offset] = s.instance;
+      }
+      messages->push_back(msg);
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////
+// Dispatch
+
+float sink_sum = 0;
+int sink_count = 0;
+
+void Sink(void* context, int subscription, float value) {
+  sink_sum += value;
+  sink_count++;
+}
+
+// Baseline: every subscription is checked for every message, and matching
+// messages are decoded once per subscription, like a list of handlers
+struct LinearSubscription {
+  N2kRxTable* decoder;  // Table with only this subscription
+  uint32_t pgn;
+  uint8_t source;
+};
+
+double TimeDispatch(const std::vector<Message>& messages, int rounds,
+                    bool linear, N2kRxTable* table,
+                    const std::vector<LinearSubscription>& linear_subs,
+                    size_t* allocs) {
+  size_t allocs_before = HostAllocations();
+  clock_t start = clock();
+  for (int r = 0; r < rounds; r++) {
+    for (const Message& msg : messages) {
+      if (!linear) {
+        table->dispatch(msg.pgn, msg.source, msg.data, msg.len);
+        continue;
+      }
+      for (const LinearSubscription& sub : linear_subs) {
+        if (sub.pgn == msg.pgn &&
+            (sub.source == N2kRxTable::kAnySource ||
+             sub.source == msg.source)) {
+          sub.decoder->dispatch(msg.pgn, msg.source, msg.data, msg.len);
+        }
+      }
+    }
+  }
+  double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+  *allocs = HostAllocations() - allocs_before;
+  return elapsed * 1e9 / ((double)rounds * messages.size());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<Message> messages;
+  if (argc > 1) {
+    if (!LoadTrace(argv[1], &messages)) {
+      fprintf(stderr, "Can't read trace %s\n", argv[1]);
+      return 1;
+    }
+    printf("Trace %s: %zu received messages\n", argv[1], messages.size());
+  } else {
+    SynthesizeTrace(&messages);
+    printf("Synthetic trace: %zu messages in 60 s\n", messages.size());
+  }
+  if (messages.empty()) {
+    return 1;
+  }
+
+  N2kRxTable table(Sink, nullptr);
+  std::vector<LinearSubscription> linear_subs;
+  for (const Subscription& s : kSubscriptions) {
+    if (table.subscribe(s.pgn, s.source, s.instance, s.field) < 0) {
+      fprintf(stderr, "Can't subscribe to %u %s\n", s.pgn, s.field);
+      return 1;
+    }
+    auto decoder = new N2kRxTable(Sink, nullptr);
+    decoder->subscribe(s.pgn, s.source, s.instance, s.field);
+    linear_subs.push_back({decoder, s.pgn, s.source});
+  }
+
+  sink_count = 0;
+  size_t allocs;
+  TimeDispatch(messages, 1, false, &table, linear_subs, &allocs);
+  printf("%d subscriptions, %d values decoded\n\n", kNumSubscriptions,
+         sink_count);
+
+  const int kRounds = 20;
+  size_t table_allocs, linear_allocs;
+  double table_ns = TimeDispatch(messages, kRounds, false, &table,
+                                 linear_subs, &table_allocs);
+  double linear_ns = TimeDispatch(messages, kRounds, true, &table,
+                                  linear_subs, &linear_allocs);
+  printf("%-14s %12s %12s\n", "dispatch", "ns/message", "allocations");
+  printf("%-14s %12.1f %12zu\n", "hash table", table_ns, table_allocs);
+  printf("%-14s %12.1f %12zu\n", "linear scan", linear_ns, linear_allocs);
+  return 0;
+}
+
+#endif  // HALMET_N2K_RX_BENCH
@@ -0,0 +1,225 @@
+#include "n2k_rx_table.h"
+
+#include <cstring>
+
+namespace halmet {
+
+namespace {
+
+using T = N2kFieldType;
+
+// Field layouts as in the NMEA2000 library's N2kMessages.cpp. Scales convert
+// to the Signal K (SI) units.
+
+const N2kFieldDef kEngineRapidFields[] = {
+    {"speed", 1, T::kUInt16, 0.25f / 60},  // Hz
+    {"boostPressure", 3, T::kUInt16, 100},  // Pa
+};
+
+const N2kFieldDef kEngineDynamicFields[] = {
+    {"oilPressure", 1, T::kUInt16, 100},           // Pa
+    {"oilTemperature", 3, T::kUInt16, 0.1},        // K
+    {"temperature", 5, T::kUInt16, 0.01},          // K
+    {"alternatorVoltage", 7, T::kInt16, 0.01},     // V
+    {"fuelRate", 9, T::kInt16, 0.1f / 3600000},    // m3/s
+    {"runTime", 11, T::kUInt32, 1},                // s
+    {"coolantPressure", 15, T::kUInt16, 100},      // Pa
+    {"fuelPressure", 17, T::kUInt16, 1000},        // Pa
+};
+
+const N2kFieldDef kBatteryStatusFields[] = {
+    {"voltage", 1, T::kInt16, 0.01},      // V
+    {"current", 3, T::kInt16, 0.1},       // A
+    {"temperature", 5, T::kUInt16, 0.01},  // K
+};
+
+const N2kFieldDef kDCDetailedStatusFields[] = {
+    {"stateOfCharge", 3, T::kUInt8, 0.01},      // ratio
+    {"stateOfHealth", 4, T::kUInt8, 0.01},      // ratio
+    {"timeRemaining", 5, T::kUInt16, 60},       // s
+    {"rippleVoltage", 7, T::kUInt16, 0.001},    // V
+};
+
+const N2kFieldDef kHeadingFields[] = {
+    {"heading", 1, T::kUInt16, 0.0001},    // rad
+    {"deviation", 3, T::kInt16, 0.0001},   // rad
+    {"variation", 5, T::kInt16, 0.0001},   // rad
+};
+
+const N2kFieldDef kAttitudeFields[] = {
+    {"yaw", 1, T::kInt16, 0.0001},    // rad
+    {"pitch", 3, T::kInt16, 0.0001},  // rad
+    {"roll", 5, T::kInt16, 0.0001},   // rad
+};
+
+const N2kFieldDef kTemperatureFields[] = {
+    {"actual", 3, T::kUInt16, 0.01},  // K
+    {"set", 5, T::kUInt16, 0.01},     // K
+};
+
+#define FIELDS(fields) fields, sizeof(fields) / sizeof(fields[0])
+
+const N2kPGNDef kPGNDefs[] = {
+    {127250, "Vessel Heading", N2kPGNDef::kNoInstance, FIELDS(kHeadingFields)},
+    {127257, "Attitude", N2kPGNDef::kNoInstance, FIELDS(kAttitudeFields)},
+    {127488, "Engine Parameters, Rapid Update", 0,
+     FIELDS(kEngineRapidFields)},
+    {127489, "Engine Parameters, Dynamic", 0, FIELDS(kEngineDynamicFields)},
+    {127506, "DC Detailed Status", 1, FIELDS(kDCDetailedStatusFields)},
+    {127508, "Battery Status", 0, FIELDS(kBatteryStatusFields)},
+    {130312, "Temperature", 1, FIELDS(kTemperatureFields)},
+};
+
+#undef FIELDS
+
+const int kNumPGNDefs = sizeof(kPGNDefs) / sizeof(kPGNDefs[0]);
+
+// Decode a field. Returns false if it's missing or "not available".
+bool DecodeField(const N2kFieldDef& field, const uint8_t* data, size_t len,
+                 float* value) {
+  const uint8_t* p = data + field.offset;
+  switch (field.type) {
+    case T::kUInt8:
+      if (field.offset + 1u > len || p[0] == 0xff) {
+        return false;
+      }
+      *value = p[0] * field.scale;
+      return true;
+    case T::kUInt16: {
+      if (field.offset + 2u > len) {
+        return false;
+      }
+      uint16_t raw = p[0] | p[1] << 8;
+      if (raw == 0xffff) {
+        return false;
+      }
+      *value = raw * field.scale;
+      return true;
+    }
+    case T::kInt16: {
+      if (field.offset + 2u > len) {
+        return false;
+      }
+      int16_t raw = (int16_t)(p[0] | p[1] << 8);
+      if (raw == 0x7fff) {
+        return false;
+      }
+      *value = raw * field.scale;
+      return true;
+    }
+    case T::kUInt32: {
+      if (field.offset + 4u > len) {
+        return false;
+      }
+      uint32_t raw = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+      if (raw == 0xffffffff) {
+        return false;
+      }
+      *value = raw * field.scale;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+const N2kPGNDef* FindN2kPGNDef(uint32_t pgn) {
+  for (const N2kPGNDef& def : kPGNDefs) {
+    if (def.pgn == pgn) {
+      return &def;
+    }
+  }
+  return nullptr;
+}
+
+const N2kPGNDef* N2kPGNDefs(int* count) {
+  *count = kNumPGNDefs;
+  return kPGNDefs;
+}
+
+N2kRxTable::N2kRxTable(Sink sink, void* context)
+    : sink_{sink}, context_{context} {
+  for (Slot& slot : slots_) {
+    slot = {0, -1};
+  }
+}
+
+int N2kRxTable::find_slot(uint32_t key) const {
+  // Fibonacci hashing, then linear probing
+  uint32_t index = (key * 2654435769u) >> 25;
+  static_assert(kTableSize == 1 << 7, "The shift assumes 128 slots");
+  for (int i = 0; i < kTableSize; i++) {
+    const Slot& slot = slots_[index];
+    if (slot.first < 0 || slot.key == key) {
+      return index;
+    }
+    index = (index + 1) % kTableSize;
+  }
+  return -1;
+}
+
+int N2kRxTable::subscribe(uint32_t pgn, uint8_t source, uint8_t instance,
+                          const char* field) {
+  const N2kPGNDef* def = FindN2kPGNDef(pgn);
+  if (def == nullptr || num_subscriptions_ == kMaxSubscriptions) {
+    return -1;
+  }
+  const N2kFieldDef* field_def = nullptr;
+  for (int i = 0; i < def->num_fields; i++) {
+    if (strcmp(def->fields[i].name, field) == 0) {
+      field_def = &def->fields[i];
+    }
+  }
+  if (field_def == nullptr) {
+    return -1;
+  }
+
+  uint32_t key = make_key(pgn, source);
+  Slot& slot = slots_[find_slot(key)];
+  int index = num_subscriptions_++;
+  subscriptions_[index] = {field_def, def->instance_offset,
+                           def->instance_offset == N2kPGNDef::kNoInstance
+                               ? kAnyInstance
+                               : instance,
+                           slot.first};
+  slot.key = key;
+  slot.first = index;
+  return index;
+}
+
+int N2kRxTable::deliver(int first, const uint8_t* data, size_t len) const {
+  int delivered = 0;
+  for (int i = first; i >= 0; i = subscriptions_[i].next) {
+    const Subscription& subscription = subscriptions_[i];
+    if (subscription.instance != kAnyInstance &&
+        (subscription.instance_offset >= len ||
+         data[subscription.instance_offset] != subscription.instance)) {
+      continue;
+    }
+    float value;
+    if (DecodeField(*subscription.field, data, len, &value)) {
+      sink_(context_, i, value);
+      delivered++;
+    }
+  }
+  return delivered;
+}
+
+int N2kRxTable::dispatch(uint32_t pgn, uint8_t source, const uint8_t* data,
+                         size_t len) const {
+  int delivered = 0;
+  int index = find_slot(make_key(pgn, source));
+  if (index >= 0 && slots_[index].first >= 0) {
+    delivered += deliver(slots_[index].first, data, len);
+  }
+  if (source != kAnySource) {
+    index = find_slot(make_key(pgn, kAnySource));
+    if (index >= 0 && slots_[index].first >= 0) {
+      delivered += deliver(slots_[index].first, data, len);
+    }
+  }
+  return delivered;
+}
+
+}  // namespace halmet
@@ -0,0 +1,108 @@
+#ifndef HALMET_SRC_N2K_RX_TABLE_H_
+#define HALMET_SRC_N2K_RX_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace halmet {
+
+/// Encodings of the decodable NMEA 2000 message fields
+enum class N2kFieldType : uint8_t {
+  kUInt8,
+  kUInt16,
+  kInt16,
+  kUInt32,
+};
+
+/// A message field at a fixed byte offset. Values are converted to SI units.
+struct N2kFieldDef {
+  const char* name;
+  uint8_t offset;
+  N2kFieldType type;
+  float scale;
+};
+
+/// A decodable PGN. `instance_offset` is the byte offset of the instance
+/// field, or kNoInstance.
+struct N2kPGNDef {
+  static constexpr uint8_t kNoInstance = 0xff;
+
+  uint32_t pgn;
+  const char* name;
+  uint8_t instance_offset;
+  const N2kFieldDef* fields;
+  int num_fields;
+};
+
+/// The definition of `pgn`, or nullptr if it can't be decoded.
+const N2kPGNDef* FindN2kPGNDef(uint32_t pgn);
+
+/// All decodable PGNs, for listing them.
+const N2kPGNDef* N2kPGNDefs(int* count);
+
+/**
+ * @brief Dispatch table from received NMEA 2000 messages to decoded values.
+ *
+ * A subscription names a PGN, a source address (or kAnySource), an instance
+ * (or kAnyInstance) and a field. dispatch() looks the PGN and source up in
+ * an open-addressing hash table and decodes only the subscribed fields of
+ * the message, which are passed to the sink with the subscription index.
+ * A message costs at most two table lookups, one for its source and one for
+ * kAnySource, whatever the number of subscriptions, and no heap
+ * allocations. Fields with the NMEA 2000 "not available" value are skipped.
+ *
+ * Tested in test/test_n2k_rx_table and timed by n2k_rx_bench_main.cpp.
+ */
+class N2kRxTable {
+ public:
+  static constexpr int kMaxSubscriptions = 64;
+  static constexpr uint8_t kAnySource = 0xff;
+  static constexpr uint8_t kAnyInstance = 0xff;
+
+  typedef void (*Sink)(void* context, int subscription, float value);
+
+  N2kRxTable(Sink sink, void* context);
+
+  /// Subscribe to a field. Returns the subscription index passed to the
+  /// sink, or -1 if the PGN or field is unknown or the table is full.
+  int subscribe(uint32_t pgn, uint8_t source, uint8_t instance,
+                const char* field);
+  int num_subscriptions() const { return num_subscriptions_; }
+
+  /// Decode the subscribed fields of a message. Returns the number of
+  /// values passed to the sink.
+  int dispatch(uint32_t pgn, uint8_t source, const uint8_t* data,
+               size_t len) const;
+
+ protected:
+  // Twice the subscriptions keeps the probe sequences short
+  static constexpr int kTableSize = 2 * kMaxSubscriptions;
+
+  struct Subscription {
+    const N2kFieldDef* field;
+    uint8_t instance_offset;
+    uint8_t instance;
+    int8_t next;  // Next subscription with the same key, or -1
+  };
+
+  struct Slot {
+    uint32_t key;
+    int8_t first;  // First subscription, or -1 if the slot is empty
+  };
+
+  static uint32_t make_key(uint32_t pgn, uint8_t source) {
+    return pgn << 8 | source;
+  }
+  int find_slot(uint32_t key) const;
+  int deliver(int first, const uint8_t* data, size_t len) const;
+
+  Sink sink_;
+  void* context_;
+  Slot slots_[kTableSize];
+  Subscription subscriptions_[kMaxSubscriptions];
+  int num_subscriptions_ = 0;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_RX_TABLE_H_
@@ -3,42 +3,121 @@
 
 #include <N2kMessages.h>
 #include <NMEA2000.h>
-
+#include <esp_cpu.h>
+
+#include "config_blob_store.h"
+#include "data_age.h"
+#include "expiring_value.h"
+#include "n2k_msg_template.h"
+#include "n2k_tx_queue.h"
+#include "rt_event_loop.h"
+#include "shared_scheduler.h"
 #include "sensesp/system/saveable.h"
 #include "sensesp/transforms/lambda_transform.h"
-#include "sensesp/transforms/repeat.h"
 #include "sensesp_base_app.h"
 
 namespace halmet {
 
+/**
+ * @brief Common base for the periodic NMEA 2000 senders.
+ *
+ * The senders transmit from rt_event_loop(), with all senders of a PGN
+ * driven by one SharedScheduler. Their inputs are timer-free ExpiringInput
+ * objects that must be set on the real-time loop; values from the SensESP
+ * loop come through ToRealtimeLoop(). Each sender keeps its message in an
+ * N2kMsgTemplate that is patched in place and transmitted without copying.
+ */
+class N2kSender : public BlobSaveable {
+ public:
+  N2kSender(String config_path, tNMEA2000* nmea2000)
+      : BlobSaveable{config_path}, nmea2000_{nmea2000} {}
+
+  /// Record the age of the transmitted data in `monitor`.
+  void set_data_age_monitor(DataAgeMonitor* monitor) { data_age_ = monitor; }
+
+  /// Transmit through `tx_queue` instead of calling SendMsg() directly.
+  void set_tx_queue(N2kTxQueue* tx_queue) { tx_queue_ = tx_queue; }
+
+  /// Record the transmit interval jitter in `monitor`.
+  void set_jitter_monitor(IntervalJitterMonitor* monitor) { jitter_ = monitor; }
+
+  /// Mean CPU cycles spent updating the message, over the last
+  /// kBuildCycleWindow messages.
+  sensesp::ObservableValue<int> build_cycles_;
+
+ protected:
+  void transmit(const tN2kMsg& msg, uint8_t instance) {
+    if (tx_queue_ != nullptr) {
+      tx_queue_->send_in_place(msg, instance);
+    } else {
+      nmea2000_->SendMsg(msg);
+    }
+    if (data_age_ != nullptr) {
+      data_age_->record();
+    }
+    if (jitter_ != nullptr) {
+      jitter_->record();
+    }
+  }
+
+  /// Update the message template with `build` and transmit it.
+  template <typename F>
+  void build_and_transmit(uint8_t instance, F build) {
+    uint32_t start = esp_cpu_get_cycle_count();
+    build(msg_template_);
+    build_cycle_sum_ += esp_cpu_get_cycle_count() - start;
+    if (++build_count_ == kBuildCycleWindow) {
+      build_cycles_ = build_cycle_sum_ / kBuildCycleWindow;
+      build_cycle_sum_ = 0;
+      build_count_ = 0;
+    }
+    transmit(msg_template_.msg(), instance);
+  }
+
+  static constexpr uint32_t kBuildCycleWindow = 64;
+
+  tNMEA2000* nmea2000_;
+  N2kMsgTemplate msg_template_;
+  uint32_t build_cycle_sum_ = 0;
+  uint32_t build_count_ = 0;
+  N2kTxQueue* tx_queue_ = nullptr;
+  DataAgeMonitor* data_age_ = nullptr;
+  IntervalJitterMonitor* jitter_ = nullptr;
+};
+
 /**
  * @brief Transmit NMEA 2000 PGN 127488: Engine Parameters, Rapid Update
  *
+ * T is the numeric type of the value path. The ESP32 FPU is single
+ * precision only, so float is the default; values are converted to double
+ * only when the message is encoded.
  */
-class N2kEngineParameterRapidSender : public sensesp::FileSystemSaveable {
+template <typename T = float>
+class N2kEngineParameterRapidSender : public N2kSender {
  public:
   N2kEngineParameterRapidSender(String config_path, uint8_t engine_instance,
                                 tNMEA2000* nmea2000)
-      : sensesp::FileSystemSaveable{config_path},
+      : N2kSender{config_path, nmea2000},
         engine_instance_{engine_instance},
-        nmea2000_{nmea2000},
         repeat_interval_{100},  // In ms. Dictated by NMEA 2000 standard!
         expiry_{1000}           // In ms. When the inputs expire.
   {
     this->initialize_members(repeat_interval_, expiry_);
-    sensesp::event_loop()->onRepeat(repeat_interval_, [this]() {
-      tN2kMsg N2kMsg;
+    SharedScheduler::get(repeat_interval_)->add([this]() {
       // At the moment, the PGN is sent regardless of whether all the values
       // are invalid or not.
-      SetN2kEngineParamRapid(
-          N2kMsg, this->engine_instance_, this->engine_speed_rpm_->get(),
-          this->engine_boost_pressure_->get(), this->engine_tilt_trim_->get());
-      this->nmea2000_->SendMsg(N2kMsg);
+      this->build_and_transmit(
+          this->engine_instance_, [this](N2kMsgTemplate& msg) {
+            msg.set_engine_param_rapid<T>(this->engine_instance_,
+                                          this->engine_speed_rpm_->get(),
+                                          this->engine_boost_pressure_->get(),
+                                          this->engine_tilt_trim_->get());
+          });
     });
 
     engine_speed_
-        .connect_to(new sensesp::LambdaTransform<double, double>(
-            [](double value) { return 60 * value; }))
+        .connect_to(new sensesp::LambdaTransform<T, T>(
+            [](T value) { return 60 * value; }))
         ->connect_to(engine_speed_rpm_);
   }
 
@@ -55,33 +134,32 @@ class N2kEngineParameterRapidSender : public sensesp::FileSystemSaveable {
     return true;
   }
 
-  sensesp::ObservableValue<double>
-      engine_speed_;  // Connected to engine_speed_rpm_
-  std::shared_ptr<sensesp::RepeatExpiring<double>> engine_boost_pressure_;
-  std::shared_ptr<sensesp::RepeatExpiring<int8_t>> engine_tilt_trim_;
+  sensesp::ObservableValue<T> engine_speed_;  // Connected to engine_speed_rpm_
+  std::shared_ptr<ExpiringInput<T>> engine_boost_pressure_;
+  std::shared_ptr<ExpiringInput<int8_t>> engine_tilt_trim_;
 
  protected:
   unsigned int repeat_interval_;
   unsigned int expiry_;
-  tNMEA2000* nmea2000_;
 
-  std::shared_ptr<sensesp::RepeatExpiring<double>> engine_speed_rpm_;
+  std::shared_ptr<ExpiringInput<T>> engine_speed_rpm_;
 
   uint8_t engine_instance_ = 0;
 
  private:
   void initialize_members(unsigned int repeat_interval, unsigned int expiry) {
-    // Initialize the RepeatExpiring objects
-    engine_boost_pressure_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval, expiry);
-    engine_tilt_trim_ = std::make_shared<sensesp::RepeatExpiring<int8_t>>(
-        repeat_interval, expiry);
-    engine_speed_rpm_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval, expiry);
+    // Initialize the expiring inputs
+    engine_boost_pressure_ =
+        std::make_shared<ExpiringInput<T>>(expiry, N2kNumericNA<T>());
+    engine_tilt_trim_ =
+        std::make_shared<ExpiringInput<int8_t>>(expiry, N2kInt8NA);
+    engine_speed_rpm_ =
+        std::make_shared<ExpiringInput<T>>(expiry, N2kNumericNA<T>());
   }
 };
 
-const String ConfigSchema(const N2kEngineParameterRapidSender& obj) {
+template <typename T>
+const String ConfigSchema(const N2kEngineParameterRapidSender<T>& obj) {
   return R"###({
     "type": "object",
     "properties": {
@@ -93,70 +171,73 @@ const String ConfigSchema(const N2kEngineParameterRapidSender& obj) {
 /**
  * @brief Transmit NMEA 2000 PGN 127489: Engine Parameters, Dynamic
  *
+ * T is the numeric type of the value path, see
+ * N2kEngineParameterRapidSender.
  */
-class N2kEngineParameterDynamicSender : public sensesp::FileSystemSaveable {
+template <typename T = float>
+class N2kEngineParameterDynamicSender : public N2kSender {
  public:
   N2kEngineParameterDynamicSender(String config_path, uint8_t engine_instance,
                                   tNMEA2000* nmea2000)
-      : sensesp::FileSystemSaveable{config_path},
+      : N2kSender{config_path, nmea2000},
         engine_instance_{engine_instance},
-        nmea2000_{nmea2000},
         repeat_interval_{500},  // In ms. Dictated by NMEA 2000 standard!
         expiry_{5000}           // In ms. When the inputs expire.
   {
     this->initialize_members(repeat_interval_, expiry_);
 
-    sensesp::event_loop()->onRepeat(repeat_interval_, [this]() {
-      tN2kMsg N2kMsg;
-      SetN2kEngineDynamicParam(
-          N2kMsg, this->engine_instance_, this->oil_pressure_->get(),
-          this->oil_temperature_->get(), this->temperature_->get(),
-          this->alternator_potential_->get(), this->fuel_rate_->get(),
-          this->total_engine_hours_->get(), this->coolant_pressure_->get(),
-          this->fuel_pressure_->get(), this->engine_load_->get(),
-          this->engine_torque_->get(), this->get_engine_status_1(),
-          this->get_engine_status_2());
-      this->nmea2000_->SendMsg(N2kMsg);
+    SharedScheduler::get(repeat_interval_)->add([this]() {
+      this->build_and_transmit(
+          this->engine_instance_, [this](N2kMsgTemplate& msg) {
+            msg.set_engine_dynamic_param<T>(
+                this->engine_instance_, this->oil_pressure_->get(),
+                this->oil_temperature_->get(), this->temperature_->get(),
+                this->alternator_potential_->get(), this->fuel_rate_->get(),
+                this->total_engine_hours_->get(),
+                this->coolant_pressure_->get(), this->fuel_pressure_->get(),
+                this->engine_load_->get(), this->engine_torque_->get(),
+                this->get_engine_status_1(), this->get_engine_status_2());
+          });
     });
   }
 
   // Data to be transmitted
-  std::shared_ptr<sensesp::RepeatExpiring<double>> oil_pressure_;
-  std::shared_ptr<sensesp::RepeatExpiring<double>> oil_temperature_;
-  std::shared_ptr<sensesp::RepeatExpiring<double>> temperature_;
-  std::shared_ptr<sensesp::RepeatExpiring<double>> alternator_potential_;
-  std::shared_ptr<sensesp::RepeatExpiring<double>> fuel_rate_;
-  std::shared_ptr<sensesp::RepeatExpiring<uint32_t>> total_engine_hours_;
-  std::shared_ptr<sensesp::RepeatExpiring<double>> coolant_pressure_;
-  std::shared_ptr<sensesp::RepeatExpiring<double>> fuel_pressure_;
-  std::shared_ptr<sensesp::RepeatExpiring<int>> engine_load_;
-  std::shared_ptr<sensesp::RepeatExpiring<int>> engine_torque_;
+  std::shared_ptr<ExpiringInput<T>> oil_pressure_;
+  std::shared_ptr<ExpiringInput<T>> oil_temperature_;
+  std::shared_ptr<ExpiringInput<T>> temperature_;
+  std::shared_ptr<ExpiringInput<T>> alternator_potential_;
+  std::shared_ptr<ExpiringInput<T>> fuel_rate_;
+  std::shared_ptr<ExpiringInput<uint32_t>> total_engine_hours_;
+  std::shared_ptr<ExpiringInput<T>> coolant_pressure_;
+  std::shared_ptr<ExpiringInput<T>> fuel_pressure_;
+  std::shared_ptr<ExpiringInput<int>> engine_load_;
+  std::shared_ptr<ExpiringInput<int>> engine_torque_;
   // Engine status 1 fields
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> check_engine_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> over_temperature_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> low_oil_pressure_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> low_oil_level_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> low_fuel_pressure_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> low_system_voltage_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> low_coolant_level_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> water_flow_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> water_in_fuel_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> charge_indicator_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> preheat_indicator_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> high_boost_pressure_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> rev_limit_exceeded_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> egr_system_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> throttle_position_sensor_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> emergency_stop_;
+  std::shared_ptr<ExpiringInput<bool>> check_engine_;
+  std::shared_ptr<ExpiringInput<bool>> over_temperature_;
+  std::shared_ptr<ExpiringInput<bool>> low_oil_pressure_;
+  std::shared_ptr<ExpiringInput<bool>> low_oil_level_;
+  std::shared_ptr<ExpiringInput<bool>> low_fuel_pressure_;
+  std::shared_ptr<ExpiringInput<bool>> low_system_voltage_;
+  std::shared_ptr<ExpiringInput<bool>> low_coolant_level_;
+  std::shared_ptr<ExpiringInput<bool>> water_flow_;
+  std::shared_ptr<ExpiringInput<bool>> water_in_fuel_;
+  std::shared_ptr<ExpiringInput<bool>> charge_indicator_;
+  std::shared_ptr<ExpiringInput<bool>> preheat_indicator_;
+  std::shared_ptr<ExpiringInput<bool>> high_boost_pressure_;
+  std::shared_ptr<ExpiringInput<bool>> rev_limit_exceeded_;
+  std::shared_ptr<ExpiringInput<bool>> egr_system_;
+  std::shared_ptr<ExpiringInput<bool>> throttle_position_sensor_;
+  std::shared_ptr<ExpiringInput<bool>> emergency_stop_;
   // Engine status 2 fields
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> warning_level_1_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> warning_level_2_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> power_reduction_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> maintenance_needed_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> engine_comm_error_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> sub_or_secondary_throttle_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> neutral_start_protect_;
-  std::shared_ptr<sensesp::RepeatExpiring<bool>> engine_shutting_down_;
+  std::shared_ptr<ExpiringInput<bool>> warning_level_1_;
+  std::shared_ptr<ExpiringInput<bool>> warning_level_2_;
+  std::shared_ptr<ExpiringInput<bool>> power_reduction_;
+  std::shared_ptr<ExpiringInput<bool>> maintenance_needed_;
+  std::shared_ptr<ExpiringInput<bool>> engine_comm_error_;
+  std::shared_ptr<ExpiringInput<bool>> sub_or_secondary_throttle_;
+  std::shared_ptr<ExpiringInput<bool>> neutral_start_protect_;
+  std::shared_ptr<ExpiringInput<bool>> engine_shutting_down_;
 
   virtual bool from_json(const JsonObject& config) override {
     if (!config["engine_instance"].is<int>()) {
@@ -221,86 +302,63 @@ class N2kEngineParameterDynamicSender : public sensesp::FileSystemSaveable {
 
   unsigned int repeat_interval_;
   unsigned int expiry_;
-  tNMEA2000* nmea2000_;
 
   uint8_t engine_instance_;
 
  private:
   void initialize_members(uint32_t repeat_interval_, uint32_t expiry_) {
-    // Initialize all RepeatExpiring members
-    oil_pressure_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval_, expiry_);
-    oil_temperature_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval_, expiry_);
-    temperature_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval_, expiry_);
-    alternator_potential_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval_, expiry_);
-    fuel_rate_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval_, expiry_);
-    total_engine_hours_ = std::make_shared<sensesp::RepeatExpiring<uint32_t>>(
-        repeat_interval_, expiry_);
-    coolant_pressure_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval_, expiry_);
-    fuel_pressure_ = std::make_shared<sensesp::RepeatExpiring<double>>(
-        repeat_interval_, expiry_);
-    engine_load_ = std::make_shared<sensesp::RepeatExpiring<int>>(
-        repeat_interval_, expiry_);
-    engine_torque_ = std::make_shared<sensesp::RepeatExpiring<int>>(
-        repeat_interval_, expiry_);
-    check_engine_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    over_temperature_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    low_oil_pressure_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    low_oil_level_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    low_fuel_pressure_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    low_system_voltage_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    low_coolant_level_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    water_flow_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    water_in_fuel_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    charge_indicator_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    preheat_indicator_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    high_boost_pressure_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    rev_limit_exceeded_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    egr_system_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    throttle_position_sensor_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    emergency_stop_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    warning_level_1_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    warning_level_2_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    power_reduction_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    maintenance_needed_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    engine_comm_error_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
+    // Initialize all expiring inputs
+    oil_pressure_ =
+        std::make_shared<ExpiringInput<T>>(expiry_, N2kNumericNA<T>());
+    oil_temperature_ =
+        std::make_shared<ExpiringInput<T>>(expiry_, N2kNumericNA<T>());
+    temperature_ =
+        std::make_shared<ExpiringInput<T>>(expiry_, N2kNumericNA<T>());
+    alternator_potential_ =
+        std::make_shared<ExpiringInput<T>>(expiry_, N2kNumericNA<T>());
+    fuel_rate_ = std::make_shared<ExpiringInput<T>>(expiry_, N2kNumericNA<T>());
+    total_engine_hours_ =
+        std::make_shared<ExpiringInput<uint32_t>>(expiry_, N2kUInt32NA);
+    coolant_pressure_ =
+        std::make_shared<ExpiringInput<T>>(expiry_, N2kNumericNA<T>());
+    fuel_pressure_ =
+        std::make_shared<ExpiringInput<T>>(expiry_, N2kNumericNA<T>());
+    engine_load_ = std::make_shared<ExpiringInput<int>>(expiry_, N2kInt8NA);
+    engine_torque_ = std::make_shared<ExpiringInput<int>>(expiry_, N2kInt8NA);
+    check_engine_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    over_temperature_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    low_oil_pressure_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    low_oil_level_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    low_fuel_pressure_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    low_system_voltage_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    low_coolant_level_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    water_flow_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    water_in_fuel_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    charge_indicator_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    preheat_indicator_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    high_boost_pressure_ =
+        std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    rev_limit_exceeded_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    egr_system_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    throttle_position_sensor_ =
+        std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    emergency_stop_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    warning_level_1_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    warning_level_2_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    power_reduction_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    maintenance_needed_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    engine_comm_error_ = std::make_shared<ExpiringInput<bool>>(expiry_, false);
     sub_or_secondary_throttle_ =
-        std::make_shared<sensesp::RepeatExpiring<bool>>(repeat_interval_,
-                                                        expiry_);
-    neutral_start_protect_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
-    engine_shutting_down_ = std::make_shared<sensesp::RepeatExpiring<bool>>(
-        repeat_interval_, expiry_);
+        std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    neutral_start_protect_ =
+        std::make_shared<ExpiringInput<bool>>(expiry_, false);
+    engine_shutting_down_ =
+        std::make_shared<ExpiringInput<bool>>(expiry_, false);
   }
 };
 
-const String ConfigSchema(const N2kEngineParameterDynamicSender& obj) {
+template <typename T>
+const String ConfigSchema(const N2kEngineParameterDynamicSender<T>& obj) {
   return R"###({
     "type": "object",
     "properties": {
@@ -312,32 +370,36 @@ const String ConfigSchema(const N2kEngineParameterDynamicSender& obj) {
 /**
  * @brief Transmit NMEA 2000 PGN 127505: Fluid Level
  *
+ * T is the numeric type of the value path, see
+ * N2kEngineParameterRapidSender.
  */
-class N2kFluidLevelSender : public sensesp::FileSystemSaveable {
+template <typename T = float>
+class N2kFluidLevelSender : public N2kSender {
  public:
   N2kFluidLevelSender(String config_path, uint8_t tank_instance,
-                      tN2kFluidType tank_type, double tank_capacity,
+                      tN2kFluidType tank_type, T tank_capacity,
                       tNMEA2000* nmea2000)
-      : sensesp::FileSystemSaveable{config_path},
+      : N2kSender{config_path, nmea2000},
         tank_instance_{tank_instance},
         tank_type_{tank_type},
         tank_capacity_{tank_capacity},
-        nmea2000_{nmea2000},
         repeat_interval_{2500},  // In ms. Dictated by NMEA 2000 standard!
         expiry_{10000}           // In ms. When the inputs expire.
   {
     tank_level_
-        .connect_to(new sensesp::LambdaTransform<double, double>(
-            [this](double value) { return 100 * value; }))
+        .connect_to(new sensesp::LambdaTransform<T, T>(
+            [](T value) { return 100 * value; }))
         ->connect_to(&tank_level_percent_);
 
-    sensesp::event_loop()->onRepeat(repeat_interval_, [this]() {
-      tN2kMsg N2kMsg;
+    SharedScheduler::get(repeat_interval_)->add([this]() {
       // At the moment, the PGN is sent regardless of whether all the values
       // are invalid or not.
-      SetN2kFluidLevel(N2kMsg, this->tank_instance_, this->tank_type_,
-                       this->tank_level_percent_.get(), this->tank_capacity_);
-      this->nmea2000_->SendMsg(N2kMsg);
+      this->build_and_transmit(
+          this->tank_instance_, [this](N2kMsgTemplate& msg) {
+            msg.set_fluid_level<T>(this->tank_instance_, this->tank_type_,
+                                   this->tank_level_percent_.get(),
+                                   this->tank_capacity_);
+          });
     });
   }
 
@@ -363,21 +425,20 @@ class N2kFluidLevelSender : public sensesp::FileSystemSaveable {
     return true;
   }
 
-  sensesp::ObservableValue<double> tank_level_;  // ratio
+  sensesp::ObservableValue<T> tank_level_;  // ratio
 
  protected:
   unsigned int repeat_interval_;
   unsigned int expiry_;
-  tNMEA2000* nmea2000_;
 
   uint8_t tank_instance_;
   tN2kFluidType tank_type_;
-  double tank_capacity_;  // in liters
-  sensesp::RepeatExpiring<double> tank_level_percent_{repeat_interval_,
-                                                      expiry_};
+  T tank_capacity_;  // in liters
+  ExpiringInput<T> tank_level_percent_{expiry_, N2kNumericNA<T>()};
 };
 
-const String ConfigSchema(const N2kFluidLevelSender& obj) {
+template <typename T>
+const String ConfigSchema(const N2kFluidLevelSender<T>& obj) {
   return R"###({
       "type": "object",
       "properties": {
@@ -0,0 +1,93 @@
+#include "n2k_socketcan.h"
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace halmet {
+
+N2kSocketCAN::N2kSocketCAN(const char* interface_name) : tNMEA2000() {
+  snprintf(interface_name_, sizeof(interface_name_), "%s", interface_name);
+}
+
+N2kSocketCAN::~N2kSocketCAN() {
+  if (socket_ >= 0) {
+    close(socket_);
+  }
+}
+
+bool N2kSocketCAN::CANOpen() {
+  socket_ = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (socket_ < 0) {
+    perror("N2kSocketCAN: socket");
+    return false;
+  }
+
+  struct ifreq ifr = {};
+  snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", interface_name_);
+  if (ioctl(socket_, SIOCGIFINDEX, &ifr) < 0) {
+    fprintf(stderr, "N2kSocketCAN: no interface %s\n", interface_name_);
+    close(socket_);
+    socket_ = -1;
+    return false;
+  }
+
+  struct sockaddr_can addr = {};
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (bind(socket_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) <
+      0) {
+    perror("N2kSocketCAN: bind");
+    close(socket_);
+    socket_ = -1;
+    return false;
+  }
+
+  // ParseMessages() polls for frames, so reads must not block
+  fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+bool N2kSocketCAN::CANSendFrame(unsigned long id, unsigned char len,
+                                const unsigned char* buf, bool wait_sent) {
+  struct can_frame frame = {};
+  // All NMEA 2000 frames use 29-bit identifiers
+  frame.can_id = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  frame.can_dlc = len > 8 ? 8 : len;
+  memcpy(frame.data, buf, frame.can_dlc);
+
+  // wait_sent only matters for the ordering of fast packet frames, which
+  // the socket queue preserves.
+  ssize_t n = write(socket_, &frame, sizeof(frame));
+  return n == sizeof(frame);
+}
+
+bool N2kSocketCAN::CANGetFrame(unsigned long& id, unsigned char& len,
+                               unsigned char* buf) {
+  struct can_frame frame;
+  while (read(socket_, &frame, sizeof(frame)) == sizeof(frame)) {
+    // Skip error frames and standard frames; they aren't NMEA 2000 traffic
+    if ((frame.can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG)) != 0 ||
+        (frame.can_id & CAN_EFF_FLAG) == 0) {
+      continue;
+    }
+    id = frame.can_id & CAN_EFF_MASK;
+    len = frame.can_dlc;
+    memcpy(buf, frame.data, len);
+    return true;
+  }
+  return false;
+}
+
+}  // namespace halmet
+
+#endif  // __linux__
@@ -0,0 +1,45 @@
+#ifndef HALMET_SRC_N2K_SOCKETCAN_H_
+#define HALMET_SRC_N2K_SOCKETCAN_H_
+
+#ifdef __linux__
+
+#include <NMEA2000.h>
+
+namespace halmet {
+
+/**
+ * @brief tNMEA2000 driver for Linux SocketCAN interfaces.
+ *
+ * Lets the NMEA 2000 stack run in a host process on a physical CAN adapter
+ * or a virtual one:
+ *
+ *   sudo modprobe vcan
+ *   sudo ip link add dev vcan0 type vcan
+ *   sudo ip link set up vcan0
+ *
+ * The traffic can then be observed with candump and friends from can-utils.
+ * Frames are sent and received without blocking; a full socket send buffer
+ * is reported as a failed send, like a full TWAI transmit queue.
+ */
+class N2kSocketCAN : public tNMEA2000 {
+ public:
+  N2kSocketCAN(const char* interface_name = "vcan0");
+  virtual ~N2kSocketCAN();
+
+ protected:
+  virtual bool CANOpen() override;
+  virtual bool CANSendFrame(unsigned long id, unsigned char len,
+                            const unsigned char* buf,
+                            bool wait_sent = true) override;
+  virtual bool CANGetFrame(unsigned long& id, unsigned char& len,
+                           unsigned char* buf) override;
+
+  char interface_name_[16];
+  int socket_ = -1;
+};
+
+}  // namespace halmet
+
+#endif  // __linux__
+
+#endif  // HALMET_SRC_N2K_SOCKETCAN_H_
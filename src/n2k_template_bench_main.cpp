@@ -0,0 +1,142 @@
+// Host benchmark of the N2k message templates.
+//
+// Builds PGNs 127488, 127489 and 127505 the way the senders do, once with
+// the library encoders into a fresh tN2kMsg and by patching an
+// N2kMsgTemplate in place with double and with float values, and reports
+// the mean build time per message. The values change on every call, as
+// they do on the bus. Build and run with:
+//
+//   pio run -e native_n2k_template_bench
+//   .pio/build/native_n2k_template_bench/program
+//
+// The host timings show the relative cost only: a host FPU handles double
+// as fast as float, while the ESP32 emulates double in software. The
+// sender build cycle metric gives the absolute numbers on the device; to
+// compare there, instantiate the senders with double instead of float.
+
+#ifdef HALMET_N2K_TEMPLATE_BENCH
+
+#include <N2kMessages.h>
+
+#include <cstdio>
+#include <ctime>
+
+#include "n2k_msg_template.h"
+
+using namespace halmet;
+
+namespace {
+
+const int kRounds = 1000000;
+
+// Exposes whether the layout check enabled patching
+class BenchTemplate : public N2kMsgTemplate {
+ public:
+  static bool patching() { return layouts_ok_; }
+};
+
+// Keeps the compiler from dropping the encodes
+volatile uint8_t sink;
+
+template <typename T>
+T Value(int i, T base, T span) {
+  return base + span * (i % 1000) / 1000;
+}
+
+template <typename Build>
+double TimeBuild(Build build) {
+  clock_t start = clock();
+  for (int i = 0; i < kRounds; i++) {
+    build(i);
+  }
+  double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+  return elapsed * 1e9 / kRounds;
+}
+
+// The sender builds, with values of type T
+
+template <typename T>
+void BuildRapid(BenchTemplate& msg, int i) {
+  msg.set_engine_param_rapid<T>(0, Value<T>(i, 600, 3000), N2kNumericNA<T>(),
+                                0);
+  sink = msg.msg().Data[1];
+}
+
+template <typename T>
+void BuildDynamic(BenchTemplate& msg, int i) {
+  const T na = N2kNumericNA<T>();
+  msg.set_engine_dynamic_param<T>(
+      0, Value<T>(i, 200000, 300000), Value<T>(i, 330, 60),
+      Value<T>(i, 330, 40), na, na, 3600 * 1234 + i / 1000, na, na, N2kInt8NA,
+      N2kInt8NA, 0, 0);
+  sink = msg.msg().Data[1];
+}
+
+template <typename T>
+void BuildFluid(BenchTemplate& msg, int i) {
+  msg.set_fluid_level<T>(0, N2kft_Fuel, Value<T>(i, 0, 100), 200);
+  sink = msg.msg().Data[1];
+}
+
+void Report(const char* name, double encode_ns, double double_ns,
+            double float_ns) {
+  printf("%-8s %12.1f %12.1f %12.1f %8.1fx\n", name, encode_ns, double_ns,
+         float_ns, encode_ns / float_ns);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  BenchTemplate rapid;
+  BenchTemplate dynamic;
+  BenchTemplate fluid;
+
+  // The first call encodes the message and runs the layout check
+  rapid.set_engine_param_rapid<float>(0, 0, 0, 0);
+  if (!BenchTemplate::patching()) {
+    fprintf(stderr, "Templates don't match the library encoders\n");
+    return 1;
+  }
+  dynamic.set_engine_dynamic_param<float>(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                          0);
+  fluid.set_fluid_level<float>(0, N2kft_Fuel, 0, 200);
+
+  printf("%-8s %12s %12s %12s %9s\n", "PGN", "encode ns", "double ns",
+         "float ns", "speedup");
+
+  double encode_ns = TimeBuild([](int i) {
+    tN2kMsg msg;
+    SetN2kEngineParamRapid(msg, 0, Value<double>(i, 600, 3000), N2kDoubleNA,
+                           0);
+    sink = msg.Data[1];
+  });
+  Report("127488", encode_ns,
+         TimeBuild([&rapid](int i) { BuildRapid<double>(rapid, i); }),
+         TimeBuild([&rapid](int i) { BuildRapid<float>(rapid, i); }));
+
+  encode_ns = TimeBuild([](int i) {
+    const double na = N2kDoubleNA;
+    tN2kMsg msg;
+    SetN2kEngineDynamicParam(msg, 0, Value<double>(i, 200000, 300000),
+                             Value<double>(i, 330, 60),
+                             Value<double>(i, 330, 40), na, na,
+                             3600 * 1234 + i / 1000, na, na, N2kInt8NA,
+                             N2kInt8NA, 0, 0);
+    sink = msg.Data[1];
+  });
+  Report("127489", encode_ns,
+         TimeBuild([&dynamic](int i) { BuildDynamic<double>(dynamic, i); }),
+         TimeBuild([&dynamic](int i) { BuildDynamic<float>(dynamic, i); }));
+
+  encode_ns = TimeBuild([](int i) {
+    tN2kMsg msg;
+    SetN2kFluidLevel(msg, 0, N2kft_Fuel, Value<double>(i, 0, 100), 200);
+    sink = msg.Data[1];
+  });
+  Report("127505", encode_ns,
+         TimeBuild([&fluid](int i) { BuildFluid<double>(fluid, i); }),
+         TimeBuild([&fluid](int i) { BuildFluid<float>(fluid, i); }));
+  return 0;
+}
+
+#endif  // HALMET_N2K_TEMPLATE_BENCH
@@ -0,0 +1,217 @@
+#include "n2k_tx_queue.h"
+
+#include <driver/twai.h>
+
+#include <algorithm>
+
+#include "input_trace.h"
+#include "memory_monitor.h"
+#include "rt_event_loop.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+// How often pending messages are retried and the controller state is polled
+const unsigned int kCheckInterval = 10;  // ms
+// Bus-off recovery back-off limits
+const uint32_t kMinRecoveryBackoff = 100;    // ms
+const uint32_t kMaxRecoveryBackoff = 30000;  // ms
+// More frames than this waiting in the driver means nobody is acknowledging
+const uint32_t kMaxDriverTxBacklog = 8;
+// Frames of the library send buffer left to the library's own messages,
+// e.g. the 20 frames of a product information response
+const uint16_t kReservedSendFrames = 20;
+
+// Frames of a message: single frame, or fast packet with 6 data bytes in
+// the first frame and 7 in each of the others
+uint16_t FrameCount(const tN2kMsg& msg) {
+  return msg.DataLen <= 8 ? 1 : 1 + (msg.DataLen - 6 + 6) / 7;
+}
+
+// tNMEA2000 buffers the frames that the CAN driver doesn't take right away
+// in a ring with protected indices. A pointer to a protected member, taken
+// in a derived class, may be applied to any tNMEA2000.
+struct SendFrameBuffer : tNMEA2000 {
+  /// Whether the buffer of `nmea2000` has room for `frames` and the
+  /// reserve. A message longer than that waits for an empty buffer.
+  static bool has_room(tNMEA2000* nmea2000, uint16_t frames) {
+    uint16_t size = nmea2000->*(&SendFrameBuffer::MaxCANSendFrames);
+    if (size == 0) {
+      // No buffer: SendMsg() fails if the driver is full
+      return true;
+    }
+    uint16_t write = nmea2000->*(&SendFrameBuffer::CANSendFrameBufferWrite);
+    uint16_t read = nmea2000->*(&SendFrameBuffer::CANSendFrameBufferRead);
+    uint16_t free_frames = size - 1 - (write + size - read) % size;
+    return free_frames >= std::min<int>(frames + kReservedSendFrames, size - 1);
+  }
+
+  /// Drop the buffered frames of `nmea2000`
+  static void clear(tNMEA2000* nmea2000) {
+    nmea2000->*(&SendFrameBuffer::CANSendFrameBufferRead) =
+        nmea2000->*(&SendFrameBuffer::CANSendFrameBufferWrite);
+  }
+};
+
+}  // namespace
+
+N2kTxQueue::N2kTxQueue(tNMEA2000* nmea2000) : nmea2000_{nmea2000} {
+  rt_event_loop()->onRepeat(kCheckInterval, [this]() {
+    AllocationTagScope tag(Subsystem::kN2k);
+    check_bus();
+    flush();
+  });
+}
+
+void N2kTxQueue::send(const tN2kMsg& msg, uint8_t instance) {
+  Slot* slot = enqueue(msg, instance);
+  slot->copy = msg;
+  slot->msg = &slot->copy;
+  flush();
+}
+
+void N2kTxQueue::send_in_place(const tN2kMsg& msg, uint8_t instance) {
+  Slot* slot = enqueue(msg, instance);
+  slot->msg = &msg;
+  flush();
+}
+
+N2kTxQueue::Slot* N2kTxQueue::enqueue(const tN2kMsg& msg, uint8_t instance) {
+  Slot* slot = nullptr;
+  for (auto& s : slots_) {
+    if (s.pgn == msg.PGN && s.instance == instance) {
+      slot = &s;
+      break;
+    }
+  }
+  if (slot == nullptr) {
+    slots_.emplace_back();
+    slot = &slots_.back();
+    slot->pgn = msg.PGN;
+    slot->instance = instance;
+  } else if (slot->pending) {
+    superseded_ = superseded_.get() + 1;
+  }
+  slot->pending = true;
+  slot->time = millis();
+  return slot;
+}
+
+int N2kTxQueue::resend(unsigned long pgn, uint32_t max_age) {
+  uint32_t now = millis();
+  int queued = 0;
+  for (auto& slot : slots_) {
+    if (is_cached(slot, pgn, now, max_age)) {
+      slot.pending = true;
+      queued++;
+    }
+  }
+  if (queued > 0) {
+    flush();
+  }
+  return queued;
+}
+
+bool N2kTxQueue::has_cached(unsigned long pgn, uint32_t max_age) const {
+  uint32_t now = millis();
+  for (const auto& slot : slots_) {
+    if (is_cached(slot, pgn, now, max_age)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void N2kTxQueue::flush() {
+  if (!bus_ok_state_) {
+    return;
+  }
+  for (auto& slot : slots_) {
+    if (!slot.pending) {
+      continue;
+    }
+    // Keep the message in its slot, where newer data replaces it, until
+    // the library buffer has room for it
+    if (!SendFrameBuffer::has_room(nmea2000_, FrameCount(*slot.msg))) {
+      return;
+    }
+    if (!nmea2000_->SendMsg(*slot.msg)) {
+      // Send buffer full; keep the message and try again later
+      send_failures_ = send_failures_.get() + 1;
+      return;
+    }
+    slot.pending = false;
+    if (InputTrace::get() != nullptr) {
+      InputTrace::get()->record_can(true, *slot.msg);
+    }
+  }
+}
+
+void N2kTxQueue::check_bus() {
+  twai_status_info_t status;
+  if (twai_get_status_info(&status) != ESP_OK) {
+    // The CAN driver doesn't use the TWAI driver; rely on SendMsg() results.
+    return;
+  }
+
+  uint32_t now = millis();
+  switch (status.state) {
+    case TWAI_STATE_BUS_OFF:
+      if (!recovering_ && now - bus_off_since_ >= recovery_backoff_) {
+        if (bus_ok_state_) {
+          bus_off_count_ = bus_off_count_.get() + 1;
+        }
+        debugW("CAN bus-off, initiating recovery (back-off %u ms)",
+               recovery_backoff_);
+        twai_initiate_recovery();
+        recovering_ = true;
+      }
+      set_bus_ok(false);
+      break;
+    case TWAI_STATE_RECOVERING:
+      set_bus_ok(false);
+      break;
+    case TWAI_STATE_STOPPED:
+      if (recovering_) {
+        // Recovery complete; the controller must be restarted explicitly.
+        twai_start();
+        recovering_ = false;
+        bus_off_since_ = now;
+        recovery_backoff_ = constrain(recovery_backoff_ * 2,
+                                      kMinRecoveryBackoff, kMaxRecoveryBackoff);
+      }
+      set_bus_ok(false);
+      break;
+    case TWAI_STATE_RUNNING:
+    default:
+      // Error passive with a growing backlog means the frames aren't being
+      // acknowledged, i.e. we are alone on the bus or disconnected.
+      set_bus_ok(status.tx_error_counter < 128 ||
+                 status.msgs_to_tx <= kMaxDriverTxBacklog);
+      if (bus_ok_state_ && now - bus_off_since_ > kMaxRecoveryBackoff) {
+        recovery_backoff_ = 0;
+      }
+      break;
+  }
+}
+
+void N2kTxQueue::set_bus_ok(bool ok) {
+  if (ok == bus_ok_state_) {
+    return;
+  }
+  bus_ok_state_ = ok;
+  bus_ok_ = ok;
+  if (ok) {
+    // Anything still in the driver queue or the library buffer is outdated
+    // by now
+    twai_clear_transmit_queue();
+    SendFrameBuffer::clear(nmea2000_);
+    debugI("CAN bus recovered");
+  } else {
+    bus_off_since_ = millis();
+  }
+}
+
+}  // namespace halmet
@@ -0,0 +1,96 @@
+#ifndef HALMET_SRC_N2K_TX_QUEUE_H_
+#define HALMET_SRC_N2K_TX_QUEUE_H_
+
+#include <N2kMsg.h>
+#include <NMEA2000.h>
+
+#include <list>
+
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/// Size of the tNMEA2000 send frame buffer to set with
+/// SetN2kCANSendFrameBufSize(): the longest fast packet (223 bytes) fits.
+const uint16_t kN2kSendFrameBufSize = 32;
+
+/**
+ * @brief Freshest-data-wins transmit policy for periodic PGNs.
+ *
+ * Holds at most one pending message per PGN and instance. A new message
+ * replaces the pending one instead of queuing behind it, so stale periodic
+ * frames never pile up in the CAN send buffer while the bus is down or
+ * saturated. The library send buffer is kept small (see
+ * kN2kSendFrameBufSize), and a message only leaves its slot once the
+ * buffer has room for it, leaving some frames for the library's own
+ * messages.
+ *
+ * The TWAI controller state is polled. While the controller is bus-off or
+ * error passive, messages are held instead of passed to SendMsg(). Bus-off
+ * recovery is initiated with exponential back-off. When the bus recovers,
+ * frames left in the driver queue and the library buffer are discarded so
+ * that the first frames out are current values.
+ */
+class N2kTxQueue {
+ public:
+  N2kTxQueue(tNMEA2000* nmea2000);
+
+  /// Transmit `msg`, replacing any message with the same PGN and instance
+  /// that hasn't been sent yet.
+  void send(const tN2kMsg& msg, uint8_t instance);
+
+  /// Like send(), but without copying `msg`. The message must stay valid and
+  /// may only be modified from the same event loop; whatever it contains
+  /// when the slot is flushed is sent.
+  void send_in_place(const tN2kMsg& msg, uint8_t instance);
+
+  /// Send the latest message of each instance of `pgn` again, as it was
+  /// last encoded, e.g. to answer an ISO request. Messages last updated
+  /// more than `max_age` ms ago are skipped. Returns the number of messages
+  /// queued.
+  int resend(unsigned long pgn, uint32_t max_age);
+
+  /// True if resend() would queue a message.
+  bool has_cached(unsigned long pgn, uint32_t max_age) const;
+
+  /// Number of pending messages replaced by newer data
+  sensesp::ObservableValue<int> superseded_{0};
+  /// Number of SendMsg() calls rejected by the library
+  sensesp::ObservableValue<int> send_failures_{0};
+  /// Number of bus-off events
+  sensesp::ObservableValue<int> bus_off_count_{0};
+  /// True while the controller is able to transmit
+  sensesp::ObservableValue<bool> bus_ok_{true};
+
+ protected:
+  struct Slot {
+    unsigned long pgn = 0;
+    uint8_t instance = 0;
+    bool pending = false;
+    uint32_t time = 0;             // Last update
+    const tN2kMsg* msg = nullptr;  // &copy or a message owned by the caller
+    tN2kMsg copy;
+  };
+
+  Slot* enqueue(const tN2kMsg& msg, uint8_t instance);
+  static bool is_cached(const Slot& slot, unsigned long pgn, uint32_t now,
+                        uint32_t max_age) {
+    return slot.pgn == pgn && slot.msg != nullptr &&
+           now - slot.time <= max_age;
+  }
+  void flush();
+  void check_bus();
+  void set_bus_ok(bool ok);
+
+  tNMEA2000* nmea2000_;
+  std::list<Slot> slots_;  // Slot addresses must be stable
+
+  bool bus_ok_state_ = true;
+  bool recovering_ = false;
+  uint32_t recovery_backoff_ = 0;  // ms
+  uint32_t bus_off_since_ = 0;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_TX_QUEUE_H_
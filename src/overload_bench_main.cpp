@@ -0,0 +1,62 @@
+// Host load test of the overload governor.
+//
+// Runs OverloadSim without and with LoadSheddingPolicy and prints the
+// lateness of the PGN 127488 transmissions of both runs and the shed
+// stages over time. The pass/fail criteria are checked by
+// test/test_load_shedding_policy. Build and run with:
+//
+//   pio run -e native_overload_bench
+//   .pio/build/native_overload_bench/program
+
+#ifdef HALMET_OVERLOAD_BENCH
+
+#include <algorithm>
+#include <cstdio>
+
+#include "overload_sim.h"
+
+using namespace halmet;
+
+namespace {
+
+void Print(const char* name, OverloadSim::Result& result) {
+  std::sort(result.lateness.begin(), result.lateness.end());
+  uint64_t p95 = result.lateness[result.lateness.size() * 95 / 100];
+  printf("%-10s %5d %7.1f %8.1f %6d %10.1f %8d\n", name, result.transmissions,
+         p95 / 1000.0, result.max_lateness / 1000.0, result.misses,
+         result.settled_max_lateness / 1000.0, result.settled_misses);
+}
+
+}  // namespace
+
+int main() {
+  OverloadSim::Result ungoverned = OverloadSim::run(false);
+  OverloadSim::Result governed = OverloadSim::run(true);
+
+  const uint64_t kSecond = OverloadSim::kSecond;
+  printf("PGN 127488 lateness (ms), app loop overload from %d s to %d s, "
+         "real-time loop overload from %d s to %d s\n",
+         (int)(OverloadSim::kAppOverloadStart / kSecond),
+         (int)(OverloadSim::kAppOverloadEnd / kSecond),
+         (int)(OverloadSim::kRtOverloadStart / kSecond),
+         (int)(OverloadSim::kRtOverloadEnd / kSecond));
+  printf("%-10s %5s %7s %8s %6s %10s %8s\n", "run", "sent", "p95", "max",
+         "misses", "settled max", "misses");
+  Print("ungoverned", ungoverned);
+  Print("governed", governed);
+
+  const char* kLoopNames[] = {"real-time", "app"};
+  printf("\nShed stages per second:\n");
+  for (int loop = 0; loop < OverloadSim::kNumLoops; loop++) {
+    printf("  %-9s %s\n", kLoopNames[loop], governed.levels[loop]);
+    int rank = 0;
+    for (int i = 0; i < OverloadSim::kNumStages; i++) {
+      if (OverloadSim::stage_loop(i) == loop) {
+        printf("    %d: %s\n", ++rank, OverloadSim::stage_name(i));
+      }
+    }
+  }
+  return 0;
+}
+
+#endif  // HALMET_OVERLOAD_BENCH
@@ -0,0 +1,107 @@
+#include "overload_governor.h"
+
+#include <algorithm>
+
+#include "rt_event_loop.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+// Probe interval, the PGN 127488 cadence
+const unsigned int kProbeInterval = 100;  // ms
+
+const char* kLoopNames[] = {"real-time", "app"};
+
+}  // namespace
+
+OverloadGovernor::OverloadGovernor(unsigned int window) : window_{window} {
+  for (int i = 0; i < (int)LoopId::kCount; i++) {
+    loops_[i].reported_busy = LoopBusyMicros((LoopId)i);
+  }
+  rt_event_loop()->onRepeat(kProbeInterval, [this]() { probe(); });
+  sensesp::event_loop()->onRepeat(window_, [this]() { evaluate(); });
+}
+
+void OverloadGovernor::add_stage(const char* name, LoopId loop,
+                                 std::function<void(bool shed)> action) {
+  loops_[(int)loop].stages.push_back({name, action});
+}
+
+void OverloadGovernor::probe() {
+  uint32_t now = millis();
+  if (last_probe_ != 0 &&
+      now - last_probe_ > kProbeInterval + kMissTolerance) {
+    misses_++;
+  }
+  last_probe_ = now;
+}
+
+void OverloadGovernor::evaluate() {
+  // The probe runs on the real-time loop
+  int misses = misses_.exchange(0);
+  float load = 0;
+  int level = 0;
+  for (int i = 0; i < (int)LoopId::kCount; i++) {
+    LoopId id = (LoopId)i;
+    load = std::max(load, evaluate(id, id == LoopId::kRealtime ? misses : 0));
+    level += loops_[i].applied_level;
+  }
+
+  load_.set(load);
+  deadline_misses_.set(misses);
+  shed_events_.set(shed_count_);
+  level_.set(level);
+}
+
+float OverloadGovernor::evaluate(LoopId id, int misses) {
+  Loop& loop = loops_[(int)id];
+  if (loop.policy == nullptr) {
+    loop.policy = new LoadSheddingPolicy(loop.stages.size());
+  }
+
+  uint32_t busy = LoopBusyMicros(id);
+  float load = (uint32_t)(busy - loop.reported_busy) / 1000.0f / window_;
+  loop.reported_busy = busy;
+
+  int new_level = loop.policy->update(load, misses);
+  // Shed in the order of the stages, restore in reverse
+  for (; loop.applied_level < new_level; loop.applied_level++) {
+    debugW("Overload of the %s loop (load %.2f, %d misses): shedding %s",
+           kLoopNames[(int)id], load, misses,
+           loop.stages[loop.applied_level].name);
+    loop.stages[loop.applied_level].action(true);
+    shed_count_++;
+  }
+  for (; loop.applied_level > new_level; loop.applied_level--) {
+    loop.stages[loop.applied_level - 1].action(false);
+    debugW("%s loop load %.2f: restored %s", kLoopNames[(int)id], load,
+           loop.stages[loop.applied_level - 1].name);
+  }
+  return load;
+}
+
+void ConnectOverloadGovernorOutputs(OverloadGovernor* governor) {
+  using sensesp::SKMetadata;
+
+  governor->level_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.governor.level", "",
+      new SKMetadata("", "Load shedding level",
+                     "Number of shed work stages")));
+  governor->shed_events_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.governor.shedEvents", "",
+      new SKMetadata("", "Load shedding events",
+                     "Stages shed since boot")));
+  governor->deadline_misses_.connect_to(new sensesp::SKOutputInt(
+      "sensors.halmet.governor.deadlineMisses", "",
+      new SKMetadata("", "Deadline misses",
+                     "Late runs of the 100 ms real-time probe")));
+  governor->load_.connect_to(new sensesp::SKOutputFloat(
+      "sensors.halmet.governor.load", "",
+      new SKMetadata("ratio", "Event loop load",
+                     "Busy fraction of the busier event loop")));
+}
+
+}  // namespace halmet
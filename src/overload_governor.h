@@ -0,0 +1,82 @@
+#ifndef HALMET_SRC_OVERLOAD_GOVERNOR_H_
+#define HALMET_SRC_OVERLOAD_GOVERNOR_H_
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "load_shedding_policy.h"
+#include "power_manager.h"
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/**
+ * @brief Sheds low-priority work while the event loops are overloaded.
+ *
+ * Every stage belongs to the event loop that runs its work. Every
+ * evaluation window, each loop has its own LoadSheddingPolicy fed with the
+ * load of that loop, so an overloaded loop only sheds its own stages. The
+ * real-time loop policy also gets the deadline misses of a probe event on
+ * rt_event_loop(). The probe repeats at the 100 ms PGN 127488 cadence and
+ * counts a miss when it runs more than kMissTolerance late.
+ *
+ * The stages of a loop are shed in the order they were added and restored
+ * in reverse, so add the least important work first. The CAN transmit path
+ * and the alarm inputs are never part of a stage.
+ */
+class OverloadGovernor {
+ public:
+  /// A deadline miss is a probe run later than this, in ms
+  static constexpr unsigned int kMissTolerance = 20;
+
+  OverloadGovernor(unsigned int window = 1000);
+
+  /// Add a stage for work run by `loop`. `action` is called with true to
+  /// shed the work and with false to restore it, on the SensESP event loop.
+  void add_stage(const char* name, LoopId loop,
+                 std::function<void(bool shed)> action);
+
+  /// Number of stages shed on all loops
+  sensesp::ObservableValue<int> level_{0};
+  /// Stages shed since boot
+  sensesp::ObservableValue<int> shed_events_{0};
+  /// Probe deadline misses in the last window
+  sensesp::ObservableValue<int> deadline_misses_;
+  /// Busy fraction of the busier loop in the last window
+  sensesp::ObservableValue<float> load_;
+
+ protected:
+  struct Stage {
+    const char* name;
+    std::function<void(bool shed)> action;
+  };
+
+  struct Loop {
+    std::vector<Stage> stages;
+    // Created on the first evaluation, when all stages have been added
+    LoadSheddingPolicy* policy = nullptr;
+    // Stages whose action has been called with true
+    int applied_level = 0;
+    uint32_t reported_busy = 0;
+  };
+
+  void probe();
+  void evaluate();
+  /// Evaluate `loop` and return its load
+  float evaluate(LoopId id, int misses);
+
+  unsigned int window_;
+  Loop loops_[(int)LoopId::kCount];
+  int shed_count_ = 0;
+  // Probe state, owned by rt_event_loop()
+  uint32_t last_probe_ = 0;
+  std::atomic<int> misses_{0};
+};
+
+/// Publish the governor state at sensors.halmet.governor.*
+void ConnectOverloadGovernorOutputs(OverloadGovernor* governor);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_OVERLOAD_GOVERNOR_H_
@@ -0,0 +1,170 @@
+#include "overload_sim.h"
+
+#include <algorithm>
+
+#include "load_shedding_policy.h"
+
+namespace halmet {
+
+namespace {
+
+struct Task {
+  const char* name;
+  OverloadSim::Loop loop;
+  uint64_t period;  // us
+  uint64_t cost;    // us
+  int stage;        // Stage that sheds the task, or kNone
+  uint64_t start;   // Active from, us
+  uint64_t end;     // Active until, us
+  uint64_t next;
+};
+
+const uint64_t kPGNPeriod = 100000;
+// Shed SK deltas are sent at a tenth of the rate
+const uint64_t kSKShedFactor = 10;
+
+std::vector<Task> MakeTasks() {
+  using OS = OverloadSim;
+  const uint64_t kDuration = OS::kDuration;
+  return {
+      // The PGN must be first; its lateness is measured
+      {"pgn127488", OS::kRealtime, kPGNPeriod, 300, OS::kNone, 0, kDuration,
+       0},
+      {"n2k parse", OS::kRealtime, 1000, 100, OS::kNone, 0, kDuration, 0},
+      {"adc scan", OS::kRealtime, 2000, 150, OS::kNone, 0, kDuration, 0},
+      {"logging", OS::kRealtime, 50000, 3000, OS::kLogging, 0, kDuration, 0},
+      {"can burst", OS::kRealtime, 5000, 4000, OS::kNone,
+       OS::kRtOverloadStart, OS::kRtOverloadEnd, OS::kRtOverloadStart},
+      {"sk delta", OS::kApp, 20000, 1500, OS::kSKRate, 0, kDuration, 0},
+      {"display", OS::kApp, 500000, 12000, OS::kDisplay, 0, kDuration, 0},
+      {"web ui", OS::kApp, 4800, 4500, OS::kNone, OS::kAppOverloadStart,
+       OS::kAppOverloadEnd, OS::kAppOverloadStart},
+  };
+}
+
+// Position of `stage` among the stages of its loop, in shedding order
+int StageRank(int stage) {
+  int rank = 0;
+  for (int i = 0; i < stage; i++) {
+    rank += OverloadSim::stage_loop(i) == OverloadSim::stage_loop(stage);
+  }
+  return rank;
+}
+
+int StageCount(OverloadSim::Loop loop) {
+  int count = 0;
+  for (int i = 0; i < OverloadSim::kNumStages; i++) {
+    count += OverloadSim::stage_loop(i) == loop;
+  }
+  return count;
+}
+
+bool InSettleTime(uint64_t now) {
+  const uint64_t starts[] = {OverloadSim::kAppOverloadStart,
+                             OverloadSim::kRtOverloadStart};
+  for (uint64_t start : starts) {
+    if (now >= start && now < start + OverloadSim::kSettleTime) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+const char* OverloadSim::stage_name(int stage) {
+  static const char* kNames[] = {"display", "SK rate", "debug logging"};
+  return stage >= 0 && stage < kNumStages ? kNames[stage] : "";
+}
+
+OverloadSim::Loop OverloadSim::stage_loop(int stage) {
+  return stage == kLogging ? kRealtime : kApp;
+}
+
+OverloadSim::Result OverloadSim::run(bool governed) {
+  std::vector<Task> tasks = MakeTasks();
+  LoadSheddingPolicy policies[kNumLoops] = {
+      LoadSheddingPolicy(StageCount(kRealtime)),
+      LoadSheddingPolicy(StageCount(kApp))};
+  Result result;
+  int level[kNumLoops] = {};
+  uint64_t now[kNumLoops] = {};
+  uint64_t window_end = kSecond;
+  uint64_t window_busy[kNumLoops] = {};
+  int window_misses = 0;
+
+  while (true) {
+    // Earliest due task of each loop, in trigger time order like reactesp.
+    // The loops run on their own cores; the one that starts its next task
+    // first goes next.
+    Task* task = nullptr;
+    uint64_t task_start = 0;
+    for (Task& t : tasks) {
+      if (t.next >= t.end) {
+        continue;
+      }
+      uint64_t start = std::max(t.next, now[t.loop]);
+      if (task == nullptr || start < task_start ||
+          (start == task_start && t.next < task->next)) {
+        task = &t;
+        task_start = start;
+      }
+    }
+    if (task == nullptr || task_start >= kDuration) {
+      break;
+    }
+
+    // Evaluate the windows that have passed
+    while (task_start >= window_end) {
+      for (int loop = 0; loop < kNumLoops; loop++) {
+        float load = (float)window_busy[loop] / kSecond;
+        if (governed) {
+          // The deadline probe runs on the real-time loop
+          level[loop] = policies[loop].update(
+              load, loop == kRealtime ? window_misses : 0);
+        }
+        result.levels[loop][window_end / kSecond - 1] = '0' + level[loop];
+        window_busy[loop] = 0;
+      }
+      window_end += kSecond;
+      window_misses = 0;
+    }
+
+    uint64_t scheduled = task->next;
+    uint64_t period = task->period;
+    bool skip = false;
+    if (task->stage != kNone && StageRank(task->stage) < level[task->loop]) {
+      if (task->stage == kSKRate) {
+        period *= kSKShedFactor;
+      } else {
+        skip = true;
+      }
+    }
+    task->next = scheduled + period;
+    if (skip) {
+      continue;
+    }
+
+    if (task == &tasks[0]) {
+      uint64_t lateness = task_start - scheduled;
+      result.transmissions++;
+      result.lateness.push_back(lateness);
+      result.max_lateness = std::max(result.max_lateness, lateness);
+      bool settled = !InSettleTime(task_start);
+      if (settled) {
+        result.settled_max_lateness =
+            std::max(result.settled_max_lateness, lateness);
+      }
+      if (lateness > kMissTolerance) {
+        result.misses++;
+        result.settled_misses += settled;
+        window_misses++;
+      }
+    }
+    now[task->loop] = task_start + task->cost;
+    window_busy[task->loop] += task->cost;
+  }
+  return result;
+}
+
+}  // namespace halmet
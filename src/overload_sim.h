@@ -0,0 +1,67 @@
+#ifndef HALMET_SRC_OVERLOAD_SIM_H_
+#define HALMET_SRC_OVERLOAD_SIM_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace halmet {
+
+/**
+ * @brief Simulated event loops under overload, for LoadSheddingPolicy.
+ *
+ * Two event loops on their own cores run the HALMET periodic work with the
+ * reactesp scheduling rules: due events run in trigger time order and
+ * repeat events keep their nominal schedule. The real-time loop sends PGN
+ * 127488, parses CAN and scans the ADC; the app loop sends Signal K deltas
+ * and refreshes the display. Debug logging is shed with the real-time loop.
+ *
+ * Between kAppOverloadStart and kAppOverloadEnd, a Wi-Fi reconnect and an
+ * open web UI overload the app loop. Between kRtOverloadStart and
+ * kRtOverloadEnd, a burst of CAN traffic overloads the real-time loop. Each
+ * loop has its own LoadSheddingPolicy and sheds only its own stages. The
+ * lateness of the 127488 transmissions is recorded.
+ *
+ * The costs are rough figures for an ESP32 at 240 MHz, chosen so that each
+ * overload exceeds the capacity of its loop by a few percent.
+ *
+ * Used by overload_bench_main.cpp and test/test_load_shedding_policy.
+ */
+class OverloadSim {
+ public:
+  enum Loop { kRealtime = 0, kApp, kNumLoops };
+  enum Stage { kDisplay = 0, kSKRate, kLogging, kNumStages, kNone = -1 };
+
+  static constexpr uint64_t kSecond = 1000000;  // us
+  static constexpr uint64_t kDuration = 60 * kSecond;
+  static constexpr uint64_t kAppOverloadStart = 5 * kSecond;
+  static constexpr uint64_t kAppOverloadEnd = 20 * kSecond;
+  static constexpr uint64_t kRtOverloadStart = 35 * kSecond;
+  static constexpr uint64_t kRtOverloadEnd = 45 * kSecond;
+  /// Time allowed for the governor to shed before deadlines must hold
+  static constexpr uint64_t kSettleTime = 4 * kSecond;
+  /// A transmission later than this counts as a missed deadline
+  static constexpr uint64_t kMissTolerance = 20000;  // us
+
+  static const char* stage_name(int stage);
+  /// Loop that runs the work of `stage`
+  static Loop stage_loop(int stage);
+
+  struct Result {
+    int transmissions = 0;
+    int misses = 0;
+    // Outside the first kSettleTime of each overload
+    int settled_misses = 0;
+    uint64_t max_lateness = 0;
+    uint64_t settled_max_lateness = 0;
+    std::vector<uint64_t> lateness;
+    /// Shed stages of each loop at the end of each second, as digits
+    char levels[kNumLoops][kDuration / kSecond + 1] = {};
+  };
+
+  /// Run the simulation without or with a LoadSheddingPolicy per loop.
+  static Result run(bool governed);
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_OVERLOAD_SIM_H_
@@ -0,0 +1,181 @@
+#include "power_manager.h"
+
+#include <esp_pm.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/system/lambda_consumer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const char* kLoopNames[] = {"rtLoop", "appLoop"};
+
+struct LoopState {
+  esp_pm_lock_handle_t lock = nullptr;
+  int64_t tick_start = 0;
+  // Busy time in us. Wraps after about 71 minutes; only differences over a
+  // report interval are used.
+  std::atomic<uint32_t> busy{0};
+};
+
+LoopState loop_states[(int)LoopId::kCount];
+std::atomic<bool> power_save{false};
+
+}  // namespace
+
+void BeginLoopTick(LoopId loop) {
+  LoopState& state = loop_states[(int)loop];
+  if (state.lock != nullptr) {
+    esp_pm_lock_acquire(state.lock);
+  }
+  state.tick_start = esp_timer_get_time();
+}
+
+void EndLoopTick(LoopId loop) {
+  LoopState& state = loop_states[(int)loop];
+  uint32_t busy = esp_timer_get_time() - state.tick_start;
+  state.busy.fetch_add(busy, std::memory_order_relaxed);
+  if (state.lock != nullptr) {
+    esp_pm_lock_release(state.lock);
+  }
+}
+
+uint32_t LoopBusyMicros(LoopId loop) {
+  return loop_states[(int)loop].busy.load(std::memory_order_relaxed);
+}
+
+bool power_save_enabled() { return power_save; }
+
+PowerManager::PowerManager(const String& config_path,
+                           unsigned int report_interval)
+    : BlobSaveable{config_path}, max_frequency_{(int)getCpuFrequencyMhz()} {
+  load();
+
+  for (int i = 0; i < (int)LoopId::kCount; i++) {
+    esp_err_t err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, kLoopNames[i],
+                                       &loop_states[i].lock);
+    if (err != ESP_OK) {
+      // CONFIG_PM_ENABLE is not set in the framework build
+      debugW("Power management not available: %s", esp_err_to_name(err));
+      loop_states[i].lock = nullptr;
+      supported_ = false;
+    }
+  }
+  apply();
+
+  sensesp::event_loop()->onRepeat(report_interval, [this, report_interval]() {
+    report(report_interval);
+  });
+}
+
+void PowerManager::apply() {
+  power_save = power_save_ && supported_;
+  if (!supported_) {
+    return;
+  }
+  esp_pm_config_t pm_config = {};
+  pm_config.max_freq_mhz = max_frequency_;
+  pm_config.min_freq_mhz =
+      power_save_ ? std::min(min_frequency_, max_frequency_) : max_frequency_;
+  pm_config.light_sleep_enable = false;
+  esp_err_t err = esp_pm_configure(&pm_config);
+  if (err != ESP_OK) {
+    debugW("Power management: configuration failed: %s",
+           esp_err_to_name(err));
+    power_save = false;
+    return;
+  }
+  debugI("Power management: %d-%d MHz", pm_config.min_freq_mhz,
+         pm_config.max_freq_mhz);
+}
+
+void PowerManager::compare_jitter(IntervalJitterMonitor* monitor) {
+  monitor->p95_.connect_to(new sensesp::LambdaConsumer<float>([this](float v) {
+    JitterStats& stats = jitter_[power_save_enabled()];
+    stats.p95 = std::max(stats.p95, v);
+  }));
+  monitor->max_.connect_to(new sensesp::LambdaConsumer<float>([this](float v) {
+    JitterStats& stats = jitter_[power_save_enabled()];
+    stats.max = std::max(stats.max, v);
+  }));
+}
+
+void PowerManager::report(uint32_t elapsed) {
+  for (int i = 0; i < (int)LoopId::kCount; i++) {
+    uint32_t busy = LoopBusyMicros((LoopId)i);
+    loop_load_[i].set((uint32_t)(busy - reported_busy_[i]) / 1000.0f /
+                      elapsed);
+    reported_busy_[i] = busy;
+  }
+}
+
+bool PowerManager::to_json(JsonObject& config) {
+  config["power_save"] = power_save_;
+  config["min_frequency"] = min_frequency_;
+  config["supported"] = supported_;
+
+  char report[160];
+  snprintf(report, sizeof(report),
+           "Full speed: p95 %.1f ms, max %.1f ms. "
+           "Power save: p95 %.1f ms, max %.1f ms.",
+           jitter_[0].p95 * 1000, jitter_[0].max * 1000,
+           jitter_[1].p95 * 1000, jitter_[1].max * 1000);
+  config["jitter"] = report;
+  return true;
+}
+
+bool PowerManager::from_json(const JsonObject& config) {
+  if (!config["power_save"].is<bool>() ||
+      !config["min_frequency"].is<int>()) {
+    return false;
+  }
+  bool was_power_save = power_save_;
+  power_save_ = config["power_save"];
+  min_frequency_ = config["min_frequency"];
+  // Below 80 MHz the APB clock would have to scale down too, which the CAN
+  // controller doesn't allow while it runs.
+  if (min_frequency_ != 160) {
+    min_frequency_ = 80;
+  }
+  if (power_save_ != was_power_save) {
+    // Start a new comparison for the mode switched to
+    jitter_[power_save_] = {};
+  }
+  if (loop_states[0].lock != nullptr) {
+    apply();
+  }
+  return true;
+}
+
+const String ConfigSchema(const PowerManager& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "power_save": { "title": "Power save", "type": "boolean", "description": "Scale the CPU frequency down while the event loops wait for their next deadline" },
+      "min_frequency": { "title": "Minimum CPU frequency", "type": "integer", "enum": [80, 160], "description": "CPU frequency between event loop ticks (MHz)" },
+      "supported": { "title": "Supported by the firmware", "type": "boolean", "readOnly": true },
+      "jitter": { "title": "PGN 127488 jitter by mode", "type": "string", "readOnly": true }
+    }
+  })###";
+}
+
+void ConnectPowerOutputs(PowerManager* power_manager) {
+  char sk_path[80];
+  char display_name[80];
+  for (int i = 0; i < (int)LoopId::kCount; i++) {
+    snprintf(sk_path, sizeof(sk_path), "sensors.halmet.power.%sLoad",
+             kLoopNames[i]);
+    snprintf(display_name, sizeof(display_name), "%s load", kLoopNames[i]);
+    power_manager->loop_load_[i].connect_to(new sensesp::SKOutputFloat(
+        sk_path, "",
+        new sensesp::SKMetadata("ratio", display_name,
+                                "Fraction of time spent running events")));
+  }
+}
+
+}  // namespace halmet
@@ -0,0 +1,103 @@
+#ifndef HALMET_SRC_POWER_MANAGER_H_
+#define HALMET_SRC_POWER_MANAGER_H_
+
+#include <atomic>
+
+#include "config_blob_store.h"
+#include "data_age.h"
+#include "sensesp/system/observablevalue.h"
+
+namespace halmet {
+
+/// Event loops whose ticks are tracked by the power manager
+enum class LoopId : uint8_t {
+  kRealtime = 0,
+  kApp,
+  kCount,
+};
+
+/**
+ * @brief Mark the start and end of an event loop tick.
+ *
+ * Between the two calls, the loop holds a CPU frequency lock, so all due
+ * events run at full speed. While every loop waits for its next deadline,
+ * the CPU drops to the minimum frequency. The busy time is also accounted
+ * for the loop load metric. Cheap no-ops for the lock until a PowerManager
+ * is created.
+ */
+void BeginLoopTick(LoopId loop);
+void EndLoopTick(LoopId loop);
+
+/// Total busy time of `loop` in us. Wraps around; use differences.
+uint32_t LoopBusyMicros(LoopId loop);
+
+/// True if power saving is enabled. Loops that would otherwise spin should
+/// wait for the next scheduler tick.
+bool power_save_enabled();
+
+/**
+ * @brief Dynamic CPU frequency scaling between event loop ticks.
+ *
+ * Configures the ESP-IDF power management to scale the CPU clock between
+ * 240 MHz and a configurable minimum. The event loops request the maximum
+ * frequency only while they run their due events, so the timing of the
+ * periodic work, e.g. the 100 ms PGN 127488 cadence, is kept. The pulse
+ * counters are interrupt driven and count at any clock frequency.
+ *
+ * Automatic light sleep is not used: the TWAI driver holds an APB frequency
+ * lock while the CAN controller runs, which blocks light sleep anyway, and
+ * GPIO pulse interrupts would be lost while asleep.
+ *
+ * The load of each event loop (busy fraction of the report interval) is
+ * published. Power saving can be switched in the web UI at runtime; the
+ * worst 127488 jitter seen in each mode is shown next to the setting for
+ * comparison. The supply current has to be measured externally, e.g. with
+ * a shunt in the 12 V feed, once in each mode.
+ */
+class PowerManager : public BlobSaveable {
+ public:
+  PowerManager(const String& config_path,
+               unsigned int report_interval = 10000);
+
+  /// Compare the jitter reported by `monitor` between the two modes.
+  void compare_jitter(IntervalJitterMonitor* monitor);
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  /// Busy fraction of each loop, indexed by LoopId
+  sensesp::ObservableValue<float> loop_load_[(int)LoopId::kCount];
+
+ protected:
+  struct JitterStats {
+    float p95;  // s
+    float max;  // s
+  };
+
+  void apply();
+  void report(uint32_t elapsed);
+
+  // Configuration
+  bool power_save_ = true;
+  int min_frequency_ = 80;  // MHz
+
+  // CPU frequency before power management was configured. Read once: once
+  // DFS is active, getCpuFrequencyMhz() returns the current, possibly
+  // scaled down, frequency.
+  const int max_frequency_;
+  bool supported_ = true;
+  uint32_t reported_busy_[(int)LoopId::kCount] = {};
+  // Worst jitter while full speed (0) and power save (1) were active
+  JitterStats jitter_[2] = {};
+};
+
+const String ConfigSchema(const PowerManager& obj);
+
+inline bool ConfigRequiresRestart(const PowerManager& obj) { return false; }
+
+/// Publish the loop loads at sensors.halmet.power.*
+void ConnectPowerOutputs(PowerManager* power_manager);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_POWER_MANAGER_H_
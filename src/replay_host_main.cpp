@@ -0,0 +1,510 @@
+// Host replay of an input trace through the tank and tacho pipelines.
+//
+// Feeds the ADC and pulse counter records of an input trace (see
+// src/input_trace.h) on a simulated clock, faster than real time, through
+// the input conversions of ConnectTankSender and ConnectTachoSender, the
+// N2kMsgTemplate encoding of N2kFluidLevelSender and
+// N2kEngineParameterRapidSender, and the SKDeltaSerializer of
+// SKDeltaSender. Every transmitted PGN and every Signal K delta is written
+// as a line of text, which can be compared with a golden file. Build and
+// run with:
+//
+//   pio run -e native_replay
+//   .pio/build/native_replay/program trace.htrc --output golden.txt
+//   .pio/build/native_replay/program trace.htrc --golden golden.txt
+//
+// With --golden, the exit status is 1 if the output differs. The PGNs are
+// sent to a mock CAN driver, or with --can to a SocketCAN interface, where
+// they can be watched with candump. They are sent as fast as the replay
+// runs, so the bus timing isn't meaningful.
+//
+// SensESP doesn't build on the host. The SensESP parts of the pipelines,
+// the CurveInterpolator, Linear and Frequency transforms and the sender
+// ExpiringInputs, are mirrored below with their default configuration. The
+// channels are those of the default ChannelConfig: a fuel tank on A1 and
+// the main engine tacho on D1. Metadata deltas are left out.
+
+#ifdef HALMET_REPLAY_HOST
+
+#include <N2kMessages.h>
+#include <NMEA2000.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "host_clock.h"
+#include "input_conversion.h"
+#include "n2k_msg_template.h"
+#include "n2k_socketcan.h"
+#include "sk_delta_serializer.h"
+
+using namespace halmet;
+
+namespace {
+
+// Record types and format version of InputTrace
+const uint8_t kAdc = 1;
+const uint8_t kCounter = 2;
+const uint8_t kCanTx = 3;
+const uint8_t kCanRx = 4;
+const uint8_t kFormatVersion = 2;
+
+// The default ChannelConfig channels
+const int kTankAdcKey = 0;  // A1: device 0, channel 0
+const uint8_t kTankInstance = 0;
+const float kTankCapacity = 200;  // l
+const uint8_t kTachoPin = 23;     // D1
+const uint8_t kEngineInstance = 0;
+
+// Sender intervals and input expiry times, as in n2k_senders.h
+const uint32_t kEngineRapidInterval = 100;   // ms
+const uint32_t kEngineRapidExpiry = 1000;    // ms
+const uint32_t kFluidLevelInterval = 2500;   // ms
+const uint32_t kFluidLevelExpiry = 10000;    // ms
+// SKDeltaSender interval
+const uint32_t kSKSendInterval = 20;  // ms
+
+/// ADC and counter records of an input trace
+class TraceReader {
+ public:
+  struct Record {
+    uint32_t time;  // ms from the start of the trace
+    uint8_t type;
+    uint8_t key;    // ADC device * 4 + channel, or counter pin
+    int32_t value;
+  };
+
+  bool open(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+      return false;
+    }
+    uint8_t buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+      data_.insert(data_.end(), buf, buf + len);
+    }
+    fclose(file);
+    pos_ = 5;
+    return data_.size() >= 5 && memcmp(data_.data(), "HTRC", 4) == 0 &&
+           data_[4] == kFormatVersion;
+  }
+
+  /// Read the next ADC or counter record. Returns false at the end of the
+  /// trace or on a truncated record.
+  bool next(Record* record) {
+    uint32_t delta;
+    while (read_varint(&delta) && pos_ < data_.size()) {
+      time_ += delta;
+      record->time = time_;
+      record->type = data_[pos_++];
+      uint32_t value;
+      switch (record->type) {
+        case kAdc:
+          if (pos_ + 2 > data_.size()) {
+            return false;
+          }
+          record->key = data_[pos_] * 4 + data_[pos_ + 1];
+          pos_ += 2;
+          if (!read_varint(&value)) {
+            return false;
+          }
+          record->value = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+          return true;
+        case kCounter:
+          if (pos_ >= data_.size()) {
+            return false;
+          }
+          record->key = data_[pos_++];
+          if (!read_varint(&value)) {
+            return false;
+          }
+          record->value = value;
+          return true;
+        case kCanTx:
+        case kCanRx: {
+          // CAN traffic isn't replayed; the outputs are regenerated
+          uint32_t pgn;
+          if (!read_varint(&pgn) || pos_ + 3 > data_.size()) {
+            return false;
+          }
+          pos_ += 3;
+          if (!read_varint(&value) || pos_ + value > data_.size()) {
+            return false;
+          }
+          pos_ += value;
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+ protected:
+  bool read_varint(uint32_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 35 && pos_ < data_.size(); shift += 7) {
+      uint8_t byte = data_[pos_++];
+      *value |= (uint32_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<uint8_t> data_;
+  size_t pos_ = 0;
+  uint32_t time_ = 0;
+};
+
+/// tNMEA2000 driver that drops every frame
+class N2kMockCAN : public tNMEA2000 {
+ protected:
+  virtual bool CANOpen() override { return true; }
+  virtual bool CANSendFrame(unsigned long id, unsigned char len,
+                            const unsigned char* buf,
+                            bool wait_sent = true) override {
+    return true;
+  }
+  virtual bool CANGetFrame(unsigned long& id, unsigned char& len,
+                           unsigned char* buf) override {
+    return false;
+  }
+};
+
+/// Mirrors ExpiringInput<float>
+struct ExpiringFloat {
+  uint32_t expiry;
+  float value = N2kNumericNA<float>();
+  uint32_t updated = 0;
+
+  void set(float input, uint32_t now) {
+    value = input;
+    updated = now;
+  }
+  float get(uint32_t now) const {
+    return now - updated > expiry ? N2kNumericNA<float>() : value;
+  }
+};
+
+/// Mirrors the default level curve of ConnectTankSender and
+/// sensesp::CurveInterpolator
+float TankLevel(float resistance) {
+  static const float kCurve[][2] = {{0, 0}, {180., 1}, {1000., 1}};
+  float x0 = 0;
+  float y0 = 0;
+  for (const auto& sample : kCurve) {
+    if (resistance > sample[0]) {
+      x0 = sample[0];
+      y0 = sample[1];
+      continue;
+    }
+    if (sample[0] == x0) {
+      return sample[1];
+    }
+    return y0 + (sample[1] - y0) * (resistance - x0) / (sample[0] - x0);
+  }
+  return y0;
+}
+
+/// Output lines of the replay, in the golden file format
+class ReplayLog {
+ public:
+  void pgn(uint32_t now, const tN2kMsg& msg) {
+    std::string line = std::to_string(now) + " pgn " +
+                       std::to_string(msg.PGN) + " ";
+    char hex[3];
+    for (int i = 0; i < msg.DataLen; i++) {
+      snprintf(hex, sizeof(hex), "%02x", msg.Data[i]);
+      line += hex;
+    }
+    lines_.push_back(line);
+  }
+
+  void sk(uint32_t now, const char* delta) {
+    lines_.push_back(std::to_string(now) + " sk " + delta);
+  }
+
+  const std::vector<std::string>& lines() const { return lines_; }
+
+ protected:
+  std::vector<std::string> lines_;
+};
+
+/// The tank and tacho pipelines and their senders
+class Replay {
+ public:
+  Replay(tNMEA2000* nmea2000, ReplayLog* log)
+      : nmea2000_{nmea2000}, log_{log} {
+    // In the order ConnectTankSender and ConnectTachoSender add the outputs
+    resistance_id_ =
+        serializer_.add_path("tanks.fuel.main.senderResistance", 1);
+    level_id_ = serializer_.add_path("tanks.fuel.main.currentLevel");
+    volume_id_ = serializer_.add_path("tanks.fuel.main.currentVolume", 5);
+    revolutions_id_ = serializer_.add_path("propulsion.main.revolutions", 2);
+  }
+
+  void add_record(const TraceReader::Record& record) {
+    if (record.type == kAdc && record.key == kTankAdcKey) {
+      tank_counts_ = record.value;
+      tank_valid_ = true;
+    } else if (record.type == kCounter && record.key == kTachoPin) {
+      // Summed like InputTrace::replay_counter()
+      tacho_counts_ += record.value;
+      tacho_valid_ = true;
+    }
+  }
+
+  /// Run the events due at `now`, in the order of the firmware schedulers
+  void tick(uint32_t now) {
+    if (now % kTankReadDelay == 0) {
+      read_tank(now);
+    }
+    if (now % kTachoReadDelay == 0) {
+      read_tacho(now);
+    }
+    if (now % kFluidLevelInterval == 0) {
+      fluid_level_.set_fluid_level<float>(kTankInstance, N2kft_Fuel,
+                                          tank_level_percent_.get(now),
+                                          kTankCapacity);
+      transmit(now, fluid_level_.msg());
+    }
+    if (now % kEngineRapidInterval == 0) {
+      engine_rapid_.set_engine_param_rapid<float>(
+          kEngineInstance, engine_speed_rpm_.get(now),
+          N2kNumericNA<float>(), N2kInt8NA);
+      transmit(now, engine_rapid_.msg());
+    }
+    if (now % kSKSendInterval == 0) {
+      send_sk(now);
+    }
+  }
+
+ protected:
+  struct Output {
+    float value = 0;
+    bool changed = false;
+  };
+
+  void read_tank(uint32_t now) {
+    if (!tank_valid_) {
+      return;
+    }
+    float resistance = SenderResistance(tank_counts_);
+    set_sk(resistance_id_, resistance);
+    float level = TankLevel(resistance);
+    set_sk(level_id_, level);
+    tank_level_percent_.set(100 * level, now);
+    // Linear with the default tank size
+    set_sk(volume_id_, kTankDefaultSize * level);
+  }
+
+  void read_tacho(uint32_t now) {
+    if (!tacho_valid_) {
+      return;
+    }
+    // sensesp::Frequency with the default multiplier
+    float frequency = kDefaultFrequencyScale * tacho_counts_ /
+                      ((now - last_tacho_read_) / 1000.);
+    last_tacho_read_ = now;
+    tacho_counts_ = 0;
+    set_sk(revolutions_id_, frequency);
+    engine_speed_rpm_.set(60 * frequency, now);
+  }
+
+  void transmit(uint32_t now, const tN2kMsg& msg) {
+    log_->pgn(now, msg);
+    nmea2000_->SendMsg(msg);
+  }
+
+  void set_sk(int id, float value) {
+    outputs_[id].value = value;
+    outputs_[id].changed = true;
+  }
+
+  // As SKDeltaSender::send(), without the metadata
+  void send_sk(uint32_t now) {
+    serializer_.begin();
+    for (int i = 0; i < serializer_.num_paths(); i++) {
+      if (!outputs_[i].changed) {
+        continue;
+      }
+      outputs_[i].changed = false;
+      if (!serializer_.add(i, outputs_[i].value)) {
+        flush_sk(now);
+        serializer_.begin();
+        serializer_.add(i, outputs_[i].value);
+      }
+    }
+    flush_sk(now);
+  }
+
+  void flush_sk(uint32_t now) {
+    if (serializer_.finish() > 0) {
+      log_->sk(now, serializer_.data());
+    }
+  }
+
+  tNMEA2000* nmea2000_;
+  ReplayLog* log_;
+
+  int32_t tank_counts_ = 0;
+  bool tank_valid_ = false;
+  int32_t tacho_counts_ = 0;
+  bool tacho_valid_ = false;
+  uint32_t last_tacho_read_ = 0;
+
+  ExpiringFloat tank_level_percent_{kFluidLevelExpiry};
+  ExpiringFloat engine_speed_rpm_{kEngineRapidExpiry};
+  N2kMsgTemplate fluid_level_;
+  N2kMsgTemplate engine_rapid_;
+
+  SKDeltaSerializer serializer_;
+  Output outputs_[SKDeltaSerializer::kMaxPaths];
+  int resistance_id_;
+  int level_id_;
+  int volume_id_;
+  int revolutions_id_;
+};
+
+bool ReadLines(const char* path, std::vector<std::string>* lines) {
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char buf[2048];
+  while (fgets(buf, sizeof(buf), file) != nullptr) {
+    buf[strcspn(buf, "\n")] = '\0';
+    lines->push_back(buf);
+  }
+  fclose(file);
+  return true;
+}
+
+/// Print the differences from the golden lines. Returns their number.
+int Diff(const std::vector<std::string>& golden,
+         const std::vector<std::string>& lines) {
+  const int kMaxReported = 20;
+  int differences = 0;
+  size_t count = std::max(golden.size(), lines.size());
+  for (size_t i = 0; i < count; i++) {
+    const char* expected = i < golden.size() ? golden[i].c_str() : "(none)";
+    const char* actual = i < lines.size() ? lines[i].c_str() : "(none)";
+    if (strcmp(expected, actual) == 0) {
+      continue;
+    }
+    if (++differences <= kMaxReported) {
+      printf("line %zu:\n  golden: %s\n  replay: %s\n", i + 1, expected,
+             actual);
+    }
+  }
+  return differences;
+}
+
+void Usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s TRACE [--output FILE] [--golden FILE] [--can IFACE]\n",
+          program);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const char* trace_path = nullptr;
+  const char* output_path = nullptr;
+  const char* golden_path = nullptr;
+  const char* can_interface = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--output") == 0) {
+      output_path = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--golden") == 0) {
+      golden_path = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--can") == 0) {
+      can_interface = argv[++i];
+    } else if (trace_path == nullptr && argv[i][0] != '-') {
+      trace_path = argv[i];
+    } else {
+      Usage(argv[0]);
+      return 2;
+    }
+  }
+  if (trace_path == nullptr) {
+    Usage(argv[0]);
+    return 2;
+  }
+
+  TraceReader reader;
+  if (!reader.open(trace_path)) {
+    fprintf(stderr, "%s isn't a version %d input trace\n", trace_path,
+            kFormatVersion);
+    return 2;
+  }
+
+  UseSimulatedClock(0);
+  std::unique_ptr<tNMEA2000> nmea2000;
+  if (can_interface != nullptr) {
+    nmea2000.reset(new N2kSocketCAN(can_interface));
+  } else {
+    nmea2000.reset(new N2kMockCAN());
+  }
+  nmea2000->SetProductInformation("20231229", 104, "HALMET replay", "1.0.0",
+                                  "1.0.0");
+  nmea2000->SetDeviceInformation(1, 140, 50, 2046);
+  nmea2000->SetMode(tNMEA2000::N2km_NodeOnly, 71);
+  nmea2000->EnableForward(false);
+  if (!nmea2000->Open()) {
+    fprintf(stderr, "Cannot open the CAN interface\n");
+    return 2;
+  }
+
+  ReplayLog log;
+  Replay replay(nmea2000.get(), &log);
+  TraceReader::Record record;
+  bool more = reader.next(&record);
+  uint32_t end = 0;
+  for (uint32_t now = 1; more || now <= end; now++) {
+    AdvanceClock(1);
+    while (more && record.time <= now) {
+      replay.add_record(record);
+      end = record.time + kFluidLevelInterval;
+      more = reader.next(&record);
+    }
+    replay.tick(now);
+    nmea2000->ParseMessages();
+  }
+
+  if (output_path != nullptr) {
+    FILE* file = fopen(output_path, "w");
+    if (file == nullptr) {
+      fprintf(stderr, "Cannot write %s\n", output_path);
+      return 2;
+    }
+    for (const auto& line : log.lines()) {
+      fprintf(file, "%s\n", line.c_str());
+    }
+    fclose(file);
+  }
+  printf("Replayed %u ms of %s: %zu PGNs and deltas\n", end, trace_path,
+         log.lines().size());
+
+  if (golden_path != nullptr) {
+    std::vector<std::string> golden;
+    if (!ReadLines(golden_path, &golden)) {
+      fprintf(stderr, "Cannot read %s\n", golden_path);
+      return 2;
+    }
+    int differences = Diff(golden, log.lines());
+    printf("%d lines differ from %s\n", differences, golden_path);
+    return differences > 0 ? 1 : 0;
+  }
+  return 0;
+}
+
+#endif  // HALMET_REPLAY_HOST
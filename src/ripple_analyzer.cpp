@@ -0,0 +1,143 @@
+#include "ripple_analyzer.h"
+
+#include <cmath>
+
+namespace halmet {
+
+namespace {
+
+const float kPi = 3.14159265358979f;
+
+}  // namespace
+
+RippleAnalyzer::RippleAnalyzer() {
+  hann_ = new float[kWindow];
+  cos_ = new float[kWindow / 2];
+  sin_ = new float[kWindow / 2];
+  re_ = new float[kWindow];
+  im_ = new float[kWindow];
+  for (size_t i = 0; i < kWindow; i++) {
+    hann_[i] = 0.5f - 0.5f * cosf(2 * kPi * i / kWindow);
+    hann_sum_ += hann_[i];
+  }
+  for (size_t i = 0; i < kWindow / 2; i++) {
+    cos_[i] = cosf(2 * kPi * i / kWindow);
+    sin_[i] = sinf(2 * kPi * i / kWindow);
+  }
+}
+
+RippleAnalyzer::~RippleAnalyzer() {
+  delete[] hann_;
+  delete[] cos_;
+  delete[] sin_;
+  delete[] re_;
+  delete[] im_;
+}
+
+void RippleAnalyzer::fft() {
+  // Bit-reversal permutation
+  for (size_t i = 1, j = 0; i < kWindow; i++) {
+    size_t bit = kWindow >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j |= bit;
+    if (i < j) {
+      float tmp = re_[i];
+      re_[i] = re_[j];
+      re_[j] = tmp;
+      tmp = im_[i];
+      im_[i] = im_[j];
+      im_[j] = tmp;
+    }
+  }
+
+  // Butterflies with twiddle factors exp(-2 pi i k / N)
+  for (size_t size = 2; size <= kWindow; size <<= 1) {
+    size_t half = size / 2;
+    size_t step = kWindow / size;
+    for (size_t start = 0; start < kWindow; start += size) {
+      for (size_t k = 0; k < half; k++) {
+        float w_re = cos_[k * step];
+        float w_im = -sin_[k * step];
+        size_t a = start + k;
+        size_t b = a + half;
+        float t_re = re_[b] * w_re - im_[b] * w_im;
+        float t_im = re_[b] * w_im + im_[b] * w_re;
+        re_[b] = re_[a] - t_re;
+        im_[b] = im_[a] - t_im;
+        re_[a] += t_re;
+        im_[a] += t_im;
+      }
+    }
+  }
+}
+
+RippleAnalyzer::Result RippleAnalyzer::analyze(const float* samples,
+                                               float sample_rate) {
+  Result result = {};
+
+  float sum = 0;
+  float min = samples[0];
+  float max = samples[0];
+  for (size_t i = 0; i < kWindow; i++) {
+    sum += samples[i];
+    min = fminf(min, samples[i]);
+    max = fmaxf(max, samples[i]);
+  }
+  result.mean = sum / kWindow;
+  result.peak_to_peak = max - min;
+
+  float sum_sq = 0;
+  for (size_t i = 0; i < kWindow; i++) {
+    float ac = samples[i] - result.mean;
+    sum_sq += ac * ac;
+    re_[i] = ac * hann_[i];
+    im_[i] = 0;
+  }
+  result.rms = sqrtf(sum_sq / kWindow);
+  if (result.peak_to_peak == 0) {
+    return result;
+  }
+
+  fft();
+
+  // Strongest bin, excluding DC and Nyquist. The magnitudes are stored in
+  // re_, which is no longer needed.
+  size_t peak = 1;
+  for (size_t k = 1; k < kWindow / 2; k++) {
+    re_[k] = sqrtf(re_[k] * re_[k] + im_[k] * im_[k]);
+    if (re_[k] > re_[peak]) {
+      peak = k;
+    }
+  }
+
+  // Parabolic interpolation of the log magnitudes, which is close to exact
+  // for the Gaussian-like main lobe of the Hann window
+  float a = peak > 1 ? re_[peak - 1] : 0;
+  float b = re_[peak];
+  float c = peak + 1 < kWindow / 2 ? re_[peak + 1] : 0;
+  float delta = 0;
+  if (a > 0 && c > 0) {
+    float la = logf(a);
+    float lb = logf(b);
+    float lc = logf(c);
+    float denominator = la - 2 * lb + lc;
+    if (denominator < 0) {
+      delta = 0.5f * (la - lc) / denominator;
+    }
+  }
+
+  // Correct the amplitude for the Hann response at `delta` bins off centre
+  float response = 1;
+  if (delta != 0) {
+    float x = kPi * delta;
+    response = sinf(x) / x / (1 - delta * delta);
+  }
+
+  result.dominant_frequency = (peak + delta) * sample_rate / kWindow;
+  result.dominant_amplitude = 2 * b / (hann_sum_ * response);
+  return result;
+}
+
+}  // namespace halmet
@@ -0,0 +1,50 @@
+#ifndef HALMET_SRC_RIPPLE_ANALYZER_H_
+#define HALMET_SRC_RIPPLE_ANALYZER_H_
+
+#include <cstddef>
+
+namespace halmet {
+
+/**
+ * @brief AC content of a fixed-size window of samples.
+ *
+ * Computes the mean, the RMS and peak-to-peak of the AC part, and the
+ * frequency and amplitude of the strongest spectral component, using a
+ * Hann-windowed radix-2 FFT. The window, twiddle factors and FFT buffers are
+ * allocated once in the constructor.
+ *
+ * Tested in test/test_ripple_analyzer and timed by ripple_bench_main.cpp.
+ */
+class RippleAnalyzer {
+ public:
+  /// Samples per analysis window
+  static constexpr size_t kWindow = 512;
+
+  struct Result {
+    float mean;
+    float rms;                 // RMS of the AC part
+    float peak_to_peak;
+    float dominant_frequency;  // Hz, 0 if there is no AC content
+    float dominant_amplitude;  // Amplitude (not RMS) of the component
+  };
+
+  RippleAnalyzer();
+  ~RippleAnalyzer();
+
+  /// Analyze kWindow samples taken at `sample_rate` Hz.
+  Result analyze(const float* samples, float sample_rate);
+
+ protected:
+  void fft();
+
+  float* hann_;
+  float* cos_;
+  float* sin_;
+  float* re_;
+  float* im_;
+  float hann_sum_ = 0;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_RIPPLE_ANALYZER_H_
@@ -0,0 +1,54 @@
+// Host benchmark of the ripple analysis.
+//
+// Measures the CPU time per analysis window of RippleAnalyzer on an
+// alternator ripple waveform. The analysis results are checked by
+// test/test_ripple_analyzer. Build and run with:
+//
+//   pio run -e native_ripple_bench
+//   .pio/build/native_ripple_bench/program
+
+#ifdef HALMET_RIPPLE_BENCH
+
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+
+#include "ripple_analyzer.h"
+
+using namespace halmet;
+
+namespace {
+
+const float kSampleRate = 860;
+const float kPi = 3.14159265358979f;
+const size_t kWindow = RippleAnalyzer::kWindow;
+
+// 13.8 V with 0.2 V of 120 Hz ripple
+void Generate(float* samples) {
+  for (size_t i = 0; i < kWindow; i++) {
+    float t = i / kSampleRate;
+    samples[i] = 13.8f + 0.2f * sinf(2 * kPi * 120 * t);
+  }
+}
+
+}  // namespace
+
+int main() {
+  RippleAnalyzer analyzer;
+  static float samples[kWindow];
+  Generate(samples);
+
+  // CPU time per window
+  const int kIterations = 2000;
+  float sink = 0;
+  clock_t start = clock();
+  for (int i = 0; i < kIterations; i++) {
+    sink += analyzer.analyze(samples, kSampleRate).rms;
+  }
+  double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("%zu-sample window: %.1f us per analysis (%g)\n", kWindow,
+         elapsed * 1e6 / kIterations, sink > 0 ? 1.0 : 0.0);
+  return 0;
+}
+
+#endif  // HALMET_RIPPLE_BENCH
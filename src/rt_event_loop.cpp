@@ -0,0 +1,103 @@
+#include "rt_event_loop.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "power_manager.h"
+
+namespace halmet {
+
+namespace {
+
+// The Wi-Fi and lwIP tasks are pinned to core 0, so keep the time-critical
+// work on core 1.
+const BaseType_t kRealtimeCore = 1;
+const BaseType_t kAppCore = 0;
+// Above loopTask and httpd, below the ESP-IDF system tasks
+const UBaseType_t kRealtimePriority = 10;
+const UBaseType_t kAppPriority = 1;
+const uint32_t kRealtimeStackSize = 8192;
+const uint32_t kAppStackSize = 8192;
+
+std::shared_ptr<reactesp::EventLoop> realtime_loop;
+
+void RealtimeTask(void* arg) {
+  TickType_t last_wake = xTaskGetTickCount();
+  while (true) {
+    BeginLoopTick(LoopId::kRealtime);
+    realtime_loop->tick();
+    EndLoopTick(LoopId::kRealtime);
+    // Wake at every scheduler tick (1 ms). The loop doesn't expose its next
+    // deadline, and all real-time events have millisecond resolution.
+    vTaskDelayUntil(&last_wake, 1);
+  }
+}
+
+void AppTask(void* arg) {
+  while (true) {
+    BeginLoopTick(LoopId::kApp);
+    sensesp::event_loop()->tick();
+    EndLoopTick(LoopId::kApp);
+    // Yield so that the core 0 idle task can feed the task watchdog
+    vTaskDelay(1);
+  }
+}
+
+}  // namespace
+
+std::vector<LoopBridgeBase*> LoopBridgeBase::bridges_[(int)LoopId::kCount];
+
+void LoopBridgeBase::register_bridge(LoopId loop) {
+  std::vector<LoopBridgeBase*>* bridges = &bridges_[(int)loop];
+  if (bridges->empty()) {
+    auto event_loop = loop == LoopId::kRealtime ? realtime_loop
+                                                : sensesp::event_loop();
+    event_loop->onTick([bridges]() {
+      for (LoopBridgeBase* bridge : *bridges) {
+        AllocationTagScope scope(bridge->subsystem_);
+        bridge->drain();
+      }
+    });
+  }
+  subsystem_ = AllocationTag();
+  bridges->push_back(this);
+}
+
+std::shared_ptr<reactesp::EventLoop> rt_event_loop() {
+  return realtime_loop ? realtime_loop : sensesp::event_loop();
+}
+
+bool realtime_loop_enabled() { return realtime_loop != nullptr; }
+
+void EnableRealtimeLoop() {
+  if (!realtime_loop) {
+    realtime_loop = std::make_shared<reactesp::EventLoop>();
+  }
+}
+
+void RunEventLoops() {
+  if (!realtime_loop_enabled()) {
+    while (true) {
+      BeginLoopTick(LoopId::kApp);
+      sensesp::event_loop()->tick();
+      EndLoopTick(LoopId::kApp);
+      // Wait for the next scheduler tick like the real-time loop does
+      // instead of spinning
+      if (power_save_enabled()) {
+        vTaskDelay(1);
+      }
+    }
+  }
+
+  xTaskCreatePinnedToCore(RealtimeTask, "rt_loop", kRealtimeStackSize, nullptr,
+                          kRealtimePriority, nullptr, kRealtimeCore);
+  xTaskCreatePinnedToCore(AppTask, "app_loop", kAppStackSize, nullptr,
+                          kAppPriority, nullptr, kAppCore);
+  // Block the calling task forever to keep the objects created in setup()
+  // alive.
+  while (true) {
+    vTaskDelay(portMAX_DELAY);
+  }
+}
+
+}  // namespace halmet
@@ -0,0 +1,144 @@
+#ifndef HALMET_SRC_RT_EVENT_LOOP_H_
+#define HALMET_SRC_RT_EVENT_LOOP_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "data_age.h"
+#include "memory_monitor.h"
+#include "power_manager.h"
+#include "sensesp/system/valueconsumer.h"
+#include "sensesp/system/valueproducer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Event loop for acquisition and NMEA 2000 work.
+ *
+ * Until EnableRealtimeLoop() is called, this is the same loop as
+ * sensesp::event_loop(). After it, the real-time loop is a separate
+ * reactesp::EventLoop that RunEventLoops() runs in its own task pinned to
+ * core 1, while SensESP (Signal K, HTTP, display) runs on core 0 together
+ * with the Wi-Fi stack.
+ */
+std::shared_ptr<reactesp::EventLoop> rt_event_loop();
+
+/// True if the real-time loop is separate from the SensESP event loop.
+bool realtime_loop_enabled();
+
+/// Create the separate real-time loop. Call before creating any objects
+/// that add events to rt_event_loop().
+void EnableRealtimeLoop();
+
+/// Run the event loops. Never returns.
+[[noreturn]] void RunEventLoops();
+
+/**
+ * @brief Base of the loop bridges.
+ *
+ * All bridges to a loop are drained from a single tick event on that loop
+ * instead of one event per bridge. The allocations of the consumers are
+ * attributed to the subsystem that created the bridge.
+ */
+class LoopBridgeBase {
+ public:
+  virtual ~LoopBridgeBase() = default;
+
+ protected:
+  /// Drain every bridge to `loop` from the shared tick event of `loop`,
+  /// which is registered with the first bridge to it.
+  void register_bridge(LoopId loop);
+
+  virtual void drain() = 0;
+
+  Subsystem subsystem_ = Subsystem::kOther;
+
+  static std::vector<LoopBridgeBase*> bridges_[(int)LoopId::kCount];
+};
+
+/**
+ * @brief Hand values over from one event loop to the other.
+ *
+ * A bounded single-producer single-consumer ring, drained on the `to`
+ * loop. The producing side never blocks: if the consuming loop falls
+ * behind, new values are dropped and counted. Acquisition timestamps are
+ * carried across.
+ *
+ * When the real-time loop is not enabled, values are passed on directly.
+ */
+template <typename T>
+class LoopBridge : public LoopBridgeBase,
+                   public sensesp::ValueConsumer<T>,
+                   public sensesp::ValueProducer<T> {
+ public:
+  explicit LoopBridge(LoopId to = LoopId::kApp) {
+    if (realtime_loop_enabled()) {
+      register_bridge(to);
+    }
+  }
+
+  virtual void set(const T& input) override {
+    if (!realtime_loop_enabled()) {
+      this->emit(input);
+      return;
+    }
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == kCapacity) {
+      dropped_++;
+      return;
+    }
+    Entry& entry = ring_[head % kCapacity];
+    entry.value = input;
+    entry.acquired = AcquisitionTime::current();
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  uint32_t dropped() const { return dropped_; }
+
+ protected:
+  static constexpr uint32_t kCapacity = 8;
+
+  struct Entry {
+    T value;
+    uint32_t acquired;
+  };
+
+  virtual void drain() override {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    while (tail != head_.load(std::memory_order_acquire)) {
+      Entry entry = ring_[tail % kCapacity];
+      tail_.store(++tail, std::memory_order_release);
+      if (entry.acquired != 0) {
+        AcquisitionTime::Scope scope(entry.acquired);
+        this->emit(entry.value);
+      } else {
+        this->emit(entry.value);
+      }
+    }
+  }
+
+  Entry ring_[kCapacity];
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+  uint32_t dropped_ = 0;
+};
+
+/// Return a producer that emits the values of `producer` on the SensESP loop.
+template <typename T>
+LoopBridge<T>* ToAppLoop(sensesp::ValueProducer<T>* producer) {
+  return producer->connect_to(new LoopBridge<T>());
+}
+
+/// Return a producer that emits the values of `producer` on the real-time
+/// loop. Use it for every value set on the SensESP loop and read by
+/// real-time work.
+template <typename T>
+LoopBridge<T>* ToRealtimeLoop(sensesp::ValueProducer<T>* producer) {
+  return producer->connect_to(new LoopBridge<T>(LoopId::kRealtime));
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_RT_EVENT_LOOP_H_
@@ -0,0 +1,251 @@
+#include "runtime_mode.h"
+
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+
+#include "sensesp/system/lambda_consumer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+const char* kPreferencesNamespace = "halmet_mode";
+const char* kHeadlessKey = "headless";
+const char* kStatsKeys[] = {"stats_full", "stats_n2k"};
+const char* kModeNames[] = {"full", "NMEA 2000 only"};
+
+// Created on the file system once the NVS settings are in use. A factory
+// reset formats the file system, so a missing marker means that the NVS
+// settings are stale.
+const char* kMarkerPath = "/halmet_mode";
+
+const unsigned int kButtonPollInterval = 50;  // ms
+// Consecutive polls with the button down that count as a press
+const int kPressPolls = 2;
+// Longest time between the two presses of a double click
+const unsigned int kDoubleClickTime = 600;  // ms
+// The measurement starts once Wi-Fi, the Signal K connection and the
+// address claim have settled
+const unsigned int kMeasureDelay = 60000;  // ms
+const unsigned int kMeasureTime = 300000;  // ms
+
+}  // namespace
+
+RuntimeMode::RuntimeMode(const String& config_path, int button_pin,
+                         unsigned int toggle_window)
+    : sensesp::FileSystemSaveable{config_path},
+      button_pin_{button_pin},
+      toggle_window_{toggle_window} {
+  load();
+  headless_ = next_headless_;
+  debugI("Runtime mode: %s", kModeNames[headless_]);
+}
+
+bool RuntimeMode::load() {
+  Preferences prefs;
+  prefs.begin(kPreferencesNamespace, true);
+  next_headless_ = prefs.getBool(kHeadlessKey, false);
+  for (int i = 0; i < 2; i++) {
+    have_stats_[i] = prefs.getBytesLength(kStatsKeys[i]) == sizeof(Stats) &&
+                     prefs.getBytes(kStatsKeys[i], &stats_[i],
+                                    sizeof(Stats)) == sizeof(Stats);
+  }
+  prefs.end();
+  return true;
+}
+
+bool RuntimeMode::save() {
+  Preferences prefs;
+  prefs.begin(kPreferencesNamespace, false);
+  prefs.putBool(kHeadlessKey, next_headless_);
+  prefs.end();
+  return true;
+}
+
+void RuntimeMode::start() {
+  if (!SPIFFS.exists(kMarkerPath)) {
+    clear();
+    File marker = SPIFFS.open(kMarkerPath, FILE_WRITE);
+    marker.close();
+    if (headless_) {
+      debugI("Runtime mode: settings cleared, restarting in full mode");
+      ESP.restart();
+    }
+  }
+
+  sensesp::event_loop()->onDelay(kMeasureDelay,
+                                 [this]() { begin_measurement(); });
+
+  // In full mode, the button belongs to SensESP (a press restarts, a long
+  // press resets to factory settings) and the mode is set in the web UI
+  if (!headless_) {
+    return;
+  }
+  pinMode(button_pin_, INPUT_PULLUP);
+  button_event_ = sensesp::event_loop()->onRepeat(
+      kButtonPollInterval, [this]() { poll_button(); });
+  sensesp::event_loop()->onDelay(toggle_window_, [this]() {
+    if (!toggled_) {
+      sensesp::event_loop()->remove(button_event_);
+    }
+  });
+}
+
+bool RuntimeMode::clear() {
+  Preferences prefs;
+  prefs.begin(kPreferencesNamespace, false);
+  prefs.clear();
+  prefs.end();
+  next_headless_ = false;
+  have_stats_[0] = false;
+  have_stats_[1] = false;
+  return true;
+}
+
+void RuntimeMode::poll_button() {
+  bool pressed = digitalRead(button_pin_) == LOW;
+
+  if (toggled_) {
+    // The button is on a strapping pin; don't restart while it's held low
+    if (!pressed) {
+      ESP.restart();
+    }
+    return;
+  }
+
+  pressed_polls_ = pressed ? pressed_polls_ + 1 : 0;
+  if (pressed_polls_ != kPressPolls) {
+    return;
+  }
+  // A press starts here. Two within kDoubleClickTime switch the mode.
+  uint32_t now = millis();
+  if (clicks_ > 0 && now - last_click_ > kDoubleClickTime) {
+    clicks_ = 0;
+  }
+  last_click_ = now;
+  if (++clicks_ == 2) {
+    next_headless_ = !headless_;
+    save();
+    toggled_ = true;
+    debugI("Runtime mode: switching to %s after the button is released",
+           kModeNames[next_headless_]);
+  }
+}
+
+void RuntimeMode::compare_jitter(IntervalJitterMonitor* monitor) {
+  monitor->p95_.connect_to(new sensesp::LambdaConsumer<float>([this](float v) {
+    if (measuring_) {
+      jitter_p95_ = std::max(jitter_p95_, v);
+    }
+  }));
+  monitor->max_.connect_to(new sensesp::LambdaConsumer<float>([this](float v) {
+    if (measuring_) {
+      jitter_max_ = std::max(jitter_max_, v);
+    }
+  }));
+}
+
+void RuntimeMode::begin_measurement() {
+  measure_start_ = millis();
+  for (int i = 0; i < (int)LoopId::kCount; i++) {
+    start_busy_[i] = LoopBusyMicros((LoopId)i);
+  }
+  jitter_p95_ = 0;
+  jitter_max_ = 0;
+  measuring_ = true;
+  sensesp::event_loop()->onDelay(kMeasureTime,
+                                 [this]() { end_measurement(); });
+}
+
+void RuntimeMode::end_measurement() {
+  measuring_ = false;
+  uint32_t elapsed = millis() - measure_start_;
+
+  Stats& stats = stats_[headless_];
+  stats.free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  stats.min_free_heap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  for (int i = 0; i < (int)LoopId::kCount; i++) {
+    uint32_t busy = LoopBusyMicros((LoopId)i) - start_busy_[i];
+    stats.loop_load[i] = busy / 1000.0f / elapsed;
+  }
+  stats.jitter_p95 = jitter_p95_;
+  stats.jitter_max = jitter_max_;
+  have_stats_[headless_] = true;
+
+  // Written once per boot
+  Preferences prefs;
+  prefs.begin(kPreferencesNamespace, false);
+  prefs.putBytes(kStatsKeys[headless_], &stats, sizeof(Stats));
+  prefs.end();
+
+  char report[160];
+  format_stats(stats, report, sizeof(report));
+  debugI("Runtime mode %s: %s", kModeNames[headless_], report);
+  if (have_stats_[!headless_]) {
+    format_stats(stats_[!headless_], report, sizeof(report));
+    debugI("Runtime mode %s: %s", kModeNames[!headless_], report);
+  }
+}
+
+void RuntimeMode::format_stats(const Stats& stats, char* buf, size_t size) {
+  snprintf(buf, size,
+           "free heap %.1f kB (min %.1f kB), loop load rt %.1f%% app %.1f%%, "
+           "PGN 127488 jitter p95 %.1f ms max %.1f ms",
+           stats.free_heap / 1024.0f, stats.min_free_heap / 1024.0f,
+           stats.loop_load[(int)LoopId::kRealtime] * 100,
+           stats.loop_load[(int)LoopId::kApp] * 100, stats.jitter_p95 * 1000,
+           stats.jitter_max * 1000);
+}
+
+bool RuntimeMode::to_json(JsonObject& config) {
+  config["headless"] = next_headless_;
+  config["mode"] = kModeNames[headless_];
+
+  char report[160];
+  for (int i = 0; i < 2; i++) {
+    if (have_stats_[i]) {
+      format_stats(stats_[i], report, sizeof(report));
+      config[kStatsKeys[i]] = report;
+    }
+  }
+  if (have_stats_[0] && have_stats_[1]) {
+    const Stats& full = stats_[0];
+    const Stats& n2k = stats_[1];
+    snprintf(report, sizeof(report),
+             "RAM recovered %.1f kB, app loop load %.1f%% -> %.1f%%, "
+             "PGN 127488 jitter p95 %.1f ms -> %.1f ms",
+             ((int32_t)n2k.free_heap - (int32_t)full.free_heap) / 1024.0f,
+             full.loop_load[(int)LoopId::kApp] * 100,
+             n2k.loop_load[(int)LoopId::kApp] * 100, full.jitter_p95 * 1000,
+             n2k.jitter_p95 * 1000);
+    config["difference"] = report;
+  }
+  return true;
+}
+
+bool RuntimeMode::from_json(const JsonObject& config) {
+  if (!config["headless"].is<bool>()) {
+    return false;
+  }
+  next_headless_ = config["headless"];
+  return true;
+}
+
+const String ConfigSchema(const RuntimeMode& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "headless": { "title": "NMEA 2000 only", "type": "boolean", "description": "Run without Wi-Fi, web UI and Signal K. To switch back, double-click the button within 30 seconds after power-up; the device restarts when the button is released. A factory reset also switches back." },
+      "mode": { "title": "Current mode", "type": "string", "readOnly": true },
+      "stats_full": { "title": "Full mode", "type": "string", "readOnly": true, "description": "Measured 1 to 6 minutes after boot" },
+      "stats_n2k": { "title": "NMEA 2000 only mode", "type": "string", "readOnly": true, "description": "Measured 1 to 6 minutes after boot" },
+      "difference": { "title": "NMEA 2000 only compared with full mode", "type": "string", "readOnly": true }
+    }
+  })###";
+}
+
+}  // namespace halmet
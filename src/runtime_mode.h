@@ -0,0 +1,99 @@
+#ifndef HALMET_SRC_RUNTIME_MODE_H_
+#define HALMET_SRC_RUNTIME_MODE_H_
+
+#include "data_age.h"
+#include "power_manager.h"
+#include "sensesp/system/saveable.h"
+
+namespace halmet {
+
+/**
+ * @brief Full or NMEA 2000 only (headless) runtime mode.
+ *
+ * In headless mode, the application is built without networking: Wi-Fi,
+ * the HTTP server, mDNS and the Signal K connection are never started.
+ * The inputs and the NMEA 2000 senders run as in full mode.
+ *
+ * The mode has to be known before the application is built, i.e. before
+ * the file system is mounted, so it is stored in NVS instead of a config
+ * file. It is switched in the web UI in full mode, or back from headless
+ * mode with a double click of the button during the toggle window after
+ * boot. In full mode, the button is left to SensESP, where a press restarts
+ * and a long press resets to factory settings. The new mode takes effect
+ * after a restart; after a double click, the device restarts once the
+ * button is released. A factory reset formats the file system; the NVS
+ * settings are cleared on the next boot when the marker file that
+ * RuntimeMode keeps there is missing.
+ *
+ * Once per boot, after the startup has settled, the free heap, the event
+ * loop loads and the PGN 127488 jitter are measured and stored in NVS for
+ * the mode that ran. Headless mode has no web UI, so its figures are logged
+ * and shown next to the setting after switching back to full mode.
+ */
+class RuntimeMode : public sensesp::FileSystemSaveable {
+ public:
+  RuntimeMode(const String& config_path, int button_pin,
+              unsigned int toggle_window = 30000);
+
+  /// True if this boot runs without networking.
+  bool headless() const { return headless_; }
+
+  /// Start the toggle window and the measurement. Call once the
+  /// application has been built.
+  void start();
+
+  /// Compare the jitter reported by `monitor` between the two modes.
+  void compare_jitter(IntervalJitterMonitor* monitor);
+
+  virtual bool load() override;
+  virtual bool save() override;
+  /// Clear the mode and the measurements stored in NVS.
+  virtual bool clear() override;
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  struct Stats {
+    uint32_t free_heap;      // bytes
+    uint32_t min_free_heap;  // bytes, since boot
+    // Busy fraction of each loop, indexed by LoopId
+    float loop_load[(int)LoopId::kCount];
+    float jitter_p95;  // s
+    float jitter_max;  // s
+  };
+
+  void poll_button();
+  void begin_measurement();
+  void end_measurement();
+  void format_stats(const Stats& stats, char* buf, size_t size);
+
+  int button_pin_;
+  unsigned int toggle_window_;
+  reactesp::RepeatEvent* button_event_ = nullptr;
+  int pressed_polls_ = 0;
+  int clicks_ = 0;
+  uint32_t last_click_ = 0;
+  bool toggled_ = false;
+
+  // Mode of this boot and mode of the next boot
+  bool headless_ = false;
+  bool next_headless_ = false;
+
+  bool measuring_ = false;
+  uint32_t measure_start_ = 0;
+  uint32_t start_busy_[(int)LoopId::kCount] = {};
+  float jitter_p95_ = 0;
+  float jitter_max_ = 0;
+  // Stored measurements, indexed by headless
+  Stats stats_[2] = {};
+  bool have_stats_[2] = {};
+};
+
+const String ConfigSchema(const RuntimeMode& obj);
+
+inline bool ConfigRequiresRestart(const RuntimeMode& obj) { return true; }
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_RUNTIME_MODE_H_
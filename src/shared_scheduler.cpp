@@ -0,0 +1,33 @@
+#include "shared_scheduler.h"
+
+namespace halmet {
+
+namespace {
+
+// Schedulers are created during setup() and never deleted
+std::vector<SharedScheduler*>& schedulers() {
+  static std::vector<SharedScheduler*> instances;
+  return instances;
+}
+
+}  // namespace
+
+SharedScheduler* SharedScheduler::get(
+    unsigned int interval, std::shared_ptr<reactesp::EventLoop> loop) {
+  for (auto scheduler : schedulers()) {
+    if (scheduler->interval_ == interval && scheduler->loop_ == loop) {
+      return scheduler;
+    }
+  }
+  auto scheduler = new SharedScheduler(interval, loop);
+  schedulers().push_back(scheduler);
+  return scheduler;
+}
+
+SharedScheduler::SharedScheduler(unsigned int interval,
+                                 std::shared_ptr<reactesp::EventLoop> loop)
+    : interval_{interval}, loop_{loop} {
+  loop_->onRepeat(interval_, [this]() { run(); });
+}
+
+}  // namespace halmet
@@ -0,0 +1,55 @@
+#ifndef HALMET_SRC_SHARED_SCHEDULER_H_
+#define HALMET_SRC_SHARED_SCHEDULER_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "memory_monitor.h"
+#include "rt_event_loop.h"
+
+namespace halmet {
+
+/**
+ * @brief One repeat event running the periodic work of many objects.
+ *
+ * Objects of the same kind (tank inputs, pulse counters, N2k senders of one
+ * PGN) add their work to the scheduler for their interval instead of
+ * creating an event each. The tasks are kept in a contiguous table and run
+ * in the order they were added, so another channel costs one more iteration
+ * rather than another timer.
+ */
+class SharedScheduler {
+ public:
+  /// The scheduler for `interval` ms on `loop`, created on first use.
+  static SharedScheduler* get(
+      unsigned int interval,
+      std::shared_ptr<reactesp::EventLoop> loop = rt_event_loop());
+
+  /// Add a task. Its allocations are attributed to the subsystem the
+  /// calling task is tagged with.
+  void add(std::function<void()> task) {
+    tasks_.push_back(TagCallback(std::move(task)));
+  }
+
+  unsigned int interval() const { return interval_; }
+  size_t size() const { return tasks_.size(); }
+
+ protected:
+  SharedScheduler(unsigned int interval,
+                  std::shared_ptr<reactesp::EventLoop> loop);
+
+  void run() {
+    for (auto& task : tasks_) {
+      task();
+    }
+  }
+
+  unsigned int interval_;
+  std::shared_ptr<reactesp::EventLoop> loop_;
+  std::vector<std::function<void()>> tasks_;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_SHARED_SCHEDULER_H_
@@ -0,0 +1,137 @@
+// Host benchmark of the Signal K delta serialization.
+//
+// Compares SKDeltaSerializer with the SensESP delta path that it replaces.
+// In SensESP, SKOutput::as_signalk_json() builds each output value into a
+// JsonDocument and serializes it into a String that SKDeltaQueue::append()
+// queues; SKDeltaQueue::get_delta() then assembles the queued strings into
+// a delta in another JsonDocument. SensESP doesn't build on the host, so
+// SensESPPath repeats those steps with the same ArduinoJson calls, with
+// std::string in place of the Arduino String. Heap allocations are counted
+// by host_alloc_count.cpp. Build and run with:
+//
+//   pio run -e native_sk_bench
+//   .pio/build/native_sk_bench/program
+
+#ifdef HALMET_SK_BENCH
+
+#include <ArduinoJson.h>
+
+#include <cstdio>
+#include <ctime>
+#include <list>
+#include <string>
+
+#include "host_alloc_count.h"
+#include "sk_delta_serializer.h"
+
+using namespace halmet;
+
+namespace {
+
+// The HALMET outputs updated on every delta, with their value decimals
+struct Output {
+  const char* path;
+  int decimals;
+};
+
+const Output kOutputs[] = {
+    {"tanks.fuel.main.currentLevel", 3},
+    {"tanks.fuel.main.currentVolume", 5},
+    {"tanks.fuel.main.senderResistance", 1},
+    {"propulsion.main.revolutions", 2},
+    {"sensors.a2.voltage", 2},
+};
+const int kNumOutputs = sizeof(kOutputs) / sizeof(kOutputs[0]);
+const int kNumDeltas = 100000;
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+float Value(int delta, int output) { return 0.001f * delta + output; }
+
+/// The SensESP path: one document and string per value, one document and
+/// string per delta.
+class SensESPPath {
+ public:
+  /// SKOutput::set() and SKDeltaQueue::append()
+  void set(int output, float value) {
+    JsonDocument doc;
+    // SKEmitter::get_sk_path() returns a copy
+    std::string path = kOutputs[output].path;
+    doc["path"] = path;
+    doc["value"] = value;
+    std::string json;
+    serializeJson(doc, json);
+    buffer_.push_back(json);
+  }
+
+  /// SKDeltaQueue::get_delta()
+  size_t get_delta(std::string& output) {
+    JsonDocument doc;
+    JsonArray updates = doc["updates"].to<JsonArray>();
+    JsonObject current = updates.add<JsonObject>();
+    JsonArray values = current["values"].to<JsonArray>();
+    for (const auto& item : buffer_) {
+      values.add(serialized(item));
+    }
+    output.clear();
+    serializeJson(doc, output);
+    buffer_.clear();
+    return output.size();
+  }
+
+ private:
+  std::list<std::string> buffer_;
+};
+
+void Report(const char* name, size_t allocs, double elapsed, size_t bytes) {
+  printf("%-12s %8.2f allocs/delta %8.2f us/delta %8.1f bytes/delta\n", name,
+         (double)allocs / kNumDeltas, elapsed / kNumDeltas,
+         (double)bytes / kNumDeltas);
+}
+
+}  // namespace
+
+int main() {
+  printf("%d deltas of %d values\n", kNumDeltas, kNumOutputs);
+
+  SensESPPath sensesp;
+  std::string output;
+  size_t bytes = 0;
+  size_t allocs = HostAllocations();
+  double start = Now();
+  for (int i = 0; i < kNumDeltas; i++) {
+    for (int j = 0; j < kNumOutputs; j++) {
+      sensesp.set(j, Value(i, j));
+    }
+    bytes += sensesp.get_delta(output);
+  }
+  Report("sensesp", HostAllocations() - allocs, Now() - start, bytes);
+  printf("  %s\n", output.c_str());
+
+  SKDeltaSerializer serializer;
+  int ids[kNumOutputs];
+  for (int j = 0; j < kNumOutputs; j++) {
+    ids[j] = serializer.add_path(kOutputs[j].path, kOutputs[j].decimals);
+  }
+  bytes = 0;
+  allocs = HostAllocations();
+  start = Now();
+  for (int i = 0; i < kNumDeltas; i++) {
+    serializer.begin();
+    for (int j = 0; j < kNumOutputs; j++) {
+      serializer.add(ids[j], Value(i, j));
+    }
+    bytes += serializer.finish();
+  }
+  allocs = HostAllocations() - allocs;
+  Report("serializer", allocs, Now() - start, bytes);
+  printf("  %s\n", serializer.data());
+
+  return allocs == 0 ? 0 : 1;
+}
+
+#endif  // HALMET_SK_BENCH
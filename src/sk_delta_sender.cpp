@@ -0,0 +1,157 @@
+#include "sk_delta_sender.h"
+
+#include "memory_monitor.h"
+#include "sensesp_app.h"
+
+namespace halmet {
+
+namespace {
+
+// Interval between deltas, in ms
+const unsigned int kSendInterval = 20;
+
+}  // namespace
+
+SKDeltaSender* SKDeltaSender::get() {
+  static SKDeltaSender* instance = new SKDeltaSender(kSendInterval);
+  return instance;
+}
+
+SKDeltaSender::SKDeltaSender(unsigned int interval) {
+  if (sensesp::sensesp_app == nullptr) {
+    // NMEA 2000 only mode: there's no Signal K connection, the outputs only
+    // store their values
+    return;
+  }
+  payload_.reserve(1024);
+  sensesp::event_loop()->onRepeat(interval, [this]() { send(); });
+}
+
+int SKDeltaSender::add_output(const String& sk_path, int decimals,
+                              sensesp::SKMetadata* meta) {
+  int id = serializer_.add_path(sk_path.c_str(), decimals);
+  if (id < 0) {
+    debugE("SKDeltaSender: no room for %s", sk_path.c_str());
+    return -1;
+  }
+  outputs_[id].meta = meta;
+  return id;
+}
+
+void SKDeltaSender::set(int id, float value) {
+  if (id < 0) {
+    return;
+  }
+  outputs_[id].value = value;
+  outputs_[id].seq = outputs_[id].seq + 1;
+}
+
+void SKDeltaSender::send_payload() {
+  if (serializer_.finish() == 0) {
+    return;
+  }
+  // The payload capacity covers the serializer buffer, so this only copies
+  payload_ = serializer_.data();
+  sensesp::sensesp_app->get_ws_client()->sendTXT(payload_);
+}
+
+void SKDeltaSender::drop(int id, const char* what) {
+  dropped_++;
+  // The entry doesn't fit into an empty delta either, so it will be dropped
+  // on every send. Log it once per output.
+  if (!outputs_[id].drop_logged) {
+    outputs_[id].drop_logged = true;
+    debugW("SKDeltaSender: %s of output %d doesn't fit into a delta, dropped",
+           what, id);
+  }
+}
+
+void SKDeltaSender::send() {
+  AllocationTagScope tag(Subsystem::kSignalK);
+  auto ws_client = sensesp::sensesp_app->get_ws_client();
+  if (ws_client == nullptr || !ws_client->is_connected()) {
+    meta_sent_ = false;
+    return;
+  }
+  if (++skipped_intervals_ < rate_divider_) {
+    return;
+  }
+  skipped_intervals_ = 0;
+  int num_outputs = serializer_.num_paths();
+
+  if (!meta_sent_) {
+    serializer_.begin_meta();
+    for (int i = 0; i < num_outputs; i++) {
+      sensesp::SKMetadata* meta = outputs_[i].meta;
+      if (meta == nullptr) {
+        continue;
+      }
+      const char* units = meta->units_.c_str();
+      const char* display_name = meta->display_name_.c_str();
+      const char* description = meta->description_.c_str();
+      if (!serializer_.add_meta(i, units, display_name, description)) {
+        send_payload();
+        serializer_.begin_meta();
+        if (!serializer_.add_meta(i, units, display_name, description)) {
+          drop(i, "metadata");
+        }
+      }
+    }
+    send_payload();
+    meta_sent_ = true;
+  }
+
+  serializer_.begin();
+  for (int i = 0; i < num_outputs; i++) {
+    uint32_t seq = outputs_[i].seq;
+    if (seq == outputs_[i].sent_seq) {
+      continue;
+    }
+    float value = outputs_[i].value;
+    if (!serializer_.add(i, value)) {
+      send_payload();
+      serializer_.begin();
+      if (!serializer_.add(i, value)) {
+        drop(i, "value");
+      }
+    }
+    outputs_[i].sent_seq = seq;
+  }
+  send_payload();
+}
+
+SKDeltaOutputFloat::SKDeltaOutputFloat(const String& sk_path,
+                                       const String& config_path,
+                                       sensesp::SKMetadata* meta, int decimals)
+    : BlobSaveable{config_path}, sk_path_{sk_path} {
+  load();
+  id_ = SKDeltaSender::get()->add_output(sk_path_, decimals, meta);
+}
+
+void SKDeltaOutputFloat::set(const float& value) {
+  SKDeltaSender::get()->set(id_, value);
+}
+
+bool SKDeltaOutputFloat::to_json(JsonObject& root) {
+  root["sk_path"] = sk_path_;
+  return true;
+}
+
+bool SKDeltaOutputFloat::from_json(const JsonObject& config) {
+  if (!config["sk_path"].is<String>()) {
+    return false;
+  }
+  sk_path_ = config["sk_path"].as<String>();
+  return true;
+}
+
+const String ConfigSchema(const SKDeltaOutputFloat& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "sk_path": { "title": "Signal K Path", "type": "string" }
+    }
+  })###";
+}
+
+}  // namespace halmet
@@ -0,0 +1,95 @@
+#ifndef HALMET_SRC_SK_DELTA_SENDER_H_
+#define HALMET_SRC_SK_DELTA_SENDER_H_
+
+#include "config_blob_store.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/system/valueconsumer.h"
+#include "sk_delta_serializer.h"
+
+namespace halmet {
+
+/**
+ * @brief Sends the SKDeltaOutputFloat values to the Signal K server.
+ *
+ * The outputs only store their latest value. Every send interval, the values
+ * that changed are serialized into one delta with SKDeltaSerializer and sent
+ * over the SensESP websocket connection. The serializer buffer and the
+ * payload string are allocated once, so sending doesn't touch the heap.
+ * Metadata is sent once per connection.
+ */
+class SKDeltaSender {
+ public:
+  /// The sender, created on first use.
+  static SKDeltaSender* get();
+
+  /// Register an output. Returns its id, or -1 if there's no room.
+  int add_output(const String& sk_path, int decimals,
+                 sensesp::SKMetadata* meta);
+  /// Store the latest value of output `id`. May be called from any task.
+  void set(int id, float value);
+
+  /// Send only every `divider`th interval, e.g. to shed load.
+  void set_rate_divider(int divider) { rate_divider_ = divider; }
+
+  /// Number of values and metadata entries that didn't fit into an empty
+  /// delta and were dropped.
+  uint32_t dropped() const { return dropped_; }
+
+ protected:
+  SKDeltaSender(unsigned int interval);
+
+  void send();
+  void send_payload();
+  void drop(int id, const char* what);
+
+  struct Output {
+    sensesp::SKMetadata* meta;
+    volatile float value;
+    volatile uint32_t seq;
+    uint32_t sent_seq;
+    bool drop_logged;
+  };
+
+  SKDeltaSerializer serializer_;
+  Output outputs_[SKDeltaSerializer::kMaxPaths] = {};
+  String payload_;
+  bool meta_sent_ = false;
+  int rate_divider_ = 1;
+  int skipped_intervals_ = 0;
+  uint32_t dropped_ = 0;
+};
+
+/**
+ * @brief Signal K float output sent through SKDeltaSender.
+ *
+ * Drop-in replacement for sensesp::SKOutputFloat with the same
+ * configuration, for the frequently updated HALMET values. Changing the
+ * path requires a restart.
+ */
+class SKDeltaOutputFloat : public BlobSaveable,
+                           public sensesp::ValueConsumer<float> {
+ public:
+  SKDeltaOutputFloat(const String& sk_path, const String& config_path = "",
+                     sensesp::SKMetadata* meta = nullptr, int decimals = 3);
+
+  virtual void set(const float& value) override;
+
+  const String& get_sk_path() const { return sk_path_; }
+
+  virtual bool to_json(JsonObject& root) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  String sk_path_;
+  int id_;
+};
+
+const String ConfigSchema(const SKDeltaOutputFloat& obj);
+
+inline bool ConfigRequiresRestart(const SKDeltaOutputFloat& obj) {
+  return true;
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_SK_DELTA_SENDER_H_
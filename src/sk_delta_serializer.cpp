@@ -0,0 +1,192 @@
+#include "sk_delta_serializer.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "fast_format.h"
+
+namespace halmet {
+
+namespace {
+
+const char kValuesHeader[] = "{\"updates\":[{\"values\":[";
+const char kMetaHeader[] = "{\"updates\":[{\"meta\":[";
+const char kTrailer[] = "]}]}";
+// Room kept free for the trailer and the terminating zero
+const size_t kTrailerRoom = sizeof(kTrailer);
+
+/// Write `src` as JSON string contents into `dst`. Returns the number of
+/// characters written, or -1 if `room` is too small.
+int Escape(char* dst, size_t room, const char* src) {
+  static const char kHex[] = "0123456789abcdef";
+  size_t n = 0;
+  for (; *src; src++) {
+    unsigned char c = *src;
+    if (c == '"' || c == '\\') {
+      if (n + 2 > room) return -1;
+      dst[n++] = '\\';
+      dst[n++] = c;
+    } else if (c < 0x20) {
+      if (n + 6 > room) return -1;
+      memcpy(dst + n, "\\u00", 4);
+      dst[n + 4] = kHex[c >> 4];
+      dst[n + 5] = kHex[c & 0xf];
+      n += 6;
+    } else {
+      if (n + 1 > room) return -1;
+      dst[n++] = c;
+    }
+  }
+  return n;
+}
+
+}  // namespace
+
+SKDeltaSerializer::SKDeltaSerializer(size_t buffer_size, size_t fragment_size)
+    : fragment_size_{fragment_size}, size_{buffer_size} {
+  fragments_ = static_cast<char*>(malloc(fragment_size_));
+  buf_ = static_cast<char*>(malloc(size_));
+  buf_[0] = '\0';
+}
+
+SKDeltaSerializer::~SKDeltaSerializer() {
+  free(fragments_);
+  free(buf_);
+}
+
+int SKDeltaSerializer::add_path(const char* path, int decimals) {
+  if (num_paths_ >= kMaxPaths) {
+    return -1;
+  }
+  static const char kPrefix[] = "{\"path\":\"";
+  static const char kSuffix[] = "\",\"value\":";
+  size_t start = fragment_len_;
+  size_t room = fragment_size_ - start;
+  if (room < sizeof(kPrefix) + sizeof(kSuffix)) {
+    return -1;
+  }
+  char* dst = fragments_ + start;
+  memcpy(dst, kPrefix, sizeof(kPrefix) - 1);
+  size_t n = sizeof(kPrefix) - 1;
+  int escaped = Escape(dst + n, room - n - (sizeof(kSuffix) - 1), path);
+  if (escaped < 0) {
+    return -1;
+  }
+  n += escaped;
+  memcpy(dst + n, kSuffix, sizeof(kSuffix) - 1);
+  n += sizeof(kSuffix) - 1;
+
+  fragment_len_ += n;
+  paths_[num_paths_] = {static_cast<uint16_t>(start), static_cast<uint16_t>(n),
+                        static_cast<uint8_t>(decimals)};
+  return num_paths_++;
+}
+
+void SKDeltaSerializer::begin() {
+  len_ = 0;
+  count_ = 0;
+  append(kValuesHeader);
+}
+
+void SKDeltaSerializer::begin_meta() {
+  len_ = 0;
+  count_ = 0;
+  append(kMetaHeader);
+}
+
+bool SKDeltaSerializer::append(const char* str, size_t len) {
+  if (len_ + len + kTrailerRoom > size_) {
+    return false;
+  }
+  memcpy(buf_ + len_, str, len);
+  len_ += len;
+  return true;
+}
+
+bool SKDeltaSerializer::append(const char* str) {
+  return append(str, strlen(str));
+}
+
+bool SKDeltaSerializer::append_string(const char* str) {
+  if (!append("\"", 1)) {
+    return false;
+  }
+  int n = Escape(buf_ + len_, size_ - len_ - kTrailerRoom, str);
+  if (n < 0) {
+    return false;
+  }
+  len_ += n;
+  return append("\"", 1);
+}
+
+bool SKDeltaSerializer::begin_entry(int id) {
+  if (id < 0 || id >= num_paths_) {
+    return false;
+  }
+  if (count_ > 0 && !append(",", 1)) {
+    return false;
+  }
+  const Path& path = paths_[id];
+  return append(fragments_ + path.offset, path.length);
+}
+
+bool SKDeltaSerializer::add(int id, float value) {
+  size_t mark = len_;
+  if (begin_entry(id)) {
+    size_t n = FormatFloat(buf_ + len_, size_ - len_ - kTrailerRoom,
+                           value, paths_[id].decimals);
+    len_ += n;
+    if (n > 0 && append("}", 1)) {
+      count_++;
+      return true;
+    }
+  }
+  len_ = mark;
+  return false;
+}
+
+bool SKDeltaSerializer::add(int id, bool value) {
+  size_t mark = len_;
+  if (begin_entry(id) && append(value ? "true}" : "false}")) {
+    count_++;
+    return true;
+  }
+  len_ = mark;
+  return false;
+}
+
+bool SKDeltaSerializer::add_meta(int id, const char* units,
+                                 const char* display_name,
+                                 const char* description) {
+  size_t mark = len_;
+  bool ok = begin_entry(id) && append("{", 1);
+  const char* separator = "";
+  const char* keys[] = {"\"units\":", "\"displayName\":", "\"description\":"};
+  const char* values[] = {units, display_name, description};
+  for (int i = 0; ok && i < 3; i++) {
+    if (values[i] != nullptr && values[i][0] != '\0') {
+      ok = append(separator) && append(keys[i]) && append_string(values[i]);
+      separator = ",";
+    }
+  }
+  if (ok && append("}}", 2)) {
+    count_++;
+    return true;
+  }
+  len_ = mark;
+  return false;
+}
+
+size_t SKDeltaSerializer::finish() {
+  if (count_ == 0) {
+    len_ = 0;
+    buf_[0] = '\0';
+    return 0;
+  }
+  // append() always leaves room for the trailer
+  memcpy(buf_ + len_, kTrailer, sizeof(kTrailer));
+  len_ += sizeof(kTrailer) - 1;
+  return len_;
+}
+
+}  // namespace halmet
@@ -0,0 +1,82 @@
+#ifndef HALMET_SRC_SK_DELTA_SERIALIZER_H_
+#define HALMET_SRC_SK_DELTA_SERIALIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace halmet {
+
+/**
+ * @brief Streaming Signal K delta serializer.
+ *
+ * Writes deltas such as
+ *
+ *   {"updates":[{"values":[{"path":"tanks.fuel.main.currentLevel",
+ *   "value":0.52},...]}]}
+ *
+ * straight into a buffer allocated once in the constructor. The
+ * `{"path":"...","value":` fragment of each path is escaped and stored when
+ * the path is added, and values are formatted with FormatFloat(), so
+ * serializing a delta never touches the heap.
+ *
+ * Paths are added during setup. A delta is built with begin(), any number
+ * of add() calls and finish(). If a value doesn't fit into the buffer, add()
+ * returns false and leaves the delta intact; finish and send it, then begin
+ * a new one.
+ *
+ * sk_delta_bench_main.cpp compares it with the SensESP JSON path.
+ */
+class SKDeltaSerializer {
+ public:
+  static constexpr int kMaxPaths = 64;
+
+  SKDeltaSerializer(size_t buffer_size = 1024, size_t fragment_size = 4096);
+  ~SKDeltaSerializer();
+
+  /// Add a path, with the number of fraction digits of its values. Returns
+  /// the path id, or -1 if there's no room.
+  int add_path(const char* path, int decimals = 3);
+  int num_paths() const { return num_paths_; }
+
+  /// Start a delta with values.
+  void begin();
+  bool add(int id, float value);
+  bool add(int id, bool value);
+
+  /// Start a delta with metadata.
+  void begin_meta();
+  bool add_meta(int id, const char* units, const char* display_name,
+                const char* description);
+
+  /// Close the delta. Returns its length, or 0 if nothing was added.
+  size_t finish();
+  const char* data() const { return buf_; }
+  int count() const { return count_; }
+
+ protected:
+  struct Path {
+    uint16_t offset;  // Fragment offset in fragments_
+    uint16_t length;
+    uint8_t decimals;
+  };
+
+  bool append(const char* str, size_t len);
+  bool append(const char* str);
+  bool append_string(const char* str);
+  bool begin_entry(int id);
+
+  Path paths_[kMaxPaths];
+  int num_paths_ = 0;
+  char* fragments_;
+  size_t fragment_size_;
+  size_t fragment_len_ = 0;
+
+  char* buf_;
+  size_t size_;
+  size_t len_ = 0;
+  int count_ = 0;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_SK_DELTA_SERIALIZER_H_
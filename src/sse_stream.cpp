@@ -0,0 +1,204 @@
+#include "sse_stream.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "fast_format.h"
+#include "sensesp/system/lambda_consumer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+// How often the streaming task checks for due events
+const uint32_t kPollInterval = 10;  // ms
+// Comment line sent to idle clients to keep proxies from timing out
+const uint32_t kKeepaliveInterval = 15000;  // ms
+
+size_t Append(char* buf, size_t size, size_t pos, const char* str) {
+  while (*str && pos + 1 < size) {
+    buf[pos++] = *str++;
+  }
+  buf[pos] = '\0';
+  return pos;
+}
+
+}  // namespace
+
+SSEStream::SSEStream(unsigned int max_rate) : max_rate_{max_rate} {}
+
+void SSEStream::add_channel(const char* name,
+                            sensesp::ValueProducer<float>* producer,
+                            int decimals) {
+  if (num_channels_ >= kMaxChannels) {
+    debugE("SSEStream: too many channels, ignoring %s", name);
+    return;
+  }
+  int index = num_channels_++;
+  channels_[index].name = name;
+  channels_[index].decimals = decimals;
+  channels_[index].value = NAN;
+  channels_[index].seq = 0;
+  producer->connect_to(
+      new sensesp::LambdaConsumer<float>([this, index](float value) {
+        channels_[index].value = value;
+        channels_[index].seq = channels_[index].seq + 1;
+      }));
+}
+
+void SSEStream::add_http_handler(std::shared_ptr<sensesp::HTTPServer> server) {
+  auto handler = std::make_shared<sensesp::HTTPRequestHandler>(
+      1 << HTTP_GET, "/api/stream",
+      [this](httpd_req_t* req) { return handle_request(req); });
+  server->add_handler(handler);
+  // The streaming task only runs if there's an HTTP server to stream from,
+  // i.e. not in NMEA 2000 only mode
+  xTaskCreate(task, "sse_stream", 3072, this, 1, nullptr);
+}
+
+esp_err_t SSEStream::handle_request(httpd_req_t* req) {
+  Client* client = nullptr;
+  for (auto& c : clients_) {
+    if (!c.active) {
+      client = &c;
+      break;
+    }
+  }
+  if (client == nullptr) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_sendstr(req, "Too many stream clients");
+  }
+
+  uint32_t mask = 0;
+  unsigned int rate = max_rate_;
+  char query[128];
+  char value[96];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    if (httpd_query_key_value(query, "ch", value, sizeof(value)) == ESP_OK) {
+      char* saveptr;
+      for (char* tok = strtok_r(value, ",", &saveptr); tok != nullptr;
+           tok = strtok_r(nullptr, ",", &saveptr)) {
+        for (int i = 0; i < num_channels_; i++) {
+          if (strcmp(tok, channels_[i].name) == 0) {
+            mask |= 1 << i;
+          }
+        }
+      }
+    }
+    if (httpd_query_key_value(query, "rate", value, sizeof(value)) == ESP_OK) {
+      rate = atoi(value);
+    }
+  }
+  if (mask == 0) {
+    mask = (1 << num_channels_) - 1;
+  }
+  rate = constrain(rate, 1U, max_rate_);
+
+  httpd_resp_set_type(req, "text/event-stream");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+  // The first chunk also sends the response headers
+  if (httpd_resp_send_chunk(req, "retry: 2000\n\n", HTTPD_RESP_USE_STRLEN) !=
+      ESP_OK) {
+    return ESP_FAIL;
+  }
+
+  httpd_req_t* async_req;
+  if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  client->req = async_req;
+  client->channel_mask = mask;
+  client->interval_ms = 1000 / rate;
+  client->last_event = millis();
+  for (int i = 0; i < kMaxChannels; i++) {
+    client->sent_seq[i] = 0;
+  }
+  client->first_channel = 0;
+  client->active = true;
+  return ESP_OK;
+}
+
+void SSEStream::task(void* arg) {
+  auto self = static_cast<SSEStream*>(arg);
+  while (true) {
+    vTaskDelay(pdMS_TO_TICKS(kPollInterval));
+    self->send_events();
+  }
+}
+
+void SSEStream::send_events() {
+  uint32_t now = millis();
+  for (auto& client : clients_) {
+    if (!client.active || now - client.last_event < client.interval_ms) {
+      continue;
+    }
+    if (!send_event(client, now)) {
+      close_client(client);
+    }
+  }
+}
+
+bool SSEStream::send_event(Client& client, uint32_t now) {
+  const size_t size = sizeof(client.buf);
+  // Room left for the closing "}\n\n" and the terminating zero
+  const size_t end = size - 4;
+  size_t pos = Append(client.buf, size, 0, "data: {");
+  bool first = true;
+  int carry_over = -1;
+  // Start with the first channel left over from the previous event, so that
+  // with many changing channels, all of them get their turn
+  for (int n = 0; n < num_channels_; n++) {
+    int i = (client.first_channel + n) % num_channels_;
+    uint32_t seq = channels_[i].seq;
+    if (!(client.channel_mask & (1 << i)) || seq == client.sent_seq[i]) {
+      continue;
+    }
+    char value[32];
+    size_t value_len = FormatFloat(value, sizeof(value), channels_[i].value,
+                                   channels_[i].decimals);
+    // ,"name":value
+    size_t entry_len = strlen(channels_[i].name) + 4 + value_len;
+    if (value_len == 0 || (first && pos + entry_len > end)) {
+      // Doesn't fit even into an empty event; drop the value
+      client.sent_seq[i] = seq;
+      debugW("SSEStream: %s doesn't fit into an event", channels_[i].name);
+      continue;
+    }
+    if (pos + entry_len > end) {
+      // Send it with the next event
+      if (carry_over < 0) {
+        carry_over = i;
+      }
+      continue;
+    }
+    client.sent_seq[i] = seq;
+    pos = Append(client.buf, size, pos, first ? "\"" : ",\"");
+    pos = Append(client.buf, size, pos, channels_[i].name);
+    pos = Append(client.buf, size, pos, "\":");
+    pos = Append(client.buf, size, pos, value);
+    first = false;
+  }
+  client.first_channel = carry_over < 0 ? 0 : carry_over;
+
+  if (first) {
+    // Nothing changed
+    if (now - client.last_event < kKeepaliveInterval) {
+      return true;
+    }
+    pos = Append(client.buf, size, 0, ": keepalive\n\n");
+  } else {
+    pos = Append(client.buf, size, pos, "}\n\n");
+  }
+
+  client.last_event = now;
+  return httpd_resp_send_chunk(client.req, client.buf, pos) == ESP_OK;
+}
+
+void SSEStream::close_client(Client& client) {
+  httpd_req_async_handler_complete(client.req);
+  client.req = nullptr;
+  client.active = false;
+}
+
+}  // namespace halmet
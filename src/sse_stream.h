@@ -0,0 +1,74 @@
+#ifndef HALMET_SRC_SSE_STREAM_H_
+#define HALMET_SRC_SSE_STREAM_H_
+
+#include <esp_http_server.h>
+
+#include <memory>
+
+#include "sensesp/net/http_server.h"
+#include "sensesp/system/valueproducer.h"
+
+namespace halmet {
+
+/**
+ * @brief Live value stream over Server-Sent Events.
+ *
+ * GET /api/stream?ch=rpm,a2&rate=10 streams the selected channels as
+ * `data: {"rpm":1500,"a2":12.34}` events at most `rate` times per second.
+ * Without `ch`, all channels are streamed. Only channels that changed since
+ * the previous event are included.
+ *
+ * The input side only stores the latest value, so the event loop never waits
+ * for a client. Connections are detached from the HTTP server with the async
+ * request API and served from a low-priority task that formats events into
+ * per-client static buffers.
+ */
+class SSEStream {
+ public:
+  static constexpr int kMaxChannels = 16;
+  static constexpr int kMaxClients = 3;
+
+  SSEStream(unsigned int max_rate = 20);
+
+  /// Make a producer available for streaming under `name`. Values are sent
+  /// with `decimals` fraction digits.
+  void add_channel(const char* name, sensesp::ValueProducer<float>* producer,
+                   int decimals = 3);
+
+  void add_http_handler(std::shared_ptr<sensesp::HTTPServer> server);
+
+ protected:
+  struct Channel {
+    const char* name;
+    int decimals;
+    volatile float value;
+    volatile uint32_t seq;
+  };
+
+  struct Client {
+    httpd_req_t* req;
+    volatile bool active;
+    uint32_t channel_mask;
+    uint32_t interval_ms;
+    uint32_t last_event;
+    uint32_t sent_seq[kMaxChannels];
+    // Channel to start the next event with
+    int first_channel;
+    char buf[384];
+  };
+
+  esp_err_t handle_request(httpd_req_t* req);
+  void send_events();
+  bool send_event(Client& client, uint32_t now);
+  void close_client(Client& client);
+  static void task(void* arg);
+
+  unsigned int max_rate_;
+  Channel channels_[kMaxChannels];
+  int num_channels_ = 0;
+  Client clients_[kMaxClients] = {};
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_SSE_STREAM_H_
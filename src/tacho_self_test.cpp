@@ -0,0 +1,366 @@
+#include "tacho_self_test.h"
+
+#include <cmath>
+#include <cstdarg>
+#include <cstring>
+
+#include "rt_event_loop.h"
+#include "sensesp/system/lambda_consumer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+// How often the output frequency is updated during a test
+const unsigned int kTickInterval = 10;  // ms
+// LEDC source clock (APB)
+const float kLEDCClock = 80e6;
+// Highest LEDC duty resolution used for the test output
+const uint8_t kMaxResolution = 13;
+// Ramp frequencies below this are too coarse for the counting window
+const float kMinRampFrequency = 20;  // Hz
+
+}  // namespace
+
+TachoSelfTest::TachoSelfTest(uint8_t output_pin, unsigned int idle_frequency,
+                             sensesp::Frequency* tacho,
+                             const String& config_path)
+    : BlobSaveable{config_path},
+      output_pin_{output_pin},
+      idle_frequency_{idle_frequency},
+      tacho_{tacho} {
+  mutex_ = xSemaphoreCreateMutex();
+  load();
+
+  tacho_->connect_to(new sensesp::LambdaConsumer<float>(
+      [this](float value) { on_output(value); }));
+  rt_event_loop()->onRepeat(kTickInterval, [this]() { tick(); });
+}
+
+bool TachoSelfTest::parse_profile(const String& profile,
+                                  std::vector<Segment>* segments) {
+  segments->clear();
+  int start = 0;
+  while (start < (int)profile.length()) {
+    int end = profile.indexOf(',', start);
+    if (end < 0) {
+      end = profile.length();
+    }
+    String item = profile.substring(start, end);
+    item.trim();
+    start = end + 1;
+    if (item.length() == 0) {
+      continue;
+    }
+
+    Segment segment = {};
+    float from, to;
+    unsigned int duration;
+    if (sscanf(item.c_str(), "hold %f %u", &from, &duration) == 2) {
+      segment = {kHold, from, from, duration};
+    } else if (sscanf(item.c_str(), "ramp %f %f %u", &from, &to,
+                      &duration) == 3) {
+      segment = {kRamp, from, to, duration};
+    } else if (sscanf(item.c_str(), "off %u", &duration) == 1) {
+      segment = {kOff, 0, 0, duration};
+    } else {
+      debugE("Tacho self-test: invalid profile segment \"%s\"", item.c_str());
+      return false;
+    }
+    if (segment.type == kHold && segment.from == 0) {
+      segment.type = kOff;
+    }
+    if (segment.from < 0 || segment.to < 0 || segment.duration == 0) {
+      debugE("Tacho self-test: invalid profile segment \"%s\"", item.c_str());
+      return false;
+    }
+    segments->push_back(segment);
+  }
+  return !segments->empty();
+}
+
+void TachoSelfTest::tick() {
+  if (start_requested_.exchange(false)) {
+    start();
+  }
+  if (state_ != kRunning) {
+    return;
+  }
+
+  uint32_t elapsed = millis() - segment_start_;
+  const Segment& segment = segments_[segment_index_];
+  if (elapsed >= segment.duration) {
+    finish_segment();
+    if (segment_index_ + 1 < segments_.size()) {
+      start_segment(segment_index_ + 1);
+    } else {
+      finish();
+    }
+    return;
+  }
+  if (segment.type == kRamp) {
+    set_output(segment.from +
+               (segment.to - segment.from) * elapsed / segment.duration);
+  }
+}
+
+void TachoSelfTest::start() {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  String profile = profile_;
+  test_tolerance_ = tolerance_;
+  xSemaphoreGive(mutex_);
+
+  if (!parse_profile(profile, &segments_)) {
+    state_ = kFailed;
+    snprintf(report_, sizeof(report_), "Invalid profile");
+    publish();
+    return;
+  }
+
+  // The measured frequency is compared in Hz at the input
+  JsonDocument doc;
+  JsonObject tacho_config = doc.to<JsonObject>();
+  tacho_->to_json(tacho_config);
+  multiplier_ = tacho_config["multiplier"] | 1.0f;
+  if (multiplier_ == 0) {
+    multiplier_ = 1;
+  }
+
+  steady_state_error_ = 0;
+  step_response_time_ = 0;
+  unsettled_steps_ = 0;
+  max_trackable_frequency_ = 0;
+  count_loss_frequency_ = 0;
+  report_[0] = '\0';
+  last_output_ = 0;
+  state_ = kRunning;
+  publish();
+  debugI("Tacho self-test: started, %d segments", (int)segments_.size());
+  start_segment(0);
+}
+
+void TachoSelfTest::start_segment(size_t index) {
+  segment_index_ = index;
+  segment_start_ = millis();
+  settled_ = false;
+  response_time_ = 0;
+  settled_sum_ = 0;
+  settled_count_ = 0;
+  ramp_loss_frequency_ = 0;
+  set_output(segments_[index].from);
+}
+
+void TachoSelfTest::finish_segment() {
+  const Segment& segment = segments_[segment_index_];
+  switch (segment.type) {
+    case kOff:
+      if (!settled_) {
+        unsettled_steps_++;
+        append_report("off: not settled; ");
+      } else {
+        append_report("off: settled in %d ms; ", response_time_);
+      }
+      break;
+    case kHold: {
+      if (!settled_) {
+        unsettled_steps_++;
+        append_report("hold %.0f Hz: not settled; ", segment.from);
+        break;
+      }
+      if (settled_count_ == 0) {
+        append_report("hold %.0f Hz: settled in %d ms; ", segment.from,
+                      response_time_);
+        break;
+      }
+      float mean = settled_sum_ / settled_count_;
+      float error = 100 * (mean - segment.from) / segment.from;
+      if (fabsf(error) > fabsf(steady_state_error_)) {
+        steady_state_error_ = error;
+      }
+      append_report("hold %.0f Hz: settled in %d ms, %.1f Hz, %+.2f%%; ",
+                    segment.from, response_time_, mean, error);
+      break;
+    }
+    case kRamp:
+      if (ramp_loss_frequency_ > 0) {
+        append_report("ramp %.0f-%.0f Hz: pulses lost at %.0f Hz; ",
+                      segment.from, segment.to, ramp_loss_frequency_);
+      } else {
+        append_report("ramp %.0f-%.0f Hz: tracked; ", segment.from,
+                      segment.to);
+      }
+      break;
+  }
+}
+
+void TachoSelfTest::finish() {
+  set_output(idle_frequency_);
+  state_ = kDone;
+  publish();
+  debugI("Tacho self-test: error %.2f%%, step response %d ms, tracked to "
+         "%.0f Hz",
+         steady_state_error_, step_response_time_, max_trackable_frequency_);
+}
+
+void TachoSelfTest::on_output(float value) {
+  uint32_t now = millis();
+  uint32_t window = now - last_output_;
+  last_output_ = now;
+  if (state_ != kRunning || window == now) {
+    return;
+  }
+
+  float measured = value / multiplier_;
+  const Segment& segment = segments_[segment_index_];
+  bool window_in_segment = (int32_t)(now - window - segment_start_) >= 0;
+
+  switch (segment.type) {
+    case kHold:
+    case kOff:
+      if (!settled_) {
+        if (fabsf(measured - segment.from) <=
+            tolerance(segment.from, window)) {
+          settled_ = true;
+          response_time_ = now - segment_start_;
+          if (response_time_ > step_response_time_) {
+            step_response_time_ = response_time_;
+          }
+        }
+      } else if (window_in_segment) {
+        settled_sum_ += measured;
+        settled_count_++;
+      }
+      break;
+    case kRamp: {
+      if (!window_in_segment || ramp_loss_frequency_ > 0) {
+        break;
+      }
+      // A linear ramp averages to its value at the middle of the window
+      float t = (now - window / 2 - segment_start_) / (float)segment.duration;
+      float expected = segment.from + (segment.to - segment.from) * t;
+      if (expected < kMinRampFrequency) {
+        break;
+      }
+      if (fabsf(measured - expected) <= tolerance(expected, window)) {
+        if (expected > max_trackable_frequency_) {
+          max_trackable_frequency_ = expected;
+        }
+      } else {
+        ramp_loss_frequency_ = expected;
+        if (count_loss_frequency_ == 0 || expected < count_loss_frequency_) {
+          count_loss_frequency_ = expected;
+        }
+      }
+      break;
+    }
+  }
+}
+
+void TachoSelfTest::set_output(float frequency) {
+  if (frequency < 1) {
+    ledcWrite(output_pin_, 0);
+    commanded_ = 0;
+    return;
+  }
+  // Use the highest duty resolution the frequency allows
+  uint8_t resolution = log2f(kLEDCClock / frequency);
+  if (resolution > kMaxResolution) {
+    resolution = kMaxResolution;
+  } else if (resolution < 1) {
+    resolution = 1;
+  }
+  if ((uint32_t)frequency != (uint32_t)commanded_ ||
+      resolution != output_resolution_) {
+    ledcChangeFrequency(output_pin_, frequency, resolution);
+    output_resolution_ = resolution;
+  }
+  // 50% duty cycle
+  ledcWrite(output_pin_, 1 << (resolution - 1));
+  commanded_ = frequency;
+}
+
+float TachoSelfTest::tolerance(float frequency, uint32_t window) const {
+  // At low frequencies, the counting resolution dominates
+  float count_resolution = 1.5f * 1000 / window;
+  return fmaxf(frequency * test_tolerance_ / 100, count_resolution);
+}
+
+void TachoSelfTest::append_report(const char* format, ...) {
+  size_t len = strlen(report_);
+  va_list args;
+  va_start(args, format);
+  vsnprintf(report_ + len, sizeof(report_) - len, format, args);
+  va_end(args);
+}
+
+void TachoSelfTest::publish() {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  results_.state = state_;
+  results_.steady_state_error = steady_state_error_;
+  results_.step_response_time = step_response_time_;
+  results_.unsettled_steps = unsettled_steps_;
+  results_.max_trackable_frequency = max_trackable_frequency_;
+  results_.count_loss_frequency = count_loss_frequency_;
+  snprintf(results_.report, sizeof(results_.report), "%s", report_);
+  xSemaphoreGive(mutex_);
+}
+
+bool TachoSelfTest::to_json(JsonObject& config) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  config["profile"] = profile_;
+  config["tolerance"] = tolerance_;
+  config["run"] = false;
+
+  static const char* kStateNames[] = {"idle", "running", "done",
+                                      "invalid profile"};
+  const Results& results = results_;
+  config["state"] = kStateNames[results.state];
+  if (results.state == kDone) {
+    config["steady_state_error"] = results.steady_state_error;
+    config["step_response_time"] = results.step_response_time;
+    config["unsettled_steps"] = results.unsettled_steps;
+    config["max_trackable_frequency"] = results.max_trackable_frequency;
+    config["count_loss_frequency"] = results.count_loss_frequency;
+  }
+  if (results.state == kDone || results.state == kFailed) {
+    config["report"] = results.report;
+  }
+  xSemaphoreGive(mutex_);
+  return true;
+}
+
+bool TachoSelfTest::from_json(const JsonObject& config) {
+  if (!config["profile"].is<String>() || !config["tolerance"].is<float>()) {
+    return false;
+  }
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  profile_ = config["profile"].as<String>();
+  tolerance_ = config["tolerance"];
+  xSemaphoreGive(mutex_);
+  if (config["run"].is<bool>() && config["run"].as<bool>()) {
+    // Picked up by the real-time loop
+    start_requested_ = true;
+  }
+  return true;
+}
+
+const String ConfigSchema(const TachoSelfTest& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "profile": { "title": "Profile", "type": "string", "description": "Comma-separated segments: 'hold <Hz> <ms>', 'ramp <from Hz> <to Hz> <ms>', 'off <ms>'" },
+      "tolerance": { "title": "Tolerance", "type": "number", "description": "Allowed deviation of the measured frequency (%)" },
+      "run": { "title": "Run self-test", "type": "boolean", "description": "Start the test when the configuration is saved. The test output must be connected to the tacho input." },
+      "state": { "title": "State", "type": "string", "readOnly": true },
+      "steady_state_error": { "title": "Steady-state error", "type": "number", "readOnly": true, "description": "Worst mean deviation during the hold segments (%)" },
+      "step_response_time": { "title": "Step response time", "type": "integer", "readOnly": true, "description": "Slowest time to settle within the tolerance after a step (ms)" },
+      "unsettled_steps": { "title": "Unsettled steps", "type": "integer", "readOnly": true, "description": "Steps that never settled within the tolerance" },
+      "max_trackable_frequency": { "title": "Maximum trackable frequency", "type": "number", "readOnly": true, "description": "Highest ramp frequency measured within the tolerance (Hz)" },
+      "count_loss_frequency": { "title": "Count loss frequency", "type": "number", "readOnly": true, "description": "Ramp frequency at which pulses were first lost, 0 if none (Hz)" },
+      "report": { "title": "Report", "type": "string", "readOnly": true }
+    }
+  })###";
+}
+
+}  // namespace halmet
@@ -0,0 +1,128 @@
+#ifndef HALMET_SRC_TACHO_SELF_TEST_H_
+#define HALMET_SRC_TACHO_SELF_TEST_H_
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <atomic>
+#include <vector>
+
+#include "config_blob_store.h"
+#include "sensesp/system/saveable.h"
+#include "sensesp/transforms/frequency.h"
+
+namespace halmet {
+
+/**
+ * @brief Built-in self-test of a tacho input using the LEDC test output.
+ *
+ * With the test output wired to a digital input, the test drives the output
+ * through a frequency profile and compares the frequency measured by the
+ * tacho pipeline with the commanded one. The profile is a comma-separated
+ * list of segments:
+ *
+ *   hold <Hz> <ms>           Step to a frequency and hold it
+ *   ramp <from Hz> <to Hz> <ms>  Sweep linearly between two frequencies
+ *   off <ms>                 Drop the output to zero
+ *
+ * The report has the worst steady-state error of the hold segments, the
+ * slowest step response (time until the measured frequency is within the
+ * tolerance of a new hold or off level) and the highest frequency tracked
+ * during the ramps before pulses were lost. The test is started from the
+ * web UI; while it runs, the tacho outputs carry the test frequencies.
+ */
+class TachoSelfTest : public BlobSaveable {
+ public:
+  /// `tacho` is the output of the tacho pipeline fed by `output_pin`, which
+  /// idles at `idle_frequency` when no test is running.
+  TachoSelfTest(uint8_t output_pin, unsigned int idle_frequency,
+                sensesp::Frequency* tacho, const String& config_path);
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  enum SegmentType { kHold, kRamp, kOff };
+
+  struct Segment {
+    SegmentType type;
+    float from;  // Hz
+    float to;    // Hz
+    uint32_t duration;  // ms
+  };
+
+  enum State { kIdle, kRunning, kDone, kFailed };
+
+  /// Copy of the results read by the web UI
+  struct Results {
+    int state;
+    float steady_state_error;
+    int step_response_time;
+    int unsettled_steps;
+    float max_trackable_frequency;
+    float count_loss_frequency;
+    char report[512];
+  };
+
+  static bool parse_profile(const String& profile,
+                            std::vector<Segment>* segments);
+
+  void tick();
+  void start();
+  void start_segment(size_t index);
+  void finish_segment();
+  void finish();
+  void on_output(float value);
+  void set_output(float frequency);
+  float tolerance(float frequency, uint32_t window) const;
+  void append_report(const char* format, ...);
+  void publish();
+
+  uint8_t output_pin_;
+  unsigned int idle_frequency_;
+  sensesp::Frequency* tacho_;
+
+  // Configuration, set on the HTTP task and read when a test starts
+  String profile_ =
+      "hold 380 3000, hold 1000 3000, off 3000, hold 50 4000, "
+      "ramp 100 20000 20000, hold 380 3000";
+  float tolerance_ = 2;  // %
+  std::atomic<bool> start_requested_{false};
+
+  // Test state, owned by the real-time loop
+  float test_tolerance_ = 2;  // %
+  std::vector<Segment> segments_;
+  size_t segment_index_ = 0;
+  uint32_t segment_start_ = 0;
+  float commanded_ = 0;
+  uint8_t output_resolution_ = 0;
+  float multiplier_ = 1;
+  uint32_t last_output_ = 0;
+  bool settled_ = false;
+  int response_time_ = 0;  // ms
+  float settled_sum_ = 0;
+  int settled_count_ = 0;
+  float ramp_loss_frequency_ = 0;  // Hz
+
+  // Results, owned by the real-time loop
+  int state_ = kIdle;
+  float steady_state_error_ = 0;   // %, worst of the hold segments
+  int step_response_time_ = 0;     // ms, slowest
+  int unsettled_steps_ = 0;
+  float max_trackable_frequency_ = 0;  // Hz
+  float count_loss_frequency_ = 0;     // Hz, 0 if no pulses were lost
+  char report_[512] = "";
+
+  // Guards the configuration and the published results, which are accessed
+  // from the HTTP task
+  SemaphoreHandle_t mutex_;
+  Results results_ = {};
+};
+
+const String ConfigSchema(const TachoSelfTest& obj);
+
+inline bool ConfigRequiresRestart(const TachoSelfTest& obj) { return false; }
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_TACHO_SELF_TEST_H_
@@ -0,0 +1,117 @@
+// Bins and quantiles of the data age and jitter histogram. Run with:
+//
+//   pio test -e native -f test_age_histogram
+
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "age_histogram.h"
+
+using namespace halmet;
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_bins_are_contiguous() {
+  for (int bin = 0; bin < AgeHistogram::kNumBins; bin++) {
+    uint32_t lower = AgeHistogram::bin_lower(bin);
+    uint32_t upper = AgeHistogram::bin_upper(bin);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(upper, lower);
+    TEST_ASSERT_EQUAL(bin, AgeHistogram::bin_index(lower));
+    TEST_ASSERT_EQUAL(bin, AgeHistogram::bin_index(upper));
+    if (bin > 0) {
+      TEST_ASSERT_EQUAL_UINT32(AgeHistogram::bin_upper(bin - 1) + 1, lower);
+    }
+  }
+  TEST_ASSERT_EQUAL(AgeHistogram::kNumBins - 1,
+                    AgeHistogram::bin_index(UINT32_MAX));
+}
+
+void test_small_values_are_exact() {
+  for (uint32_t value = 0; value < 2 * AgeHistogram::kSubBins; value++) {
+    int bin = AgeHistogram::bin_index(value);
+    TEST_ASSERT_EQUAL_UINT32(value, AgeHistogram::bin_lower(bin));
+    TEST_ASSERT_EQUAL_UINT32(value, AgeHistogram::bin_upper(bin));
+  }
+}
+
+void test_bin_width_within_an_eighth() {
+  // Below the overflow bin, no bin is wider than 1/8 of its lower bound
+  for (int bin = AgeHistogram::kSubBins; bin < AgeHistogram::kNumBins - 1;
+       bin++) {
+    uint32_t lower = AgeHistogram::bin_lower(bin);
+    uint32_t width = AgeHistogram::bin_upper(bin) - lower + 1;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(lower / 8, width);
+  }
+}
+
+void test_quantiles_track_the_true_values() {
+  // 1000 ages spread over 1-300 ms; the true quantiles are known exactly
+  srand(1);
+  AgeHistogram histogram;
+  std::vector<uint32_t> ages;
+  for (int i = 0; i < 1000; i++) {
+    uint32_t age = 1 + rand() % 300;
+    ages.push_back(age);
+    histogram.add(age);
+  }
+  std::sort(ages.begin(), ages.end());
+  const float quantiles[] = {0.5, 0.95};
+  for (float q : quantiles) {
+    uint32_t expected = ages[(size_t)(q * ages.size())];
+    uint32_t reported = histogram.quantile(q);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(expected, reported);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(expected + expected / 8, reported);
+  }
+  TEST_ASSERT_EQUAL_UINT32(ages.back(), histogram.max());
+  TEST_ASSERT_EQUAL_UINT32(1000, histogram.count());
+}
+
+void test_not_a_power_of_two() {
+  // A steady 100 ms age used to be reported as 128 ms
+  AgeHistogram histogram;
+  for (int i = 0; i < 100; i++) {
+    histogram.add(100);
+  }
+  TEST_ASSERT_EQUAL_UINT32(100, histogram.quantile(0.5));
+  // Once the maximum is higher, the top of the 96-103 bin is reported
+  histogram.add(140);
+  TEST_ASSERT_EQUAL_UINT32(103, histogram.quantile(0.95));
+  TEST_ASSERT_EQUAL_UINT32(140, histogram.max());
+}
+
+void test_large_jitter_not_clipped() {
+  // 50 ms of jitter in microseconds used to saturate at 32768 us
+  AgeHistogram histogram;
+  for (int i = 0; i < 20; i++) {
+    histogram.add(50000);
+  }
+  uint32_t p95 = histogram.quantile(0.95);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(50000, p95);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(50000 + 50000 / 8, p95);
+}
+
+void test_clear() {
+  AgeHistogram histogram;
+  histogram.add(5);
+  histogram.clear();
+  TEST_ASSERT_EQUAL_UINT32(0, histogram.count());
+  TEST_ASSERT_EQUAL_UINT32(0, histogram.max());
+  TEST_ASSERT_EQUAL_UINT32(0, histogram.quantile(0.5));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bins_are_contiguous);
+  RUN_TEST(test_small_values_are_exact);
+  RUN_TEST(test_bin_width_within_an_eighth);
+  RUN_TEST(test_quantiles_track_the_true_values);
+  RUN_TEST(test_not_a_power_of_two);
+  RUN_TEST(test_large_jitter_not_clipped);
+  RUN_TEST(test_clear);
+  return UNITY_END();
+}
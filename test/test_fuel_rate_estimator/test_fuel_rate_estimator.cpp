@@ -0,0 +1,341 @@
+// Fuel rate estimation from synthetic tank volume runs and traces.
+//
+// The runs add slosh, sender noise, throttle changes and refuelling to a
+// known consumption and check the time until the estimate converges and
+// its error afterwards. The trace test decodes an input trace, converts it
+// to a volume with a linear sender curve, and checks the estimate against
+// the consumption the trace was generated with. Run with:
+//
+//   pio test -e native -f test_fuel_rate_estimator
+//
+// test/fixtures/fuel_cruise.htrc is synthetic: tools/make_fuel_trace.py
+// writes it with its own wave, sender and ADC noise model, independent of
+// the simulation below. Its parameters are repeated in kCruiseTrace.
+
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "fuel_rate_estimator.h"
+
+using namespace halmet;
+
+namespace {
+
+const float kPi = 3.14159265358979f;
+// Tank senders are read every 500 ms
+const uint32_t kSampleInterval = 500;  // ms
+const double kLitersPerHour = 1 / 3.6e6;  // m3/s
+
+// A run converges when the estimate is valid and stays within the
+// tolerance: 10% of the true consumption, but at least 1 l/h
+const double kRelativeTolerance = 0.1;
+const double kMinTolerance = 1;  // l/h
+// Acceptance limits
+const double kMaxConvergenceTime = 900;  // s
+const double kMaxRmsError = 1;           // l/h, after convergence
+
+struct Case {
+  const char* name;
+  float duration;       // min
+  float capacity;       // l
+  float initial;        // l
+  float rate;           // Consumption, l/h
+  float step_time;      // min, 0 for no step
+  float step_rate;      // Consumption after the step, l/h
+  float refuel_time;    // min, 0 for none
+  float refuel_volume;  // l, added over three minutes
+  float slosh;          // Amplitude, l
+  float slosh_period;   // s
+  float noise;          // Standard deviation of the sender noise, l
+  float lsb;            // Volume quantization, l
+};
+
+double Gaussian() {
+  double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2 * log(u1)) * cos(2 * kPi * u2);
+}
+
+// The true consumption at time t, l/h
+double TrueRate(const Case& c, double t) {
+  return c.step_time > 0 && t >= c.step_time * 60 ? c.step_rate : c.rate;
+}
+
+struct Result {
+  double convergence_time;  // s from the start or the step, or -1
+  double rms_error;         // l/h, after convergence
+};
+
+// Evaluate one segment of the run [start, end): convergence time from
+// `start` and the error afterwards
+struct Segment {
+  double start;
+  double end;
+  double last_bad = -1;  // Last block outside the tolerance
+  std::vector<std::pair<double, double>> errors;  // time, error
+};
+
+void Track(Segment* segment, double t, bool valid, double error,
+           double tolerance) {
+  if (t < segment->start || t >= segment->end) {
+    return;
+  }
+  if (!valid || fabs(error) > tolerance) {
+    segment->last_bad = t;
+  }
+  segment->errors.push_back({t, error});
+}
+
+Result Evaluate(const Segment& segment) {
+  Result result = {-1, 0};
+  // Convergence requires the estimate to have settled well before the end
+  if (segment.last_bad > segment.end - 300) {
+    return result;
+  }
+  result.convergence_time =
+      segment.last_bad < 0 ? 0 : segment.last_bad - segment.start;
+  double sum_sq = 0;
+  int n = 0;
+  for (const auto& e : segment.errors) {
+    if (e.first > segment.last_bad) {
+      sum_sq += e.second * e.second;
+      n++;
+    }
+  }
+  result.rms_error = n > 0 ? sqrt(sum_sq / n) : 0;
+  return result;
+}
+
+void CheckSegment(const Result& result, double max_rms_error) {
+  TEST_ASSERT_TRUE_MESSAGE(result.convergence_time >= 0, "Not converged");
+  TEST_ASSERT_LESS_OR_EQUAL(kMaxConvergenceTime, result.convergence_time);
+  TEST_ASSERT_LESS_OR_EQUAL(max_rms_error, result.rms_error);
+}
+
+void RunCase(const Case& c) {
+  srand(1);
+  FuelRateEstimator estimator;
+  std::vector<Segment> segments;
+  if (c.step_time > 0) {
+    segments.push_back({0, c.step_time * 60.});
+    segments.push_back({c.step_time * 60., c.duration * 60.});
+  } else {
+    segments.push_back({0, c.duration * 60.});
+  }
+
+  double volume = c.initial;
+  double slosh_phase = 0;
+  uint32_t steps = c.duration * 60000 / kSampleInterval;
+  for (uint32_t i = 0; i < steps; i++) {
+    double t = i * kSampleInterval / 1000.;
+    double dt = kSampleInterval / 1000.;
+    double rate = TrueRate(c, t);
+    volume -= rate * dt / 3600;
+    if (c.refuel_time > 0 && t >= c.refuel_time * 60 &&
+        t < c.refuel_time * 60 + 180) {
+      volume += c.refuel_volume * dt / 180;
+    }
+    // Slosh at the natural period of the tank, modulated by the waves
+    slosh_phase += 2 * kPi * dt / (c.slosh_period * (1 + 0.1 * Gaussian()));
+    double slosh =
+        c.slosh * sin(slosh_phase) * (0.6 + 0.4 * sin(2 * kPi * t / 47));
+    double measured = volume + slosh + c.noise * Gaussian();
+    measured = std::max(0., std::min((double)c.capacity, measured));
+    measured = round(measured / c.lsb) * c.lsb;
+
+    if (!estimator.update(measured / 1000, i * kSampleInterval)) {
+      continue;
+    }
+    double estimate = -estimator.rate() / kLitersPerHour;
+    double tolerance = std::max(kMinTolerance, kRelativeTolerance * rate);
+    // Blocks overlapping a refuel are not scored
+    if (c.refuel_time > 0 && t >= c.refuel_time * 60 &&
+        t < c.refuel_time * 60 + 180 + 20) {
+      continue;
+    }
+    for (Segment& segment : segments) {
+      Track(&segment, t, estimator.valid(), estimate - rate, tolerance);
+    }
+  }
+
+  for (const Segment& segment : segments) {
+    CheckSegment(Evaluate(segment), kMaxRmsError);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////
+// Input traces
+
+// A trace and the parameters it was generated with
+struct Trace {
+  const char* path;
+  int input;           // 1-based analog input
+  float empty_ohms;
+  float full_ohms;
+  float capacity;      // l
+  float duration;      // s
+  float initial;       // Volume at the start, l
+  float rate;          // Consumption, l/h
+};
+
+const Trace kCruiseTrace = {HALMET_TEST_FIXTURES "/fuel_cruise.htrc",
+                            1, 240, 33, 200, 1800, 150, 15};
+
+uint32_t ReadVarint(const std::vector<uint8_t>& buf, size_t* pos) {
+  uint32_t result = 0;
+  int shift = 0;
+  while (*pos < buf.size()) {
+    uint8_t byte = buf[(*pos)++];
+    result |= (uint32_t)(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+    shift += 7;
+  }
+  return result;
+}
+
+struct Sample {
+  uint32_t time;  // ms
+  float volume;   // l
+};
+
+// The samples of analog input `input` (0-15) of an input trace, converted
+// to a volume like ConnectTankSender() does with a linear level curve
+bool LoadTrace(const char* path, int input, float empty_ohms, float full_ohms,
+               float capacity, std::vector<Sample>* samples) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  std::vector<uint8_t> buf;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    buf.insert(buf.end(), chunk, chunk + n);
+  }
+  fclose(file);
+  if (buf.size() < 5 || memcmp(buf.data(), "HTRC", 4) != 0) {
+    return false;
+  }
+  // Volts per count: 7.8125 uV, or 1 LSB at GAIN_ONE in version 1 traces
+  double volts_per_count = buf[4] == 1 ? 125e-6 : 7.8125e-6;
+
+  uint32_t time = 0;
+  size_t pos = 5;
+  while (pos < buf.size()) {
+    time += ReadVarint(buf, &pos);
+    uint8_t type = buf[pos++];
+    if (type == 1) {  // ADC
+      int key = buf[pos] * 4 + buf[pos + 1];
+      pos += 2;
+      uint32_t zigzag = ReadVarint(buf, &pos);
+      int32_t counts = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+      if (key != input) {
+        continue;
+      }
+      // HALMET voltage divider and sender measurement current
+      double ohms = counts * volts_per_count * (33.3 / 3.3) / 0.01;
+      double level = (ohms - empty_ohms) / (full_ohms - empty_ohms);
+      level = std::max(0., std::min(1., level));
+      samples->push_back({time, (float)(level * capacity)});
+    } else if (type == 2) {  // Counter
+      pos += 1;
+      ReadVarint(buf, &pos);
+    } else if (type == 3 || type == 4) {  // CAN
+      ReadVarint(buf, &pos);
+      pos += 3;
+      pos += ReadVarint(buf, &pos);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RunTrace(const Trace& trace) {
+  std::vector<Sample> samples;
+  TEST_ASSERT_TRUE_MESSAGE(
+      LoadTrace(trace.path, trace.input - 1, trace.empty_ohms,
+                trace.full_ohms, trace.capacity, &samples),
+      trace.path);
+  TEST_ASSERT_GREATER_THAN(1, samples.size());
+  double duration = (samples.back().time - samples.front().time) / 1000.;
+  TEST_ASSERT_FLOAT_WITHIN(1, trace.duration, duration);
+
+  // The decoded volume starts at the initial volume, give or take the
+  // level sway over the first minute
+  double sum = 0;
+  int n = 0;
+  for (const Sample& s : samples) {
+    if (s.time - samples.front().time < 60000) {
+      sum += s.volume;
+      n++;
+    }
+  }
+  TEST_ASSERT_FLOAT_WITHIN(1.5, trace.initial, sum / n);
+
+  Segment segment = {0, duration};
+  FuelRateEstimator estimator;
+  double tolerance =
+      std::max(kMinTolerance, kRelativeTolerance * trace.rate);
+  for (const Sample& s : samples) {
+    if (!estimator.update(s.volume / 1000, s.time)) {
+      continue;
+    }
+    double estimate = -estimator.rate() / kLitersPerHour;
+    Track(&segment, (s.time - samples.front().time) / 1000.,
+          estimator.valid(), estimate - trace.rate, tolerance);
+  }
+  CheckSegment(Evaluate(segment), kMaxRmsError);
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_cruise() {
+  RunCase({"cruise", 60, 200, 180, 20, 0, 0, 0, 0, 3, 4, 0.5, 0.2});
+}
+
+void test_idle_calm() {
+  RunCase({"idle, calm", 60, 200, 120, 2, 0, 0, 0, 0, 0.3, 5, 0.3, 0.2});
+}
+
+void test_rough_sea() {
+  RunCase({"rough sea", 60, 400, 350, 40, 0, 0, 0, 0, 8, 3, 1, 0.4});
+}
+
+void test_throttle_step() {
+  RunCase({"throttle step", 60, 200, 180, 10, 30, 30, 0, 0, 3, 4, 0.5, 0.2});
+}
+
+void test_refuel() {
+  RunCase({"refuel", 60, 200, 60, 20, 0, 0, 20, 120, 3, 4, 0.5, 0.2});
+}
+
+void test_engine_off() {
+  RunCase({"engine off", 60, 200, 100, 0, 0, 0, 0, 0, 1, 4, 0.5, 0.2});
+}
+
+void test_synthetic_trace_cruise() { RunTrace(kCruiseTrace); }
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_cruise);
+  RUN_TEST(test_idle_calm);
+  RUN_TEST(test_rough_sea);
+  RUN_TEST(test_throttle_step);
+  RUN_TEST(test_refuel);
+  RUN_TEST(test_engine_off);
+  RUN_TEST(test_synthetic_trace_cruise);
+  return UNITY_END();
+}
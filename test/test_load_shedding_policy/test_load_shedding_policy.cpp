@@ -0,0 +1,136 @@
+// Load shedding decisions, alone and on simulated overloaded event loops.
+//
+// Run with:
+//
+//   pio test -e native -f test_load_shedding_policy
+
+#include <unity.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "load_shedding_policy.h"
+#include "overload_sim.h"
+
+using namespace halmet;
+
+namespace {
+
+const int kStages = 3;
+const int kRestoreWindows = 5;
+
+// Feed `windows` windows of the same load, return the last level
+int Feed(LoadSheddingPolicy& policy, int windows, float load, int misses) {
+  int level = policy.level();
+  for (int i = 0; i < windows; i++) {
+    level = policy.update(load, misses);
+  }
+  return level;
+}
+
+// Highest shed level of `loop` from `start` to `end` (us)
+int MaxLevel(const OverloadSim::Result& result, OverloadSim::Loop loop,
+             uint64_t start, uint64_t end) {
+  int level = 0;
+  for (uint64_t t = start; t < end; t += OverloadSim::kSecond) {
+    int digit = result.levels[loop][t / OverloadSim::kSecond] - '0';
+    level = std::max(level, digit);
+  }
+  return level;
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_sheds_one_stage_per_overloaded_window() {
+  LoadSheddingPolicy policy(kStages);
+  TEST_ASSERT_EQUAL(0, policy.update(0.5, 0));
+  TEST_ASSERT_EQUAL(1, policy.update(0.9, 0));
+  TEST_ASSERT_EQUAL(2, policy.update(0.9, 0));
+  TEST_ASSERT_EQUAL(3, policy.update(0.9, 0));
+  // Never more than the number of stages
+  TEST_ASSERT_EQUAL(3, policy.update(0.9, 0));
+}
+
+void test_deadline_miss_sheds() {
+  LoadSheddingPolicy policy(kStages);
+  TEST_ASSERT_EQUAL(1, policy.update(0.3, 1));
+}
+
+void test_restores_after_calm_windows() {
+  LoadSheddingPolicy policy(kStages);
+  Feed(policy, 2, 0.9, 0);
+  TEST_ASSERT_EQUAL(2, Feed(policy, kRestoreWindows - 1, 0.3, 0));
+  TEST_ASSERT_EQUAL(1, policy.update(0.3, 0));
+  TEST_ASSERT_EQUAL(0, Feed(policy, kRestoreWindows, 0.3, 0));
+}
+
+void test_holds_between_thresholds() {
+  LoadSheddingPolicy policy(kStages);
+  policy.update(0.9, 0);
+  // Between the restore and the shed threshold nothing changes
+  TEST_ASSERT_EQUAL(1, Feed(policy, 10 * kRestoreWindows, 0.7, 0));
+}
+
+void test_hold_off_doubles_after_failed_restore() {
+  LoadSheddingPolicy policy(kStages);
+  policy.update(0.9, 0);
+  Feed(policy, kRestoreWindows, 0.3, 0);
+  TEST_ASSERT_EQUAL(0, policy.level());
+  // The overload returns right after the restore
+  TEST_ASSERT_EQUAL(1, policy.update(0.9, 0));
+  // The next restore waits twice as long
+  TEST_ASSERT_EQUAL(1, Feed(policy, 2 * kRestoreWindows - 1, 0.3, 0));
+  TEST_ASSERT_EQUAL(0, policy.update(0.3, 0));
+}
+
+void test_simulated_overload_keeps_deadlines() {
+  OverloadSim::Result ungoverned = OverloadSim::run(false);
+  OverloadSim::Result governed = OverloadSim::run(true);
+
+  // The overload makes the ungoverned loop miss deadlines...
+  TEST_ASSERT_GREATER_THAN(0, ungoverned.settled_misses);
+  // ...while the governed loop holds them once the shedding has settled
+  TEST_ASSERT_EQUAL(0, governed.settled_misses);
+  TEST_ASSERT_LESS_OR_EQUAL(OverloadSim::kMissTolerance,
+                            governed.settled_max_lateness);
+  TEST_ASSERT_EQUAL(ungoverned.transmissions, governed.transmissions);
+  // Everything is restored after the overload
+  for (int loop = 0; loop < OverloadSim::kNumLoops; loop++) {
+    size_t seconds = strlen(governed.levels[loop]);
+    TEST_ASSERT_EQUAL('0', governed.levels[loop][seconds - 1]);
+  }
+}
+
+void test_sheds_only_on_the_overloaded_loop() {
+  OverloadSim::Result governed = OverloadSim::run(true);
+  using OS = OverloadSim;
+
+  // The app loop overload sheds app loop work only...
+  TEST_ASSERT_GREATER_THAN(
+      0, MaxLevel(governed, OS::kApp, OS::kAppOverloadStart,
+                  OS::kAppOverloadEnd));
+  TEST_ASSERT_EQUAL(0, MaxLevel(governed, OS::kRealtime, 0,
+                                OS::kRtOverloadStart));
+  // ...and the real-time loop overload real-time loop work only
+  TEST_ASSERT_GREATER_THAN(
+      0, MaxLevel(governed, OS::kRealtime, OS::kRtOverloadStart,
+                  OS::kRtOverloadEnd));
+  TEST_ASSERT_EQUAL(0, MaxLevel(governed, OS::kApp, OS::kRtOverloadStart,
+                                OS::kDuration));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sheds_one_stage_per_overloaded_window);
+  RUN_TEST(test_deadline_miss_sheds);
+  RUN_TEST(test_restores_after_calm_windows);
+  RUN_TEST(test_holds_between_thresholds);
+  RUN_TEST(test_hold_off_doubles_after_failed_restore);
+  RUN_TEST(test_simulated_overload_keeps_deadlines);
+  RUN_TEST(test_sheds_only_on_the_overloaded_loop);
+  return UNITY_END();
+}
@@ -0,0 +1,253 @@
+// Address claim contention between several NMEA 2000 nodes.
+//
+// Runs the NMEA2000 library address claim of several nodes on a simulated
+// bus and a simulated clock, and checks that N2kAddressClaim sees them
+// settle on distinct addresses, and that nodes restarting from their stored
+// addresses don't negotiate again. Run with:
+//
+//   pio test -e native -f test_n2k_address_claim
+
+#include <NMEA2000.h>
+#include <unity.h>
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "host_clock.h"
+#include "n2k_address_claim.h"
+
+using namespace halmet;
+
+namespace {
+
+const uint8_t kDefaultAddress = 71;
+// Long enough for several rounds of contention
+const uint32_t kRunTime = 5000;  // ms
+// The firmware polls the claim every 50 ms; poll more often here so that
+// the settle time is measured to the millisecond
+const uint32_t kStep = 1;  // ms
+
+struct Frame {
+  unsigned long id;
+  unsigned char len;
+  unsigned char data[8];
+};
+
+class SimBus;
+
+/// tNMEA2000 node on a SimBus
+class SimNode : public tNMEA2000 {
+ public:
+  SimNode(SimBus* bus) : bus_{bus} {}
+
+  void receive(const Frame& frame) { inbox_.push_back(frame); }
+
+ protected:
+  virtual bool CANOpen() override { return true; }
+  virtual bool CANSendFrame(unsigned long id, unsigned char len,
+                            const unsigned char* buf,
+                            bool wait_sent = true) override;
+  virtual bool CANGetFrame(unsigned long& id, unsigned char& len,
+                           unsigned char* buf) override {
+    if (inbox_.empty()) {
+      return false;
+    }
+    const Frame& frame = inbox_.front();
+    id = frame.id;
+    len = frame.len;
+    memcpy(buf, frame.data, frame.len);
+    inbox_.pop_front();
+    return true;
+  }
+
+  SimBus* bus_;
+  std::deque<Frame> inbox_;
+};
+
+/// Broadcast bus without loopback: every frame reaches all other nodes
+class SimBus {
+ public:
+  struct Member {
+    std::unique_ptr<SimNode> node;
+    std::unique_ptr<N2kAddressClaim> claim;
+  };
+
+  /// Add a node with a unique number and a preferred address, and open it.
+  Member& add_node(unsigned long unique_number, uint8_t address) {
+    members_.emplace_back();
+    Member& member = members_.back();
+    member.node.reset(new SimNode(this));
+    member.node->SetDeviceInformation(unique_number, 140, 50, 2046);
+    member.node->SetMode(tNMEA2000::N2km_ListenAndNode, address);
+    member.node->EnableForward(false);
+    member.node->Open();
+    member.claim.reset(new N2kAddressClaim(member.node.get()));
+    member.claim->start(millis());
+    return member;
+  }
+
+  void broadcast(const SimNode* sender, const Frame& frame) {
+    for (auto& member : members_) {
+      if (member.node.get() != sender) {
+        member.node->receive(frame);
+      }
+    }
+  }
+
+  void run(uint32_t duration) {
+    for (uint32_t t = 0; t < duration; t += kStep) {
+      AdvanceClock(kStep);
+      for (auto& member : members_) {
+        member.node->ParseMessages();
+        member.claim->poll(millis());
+      }
+    }
+  }
+
+  std::vector<Member>& members() { return members_; }
+
+ protected:
+  std::vector<Member> members_;
+};
+
+bool SimNode::CANSendFrame(unsigned long id, unsigned char len,
+                           const unsigned char* buf, bool wait_sent) {
+  Frame frame = {id, len, {}};
+  memcpy(frame.data, buf, len > 8 ? 8 : len);
+  bus_->broadcast(this, frame);
+  return true;
+}
+
+void AssertDistinctSettledAddresses(SimBus& bus) {
+  std::set<uint8_t> addresses;
+  for (auto& member : bus.members()) {
+    TEST_ASSERT_TRUE(member.claim->ready());
+    TEST_ASSERT_TRUE(member.claim->settled(millis()));
+    uint8_t address = member.claim->address();
+    TEST_ASSERT_EQUAL_UINT8(member.node->GetN2kSource(), address);
+    TEST_ASSERT_LESS_OR_EQUAL(N2kAddressClaim::kMaxSourceAddress, address);
+    TEST_ASSERT_TRUE_MESSAGE(addresses.insert(address).second,
+                             "Two nodes claimed the same address");
+  }
+}
+
+}  // namespace
+
+void setUp() { UseSimulatedClock(1000); }
+
+void tearDown() {}
+
+void test_preferred_address() {
+  TEST_ASSERT_EQUAL_UINT8(30, N2kAddressClaim::preferred_address(30, 71));
+  TEST_ASSERT_EQUAL_UINT8(251, N2kAddressClaim::preferred_address(251, 71));
+  // Never stored, or outside the self-configurable range
+  TEST_ASSERT_EQUAL_UINT8(71, N2kAddressClaim::preferred_address(0xff, 71));
+  TEST_ASSERT_EQUAL_UINT8(71, N2kAddressClaim::preferred_address(252, 71));
+}
+
+void test_contention_at_boot() {
+  // Four HALMETs powered up together, all with the default address
+  SimBus bus;
+  for (unsigned long unique = 1; unique <= 4; unique++) {
+    bus.add_node(unique, kDefaultAddress);
+  }
+  bus.run(kRunTime);
+
+  AssertDistinctSettledAddresses(bus);
+
+  // One node keeps the default address without a change; the others moved
+  int kept = 0;
+  for (auto& member : bus.members()) {
+    if (member.claim->claim_changes() == 0) {
+      kept++;
+      TEST_ASSERT_EQUAL_UINT8(kDefaultAddress, member.claim->address());
+      TEST_ASSERT_EQUAL_UINT32(N2kAddressClaim::kSettleTime,
+                               member.claim->time_to_ready());
+    } else {
+      TEST_ASSERT_GREATER_THAN_UINT32(N2kAddressClaim::kSettleTime,
+                                      member.claim->time_to_ready());
+    }
+  }
+  TEST_ASSERT_EQUAL(1, kept);
+}
+
+void test_restart_from_stored_addresses() {
+  std::vector<uint8_t> stored;
+  {
+    SimBus bus;
+    for (unsigned long unique = 1; unique <= 4; unique++) {
+      bus.add_node(unique, kDefaultAddress);
+    }
+    bus.run(kRunTime);
+    for (auto& member : bus.members()) {
+      stored.push_back(member.claim->address());
+    }
+  }
+
+  // After a power cycle, every node starts from the address it stored, so
+  // nobody has to move and every claim settles after the minimum time
+  SimBus bus;
+  for (size_t i = 0; i < stored.size(); i++) {
+    bus.add_node(i + 1, N2kAddressClaim::preferred_address(stored[i],
+                                                           kDefaultAddress));
+  }
+  bus.run(kRunTime);
+
+  AssertDistinctSettledAddresses(bus);
+  for (size_t i = 0; i < stored.size(); i++) {
+    auto& claim = bus.members()[i].claim;
+    TEST_ASSERT_EQUAL_UINT8(stored[i], claim->address());
+    TEST_ASSERT_EQUAL(0, claim->claim_changes());
+    TEST_ASSERT_EQUAL_UINT32(N2kAddressClaim::kSettleTime,
+                             claim->time_to_ready());
+  }
+}
+
+void test_late_joiner_with_taken_address() {
+  // Three nodes are running when a fourth joins with a stored address that
+  // one of them holds by now, e.g. after the bus was rewired
+  SimBus bus;
+  for (unsigned long unique = 1; unique <= 3; unique++) {
+    bus.add_node(unique, kDefaultAddress + unique);
+  }
+  bus.run(kRunTime);
+  uint8_t taken = bus.members()[1].claim->address();
+
+  // The joining node has the highest NAME, so it has to move
+  bus.add_node(10, taken);
+  bus.run(kRunTime);
+
+  AssertDistinctSettledAddresses(bus);
+  TEST_ASSERT_EQUAL_UINT8(taken, bus.members()[1].claim->address());
+  TEST_ASSERT_NOT_EQUAL(taken, bus.members()[3].claim->address());
+}
+
+void test_late_joiner_with_priority() {
+  // The joining node has the lowest NAME, so the running node has to move
+  SimBus bus;
+  for (unsigned long unique = 2; unique <= 4; unique++) {
+    bus.add_node(unique, kDefaultAddress + unique);
+  }
+  bus.run(kRunTime);
+  uint8_t taken = bus.members()[0].claim->address();
+
+  bus.add_node(1, taken);
+  bus.run(kRunTime);
+
+  AssertDistinctSettledAddresses(bus);
+  TEST_ASSERT_EQUAL_UINT8(taken, bus.members()[3].claim->address());
+  TEST_ASSERT_NOT_EQUAL(taken, bus.members()[0].claim->address());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_preferred_address);
+  RUN_TEST(test_contention_at_boot);
+  RUN_TEST(test_restart_from_stored_addresses);
+  RUN_TEST(test_late_joiner_with_taken_address);
+  RUN_TEST(test_late_joiner_with_priority);
+  return UNITY_END();
+}
@@ -0,0 +1,206 @@
+// NMEA 2000 receive dispatch: field decoding, source and instance matching,
+// and agreement with a linear scan of the subscriptions. Run with:
+//
+//   pio test -e native -f test_n2k_rx_table
+
+#include <unity.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "host_alloc_count.h"
+#include "n2k_rx_table.h"
+
+using namespace halmet;
+
+namespace {
+
+struct Value {
+  int subscription;
+  float value;
+};
+
+std::vector<Value> values;
+
+void Sink(void* context, int subscription, float value) {
+  values.push_back({subscription, value});
+}
+
+int count = 0;
+float sum = 0;
+
+void CountingSink(void* context, int subscription, float value) {
+  count++;
+  sum += value;
+}
+
+// PGN 127488 of `instance` at `rpm`
+void EngineRapid(uint8_t instance, int rpm, uint8_t* data) {
+  uint16_t raw = rpm * 4;
+  data[0] = instance;
+  data[1] = raw;
+  data[2] = raw >> 8;
+  // Boost pressure and tilt/trim not available
+  data[3] = 0xff;
+  data[4] = 0xff;
+  data[5] = 0x7f;
+  data[6] = 0xff;
+  data[7] = 0xff;
+}
+
+}  // namespace
+
+void setUp() { values.clear(); }
+
+void tearDown() {}
+
+void test_decodes_subscribed_fields() {
+  N2kRxTable table(Sink, nullptr);
+  int speed = table.subscribe(127488, N2kRxTable::kAnySource, 0, "speed");
+  TEST_ASSERT_EQUAL(0, speed);
+
+  uint8_t data[8];
+  EngineRapid(0, 1800, data);
+  TEST_ASSERT_EQUAL(1, table.dispatch(127488, 30, data, sizeof(data)));
+  TEST_ASSERT_EQUAL(speed, values[0].subscription);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 30, values[0].value);  // Hz
+
+  // Unsubscribed PGNs are ignored
+  TEST_ASSERT_EQUAL(0, table.dispatch(127489, 30, data, sizeof(data)));
+}
+
+void test_matches_source() {
+  N2kRxTable table(Sink, nullptr);
+  int any = table.subscribe(127250, N2kRxTable::kAnySource, 0, "heading");
+  int compass = table.subscribe(127250, 17, 0, "heading");
+
+  uint8_t data[8] = {0, 0x10, 0x27, 0xff, 0x7f, 0xff, 0x7f, 0xff};
+  TEST_ASSERT_EQUAL(2, table.dispatch(127250, 17, data, sizeof(data)));
+  TEST_ASSERT_EQUAL(1, table.dispatch(127250, 18, data, sizeof(data)));
+  TEST_ASSERT_EQUAL(any, values[2].subscription);
+  for (const Value& value : values) {
+    TEST_ASSERT_TRUE(value.subscription == any ||
+                     value.subscription == compass);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 1.0, value.value);  // rad
+  }
+}
+
+void test_matches_instance() {
+  N2kRxTable table(Sink, nullptr);
+  int port = table.subscribe(127488, N2kRxTable::kAnySource, 0, "speed");
+  int starboard = table.subscribe(127488, N2kRxTable::kAnySource, 1, "speed");
+
+  uint8_t data[8];
+  EngineRapid(1, 600, data);
+  TEST_ASSERT_EQUAL(1, table.dispatch(127488, 31, data, sizeof(data)));
+  TEST_ASSERT_EQUAL(starboard, values[0].subscription);
+  EngineRapid(2, 600, data);
+  TEST_ASSERT_EQUAL(0, table.dispatch(127488, 31, data, sizeof(data)));
+  TEST_ASSERT_NOT_EQUAL(port, starboard);
+}
+
+void test_skips_unavailable_and_missing_fields() {
+  N2kRxTable table(Sink, nullptr);
+  table.subscribe(127488, N2kRxTable::kAnySource, 0, "speed");
+  table.subscribe(127488, N2kRxTable::kAnySource, 0, "boostPressure");
+
+  uint8_t data[8];
+  EngineRapid(0, 1000, data);
+  // Boost pressure is "not available"
+  TEST_ASSERT_EQUAL(1, table.dispatch(127488, 30, data, sizeof(data)));
+  // Speed is cut off
+  TEST_ASSERT_EQUAL(0, table.dispatch(127488, 30, data, 2));
+}
+
+void test_rejects_unknown_subscriptions() {
+  N2kRxTable table(Sink, nullptr);
+  TEST_ASSERT_EQUAL(-1, table.subscribe(129029, 0xff, 0, "latitude"));
+  TEST_ASSERT_EQUAL(-1, table.subscribe(127488, 0xff, 0, "torque"));
+  for (int i = 0; i < N2kRxTable::kMaxSubscriptions; i++) {
+    TEST_ASSERT_EQUAL(i, table.subscribe(127488, i, 0, "speed"));
+  }
+  TEST_ASSERT_EQUAL(-1, table.subscribe(127488, 0xff, 0, "speed"));
+}
+
+void test_agrees_with_linear_scan() {
+  // Every decodable field of every PGN, from any source and from one
+  int num_defs;
+  const N2kPGNDef* defs = N2kPGNDefs(&num_defs);
+  N2kRxTable table(CountingSink, nullptr);
+  std::vector<N2kRxTable*> singles;
+  std::vector<uint8_t> sources;
+  for (int d = 0; d < num_defs; d++) {
+    for (int f = 0; f < defs[d].num_fields; f++) {
+      for (uint8_t source : {N2kRxTable::kAnySource, (uint8_t)(d + 10)}) {
+        const char* field = defs[d].fields[f].name;
+        if (table.subscribe(defs[d].pgn, source, d % 2, field) < 0) {
+          continue;
+        }
+        auto single = new N2kRxTable(CountingSink, nullptr);
+        single->subscribe(defs[d].pgn, source, d % 2, field);
+        singles.push_back(single);
+      }
+    }
+  }
+
+  // Random payloads of the decodable PGNs from a few sources
+  srand(1);
+  for (int i = 0; i < 10000; i++) {
+    const N2kPGNDef& def = defs[rand() % num_defs];
+    uint8_t source = 10 + rand() % (num_defs + 2);
+    uint8_t data[26];
+    for (uint8_t& byte : data) {
+      byte = rand();
+    }
+    if (def.instance_offset != N2kPGNDef::kNoInstance) {
+      data[def.instance_offset] = rand() % 3;
+    }
+
+    count = 0;
+    sum = 0;
+    table.dispatch(def.pgn, source, data, sizeof(data));
+    int table_count = count;
+    float table_sum = sum;
+    count = 0;
+    sum = 0;
+    for (N2kRxTable* single : singles) {
+      single->dispatch(def.pgn, source, data, sizeof(data));
+    }
+    TEST_ASSERT_EQUAL(count, table_count);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3 * (1 + fabsf(sum)), sum, table_sum);
+  }
+  for (N2kRxTable* single : singles) {
+    delete single;
+  }
+}
+
+void test_dispatch_does_not_allocate() {
+  if (!HostAllocationsCounted()) {
+    TEST_IGNORE_MESSAGE("Allocations are only counted with glibc");
+  }
+  N2kRxTable table(CountingSink, nullptr);
+  table.subscribe(127488, N2kRxTable::kAnySource, 0, "speed");
+  table.subscribe(127489, N2kRxTable::kAnySource, 0, "temperature");
+  uint8_t data[26] = {};
+  size_t allocs = HostAllocations();
+  for (int i = 0; i < 1000; i++) {
+    table.dispatch(127488, 30, data, 8);
+    table.dispatch(127489, 30, data, sizeof(data));
+    table.dispatch(129025, 40, data, 8);
+  }
+  TEST_ASSERT_EQUAL(0, HostAllocations() - allocs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_decodes_subscribed_fields);
+  RUN_TEST(test_matches_source);
+  RUN_TEST(test_matches_instance);
+  RUN_TEST(test_skips_unavailable_and_missing_fields);
+  RUN_TEST(test_rejects_unknown_subscriptions);
+  RUN_TEST(test_agrees_with_linear_scan);
+  RUN_TEST(test_dispatch_does_not_allocate);
+  return UNITY_END();
+}
@@ -0,0 +1,124 @@
+// Ripple analysis of synthetic waveforms with known ripple.
+//
+// Runs RippleAnalyzer over DC levels with tones, noise and quantization and
+// checks the mean, the RMS of the AC part and the dominant component. Run
+// with:
+//
+//   pio test -e native -f test_ripple_analyzer
+
+#include <unity.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "ripple_analyzer.h"
+
+using namespace halmet;
+
+namespace {
+
+const float kSampleRate = 860;
+const float kPi = 3.14159265358979f;
+const size_t kWindow = RippleAnalyzer::kWindow;
+
+struct Tone {
+  float frequency;
+  float amplitude;
+};
+
+struct Case {
+  float dc;
+  Tone tones[2];
+  float noise;      // Uniform noise amplitude
+  float lsb;        // Quantization step, 0 for none
+  float frequency;  // Expected dominant frequency, 0 for none
+  float amplitude;  // Expected dominant amplitude
+};
+
+RippleAnalyzer analyzer;
+float samples[kWindow];
+
+void Generate(const Case& c) {
+  srand(1);
+  for (size_t i = 0; i < kWindow; i++) {
+    float t = i / kSampleRate;
+    float value = c.dc;
+    for (const Tone& tone : c.tones) {
+      value += tone.amplitude * sinf(2 * kPi * tone.frequency * t);
+    }
+    value += c.noise * (2.0f * rand() / RAND_MAX - 1);
+    if (c.lsb > 0) {
+      value = roundf(value / c.lsb) * c.lsb;
+    }
+    samples[i] = value;
+  }
+}
+
+// Expected RMS of the AC part: the tones plus uniform noise
+float ExpectedRms(const Case& c) {
+  float sum_sq = c.noise * c.noise / 3;
+  for (const Tone& tone : c.tones) {
+    sum_sq += tone.amplitude * tone.amplitude / 2;
+  }
+  return sqrtf(sum_sq);
+}
+
+void CheckCase(const Case& c) {
+  Generate(c);
+  RippleAnalyzer::Result result = analyzer.analyze(samples, kSampleRate);
+
+  float rms = ExpectedRms(c);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f * c.dc, c.dc, result.mean);
+  TEST_ASSERT_FLOAT_WITHIN(0.03f * rms + 0.001f, rms, result.rms);
+  if (c.frequency > 0) {
+    // Within a quarter of the bin width and 3% of the amplitude
+    TEST_ASSERT_FLOAT_WITHIN(0.25f * kSampleRate / kWindow, c.frequency,
+                             result.dominant_frequency);
+    TEST_ASSERT_FLOAT_WITHIN(0.03f * c.amplitude, c.amplitude,
+                             result.dominant_amplitude);
+  }
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_dc() { CheckCase({13.8, {}, 0, 0, 0, 0}); }
+
+void test_alternator_ripple() {
+  CheckCase({13.8, {{120, 0.2}}, 0, 0, 120, 0.2});
+}
+
+void test_off_bin_tone() {
+  CheckCase({12.6, {{57.3, 0.05}}, 0, 0, 57.3, 0.05});
+}
+
+void test_two_tones() {
+  CheckCase({14.2, {{100, 0.3}, {300, 0.1}}, 0, 0, 100, 0.3});
+}
+
+void test_noisy_ripple() {
+  CheckCase({13.8, {{180, 0.1}}, 0.02, 0, 180, 0.1});
+}
+
+void test_quantized_ripple() {
+  CheckCase({12.0, {{50, 0.01}}, 0, 0.00125, 50, 0.01});
+}
+
+void test_near_nyquist() {
+  CheckCase({13.8, {{400, 0.05}}, 0, 0, 400, 0.05});
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_dc);
+  RUN_TEST(test_alternator_ripple);
+  RUN_TEST(test_off_bin_tone);
+  RUN_TEST(test_two_tones);
+  RUN_TEST(test_noisy_ripple);
+  RUN_TEST(test_quantized_ripple);
+  RUN_TEST(test_near_nyquist);
+  return UNITY_END();
+}
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Convert a HALMET data log download to CSV.
+
+Usage:
+    curl -o halmet.hlog http://halmet.local/api/datalog
+    python3 tools/halmet_log_decode.py halmet.hlog > halmet.csv
+
+The output has one row per logged sample: time, channel, value. Time is UTC
+ISO 8601 if the device had a wall clock when the segment was started,
+otherwise seconds of uptime.
+
+See src/data_logger.h for the format description.
+"""
+
+import argparse
+import csv
+import datetime
+import struct
+import sys
+
+
+def read_varint(buf, pos):
+    result = 0
+    shift = 0
+    while True:
+        byte = buf[pos]
+        pos += 1
+        result |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return result, pos
+        shift += 7
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_segment(seg):
+    if seg[:4] != b"HLOG":
+        raise ValueError("bad segment magic")
+    version, channel_count, tick_ms, epoch_s, start_tick = struct.unpack_from(
+        "<BBHII", seg, 4
+    )
+    if version != 1:
+        raise ValueError(f"unsupported segment version {version}")
+    pos = 16
+    channels = []
+    for _ in range(channel_count):
+        (resolution,) = struct.unpack_from("<f", seg, pos)
+        name_len = seg[pos + 4]
+        name = seg[pos + 5 : pos + 5 + name_len].decode("utf-8", "replace")
+        pos += 5 + name_len
+        channels.append((name, resolution))
+
+    tick = start_tick
+    last = [0] * channel_count
+    while pos < len(seg):
+        try:
+            dt, pos = read_varint(seg, pos)
+            channel = seg[pos]
+            delta, pos = read_varint(seg, pos + 1)
+        except IndexError:
+            break  # Partially written record at the end of the segment
+        tick += dt
+        last[channel] += unzigzag(delta)
+        name, resolution = channels[channel]
+        seconds = (tick - start_tick) * tick_ms / 1000
+        if epoch_s:
+            when = datetime.datetime.fromtimestamp(
+                epoch_s + seconds, datetime.timezone.utc
+            ).isoformat()
+        else:
+            when = f"{tick * tick_ms / 1000:.1f}"
+        yield when, name, round(last[channel] * resolution, 6)
+
+
+def decode_stream(data):
+    pos = 0
+    while pos + 4 <= len(data):
+        (length,) = struct.unpack_from("<I", data, pos)
+        pos += 4
+        yield from decode_segment(data[pos : pos + length])
+        pos += length
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="log file downloaded from /api/datalog")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+
+    writer = csv.writer(sys.stdout)
+    writer.writerow(["time", "channel", "value"])
+    for row in decode_stream(data):
+        writer.writerow(row)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+"""Decode and compare HALMET input traces.
+
+Usage:
+    curl -o golden.htrc http://halmet.local/api/trace
+    python3 tools/halmet_trace.py decode golden.htrc > golden.csv
+
+To check a firmware change against a recorded trace, upload the trace to a
+bench device, set the Input Trace mode to replay, restart, and download the
+new trace once the replay has finished:
+
+    curl -T golden.htrc http://halmet.local/api/trace
+    curl -o replay.htrc http://halmet.local/api/trace
+    python3 tools/halmet_trace.py diff golden.htrc replay.htrc
+
+diff compares the transmitted PGNs of the two traces payload by payload and
+their transmit intervals. The exit status is 1 if they differ. The replay
+trace starts later than the golden one, by the boot time of the device, so
+the two are aligned on the replayed inputs first: the offset is the time
+between the first golden ADC or counter record and the first record of the
+same input with the same value in the replay trace (or --offset). Each
+golden frame is then paired with the nearest transmitted frame of the same
+PGN, within half the golden transmit interval.
+
+The Signal K output isn't part of the trace, so only the NMEA 2000 output
+is compared, and the device replays at the speed of the trace. The host
+replay runner (src/replay_host_main.cpp) replays a trace faster than real
+time through the tank and tacho pipelines of the default configuration and
+compares both the PGNs and the Signal K deltas with a golden file:
+
+    pio run -e native_replay
+    .pio/build/native_replay/program golden.htrc --output golden.txt
+    .pio/build/native_replay/program golden.htrc --golden golden.txt
+
+See src/input_trace.h for the format description.
+"""
+
+import argparse
+import collections
+import csv
+import statistics
+import sys
+
+ADC, COUNTER, CAN_TX, CAN_RX = 1, 2, 3, 4
+
+
+def read_varint(buf, pos):
+    result = 0
+    shift = 0
+    while True:
+        byte = buf[pos]
+        pos += 1
+        result |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return result, pos
+        shift += 7
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_trace(data):
+    """Yield (time_ms, type, fields) tuples."""
+    if data[:4] != b"HTRC":
+        raise ValueError("bad trace magic")
+    # Version 2 changed the scale of the ADC counts only
+    if data[4] not in (1, 2):
+        raise ValueError(f"unsupported trace version {data[4]}")
+    pos = 5
+    time_ms = 0
+    while pos < len(data):
+        try:
+            dt, pos = read_varint(data, pos)
+            kind = data[pos]
+            pos += 1
+            if kind == ADC:
+                device, channel = data[pos], data[pos + 1]
+                counts, pos = read_varint(data, pos + 2)
+                fields = {"device": device, "channel": channel,
+                          "counts": unzigzag(counts)}
+            elif kind == COUNTER:
+                pin = data[pos]
+                count, pos = read_varint(data, pos + 1)
+                fields = {"pin": pin, "count": count}
+            elif kind in (CAN_TX, CAN_RX):
+                pgn, pos = read_varint(data, pos)
+                priority, source, destination = data[pos : pos + 3]
+                length, pos = read_varint(data, pos + 3)
+                payload = data[pos : pos + length]
+                if len(payload) != length:
+                    break
+                pos += length
+                fields = {"pgn": pgn, "priority": priority, "source": source,
+                          "destination": destination, "data": payload.hex()}
+            else:
+                raise ValueError(f"unknown record type {kind} at {pos - 1}")
+        except IndexError:
+            break  # Partially written record at the end of the trace
+        time_ms += dt
+        yield time_ms, kind, fields
+
+
+TYPE_NAMES = {ADC: "adc", COUNTER: "counter", CAN_TX: "can_tx",
+              CAN_RX: "can_rx"}
+
+
+def decode(args):
+    with open(args.input, "rb") as f:
+        data = f.read()
+    writer = csv.writer(sys.stdout)
+    writer.writerow(["time", "type", "fields"])
+    for time_ms, kind, fields in decode_trace(data):
+        writer.writerow([f"{time_ms / 1000:.3f}", TYPE_NAMES[kind],
+                         " ".join(f"{k}={v}" for k, v in fields.items())])
+    return 0
+
+
+def read_records(path):
+    with open(path, "rb") as f:
+        return list(decode_trace(f.read()))
+
+
+def input_key(kind, fields):
+    if kind == ADC:
+        return (ADC, fields["device"], fields["channel"], fields["counts"])
+    return (COUNTER, fields["pin"], fields["count"])
+
+
+def estimate_offset(golden, actual):
+    """Return the time from a golden input record to its replay, or None."""
+    first = next(((t, input_key(kind, fields))
+                  for t, kind, fields in golden if kind in (ADC, COUNTER)),
+                 None)
+    if first is None:
+        return None
+    golden_time, key = first
+    for t, kind, fields in actual:
+        if kind in (ADC, COUNTER) and input_key(kind, fields) == key:
+            return t - golden_time
+    return None
+
+
+def transmitted(records):
+    """Return {pgn: [(time_ms, payload)]} of the transmitted messages."""
+    frames = collections.defaultdict(list)
+    for time_ms, kind, fields in records:
+        if kind == CAN_TX:
+            frames[fields["pgn"]].append((time_ms, fields["data"]))
+    return frames
+
+
+def mean_interval(frames):
+    times = [t for t, _ in frames]
+    if len(times) < 2:
+        return None
+    return statistics.mean(b - a for a, b in zip(times, times[1:]))
+
+
+def pair_frames(expected, got, offset, window):
+    """Pair each golden frame with the nearest actual frame in time.
+
+    Both lists are sorted by time. Returns the (golden, actual) pairs and
+    the golden frames without a partner.
+    """
+    pairs = []
+    missing = []
+    j = 0
+    for time_ms, payload in expected:
+        target = time_ms + offset
+        # Skip the actual frames that are too early for this golden frame
+        while j < len(got) and got[j][0] < target - window:
+            j += 1
+        best = None
+        k = j
+        while k < len(got) and got[k][0] <= target + window:
+            if best is None or abs(got[k][0] - target) < abs(
+                    got[best][0] - target):
+                best = k
+            k += 1
+        if best is None:
+            missing.append((time_ms, payload))
+            continue
+        pairs.append(((time_ms, payload), got[best]))
+        j = best + 1
+    return pairs, missing
+
+
+def diff(args):
+    golden_records = read_records(args.golden)
+    actual_records = read_records(args.actual)
+    offset = args.offset
+    if offset is None:
+        offset = estimate_offset(golden_records, actual_records)
+        if offset is None:
+            print("Can't align the traces on their inputs; use --offset")
+            return 1
+    print(f"Replay offset {offset} ms")
+
+    golden = transmitted(golden_records)
+    actual = transmitted(actual_records)
+    # Only the golden frames in the time span of the replay can be paired
+    end = (actual_records[-1][0] - offset) if actual_records else 0
+    differences = 0
+
+    for pgn in sorted(set(golden) | set(actual)):
+        expected = [f for f in golden.get(pgn, []) if 0 <= f[0] <= end]
+        got = actual.get(pgn, [])
+        if not expected or not got:
+            print(f"PGN {pgn}: {len(expected)} golden, {len(got)} actual")
+            differences += 1
+            continue
+        golden_interval = mean_interval(expected)
+        window = golden_interval / 2 if golden_interval else args.window
+        pairs, missing = pair_frames(expected, got, offset, window)
+        mismatches = [(e, a) for e, a in pairs if e[1] != a[1]]
+        if missing:
+            print(f"PGN {pgn}: {len(missing)}/{len(expected)} golden frames "
+                  f"not transmitted, first at {missing[0][0]} ms")
+            differences += 1
+        if mismatches:
+            e, a = mismatches[0]
+            print(f"PGN {pgn}: {len(mismatches)}/{len(pairs)} payloads "
+                  f"differ, first at {e[0]} ms: {e[1]} != {a[1]}")
+            differences += 1
+        actual_interval = mean_interval(got)
+        if golden_interval and actual_interval:
+            deviation = abs(actual_interval - golden_interval)
+            if deviation > args.interval_tolerance:
+                print(f"PGN {pgn}: mean interval {actual_interval:.1f} ms, "
+                      f"golden {golden_interval:.1f} ms")
+                differences += 1
+        if not missing and not mismatches:
+            print(f"PGN {pgn}: {len(pairs)} payloads match")
+
+    return 1 if differences else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    decode_parser = subparsers.add_parser("decode", help="trace to CSV")
+    decode_parser.add_argument("input", help="trace from /api/trace")
+    decode_parser.set_defaults(func=decode)
+
+    diff_parser = subparsers.add_parser(
+        "diff", help="compare transmitted PGNs of two traces")
+    diff_parser.add_argument("golden", help="reference trace")
+    diff_parser.add_argument("actual", help="trace captured during replay")
+    diff_parser.add_argument(
+        "--interval-tolerance", type=float, default=5,
+        help="allowed change of the mean transmit interval (ms)")
+    diff_parser.add_argument(
+        "--offset", type=int,
+        help="time of the replay trace minus that of the golden trace (ms); "
+        "estimated from the inputs by default")
+    diff_parser.add_argument(
+        "--window", type=float, default=50,
+        help="pairing window for PGNs transmitted only once (ms)")
+    diff_parser.set_defaults(func=diff)
+
+    args = parser.parse_args()
+    sys.exit(args.func(args))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Write the synthetic fuel tank trace used by test_fuel_rate_estimator.
+
+Usage:
+    python3 tools/make_fuel_trace.py test/fixtures/fuel_cruise.htrc
+
+The trace is 30 minutes of steady running at 15 l/h from a 200 l tank that
+starts at 150 l, read on A1 through a 240-33 ohm sender. The test checks the
+fuel rate estimate against these parameters, not against a fit of the trace.
+
+The disturbances are modelled independently of the simulation in the test:
+the level sways with two wave trains of fixed period and random phase, the
+wire-wound sender moves in 1.5 ohm steps, the ADC adds Gaussian noise of 3
+counts, and the samples are 500 ms apart with +-15 ms of jitter. The output
+is the same for every run.
+
+See src/input_trace.h for the format description.
+"""
+
+import argparse
+import math
+import random
+
+ADC = 1
+VERSION = 2
+
+DURATION = 30 * 60  # s
+INTERVAL = 0.5  # s
+JITTER = 0.015  # s
+RATE = 15  # l/h
+CAPACITY = 200  # l
+INITIAL = 150  # l
+EMPTY_OHMS = 240
+FULL_OHMS = 33
+OHMS_STEP = 1.5
+# Wave trains: level amplitude (l) and period (s)
+WAVES = [(2.0, 6.5), (1.2, 11.0)]
+NOISE = 3  # ADC counts
+
+# HALMET voltage divider and sender measurement current
+VOLTS_PER_COUNT = 7.8125e-6
+DIVIDER = 33.3 / 3.3
+CURRENT = 0.01  # A
+
+
+def varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append(value & 0x7F | 0x80)
+        value >>= 7
+    out.append(value)
+    return out
+
+
+def zigzag(value):
+    return (value << 1) ^ (value >> 31)
+
+
+def counts(volume):
+    level = min(1, max(0, volume / CAPACITY))
+    ohms = EMPTY_OHMS + (FULL_OHMS - EMPTY_OHMS) * level
+    ohms = round(ohms / OHMS_STEP) * OHMS_STEP
+    return ohms * CURRENT / DIVIDER / VOLTS_PER_COUNT
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    rng = random.Random(48)
+    phases = [rng.uniform(0, 2 * math.pi) for _ in WAVES]
+    data = bytearray(b"HTRC") + bytes([VERSION])
+    last_ms = 0
+    for i in range(int(DURATION / INTERVAL)):
+        t = i * INTERVAL + rng.uniform(-JITTER, JITTER) if i else 0
+        volume = INITIAL - RATE * t / 3600
+        volume += sum(a * math.sin(2 * math.pi * t / p + phase)
+                      for (a, p), phase in zip(WAVES, phases))
+        value = round(counts(volume) + rng.gauss(0, NOISE))
+        time_ms = round(t * 1000)
+        data += varint(time_ms - last_ms)
+        data += bytes([ADC, 0, 0]) + varint(zigzag(value))
+        last_ms = time_ms
+    with open(args.output, "wb") as f:
+        f.write(data)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,328 @@
+#!/usr/bin/env python3
+"""Load an NMEA 2000 bus and report the timing of the HALMET periodic PGNs.
+
+Usage:
+    sudo modprobe vcan
+    sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+    .pio/build/native_n2k/program vcan0 &
+    python3 tools/n2k_bus_load.py sweep vcan0
+
+load fills the bus with traffic from simulated nodes to the given fraction
+of a 250 kbit/s NMEA 2000 bus. report listens to the traffic of the HALMET
+node and prints the actual interval, jitter and missed transmissions of its
+periodic PGNs. sweep runs report at 30%, 60% and 90% load.
+
+A vcan interface has no bit rate and no arbitration, so on vcan the load
+exercises the frame handling of the node under test, not bus contention.
+Run the tool against a physical interface (e.g. can0 with a USB adapter set
+to 250 kbit/s, connected to a HALMET) to measure arbitration delays.
+
+report --http loads the web server of the device with concurrent requests
+while measuring. To compare the worst-case PGN 127488 jitter with and
+without the real-time event loop, run it once on firmware built with
+ENABLE_REALTIME_LOOP and once without (see src/main.cpp):
+
+    python3 tools/n2k_bus_load.py report can0 --http halmet.local
+"""
+
+import argparse
+import collections
+import math
+import socket
+import statistics
+import struct
+import sys
+import threading
+import time
+import urllib.request
+
+BIT_RATE = 250000  # bit/s
+# Extended data frame with 8 data bytes, including interframe space and
+# typical bit stuffing
+BITS_PER_FRAME = 140
+
+CAN_EFF_FLAG = 0x80000000
+CAN_EFF_MASK = 0x1FFFFFFF
+FRAME_FORMAT = "=IB3x8s"
+FRAME_SIZE = struct.calcsize(FRAME_FORMAT)
+
+# PGN: (nominal interval in ms, fast packet)
+PERIODIC_PGNS = {
+    127488: (100, False),  # Engine Parameters, Rapid Update
+    127489: (500, True),   # Engine Parameters, Dynamic
+    127505: (2500, False),  # Fluid Level
+}
+
+# Traffic of the simulated nodes: (PGN, priority)
+LOAD_PGNS = [
+    (127250, 2),  # Vessel Heading
+    (127251, 2),  # Rate of Turn
+    (127257, 3),  # Attitude
+    (128259, 2),  # Speed
+    (129025, 2),  # Position, Rapid Update
+    (129026, 2),  # COG & SOG, Rapid Update
+    (130306, 2),  # Wind Data
+    (130312, 5),  # Temperature
+]
+LOAD_SOURCES = range(10, 20)
+
+# Web UI pages requested by the HTTP load
+HTTP_PATHS = ["/", "/api/info"]
+
+
+def open_socket(interface):
+    sock = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+    sock.bind((interface,))
+    return sock
+
+
+def can_id(priority, pgn, source):
+    return (priority << 26) | (pgn << 8) | source
+
+
+def parse_id(raw_id):
+    """Return (priority, pgn, source) of a 29-bit NMEA 2000 identifier."""
+    source = raw_id & 0xFF
+    pdu_format = (raw_id >> 16) & 0xFF
+    pgn = (raw_id >> 8) & 0x3FFFF
+    if pdu_format < 240:
+        pgn &= 0x3FF00  # PDU1: the PDU specific byte is the destination
+    return (raw_id >> 26) & 0x7, pgn, source
+
+
+def generate_load(interface, load, stop):
+    """Send frames at `load` times the bus capacity until `stop` is set."""
+    sock = open_socket(interface)
+    frames_per_second = load * BIT_RATE / BITS_PER_FRAME
+    period = 1 / frames_per_second
+    sent = 0
+    dropped = 0
+    start = time.monotonic()
+    while not stop.is_set():
+        # Catch up in bursts instead of sleeping for sub-millisecond periods
+        due = int((time.monotonic() - start) / period)
+        while sent + dropped < due:
+            n = sent + dropped
+            pgn, priority = LOAD_PGNS[n % len(LOAD_PGNS)]
+            source = LOAD_SOURCES[n % len(LOAD_SOURCES)]
+            data = struct.pack("<Q", n)
+            frame = struct.pack(FRAME_FORMAT,
+                                can_id(priority, pgn, source) | CAN_EFF_FLAG,
+                                8, data)
+            try:
+                sock.send(frame)
+                sent += 1
+            except OSError:
+                dropped += 1  # Interface queue full
+        time.sleep(0.001)
+    sock.close()
+    return sent, dropped
+
+
+def generate_http_load(host, clients, stop):
+    """Request web UI pages from `host` on `clients` threads until `stop`."""
+    counts = {"requests": 0, "errors": 0}
+    lock = threading.Lock()
+
+    def client(index):
+        n = index
+        while not stop.is_set():
+            url = f"http://{host}{HTTP_PATHS[n % len(HTTP_PATHS)]}"
+            n += 1
+            try:
+                with urllib.request.urlopen(url, timeout=5) as response:
+                    response.read()
+                key = "requests"
+            except OSError:
+                key = "errors"
+            with lock:
+                counts[key] += 1
+
+    threads = [threading.Thread(target=client, args=(i,))
+               for i in range(clients)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    return counts["requests"], counts["errors"]
+
+
+def capture(interface, source, duration):
+    """Return {pgn: [timestamp]} of the periodic PGNs sent by `source`."""
+    sock = open_socket(interface)
+    sock.settimeout(0.1)
+    times = collections.defaultdict(list)
+    end = time.monotonic() + duration
+    while time.monotonic() < end:
+        try:
+            frame = sock.recv(FRAME_SIZE)
+        except socket.timeout:
+            continue
+        now = time.monotonic()
+        raw_id, length, data = struct.unpack(FRAME_FORMAT, frame)
+        if not raw_id & CAN_EFF_FLAG:
+            continue
+        _, pgn, frame_source = parse_id(raw_id & CAN_EFF_MASK)
+        if frame_source != source or pgn not in PERIODIC_PGNS:
+            continue
+        _, fast_packet = PERIODIC_PGNS[pgn]
+        # A fast packet message is timed by its first frame
+        if fast_packet and data[0] & 0x1F != 0:
+            continue
+        times[pgn].append(now)
+    sock.close()
+    return times
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def timing_stats(pgn, timestamps, duration):
+    nominal, _ = PERIODIC_PGNS[pgn]
+    intervals = [(b - a) * 1000 for a, b in zip(timestamps, timestamps[1:])]
+    expected = int(duration * 1000 / nominal)
+    if not intervals:
+        return {"pgn": pgn, "nominal": nominal, "count": len(timestamps),
+                "expected": expected}
+    # A gap of n nominal intervals means n - 1 missed transmissions. Jitter
+    # is measured on the other intervals so that misses don't count twice.
+    missed = sum(max(0, round(i / nominal) - 1) for i in intervals)
+    deviations = [abs(i - nominal) for i in intervals
+                  if round(i / nominal) <= 1] or [0]
+    return {
+        "pgn": pgn,
+        "nominal": nominal,
+        "count": len(timestamps),
+        "expected": expected,
+        "mean": statistics.mean(intervals),
+        "jitter_p95": percentile(deviations, 0.95),
+        "jitter_max": max(deviations),
+        "missed": missed,
+    }
+
+
+def print_report(load, stats):
+    print(f"Bus load {load:.0%}")
+    print("  PGN     nominal   mean    p95 jitter  max jitter  frames  missed")
+    for s in stats:
+        if "mean" not in s:
+            print(f"  {s['pgn']:<7} {s['nominal']:>4} ms   "
+                  f"{s['count']} of ~{s['expected']} received")
+            continue
+        print(f"  {s['pgn']:<7} {s['nominal']:>4} ms "
+              f"{s['mean']:7.1f} ms {s['jitter_p95']:7.1f} ms "
+              f"{s['jitter_max']:8.1f} ms {s['count']:7d} {s['missed']:7d}")
+
+
+def run_report(interface, source, load, duration, http_host=None,
+               http_clients=4):
+    stop = threading.Event()
+    result = {}
+    generators = []
+    if load > 0:
+        generators.append(threading.Thread(
+            target=lambda: result.update(
+                load=generate_load(interface, load, stop))))
+    if http_host:
+        generators.append(threading.Thread(
+            target=lambda: result.update(
+                http=generate_http_load(http_host, http_clients, stop))))
+    for generator in generators:
+        generator.start()
+    if generators:
+        time.sleep(1)  # Let the load settle
+    try:
+        times = capture(interface, source, duration)
+    finally:
+        stop.set()
+        for generator in generators:
+            generator.join()
+    stats = [timing_stats(pgn, times.get(pgn, []), duration)
+             for pgn in sorted(PERIODIC_PGNS)]
+    print_report(load, stats)
+    if "load" in result:
+        sent, dropped = result["load"]
+        print(f"  Load frames sent: {sent}, not queued: {dropped}")
+    if "http" in result:
+        requests, errors = result["http"]
+        print(f"  HTTP requests: {requests / duration:.1f}/s, "
+              f"errors: {errors}")
+    return stats
+
+
+def load_command(args):
+    stop = threading.Event()
+    print(f"Loading {args.interface} to {args.load:.0%}; Ctrl-C to stop")
+    thread = threading.Thread(
+        target=generate_load, args=(args.interface, args.load, stop))
+    thread.start()
+    try:
+        while thread.is_alive():
+            thread.join(0.5)
+    except KeyboardInterrupt:
+        stop.set()
+        thread.join()
+    return 0
+
+
+def report_command(args):
+    stats = run_report(args.interface, args.source, args.load, args.duration,
+                       args.http, args.http_clients)
+    return 1 if any(s.get("missed", 1) for s in stats) else 0
+
+
+def sweep_command(args):
+    missed = 0
+    for load in (0.3, 0.6, 0.9):
+        stats = run_report(args.interface, args.source, load, args.duration)
+        missed += sum(s.get("missed", 1) for s in stats)
+        print()
+    return 1 if missed else 0
+
+
+def load_fraction(value):
+    fraction = float(value.rstrip("%")) / 100
+    if not 0 <= fraction <= 1 or math.isnan(fraction):
+        raise argparse.ArgumentTypeError("load must be 0-100%")
+    return fraction
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    def add_common(p):
+        p.add_argument("interface", help="SocketCAN interface, e.g. vcan0")
+
+    load_parser = subparsers.add_parser("load", help="generate bus load")
+    add_common(load_parser)
+    load_parser.add_argument("load", type=load_fraction,
+                             help="bus load in percent")
+    load_parser.set_defaults(func=load_command)
+
+    for name, func, help_text in (
+            ("report", report_command, "timing report at one load"),
+            ("sweep", sweep_command, "timing reports at 30/60/90% load")):
+        p = subparsers.add_parser(name, help=help_text)
+        add_common(p)
+        p.add_argument("--source", type=int, default=71,
+                       help="source address of the HALMET node")
+        p.add_argument("--duration", type=float, default=30,
+                       help="measurement time per load (s)")
+        if name == "report":
+            p.add_argument("--load", type=load_fraction, default=0,
+                           help="bus load in percent")
+            p.add_argument("--http", metavar="HOST",
+                           help="load the web server of HOST while measuring")
+            p.add_argument("--http-clients", type=int, default=4,
+                           help="concurrent HTTP clients")
+        p.set_defaults(func=func)
+
+    args = parser.parse_args()
+    sys.exit(args.func(args))
+
+
+if __name__ == "__main__":
+    main()